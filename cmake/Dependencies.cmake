@@ -10,6 +10,21 @@ list(APPEND Caffe_LINKER_LIBS ${Boost_LIBRARIES})
 find_package(Threads REQUIRED)
 list(APPEND Caffe_LINKER_LIBS ${CMAKE_THREAD_LIBS_INIT})
 
+# ---[ POSIX shared memory (shm_open), for the multi-process allreduce
+if(UNIX AND NOT APPLE)
+  list(APPEND Caffe_LINKER_LIBS rt)
+endif()
+
+# ---[ OpenMP
+if(USE_OPENMP)
+  find_package(OpenMP)
+  if(OPENMP_FOUND)
+    set(CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} ${OpenMP_CXX_FLAGS}")
+  else()
+    message("-- OpenMP is not detected by cmake. Building without it...")
+  endif()
+endif()
+
 # ---[ Google-glog
 find_package(Glog REQUIRED)
 include_directories(SYSTEM ${GLOG_INCLUDE_DIRS})
@@ -25,7 +25,7 @@ template <typename Dtype>
 class Blob {
  public:
   Blob()
-       : data_(), diff_(), count_(0), capacity_(0) {}
+       : data_(), diff_(), half_data_(), count_(0), capacity_(0) {}
 
   /// @brief Deprecated; use <code>Blob(const vector<int>& shape)</code>.
   explicit Blob(const int num, const int channels, const int height,
@@ -209,6 +209,7 @@ class Blob {
 
   inline const shared_ptr<SyncedMemory>& data() const {
     CHECK(data_);
+    CheckNotHalf();
     return data_;
   }
 
@@ -265,9 +266,33 @@ class Blob {
 
   bool ShapeEquals(const BlobProto& other);
 
+  /**
+   * @brief Keep the data in IEEE half precision, freeing the Dtype copy.
+   *
+   * The half data is kept next to data_ and shared along with it by
+   * ShareData, so Blobs sharing their data stay in the same precision.
+   * While the Blob is_half(), it is read through cpu_half_data(); the const
+   * Dtype accessors (cpu_data(), data() and the like) CHECK that it is not,
+   * so concurrent readers never convert the shared data. asum_data() and
+   * sumsq_data() read the half data in place. Writes through
+   * mutable_cpu_data() and the like drop the half data. FromProto and ToProto
+   * read and write the half data directly.
+   */
+  void ToHalf();
+  bool is_half() const;
+  const uint16_t* cpu_half_data() const;
+  /// @brief Convert the data back to Dtype and drop the half data.
+  void RestoreFromHalf();
+
  protected:
+  /// @brief CHECK that the data is not held in half precision.
+  void CheckNotHalf() const;
+
   shared_ptr<SyncedMemory> data_;
   shared_ptr<SyncedMemory> diff_;
+  /// The data in half precision while the Blob is_half(); data_ is then
+  /// freed.
+  shared_ptr<SyncedMemory> half_data_;
   vector<int> shape_;
   int count_;
   int capacity_;
@@ -65,9 +65,21 @@ private:\
 // is executed we will see a fatal log.
 #define NOT_IMPLEMENTED LOG(FATAL) << "Not Implemented Yet"
 
+// Split the iterations of the following for loop across threads when built
+// with OpenMP (USE_OPENMP); otherwise the loop simply runs serially.
+#ifdef _OPENMP
+#define CAFFE_PARALLEL_FOR _Pragma("omp parallel for")
+#else
+#define CAFFE_PARALLEL_FOR
+#endif
+
 // See PR #1236
 namespace cv { class Mat; }
 
+// Forward declared to keep boost/thread.hpp out of the headers (see
+// internal_thread.hpp).
+namespace boost { template <typename T> class thread_specific_ptr; }
+
 namespace caffe {
 
 // We will use the boost shared_ptr instead of the new C++11 one mainly
@@ -120,13 +132,10 @@ class Caffe {
     shared_ptr<Generator> generator_;
   };
 
-  // Getters for boost rng, curand, and cublas handles
-  inline static RNG& rng_stream() {
-    if (!Get().random_generator_) {
-      Get().random_generator_.reset(new RNG());
-    }
-    return *(Get().random_generator_);
-  }
+  // Getters for boost rng, curand, and cublas handles. Each thread has its
+  // own boost rng, so threads running nets side by side draw independent
+  // streams.
+  static RNG& rng_stream();
 #ifndef CPU_ONLY
   inline static cublasHandle_t cublas_handle() { return Get().cublas_handle_; }
   inline static curandGenerator_t curand_generator() {
@@ -142,7 +151,7 @@ class Caffe {
   // freed in a non-pinned way, which may cause problems - I haven't verified
   // it personally but better to note it here in the header file.
   inline static void set_mode(Brew mode) { Get().mode_ = mode; }
-  // Sets the random seed of both boost and curand
+  // Sets the random seed of both boost (for the calling thread) and curand
   static void set_random_seed(const unsigned int seed);
   // Sets the device. Since we have cublas and curand stuff, set device also
   // requires us to reset those values.
@@ -155,7 +164,7 @@ class Caffe {
   cublasHandle_t cublas_handle_;
   curandGenerator_t curand_generator_;
 #endif
-  shared_ptr<RNG> random_generator_;
+  shared_ptr<boost::thread_specific_ptr<RNG> > random_generator_;
 
   Brew mode_;
   static shared_ptr<Caffe> singleton_;
@@ -12,6 +12,9 @@
 #include "caffe/loss_layers.hpp"
 #include "caffe/neuron_layers.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/half.hpp"
+#include "caffe/util/quantize.hpp"
+#include "caffe/util/sparse.hpp"
 
 namespace caffe {
 
@@ -73,6 +76,11 @@ class ArgMaxLayer : public Layer<Dtype> {
 /**
  * @brief Takes at least two Blob%s and concatenates them along either the num
  *        or channel dimension, outputting the result.
+ *
+ * When share_views() is set and every input is a contiguous slab of the output
+ * (i.e. all axes before the concat axis have size 1), the inputs are re-pointed
+ * into their slots of the output after the first copy, so that their producers
+ * write the concatenation directly and later forward passes copy nothing.
  */
 template <typename Dtype>
 class ConcatLayer : public Layer<Dtype> {
@@ -141,6 +149,9 @@ class ConcatLayer : public Layer<Dtype> {
   int num_concats_;
   int concat_input_size_;
   int concat_axis_;
+  /// top memory the bottoms alias when share_views() is enabled; kept alive
+  /// until every bottom has been re-pointed after a top reallocation.
+  vector<shared_ptr<SyncedMemory> > aliased_memory_;
 };
 
 /**
@@ -231,6 +242,16 @@ class FlattenLayer : public Layer<Dtype> {
  * @brief Also known as a "fully-connected" layer, computes an inner product
  *        with a set of learned weights, and (optionally) adds biases.
  *
+ * With quantization_param { precision: INT8 } the CPU forward pass quantizes
+ * the bottom and a per-output copy of the weights to 8 bits and accumulates
+ * their products in 32-bit integers. With precision FP16 the Net stores the
+ * weights in half precision when it is set up, and they are converted a panel
+ * at a time in the matrix product, halving their memory footprint.
+ *
+ * With inner_product_param { sparsity_threshold: t } a TEST phase net whose
+ * weights are at least a fraction t zeros (e.g. after pruning) runs the CPU
+ * forward pass as a sparse-dense product over the nonzero weights only.
+ *
  * TODO(dox): thorough documentation for Forward, Backward, and proto params.
  */
 template <typename Dtype>
@@ -243,10 +264,21 @@ class InnerProductLayer : public Layer<Dtype> {
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
 
+  virtual void ShareDerivedParamsFrom(Layer<Dtype>* source);
+
   virtual inline const char* type() const { return "InnerProduct"; }
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
 
+  /// The int8 copy of the weights used by INT8 inference.
+  inline const QuantizedWeights<Dtype>* quantized_weights() const {
+    return quantized_weights_.get();
+  }
+  /// The CSR copy of the weights used when they are sparse enough.
+  inline const SparseWeights<Dtype>* sparse_weights() const {
+    return sparse_weights_.get();
+  }
+
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
@@ -256,12 +288,26 @@ class InnerProductLayer : public Layer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+  // Makes the int8 or CSR copy of the weights if they changed since the last
+  // one was made.
+  void UpdateDerivedWeights();
 
   int M_;
   int K_;
   int N_;
   bool bias_term_;
   Blob<Dtype> bias_multiplier_;
+
+  /// Whether Forward_cpu runs in INT8 (see QuantizationParameter).
+  bool int8_;
+  /// Whether the weights are stored in half precision.
+  bool fp16_;
+  // Shared between the layers of nets serving the same model (see
+  // ShareDerivedParamsFrom).
+  shared_ptr<SparseWeights<Dtype> > sparse_weights_;
+  shared_ptr<QuantizedWeights<Dtype> > quantized_weights_;
+  vector<int8_t> quantized_bottom_;
+  vector<float> output_scale_;
 };
 
 /**
@@ -426,6 +472,9 @@ class SplitLayer : public Layer<Dtype> {
  * @brief Takes a Blob and slices it along either the num or channel dimension,
  *        outputting multiple sliced Blob results.
  *
+ * When share_views() is set and every output is a contiguous slab of the input,
+ * the outputs alias their slices of the input instead of holding copies.
+ *
  * TODO(dox): thorough documentation for Forward, Backward, and proto params.
  */
 template <typename Dtype>
@@ -457,6 +506,9 @@ class SliceLayer : public Layer<Dtype> {
   int slice_size_;
   int slice_axis_;
   vector<int> slice_point_;
+  /// bottom memory the tops alias when share_views() is enabled; kept alive
+  /// until every top has been re-pointed after a bottom reallocation.
+  vector<shared_ptr<SyncedMemory> > aliased_memory_;
 };
 
 }  // namespace caffe
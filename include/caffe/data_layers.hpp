@@ -97,6 +97,8 @@ class DataLayer : public BasePrefetchingDataLayer<Dtype> {
 
  protected:
   virtual void InternalThreadEntry();
+  // Advances the cursor by count items, restarting from the first at the end.
+  void Skip(const int count);
 
   shared_ptr<db::DB> db_;
   shared_ptr<db::Cursor> cursor_;
@@ -196,6 +198,7 @@ class HDF5OutputLayer : public Layer<Dtype> {
   // TODO: no limit on the number of blobs
   virtual inline int ExactNumBottomBlobs() const { return 2; }
   virtual inline int ExactNumTopBlobs() const { return 0; }
+  virtual inline bool RepeatableForward() const { return false; }
 
   inline std::string file_name() const { return file_name_; }
 
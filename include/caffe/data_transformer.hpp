@@ -87,6 +87,70 @@ class DataTransformer {
    */
   void Transform(Blob<Dtype>* input_blob, Blob<Dtype>* transformed_blob);
 
+  /**
+   * @brief Prepares a batch of images for a net input, as
+   *    caffe.io.Transformer.preprocess and caffe.io.oversample do one image
+   *    at a time in Python.
+   *
+   * @param images
+   *    Images of shape height x width x channels (the layout of numpy
+   *    arrays), e.g. wrapping the caller's memory with set_cpu_data. They
+   *    may differ in size but not in channels.
+   * @param resize_height, resize_width
+   *    The size the images are resized to (bilinearly) before they are
+   *    cropped to the height and width of transformed_blob: at the center,
+   *    or at random when training with a crop_size. With mirror, each crop
+   *    is mirrored at random.
+   * @param oversample
+   *    Takes ten crops per image instead: the four corners, the center and
+   *    the mirrors of those five, in the order of caffe.io.oversample.
+   * @param channel_swap
+   *    If not empty, channel c of the result is channel channel_swap[c] of
+   *    the images, e.g. 2, 1, 0 for RGB images and a BGR net.
+   * @param raw_scale
+   *    Scales the images before the mean (mean_file or mean_value) is
+   *    subtracted and the result scaled by the transform_param scale. A
+   *    mean_file is either the size of the crops or of the resized images.
+   * @param transformed_blob
+   *    Reshaped to hold an item per crop, keeping its height and width.
+   * @param num_threads
+   *    The number of threads to split the images over.
+   */
+  void TransformImages(const vector<Blob<Dtype>*>& images,
+      const int resize_height, const int resize_width, const bool oversample,
+      const vector<int>& channel_swap, const Dtype raw_scale,
+      Blob<Dtype>* transformed_blob, const int num_threads);
+
+  /**
+   * @brief Warps regions of an image to the height and width of
+   *    transformed_blob, as WindowDataLayer does when training and
+   *    caffe.Detector does in Python, to classify many proposals at once.
+   *
+   * @param image
+   *    An image of shape height x width x channels.
+   * @param regions
+   *    The boxes to warp, as y1, x1, y2, x2 with inclusive coordinates.
+   * @param context_pad
+   *    Expands each box so that this many pixels on each side of its warped
+   *    crop are context. Parts of a box outside the image are left 0, as
+   *    after subtracting the mean.
+   * @param channel_swap, raw_scale, num_threads
+   *    As for TransformImages. A mean_file may be larger than the crops, in
+   *    which case its center is used.
+   * @param transformed_blob
+   *    Reshaped to hold an item per region.
+   */
+  void TransformRegions(const Blob<Dtype>& image,
+      const vector<vector<int> >& regions, const int context_pad,
+      const vector<int>& channel_swap, const Dtype raw_scale,
+      Blob<Dtype>* transformed_blob, const int num_threads);
+
+  /**
+   * @brief Subtracts mean, of shape channels x height x width, in place of
+   *    a mean_file in TransformImages and TransformRegions.
+   */
+  void SetMean(const Blob<Dtype>& mean);
+
  protected:
    /**
    * @brief Generates a random integer from Uniform({0, 1, ..., n-1}).
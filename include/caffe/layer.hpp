@@ -32,7 +32,7 @@ class Layer {
    * layer.
    */
   explicit Layer(const LayerParameter& param)
-    : layer_param_(param) {
+    : layer_param_(param), share_views_(false), need_backward_(true) {
       // Set phase and copy blobs (if there are any).
       phase_ = param.phase();
       if (layer_param_.blobs_size() > 0) {
@@ -152,6 +152,18 @@ class Layer {
     return blobs_;
   }
 
+  /**
+   * @brief Shares the copies that source derives from its parameters (e.g.
+   *        quantized weights) with this layer, whose parameter Blob%s share
+   *        those of source.
+   *
+   * Net::ShareTrainedLayersWith calls this once the parameters are shared,
+   * so that nets serving one model keep one such copy between them; source
+   * makes its copies first if need be. Layers without such copies need not
+   * override this.
+   */
+  virtual void ShareDerivedParamsFrom(Layer<Dtype>* source) {}
+
   /**
    * @brief Returns the layer parameter.
    */
@@ -263,6 +275,28 @@ class Layer {
     return true;
   }
 
+  /**
+   * @brief Returns whether running Forward again on the same bottom blobs
+   *        reproduces the same top blobs and has no other effect.
+   *
+   * Net only recomputes the activations of checkpointed segments (see
+   * NetParameter.auto_checkpoint) made of repeatable layers; layers without
+   * bottoms are never recomputed. Layers that draw random numbers, write
+   * outputs or keep state across passes should override this to return false.
+   */
+  virtual inline bool RepeatableForward() const { return true; }
+
+  /**
+   * @brief Returns whether Reshape only depends on the shapes of the bottom
+   *        Blob%s and on the memory they hold.
+   *
+   * Net skips the Reshape before a forward pass while these, and the shapes
+   * of the top Blob%s, are as they were after the last one; layers without
+   * bottoms are always reshaped. Layers whose top shapes depend on anything
+   * else, e.g. on bottom values, should override this to return false.
+   */
+  virtual inline bool ReshapeDependsOnlyOnBottoms() const { return true; }
+
   /**
    * @brief Specifies whether the layer should compute gradients w.r.t. a
    *        parameter at a particular index given by param_id.
@@ -285,6 +319,31 @@ class Layer {
     param_propagate_down_[param_id] = value;
   }
 
+  /**
+   * @brief Returns whether the layer may alias its bottom and top Blob%s in
+   *        memory rather than copying between them.
+   */
+  inline bool share_views() const { return share_views_; }
+  /**
+   * @brief Sets whether the layer may alias its bottom and top Blob%s.
+   *
+   * Only layers that know how to alias (ConcatLayer, SliceLayer) honor this.
+   * Net enables it only where no other layer can observe the aliasing.
+   */
+  inline void set_share_views(const bool value) { share_views_ = value; }
+
+  /**
+   * @brief Returns whether Backward may be called after Forward, i.e. whether
+   *        the layer has to keep state that only the gradient needs.
+   */
+  inline bool need_backward() const { return need_backward_; }
+  /**
+   * @brief Sets whether Backward may be called on this layer.
+   *
+   * Net clears this for layers it never runs backward through, so that
+   * Forward can skip bookkeeping such as argmax masks.
+   */
+  inline void set_need_backward(const bool value) { need_backward_ = value; }
 
  protected:
   /** The protobuf that stores the layer parameters */
@@ -300,6 +359,11 @@ class Layer {
    *  the objective function. */
   vector<Dtype> loss_;
 
+  /** Whether the layer may alias bottom and top memory (see share_views). */
+  bool share_views_;
+  /** Whether Backward may follow Forward (see need_backward). */
+  bool need_backward_;
+
   /** @brief Using the CPU device, compute the layer output. */
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) = 0;
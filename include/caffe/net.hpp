@@ -1,6 +1,8 @@
 #ifndef CAFFE_NET_HPP_
 #define CAFFE_NET_HPP_
 
+#include <boost/weak_ptr.hpp>
+
 #include <map>
 #include <set>
 #include <string>
@@ -14,6 +16,8 @@
 
 namespace caffe {
 
+class MappedWeights;
+
 /**
  * @brief Connects Layer%s together into a directed acyclic graph (DAG)
  *        specified by a NetParameter.
@@ -61,19 +65,53 @@ class Net {
    * The network backward should take no input and output, since it solely
    * computes the gradient w.r.t the parameters, and the data has already been
    * provided during the forward pass.
+   *
+   * The parameter gradients are added to the parameter diffs, so that they
+   * accumulate over several passes; call ClearParamDiffs to start afresh.
    */
   void Backward();
   void BackwardFromTo(int start, int end);
   void BackwardFrom(int start);
   void BackwardTo(int end);
 
+  /**
+   * @brief Receives a notification from BackwardFromTo as each layer is
+   *        done, e.g. to start reducing or applying that layer's gradients
+   *        while the backward pass goes on below it.
+   */
+  class Callback {
+   public:
+    virtual ~Callback() {}
+    /// Called once the backward pass is done with layer layer_id (or has
+    /// skipped it, if it needs no backward), from the last layer to the
+    /// first. The gradients of the layer's parameters no longer change.
+    virtual void run(const int layer_id) = 0;
+  };
+  /// @brief Subscribes callback to the backward pass. The Net does not take
+  ///        ownership; the callback has to outlive the Net or its use.
+  void add_after_backward(Callback* callback) {
+    after_backward_.push_back(callback);
+  }
+
   /**
    * @brief Reshape all layers from bottom to top.
    *
    * This is useful to propagate changes to layer sizes without running
-   * a forward pass, e.g. to compute output feature size.
+   * a forward pass, e.g. to compute output feature size. Only layers whose
+   * bottom or top Blob%s changed since their last Reshape are reshaped (see
+   * Layer::ReshapeDependsOnlyOnBottoms); Forward does the same.
    */
   void Reshape();
+  /**
+   * @brief Sizes the blobs and layer buffers for inputs of the given shapes
+   *        (one per net input), then restores the current input shapes.
+   *
+   * Blobs keep their capacity when they shrink, so inputs of any shape
+   * whose layers need no more memory than these, e.g. any batch size up to
+   * a maximum, then run without reallocating. The memory itself is
+   * allocated by the first pass that uses it.
+   */
+  void Reserve(const vector<vector<int> >& input_shapes);
 
   Dtype ForwardBackward(const vector<Blob<Dtype>* > & bottom) {
     Dtype loss;
@@ -84,6 +122,8 @@ class Net {
 
   /// @brief Updates the network weights based on the diff values computed.
   void Update();
+  /// @brief Zeroes the diffs of all the parameters, ready for Backward.
+  void ClearParamDiffs();
 
   /**
    * @brief For an already initialized net, implicitly copies (i.e., using no
@@ -97,9 +137,29 @@ class Net {
    *        another Net.
    */
   void CopyTrainedLayersFrom(const NetParameter& param);
+  /// @brief Copies the layers from a .caffemodel or, one layer at a time,
+  ///        from a weights stream file. Mapped weights files are not copied
+  ///        but mapped, as by MapTrainedLayersFrom.
   void CopyTrainedLayersFrom(const string trained_filename);
+  /**
+   * @brief Backs the layers' data directly with a memory-mapped weights file
+   *        (see util/mapped_weights.hpp) instead of copying it.
+   *
+   * The mapping lives as long as the Net. Only float blobs can use the
+   * mapping in place; double blobs get a copy.
+   */
+  void MapTrainedLayersFrom(const string& trained_filename);
   /// @brief Writes the net to a proto.
   void ToProto(NetParameter* param, bool write_diff = false) const;
+  /// @brief Writes the net to a proto without the layer blobs: the
+  ///        definition that a weights stream file starts with.
+  void ToDefinitionProto(NetParameter* param) const;
+  /**
+   * @brief Writes the net to a weights stream file (see
+   *        util/weights_stream.hpp), serializing one layer at a time instead
+   *        of the whole net at once as ToProto does.
+   */
+  void ToWeightsStream(const string& filename, bool write_diff = false) const;
 
   /// @brief returns the network name.
   inline const string& name() const { return name_; }
@@ -150,6 +210,10 @@ class Net {
     return param_names_index_;
   }
   inline const vector<int>& param_owners() const { return param_owners_; }
+  /// @brief returns the ids, in params(), of the parameters of each layer
+  inline const vector<vector<int> >& param_id_vecs() const {
+    return param_id_vecs_;
+  }
   /// @brief Input and output blob numbers
   inline int num_inputs() const { return net_input_blobs_.size(); }
   inline int num_outputs() const { return net_output_blobs_.size(); }
@@ -165,6 +229,19 @@ class Net {
   inline const vector<int>& output_blob_indices() const {
     return net_output_blob_indices_;
   }
+  /**
+   * @brief returns the first and last layer of each segment whose inner
+   *        activations are freed after the forward pass and recomputed for
+   *        the backward pass (see NetParameter.auto_checkpoint).
+   */
+  inline const vector<pair<int, int> >& checkpoint_segments() const {
+    return segment_layers_;
+  }
+  /// @brief returns the bytes of blob data and diffs held at the peak of a
+  ///        forward and backward pass under the checkpoint plan.
+  inline size_t blob_memory_peak() const { return blob_memory_peak_; }
+  /// @brief returns the bytes of blob data and diffs without checkpointing.
+  inline size_t blob_memory_total() const { return blob_memory_total_; }
   bool has_blob(const string& blob_name) const;
   const shared_ptr<Blob<Dtype> > blob_by_name(const string& blob_name) const;
   bool has_layer(const string& layer_name) const;
@@ -203,11 +280,37 @@ class Net {
   void ForwardDebugInfo(const int layer_id);
   /// @brief Helper for displaying debug info in Backward.
   void BackwardDebugInfo(const int layer_id);
+  /// @brief Copies the blobs of a source layer into the layer of the same
+  ///        name, if the net has one.
+  void CopyTrainedLayer(const LayerParameter& source_layer);
   /// @brief Helper for displaying debug info in Update.
   void UpdateDebugInfo(const int param_id);
 
   /// @brief Get misc parameters, e.g. the LR multiplier and weight decay.
   void GetLearningRateAndWeightDecay();
+  /**
+   * @brief Let Concat and Slice layers alias their bottom and top memory
+   *        wherever no other layer can observe it.
+   */
+  void ShareConcatSliceViews();
+  /**
+   * @brief Returns whether any layer after layer_id writes the memory of the
+   *        given blob (directly or through Split layers), i.e. computes
+   *        in-place on it.
+   */
+  bool BlobWrittenAfter(const int blob_id, const int layer_id) const;
+  /**
+   * @brief Cuts the layers into the checkpointed segments requested by
+   *        param and works out the blobs each segment frees.
+   */
+  void PlanCheckpoints(const NetParameter& param);
+  /// @brief Frees the inner activations (data and diffs) of a segment.
+  void ReleaseSegment(const int segment_id);
+  /// @brief Recomputes a released segment up to (and including) layer end.
+  void RestoreSegment(const int segment_id, const int end);
+  /// @brief Reshapes a layer unless its Blob%s are as they were after its
+  ///        last Reshape.
+  void ReshapeLayer(const int layer_id);
 
   /// @brief The network name
   string name_;
@@ -255,6 +358,25 @@ class Net {
   size_t memory_used_;
   /// Whether to compute and display debug info for the net.
   bool debug_info_;
+  /// Mapped weights files that back the data of some layers.
+  vector<shared_ptr<MappedWeights> > mapped_weights_;
+  /// Callbacks run as the backward pass finishes each layer.
+  vector<Callback*> after_backward_;
+  /// The checkpointed segment of each layer, or -1.
+  vector<int> layer_segment_;
+  /// The first and last layer of each checkpointed segment.
+  vector<pair<int, int> > segment_layers_;
+  /// The blobs each segment frees, whether any of its layers needs backward
+  /// and whether its activations are currently freed.
+  vector<vector<int> > segment_blob_ids_;
+  vector<bool> segment_need_backward_;
+  vector<bool> segment_released_;
+  size_t blob_memory_peak_;
+  size_t blob_memory_total_;
+  /// The shapes of the bottom and then the top blobs of each layer, and the
+  /// data memory of its bottoms, as of its last Reshape.
+  vector<vector<vector<int> > > reshaped_shapes_;
+  vector<vector<boost::weak_ptr<SyncedMemory> > > reshaped_data_;
 
   DISABLE_COPY_AND_ASSIGN(Net);
 };
@@ -168,6 +168,10 @@ class DropoutLayer : public NeuronLayer<Dtype> {
       const vector<Blob<Dtype>*>& top);
 
   virtual inline const char* type() const { return "Dropout"; }
+  // A new mask is drawn on every training pass.
+  virtual inline bool RepeatableForward() const {
+    return this->phase_ != TRAIN;
+  }
 
  protected:
   /**
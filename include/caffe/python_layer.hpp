@@ -10,6 +10,17 @@ namespace bp = boost::python;
 
 namespace caffe {
 
+// Holds the GIL for the lifetime of the object. The bindings release the GIL
+// while a net runs, so Python layers take it back to call into Python.
+class ScopedGILAcquire {
+ public:
+  ScopedGILAcquire() : state_(PyGILState_Ensure()) {}
+  ~ScopedGILAcquire() { PyGILState_Release(state_); }
+
+ private:
+  PyGILState_STATE state_;
+};
+
 template <typename Dtype>
 class PythonLayer : public Layer<Dtype> {
  public:
@@ -18,6 +29,7 @@ class PythonLayer : public Layer<Dtype> {
 
   virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+    ScopedGILAcquire gil;
     try {
       bp::call_method<bp::object>(self_, "setup", bottom, top);
     } catch (bp::error_already_set) {
@@ -28,6 +40,7 @@ class PythonLayer : public Layer<Dtype> {
 
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+    ScopedGILAcquire gil;
     try {
       bp::call_method<bp::object>(self_, "reshape", bottom, top);
     } catch (bp::error_already_set) {
@@ -37,10 +50,13 @@ class PythonLayer : public Layer<Dtype> {
   }
 
   virtual inline const char* type() const { return "Python"; }
+  // The reshape of a Python layer may depend on anything.
+  virtual inline bool ReshapeDependsOnlyOnBottoms() const { return false; }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+    ScopedGILAcquire gil;
     try {
       bp::call_method<bp::object>(self_, "forward", bottom, top);
     } catch (bp::error_already_set) {
@@ -50,6 +66,7 @@ class PythonLayer : public Layer<Dtype> {
   }
   virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+    ScopedGILAcquire gil;
     try {
       bp::call_method<bp::object>(self_, "backward", top, propagate_down,
           bottom);
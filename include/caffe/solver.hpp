@@ -4,10 +4,61 @@
 #include <string>
 #include <vector>
 
+#include "caffe/internal_thread.hpp"
 #include "caffe/net.hpp"
 
+namespace boost { class barrier; }
+
 namespace caffe {
 
+template <typename Dtype> class Allreduce;
+template <typename Dtype> class BucketedAllreduce;
+
+/**
+ * @brief Writes a snapshot (the learned net and the solver state) to disk on
+ *        its own thread.
+ *
+ * Write copies the parameters and the solver history to host memory, so
+ * training only pauses for the copy; serializing and writing happen in the
+ * background. The copies are kept and reused by the next snapshot. The model
+ * is written as a NetParameter, or as a weights stream (see
+ * util/weights_stream.hpp), one layer at a time.
+ */
+template <typename Dtype>
+class SnapshotWriter : public InternalThread {
+ public:
+  SnapshotWriter() {}
+  virtual ~SnapshotWriter() { WaitForInternalThreadToExit(); }
+
+  // Waits for the previous snapshot, if any, to finish and then writes this
+  // one: the layer blobs of net (with their diffs if write_diff), as a
+  // weights stream if weights_stream, and state with history as its history
+  // blobs. state is left empty. Unless async, the files are written from the
+  // blobs themselves before Write returns.
+  void Write(const Net<Dtype>& net, const bool write_diff,
+      const string& model_filename, const bool weights_stream,
+      SolverState* state, const vector<shared_ptr<Blob<Dtype> > >& history,
+      const string& state_filename, const bool async);
+
+ protected:
+  virtual void InternalThreadEntry();
+  // Serializes and writes the snapshot held by the writer.
+  void WriteFiles();
+  // Writes the model of the snapshot as a weights stream.
+  void WriteWeightsStream();
+
+  // The net definition, without blobs, and the solver state, without
+  // history, as well as the blobs to write into them.
+  NetParameter net_param_;
+  SolverState state_;
+  vector<vector<shared_ptr<Blob<Dtype> > > > layer_blobs_;
+  vector<shared_ptr<Blob<Dtype> > > history_;
+  bool write_diff_, weights_stream_;
+  string model_filename_, state_filename_;
+
+  DISABLE_COPY_AND_ASSIGN(SnapshotWriter);
+};
+
 /**
  * @brief An interface for classes that perform optimization on Net%s.
  *
@@ -31,33 +82,118 @@ class Solver {
   // previously snapshotted state. You should implement the RestoreSolverState()
   // function that restores the state from a SolverState protocol buffer.
   void Restore(const char* resume_file);
-  virtual ~Solver() {}
+  virtual ~Solver();
   inline shared_ptr<Net<Dtype> > net() { return net_; }
   inline const vector<shared_ptr<Net<Dtype> > >& test_nets() {
     return test_nets_;
   }
+  // The data-parallel replicas of the train net, net() first, or nothing if
+  // replicas is 1.
+  inline const vector<shared_ptr<Net<Dtype> > >& replica_nets() {
+    return replicas_;
+  }
   int iter() { return iter_; }
+  // The loss displayed at the last iteration, averaged over average_loss
+  // iterations.
+  Dtype smoothed_loss() const { return smoothed_loss_; }
 
  protected:
   // Get the update value for the current iteration.
   virtual void ComputeUpdateValue() = 0;
+  // The number of forward/backward passes whose gradients are summed in the
+  // diffs at each update.
+  inline int accumulated_passes() const {
+    return param_.iter_size() * param_.replicas() * param_.world_size();
+  }
+  // Creates the replicas of the train net specified by net_param, each
+  // reading its own shard of the data, and starts their threads.
+  void InitReplicas(const NetParameter& net_param);
+  // Runs the forward/backward passes of all the replicas and sums their
+  // gradients into net_. Returns the average loss.
+  Dtype ReplicasForwardBackward();
+  // Runs the passes of one replica and its part of the gradient reduction.
+  void ReplicaForwardBackward(const int replica_id);
+  // The entry point of the replica threads.
+  void ReplicaThreadEntry(const int replica_id);
+  // Joins the other processes of a multi-process job (world_size > 1).
+  void InitAllreduce();
+  // Copies the parameters of rank 0 to all the processes.
+  void BroadcastParams();
+  // Sums the gradients of net_ over all the processes, and returns the
+  // average of loss over all the processes.
+  Dtype AllreduceGradients(Dtype loss);
+  // Called as the backward pass of net_ finishes each layer. During the last
+  // pass of an iteration, queues the layer's gradients for the allreduce, so
+  // it overlaps the backward pass of the layers below.
+  void LayerBackwardDone(const int layer_id);
+
+  // Forwards the backward pass notifications of net_ to LayerBackwardDone.
+  class BackwardCallback : public Net<Dtype>::Callback {
+   public:
+    explicit BackwardCallback(Solver* solver) : solver_(solver) {}
+    virtual void run(const int layer_id) {
+      solver_->LayerBackwardDone(layer_id);
+    }
+
+   private:
+    Solver* solver_;
+  };
   // The Solver::Snapshot function implements the basic snapshotting utility
   // that stores the learned net. You should implement the SnapshotSolverState()
   // function that produces a SolverState protocol buffer that needs to be
-  // written to disk together with the learned net.
+  // written to disk together with the learned net. With snapshot_async, the
+  // files are written by snapshot_writer_ after Snapshot returns.
   void Snapshot();
   // The test routine
   void TestAll();
   void Test(const int test_net_id = 0);
-  virtual void SnapshotSolverState(SolverState* state) = 0;
+  // Runs the test iterations of a test net and logs the results, each line
+  // starting with log_prefix.
+  void RunTest(const int test_net_id, const string& log_prefix);
+  // Starts evaluating all the test nets in the background (test_async).
+  void TestAllInBackground();
+  // The entry point of the background test threads.
+  void TestInBackground(const int test_net_id, const int iter,
+      const Caffe::Brew mode, const int device);
+  // Copies the train net weights into test_weights_ and shares them with the
+  // test nets.
+  void ShareTestWeights();
+  // Waits for any background test evaluation to finish.
+  void WaitForTests();
+  // Fills in the solver state, except for its history, and lists the blobs
+  // that make up the history; snapshot_writer_ serializes them.
+  virtual void SnapshotSolverState(SolverState* state,
+      vector<shared_ptr<Blob<Dtype> > >* history) = 0;
   virtual void RestoreSolverState(const SolverState& state) = 0;
   void DisplayOutputBlobs(const int net_id);
 
   SolverParameter param_;
   int iter_;
   int current_step_;
+  Dtype smoothed_loss_;
   shared_ptr<Net<Dtype> > net_;
   vector<shared_ptr<Net<Dtype> > > test_nets_;
+  SnapshotWriter<Dtype> snapshot_writer_;
+  // With test_async, the copy of the weights of each train net layer that the
+  // test nets evaluate while training goes on, and the evaluation threads.
+  vector<vector<shared_ptr<Blob<Dtype> > > > test_weights_;
+  vector<shared_ptr<boost::thread> > test_threads_;
+  // The data-parallel replicas, net_ first, and the threads that run all but
+  // net_. The replicas meet at replica_barrier_ at the start of each
+  // iteration and between the levels of the gradient reduction.
+  vector<shared_ptr<Net<Dtype> > > replicas_;
+  vector<shared_ptr<boost::thread> > replica_threads_;
+  shared_ptr<boost::barrier> replica_barrier_;
+  vector<Dtype> replica_losses_;
+  bool stop_replicas_;
+  // With world_size > 1, the connection to the other processes and the
+  // bucketed reduction of the gradients of net_ over it.
+  shared_ptr<Allreduce<Dtype> > allreduce_;
+  shared_ptr<BucketedAllreduce<Dtype> > gradient_allreduce_;
+  // Without replicas, the gradients are queued for the allreduce from the
+  // backward pass, while allreduce_in_backward_ is set.
+  shared_ptr<BackwardCallback> backward_callback_;
+  bool allreduce_in_backward_;
 
   DISABLE_COPY_AND_ASSIGN(Solver);
 };
@@ -81,13 +217,23 @@ class SGDSolver : public Solver<Dtype> {
   void PreSolve();
   Dtype GetLearningRate();
   virtual void ComputeUpdateValue();
+  // Scales the diffs by 1 / iter_size to average the accumulated gradients.
+  void NormalizeGradients();
+  // Returns the factor by which clip_gradients scales down the diffs of the
+  // owned parameters, or 1 if they need no clipping, as if the diffs were
+  // first multiplied by diff_scale.
+  Dtype GetClipScale(const Dtype diff_scale);
   virtual void ClipGradients();
-  virtual void SnapshotSolverState(SolverState * state);
+  // Splits the weight decay of a parameter by regularization type.
+  void GetLocalDecay(const int param_id, Dtype* l2_decay, Dtype* l1_decay);
+  virtual void SnapshotSolverState(SolverState* state,
+      vector<shared_ptr<Blob<Dtype> > >* history);
   virtual void RestoreSolverState(const SolverState& state);
   // history maintains the historical momentum data.
   // update maintains update related data and is not needed in snapshots.
   // temp maintains other information that might be needed in computation
-  //   of gradients/updates and is not needed in snapshots
+  //   of gradients/updates and is not needed in snapshots.
+  // update and temp are only allocated for the GPU updates.
   vector<shared_ptr<Blob<Dtype> > > history_, update_, temp_;
 
   DISABLE_COPY_AND_ASSIGN(SGDSolver);
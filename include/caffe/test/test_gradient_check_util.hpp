@@ -95,7 +95,12 @@ void GradientChecker<Dtype>::CheckGradientSingle(Layer<Dtype>* layer,
     blobs_to_check.push_back(bottom[check_bottom]);
     propagate_down[check_bottom] = true;
   }
-  // Compute the gradient analytically using Backward
+  // Compute the gradient analytically using Backward, which accumulates into
+  // the parameter diffs, so clear them first.
+  for (int i = 0; i < layer->blobs().size(); ++i) {
+    Blob<Dtype>* blob = layer->blobs()[i].get();
+    caffe_set(blob->count(), static_cast<Dtype>(0), blob->mutable_cpu_diff());
+  }
   Caffe::set_random_seed(seed_);
   // Ignore the loss from the layer (it's just the weighted sum of the losses
   // from the top blobs, whose gradients we may want to test individually).
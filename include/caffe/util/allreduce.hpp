@@ -0,0 +1,170 @@
+#ifndef CAFFE_UTIL_ALLREDUCE_H_
+#define CAFFE_UTIL_ALLREDUCE_H_
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace boost {
+class condition_variable;
+class mutex;
+class thread;
+}
+
+namespace caffe {
+
+/**
+ * @brief Sums arrays across the world_size processes of a job running on one
+ *        machine.
+ *
+ * Every process calls the collective operations in the same order with the
+ * same counts. The sums are added up in rank order, so all processes get
+ * bitwise identical results, whatever the transport.
+ */
+template <typename Dtype>
+class Allreduce {
+ public:
+  Allreduce(const int rank, const int world_size)
+      : rank_(rank), world_size_(world_size) {}
+  virtual ~Allreduce() {}
+
+  // Replaces data with the sum of data over all processes.
+  virtual void Sum(Dtype* data, const size_t count) = 0;
+  // Replaces data with the data of rank 0.
+  void Broadcast(Dtype* data, const size_t count);
+
+  inline int rank() const { return rank_; }
+  inline int world_size() const { return world_size_; }
+
+ protected:
+  int rank_;
+  int world_size_;
+
+  DISABLE_COPY_AND_ASSIGN(Allreduce);
+};
+
+/**
+ * @brief Allreduce through a POSIX shared memory segment holding one chunk
+ *        of chunk_size elements per process.
+ *
+ * Each process copies its chunk in, sums its slice of all the chunks, and
+ * copies the summed chunk out; process-shared barriers separate the steps.
+ * Rank 0 creates the segment, named after name with any slashes replaced,
+ * and unlinks it once every process has attached. The constructors block
+ * until all the processes have joined.
+ */
+template <typename Dtype>
+class ShmAllreduce : public Allreduce<Dtype> {
+ public:
+  ShmAllreduce(const int rank, const int world_size, const string& name,
+      const size_t chunk_size);
+  virtual ~ShmAllreduce();
+
+  virtual void Sum(Dtype* data, const size_t count);
+
+ protected:
+  struct Header;
+  void Wait();
+
+  string name_;
+  size_t chunk_size_;
+  size_t map_size_;
+  char* map_;
+  Header* header_;
+  // The chunk of each process, then the summed chunk.
+  Dtype* chunks_;
+  Dtype* sum_;
+};
+
+/**
+ * @brief Allreduce over Unix domain sockets, for machines without usable
+ *        POSIX shared memory.
+ *
+ * Rank 0 listens on the socket path and the other ranks connect to it; data
+ * is exchanged chunk_size elements at a time, rank 0 summing each chunk and
+ * sending the sum back.
+ */
+template <typename Dtype>
+class SocketAllreduce : public Allreduce<Dtype> {
+ public:
+  SocketAllreduce(const int rank, const int world_size, const string& path,
+      const size_t chunk_size);
+  virtual ~SocketAllreduce();
+
+  virtual void Sum(Dtype* data, const size_t count);
+
+ protected:
+  string path_;
+  size_t chunk_size_;
+  // On rank 0 the connection to each rank (sockets_[0] unused), on the other
+  // ranks the connection to rank 0.
+  vector<int> sockets_;
+  vector<Dtype> buffer_;
+};
+
+// Creates the transport selected by the allreduce fields of param and
+// connects to the other processes.
+template <typename Dtype>
+shared_ptr<Allreduce<Dtype> > GetAllreduce(const SolverParameter& param);
+
+/**
+ * @brief Sums the gradients of a set of parameters across processes, packed
+ *        into buckets of about bucket_size elements.
+ *
+ * The buckets are summed on a background thread: as soon as the gradients of
+ * all the parameters of a bucket are final (ParamReady), the bucket is queued
+ * for reduction, so communication overlaps whatever the caller does next,
+ * e.g. packing the following bucket or running the rest of the backward pass.
+ * The parameters must be marked ready in the same order on every process.
+ */
+template <typename Dtype>
+class BucketedAllreduce {
+ public:
+  // params are given in the order in which their gradients become final.
+  BucketedAllreduce(shared_ptr<Allreduce<Dtype> > allreduce,
+      const vector<Blob<Dtype>*>& params, const size_t bucket_size);
+  ~BucketedAllreduce();
+
+  // Marks the gradient of params[param_id] as final.
+  void ParamReady(const int param_id);
+  // Waits for all the buckets to be summed and stores the sums in the
+  // gradients. Every parameter must have been marked ready.
+  void Finish();
+
+  inline int num_buckets() const { return bucket_params_.size(); }
+
+ protected:
+  void ThreadEntry();
+
+  shared_ptr<Allreduce<Dtype> > allreduce_;
+  vector<Blob<Dtype>*> params_;
+  // The parameters of each bucket, the bucket of each parameter, and the
+  // number of parameters of each bucket not yet ready.
+  vector<vector<int> > bucket_params_;
+  vector<int> param_bucket_;
+  vector<int> bucket_pending_;
+  // The packed gradients of each bucket. A bucket of a single parameter is
+  // summed in place in its diff and has no buffer.
+  vector<vector<Dtype> > buffers_;
+  vector<Dtype*> bucket_data_;
+  vector<size_t> bucket_count_;
+
+  // The buckets queued for reduction and the number of buckets summed,
+  // guarded by mutex_.
+  std::deque<int> queue_;
+  int num_reduced_;
+  bool stop_;
+  shared_ptr<boost::mutex> mutex_;
+  shared_ptr<boost::condition_variable> condition_;
+  shared_ptr<boost::thread> thread_;
+
+  DISABLE_COPY_AND_ASSIGN(BucketedAllreduce);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_ALLREDUCE_H_
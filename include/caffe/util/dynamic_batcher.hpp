@@ -0,0 +1,90 @@
+#ifndef CAFFE_UTIL_DYNAMIC_BATCHER_H_
+#define CAFFE_UTIL_DYNAMIC_BATCHER_H_
+
+#include <deque>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/util/histogram.hpp"
+#include "caffe/util/inference_engine.hpp"
+
+namespace boost {
+class condition_variable;
+class mutex;
+class thread;
+}
+
+namespace caffe {
+
+/**
+ * @brief Coalesces concurrent inference requests into batches.
+ *
+ * Small requests use the matrix products poorly, so the batcher queues them
+ * and runs them together: a batch is started as soon as the queued requests
+ * fill max_batch_size items (along the first axis of the inputs), or when the
+ * oldest has waited max_delay_ms. The inputs of the batch are written
+ * straight into the input blobs of a free engine instance, whose capacity is
+ * reserved for max_batch_size items up front, and the outputs are split back
+ * along the first axis. Each engine instance is driven by a worker thread.
+ *
+ * Only requests whose inputs agree on all but the first axis are batched
+ * together; the requests are run in the order they arrive.
+ */
+template <typename Dtype>
+class DynamicBatcher {
+ public:
+  DynamicBatcher(shared_ptr<InferenceEngine<Dtype> > engine,
+      const int max_batch_size, const double max_delay_ms);
+  // Runs the requests still queued, then stops the workers.
+  ~DynamicBatcher();
+
+  // Like InferenceEngine::Predict. The inputs all hold the same number of
+  // items, at most max_batch_size, along their first axis, and so do the
+  // outputs. Safe to call from any number of threads.
+  void Predict(const vector<Blob<Dtype>*>& inputs,
+      const vector<Blob<Dtype>*>& outputs);
+
+  // Copies of the statistics so far: how long the requests waited in the
+  // queue (in milliseconds) and how many items each batch held.
+  Histogram queue_latency() const;
+  Histogram batch_fill() const;
+
+  inline const shared_ptr<InferenceEngine<Dtype> >& engine() const {
+    return engine_;
+  }
+  inline int max_batch_size() const { return max_batch_size_; }
+
+ protected:
+  struct Request;
+
+  void WorkerEntry();
+  // Waits for the next batch and takes it off the queue. Returns false once
+  // the batcher stops and the queue is empty.
+  bool NextBatch(vector<Request*>* batch);
+  // The number of items that would be batched with the request at the front
+  // of the queue. Called with mutex_ held.
+  int BatchableItems() const;
+  void RunBatch(const vector<Request*>& batch);
+
+  shared_ptr<InferenceEngine<Dtype> > engine_;
+  const int max_batch_size_;
+  const double max_delay_ms_;
+  vector<shared_ptr<boost::thread> > workers_;
+
+  // The queued requests, the statistics and whether to stop, guarded by
+  // mutex_. Workers wait on queue_changed_ and requests on batch_done_.
+  std::deque<Request*> queue_;
+  Histogram queue_latency_;
+  Histogram batch_fill_;
+  bool stop_;
+  shared_ptr<boost::mutex> mutex_;
+  shared_ptr<boost::condition_variable> queue_changed_;
+  shared_ptr<boost::condition_variable> batch_done_;
+
+  DISABLE_COPY_AND_ASSIGN(DynamicBatcher);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_DYNAMIC_BATCHER_H_
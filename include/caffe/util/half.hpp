@@ -0,0 +1,34 @@
+#ifndef CAFFE_UTIL_HALF_H_
+#define CAFFE_UTIL_HALF_H_
+
+#include <stdint.h>
+
+#include "caffe/common.hpp"
+#include "caffe/util/mkl_alternate.hpp"
+
+namespace caffe {
+
+// IEEE 754 half precision (binary16) stored in uint16_t. Conversions round to
+// nearest even. The bulk float conversions use the F16C instructions when the
+// compiler targets them (e.g. -mf16c or -march=native).
+
+uint16_t caffe_float_to_half(const float value);
+float caffe_half_to_float(const uint16_t value);
+
+template <typename Dtype>
+void caffe_cpu_float2half(const int n, const Dtype* x, uint16_t* y);
+
+template <typename Dtype>
+void caffe_cpu_half2float(const int n, const uint16_t* x, Dtype* y);
+
+// Computes C = W * X (TransW == CblasNoTrans; W is M x K, X is K x N) or
+// C = X * W^T (TransW == CblasTrans; X is M x K, W is N x K) for half
+// precision weights W. The weights are converted to Dtype a panel of rows at a
+// time, so no full Dtype copy of W is ever made.
+template <typename Dtype>
+void caffe_cpu_gemm_half(const CBLAS_TRANSPOSE TransW, const int M,
+    const int N, const int K, const uint16_t* W, const Dtype* X, Dtype* C);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_HALF_H_
@@ -0,0 +1,55 @@
+#ifndef CAFFE_UTIL_HISTOGRAM_H_
+#define CAFFE_UTIL_HISTOGRAM_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Counts values in buckets with fixed bounds, e.g. for latency
+ *        statistics.
+ *
+ * Bucket i holds the values below bounds[i] and not in an earlier bucket;
+ * a last bucket holds the values from the last bound on.
+ */
+class Histogram {
+ public:
+  // bounds must be increasing.
+  explicit Histogram(const vector<double>& bounds);
+  // Bounds growing geometrically by factor from first up to at least last.
+  static vector<double> GeometricBounds(const double first, const double last,
+      const double factor);
+
+  void Add(const double value);
+
+  inline int num_buckets() const { return counts_.size(); }
+  inline const vector<double>& bounds() const { return bounds_; }
+  inline int64_t bucket_count(const int bucket) const {
+    return counts_[bucket];
+  }
+  inline int64_t count() const { return count_; }
+  inline double sum() const { return sum_; }
+  inline double mean() const { return count_ ? sum_ / count_ : 0; }
+  inline double max() const { return max_; }
+  // Returns the upper bound of the bucket holding the q-quantile, or the
+  // largest value added if that is in the last bucket.
+  double Quantile(const double q) const;
+  // Returns the non-empty buckets as "<bound: count" pairs.
+  string ToString() const;
+
+ private:
+  vector<double> bounds_;
+  vector<int64_t> counts_;
+  int64_t count_;
+  double sum_;
+  double max_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_HISTOGRAM_H_
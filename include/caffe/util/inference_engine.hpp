@@ -0,0 +1,72 @@
+#ifndef CAFFE_UTIL_INFERENCE_ENGINE_H_
+#define CAFFE_UTIL_INFERENCE_ENGINE_H_
+
+#include <string>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/net.hpp"
+
+namespace boost {
+class condition_variable;
+class mutex;
+}
+
+namespace caffe {
+
+/**
+ * @brief Serves concurrent predictions from one trained model.
+ *
+ * A Net keeps the state of a forward pass in its blobs, so it can only run
+ * one pass at a time. The engine loads the model once and keeps a pool of Net
+ * instances that share the parameter memory of the first one (see
+ * Net::ShareTrainedLayersWith), including the half precision, int8 and sparse
+ * forms of reduced precision layers; each Predict call checks out a free
+ * instance for the duration of its forward pass. The mode (CPU or GPU) is the
+ * one set with Caffe::set_mode, which is shared by all threads.
+ */
+template <typename Dtype>
+class InferenceEngine {
+ public:
+  // Loads the deploy net of model_file (in the TEST phase) with the weights
+  // of weights_file in any format Net::CopyTrainedLayersFrom reads.
+  InferenceEngine(const string& model_file, const string& weights_file,
+      const int num_instances);
+  InferenceEngine(const NetParameter& model, const string& weights_file,
+      const int num_instances);
+
+  // Runs inputs (one per net input) through a free instance, waiting for
+  // one if all are busy, and copies the net outputs into outputs (one per
+  // net output), reshaping them as needed. The inputs may have any shape the
+  // net can be reshaped to. Safe to call from any number of threads.
+  void Predict(const vector<Blob<Dtype>*>& inputs,
+      const vector<Blob<Dtype>*>& outputs);
+
+  // Checks out a free instance for callers that fill its inputs and run it
+  // themselves (e.g. DynamicBatcher), waiting for one if none is free. The
+  // instance must be given back with ReleaseInstance.
+  int AcquireInstance();
+  void ReleaseInstance(const int instance_id);
+
+  inline int num_instances() const { return instances_.size(); }
+  inline const shared_ptr<Net<Dtype> >& instance(const int i) const {
+    return instances_[i];
+  }
+
+ protected:
+  void Init(const NetParameter& model, const string& weights_file,
+      const int num_instances);
+
+  vector<shared_ptr<Net<Dtype> > > instances_;
+  // The instances not checked out, guarded by mutex_.
+  vector<int> free_instances_;
+  shared_ptr<boost::mutex> mutex_;
+  shared_ptr<boost::condition_variable> instance_free_;
+
+  DISABLE_COPY_AND_ASSIGN(InferenceEngine);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_INFERENCE_ENGINE_H_
@@ -0,0 +1,122 @@
+#ifndef CAFFE_UTIL_INFERENCE_SERVER_H_
+#define CAFFE_UTIL_INFERENCE_SERVER_H_
+
+#include <string>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/util/dynamic_batcher.hpp"
+
+namespace boost {
+class condition_variable;
+class mutex;
+}
+
+namespace caffe {
+
+// The kinds of requests an InferenceServer answers.
+enum InferenceRequestKind {
+  INFERENCE_TENSORS = 0,
+  INFERENCE_IMAGE = 1
+};
+
+/**
+ * @brief Answers inference requests from other processes on a Unix domain
+ *        socket, running them through a DynamicBatcher.
+ *
+ * Clients keep a connection open and send one request at a time; each
+ * connection is read by its own thread, which blocks in the batcher while
+ * the batcher's workers (one per engine instance) run the batches. All
+ * integers and values are in the byte order of the machine. A request is a
+ * uint32 InferenceRequestKind followed by
+ *   - for INFERENCE_TENSORS: a uint32 number of blobs, one per net input,
+ *     each written as a uint32 number of axes, the int32 dimensions and the
+ *     float32 values. The blobs hold the same number of items (at most the
+ *     batcher's max_batch_size) along their first axis and otherwise have
+ *     the shape of the net inputs.
+ *   - for INFERENCE_IMAGE: a uint32 byte length and an image in any format
+ *     OpenCV decodes. The image is resized to the shape of the single net
+ *     input (with 1 or 3 channels) and fed as one item of raw BGR or gray
+ *     pixel values; any scaling or mean subtraction is left to the net.
+ * The reply is an int32 status: 0 followed by a uint32 number of blobs and
+ * the net outputs in the format above, or else a uint32 length and an error
+ * message, after which the server closes the connection.
+ */
+template <typename Dtype>
+class InferenceServer {
+ public:
+  // Listens on socket_path, replacing any socket file left there.
+  InferenceServer(shared_ptr<DynamicBatcher<Dtype> > batcher,
+      const string& socket_path);
+  ~InferenceServer();
+
+  // Accepts connections until Stop is called, then closes them and waits
+  // for the requests in flight.
+  void Serve();
+  // Makes Serve return. Only shuts the listening socket down, so it can be
+  // called from another thread or from a signal handler.
+  void Stop();
+
+ protected:
+  void HandleConnection(const int fd);
+  // Reads a request and answers it, reusing the blobs of the connection.
+  // Returns false once the connection is closed, or after an error reply.
+  bool HandleRequest(const int fd, vector<shared_ptr<Blob<Dtype> > >* inputs,
+      vector<shared_ptr<Blob<Dtype> > >* outputs);
+  // Read the rest of a request into inputs, checking it against the net
+  // inputs. Return false with an error to reply, or with an empty error if
+  // the connection is lost.
+  bool ReadTensorRequest(const int fd,
+      vector<shared_ptr<Blob<Dtype> > >* inputs, string* error);
+  bool ReadImageRequest(const int fd,
+      vector<shared_ptr<Blob<Dtype> > >* inputs, string* error);
+
+  shared_ptr<DynamicBatcher<Dtype> > batcher_;
+  // The shape of one item of each net input, and the number of outputs.
+  vector<vector<int> > input_shapes_;
+  int num_outputs_;
+  string socket_path_;
+  int listener_;
+  volatile bool stop_;
+  // The open connections, guarded by mutex_. Their threads remove them when
+  // they finish, signalling connection_closed_.
+  vector<int> connections_;
+  shared_ptr<boost::mutex> mutex_;
+  shared_ptr<boost::condition_variable> connection_closed_;
+
+  DISABLE_COPY_AND_ASSIGN(InferenceServer);
+};
+
+/**
+ * @brief A connection to an InferenceServer.
+ *
+ * Not thread-safe: threads sending requests concurrently should each open
+ * their own client.
+ */
+template <typename Dtype>
+class InferenceClient {
+ public:
+  explicit InferenceClient(const string& socket_path);
+  ~InferenceClient();
+
+  // Sends inputs (one per net input) and reshapes outputs to the net
+  // outputs. Returns false with the server's message on an error, after
+  // which the connection is closed.
+  bool Predict(const vector<Blob<Dtype>*>& inputs,
+      vector<shared_ptr<Blob<Dtype> > >* outputs, string* error);
+  // Sends an encoded image instead.
+  bool PredictImage(const string& image,
+      vector<shared_ptr<Blob<Dtype> > >* outputs, string* error);
+
+ protected:
+  bool ReadReply(vector<shared_ptr<Blob<Dtype> > >* outputs, string* error);
+
+  int fd_;
+
+  DISABLE_COPY_AND_ASSIGN(InferenceClient);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_INFERENCE_SERVER_H_
@@ -85,6 +85,14 @@ inline void WriteProtoToBinaryFile(
   WriteProtoToBinaryFile(proto, filename.c_str());
 }
 
+// Writes to filename + ".tmp", syncs it to disk and renames it over filename,
+// so that filename never holds a partially written proto.
+void WriteProtoToBinaryFileAtomic(const Message& proto, const char* filename);
+inline void WriteProtoToBinaryFileAtomic(
+    const Message& proto, const string& filename) {
+  WriteProtoToBinaryFileAtomic(proto, filename.c_str());
+}
+
 bool ReadFileToDatum(const string& filename, const int label, Datum* datum);
 
 inline bool ReadFileToDatum(const string& filename, Datum* datum) {
@@ -0,0 +1,65 @@
+#ifndef CAFFE_UTIL_MAPPED_WEIGHTS_H_
+#define CAFFE_UTIL_MAPPED_WEIGHTS_H_
+
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+// A mapped weights file holds the parameters of a net as raw float arrays
+// that can be memory-mapped and used in place, so loading a net does no
+// parsing or copying, and processes that map the same file share its pages.
+// The layout (integers in host byte order) is
+//
+//   "CAFFEMAP"  magic
+//   uint32      format version
+//   uint32      header size in bytes
+//   header      NetParameter with, per layer, the name, type and the shapes
+//               (only) of its blobs
+//   data        the float data of every blob in header order, starting at a
+//               page boundary, each blob aligned to kMappedWeightsAlignment
+const size_t kMappedWeightsAlignment = 64;
+
+// Returns true if filename starts with the mapped weights magic.
+bool IsMappedWeightsFile(const string& filename);
+
+// Writes the blobs of net_param as a mapped weights file. The blobs may be in
+// any form Blob::FromProto reads; they are stored as float.
+void WriteMappedWeights(const NetParameter& net_param, const string& filename);
+
+/**
+ * @brief A mapped weights file, mapped copy-on-write for as long as the
+ *        object lives.
+ *
+ * Pages that are never written stay shared with the page cache and with other
+ * processes mapping the same file; writing to a blob (e.g. fine-tuning) gives
+ * this process a private copy of the pages written.
+ */
+class MappedWeights {
+ public:
+  explicit MappedWeights(const string& filename);
+  ~MappedWeights();
+
+  inline const NetParameter& header() const { return header_; }
+  // Returns the data of blob blob_id of layer layer_id of the header.
+  float* blob_data(const int layer_id, const int blob_id) const;
+  // Copies the file into net_param with the blobs as ordinary BlobProtos.
+  void ToProto(NetParameter* net_param) const;
+
+ private:
+  string filename_;
+  char* map_;
+  size_t map_size_;
+  NetParameter header_;
+  // Byte offset in the file of each blob of each layer.
+  vector<vector<size_t> > offsets_;
+
+  DISABLE_COPY_AND_ASSIGN(MappedWeights);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_MAPPED_WEIGHTS_H_
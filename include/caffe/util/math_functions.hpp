@@ -142,6 +142,34 @@ DEFINE_CAFFE_CPU_UNARY_FUNC(fabs, y[i] = std::fabs(x[i]));
 template <typename Dtype>
 void caffe_cpu_scale(const int n, const Dtype alpha, const Dtype *x, Dtype* y);
 
+// Fused solver updates: each reads the parameter data and diff and the solver
+// history once per element, and writes the update value to the diff and the
+// new history once. The gradient used is
+//   grad_scale * diff + l2_decay * data + l1_decay * sign(data),
+// with the operations in the same order as the separate BLAS calls they
+// replace, so the SGD and Nesterov results match theirs exactly.
+
+// history = rate * gradient + momentum * history; diff = history
+template <typename Dtype>
+void caffe_cpu_sgd_update(const int n, const Dtype* data, Dtype* diff,
+    Dtype* history, const Dtype grad_scale, const Dtype l2_decay,
+    const Dtype l1_decay, const Dtype rate, const Dtype momentum);
+
+// As caffe_cpu_sgd_update, with the Nesterov step
+// diff = (1 + momentum) * history - momentum * old history.
+template <typename Dtype>
+void caffe_cpu_nesterov_update(const int n, const Dtype* data, Dtype* diff,
+    Dtype* history, const Dtype grad_scale, const Dtype l2_decay,
+    const Dtype l1_decay, const Dtype rate, const Dtype momentum);
+
+// history += gradient^2; diff = rate * gradient / (sqrt(history) + delta)
+// The square and root are a multiply and std::sqrt, which round correctly,
+// rather than caffe_powx, which can differ from them in the last bit.
+template <typename Dtype>
+void caffe_cpu_adagrad_update(const int n, const Dtype* data, Dtype* diff,
+    Dtype* history, const Dtype grad_scale, const Dtype l2_decay,
+    const Dtype l1_decay, const Dtype rate, const Dtype delta);
+
 #ifndef CPU_ONLY  // GPU
 
 // Decaf gpu gemm provides an interface that is almost the same as the cpu
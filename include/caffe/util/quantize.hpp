@@ -0,0 +1,76 @@
+#ifndef CAFFE_UTIL_QUANTIZE_H_
+#define CAFFE_UTIL_QUANTIZE_H_
+
+#include <boost/weak_ptr.hpp>
+#include <stdint.h>
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/syncedmem.hpp"
+#include "caffe/util/mkl_alternate.hpp"
+
+namespace caffe {
+
+// Symmetric 8-bit quantization: q = clamp(round(x / scale), -127, 127), so
+// that zero (and therefore zero padding) is represented exactly.
+
+// Returns the largest absolute value of x.
+template <typename Dtype>
+Dtype caffe_cpu_absmax(const int n, const Dtype* x);
+
+// Returns the scale that maps [-absmax, absmax] onto [-127, 127].
+template <typename Dtype>
+inline float caffe_int8_scale(const Dtype absmax) {
+  return absmax > 0 ? static_cast<float>(absmax) / 127.f : 1.f;
+}
+
+template <typename Dtype>
+void caffe_cpu_quantize(const int n, const Dtype* x, const float scale,
+    int8_t* y);
+
+// C = diag(row_scale) * A * op(B) * diag(col_scale), where A is M x K and
+// op(B) is K x N, with the int8 x int8 products accumulated in int32 and the
+// scaling applied as each output element is written. Either scale may be NULL
+// to mean all ones.
+template <typename Dtype>
+void caffe_cpu_gemm_s8(const CBLAS_TRANSPOSE TransB, const int M, const int N,
+    const int K, const int8_t* A, const int8_t* B, const float* row_scale,
+    const float* col_scale, Dtype* C);
+
+/**
+ * @brief Per-output-channel int8 copy of a layer's weights.
+ *
+ * The weight Blob is viewed as num_output rows; each row is quantized with its
+ * own scale, taken from QuantizationParameter weight_scale when given and
+ * computed from the row's absolute maximum otherwise. The copy remembers the
+ * data it was made from, so that it can be redone when the weights are
+ * loaded, shared or updated.
+ */
+template <typename Dtype>
+class QuantizedWeights {
+ public:
+  QuantizedWeights() : source_version_(0) {}
+
+  void Quantize(const Blob<Dtype>& weights, const int num_output,
+      const QuantizationParameter& param);
+  inline bool initialized() const { return !data_.empty(); }
+  // Whether this is a copy of the current data of weights.
+  bool IsCurrent(const Blob<Dtype>& weights) const;
+  inline const int8_t* data() const { return &data_[0]; }
+  inline const vector<float>& scale() const { return scale_; }
+
+ private:
+  vector<int8_t> data_;
+  vector<float> scale_;
+  boost::weak_ptr<SyncedMemory> source_;
+  int source_version_;
+
+  DISABLE_COPY_AND_ASSIGN(QuantizedWeights);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_QUANTIZE_H_
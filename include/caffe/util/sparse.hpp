@@ -0,0 +1,59 @@
+#ifndef CAFFE_UTIL_SPARSE_H_
+#define CAFFE_UTIL_SPARSE_H_
+
+#include <boost/weak_ptr.hpp>
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+// Returns the fraction of the n entries of x that are exactly zero.
+template <typename Dtype>
+float caffe_cpu_sparsity(const int n, const Dtype* x);
+
+// Zeroes the entries of blob below threshold in magnitude and, when that
+// makes the proto smaller, stores only the nonzeros through data_index.
+// Returns the number of zeros.
+int PruneBlobProto(const float threshold, BlobProto* blob);
+
+/**
+ * @brief Compressed sparse row (CSR) copy of a rows x cols weight matrix,
+ *        holding only its nonzero entries.
+ */
+template <typename Dtype>
+class SparseWeights {
+ public:
+  SparseWeights() : rows_(0), cols_(0), source_version_(0) {}
+
+  void FromDense(const int rows, const int cols, const Dtype* dense);
+  // Makes the CSR copy of weights, viewed as rows rows, if at least a
+  // fraction min_sparsity of it is zeros, and holds no copy otherwise. The
+  // data it was made from is remembered, as by QuantizedWeights.
+  void FromWeights(const Blob<Dtype>& weights, const int rows,
+      const float min_sparsity);
+  // Whether FromWeights was last called on the current data of weights.
+  bool IsCurrent(const Blob<Dtype>& weights) const;
+  inline bool initialized() const { return !row_ptr_.empty(); }
+  inline int nnz() const { return values_.size(); }
+
+  // C = X * W^T, where this is W (N x K), X is M x K and C is M x N.
+  void MultiplyTransposed(const int M, const Dtype* X, Dtype* C) const;
+
+ private:
+  int rows_, cols_;
+  vector<int> row_ptr_;
+  vector<int> col_index_;
+  vector<Dtype> values_;
+  boost::weak_ptr<SyncedMemory> source_;
+  int source_version_;
+
+  DISABLE_COPY_AND_ASSIGN(SparseWeights);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_SPARSE_H_
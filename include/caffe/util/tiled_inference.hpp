@@ -0,0 +1,91 @@
+#ifndef CAFFE_UTIL_TILED_INFERENCE_H_
+#define CAFFE_UTIL_TILED_INFERENCE_H_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/util/inference_engine.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Runs a fully convolutional net on inputs too large to forward
+ *        whole, such as satellite or slide images, one tile at a time.
+ *
+ * The input is cut into overlapping tiles of at most tile_height x
+ * tile_width pixels, at positions aligned to the strides of the net, and
+ * each tile contributes the outputs whose receptive fields lie inside it,
+ * or reach past it only where the input ends (and the tile is padded as the
+ * whole input is). The outputs are thus those of a forward pass on the whole
+ * input, while the activations never take more memory than a tile's. The
+ * tiles are spread over the instances of the engine, so that as many run in
+ * parallel.
+ *
+ * The net has a single 4-D input and 4-D outputs, and may only contain
+ * layers that keep positions apart: Convolution, Pooling (not global),
+ * Im2col and LRN, layers that work on each position such as the neuron
+ * layers, Eltwise, and Concat, Slice and Softmax along the channels.
+ */
+template <typename Dtype>
+class TiledInference {
+ public:
+  // Where the values of a blob come from along a spatial axis: index i is
+  // computed from the input pixels [offset + i * stride,
+  // offset + i * stride + size), padding included.
+  struct ReceptiveField {
+    int stride;
+    int offset;
+    int size;
+  };
+
+  // Runs the net of engine on tiles of at most tile_height x tile_width
+  // pixels. Tiles must be larger than the receptive fields of the outputs.
+  TiledInference(shared_ptr<InferenceEngine<Dtype> > engine,
+      const int tile_height, const int tile_width);
+
+  // Runs input, which is shaped like the net input but for its number and
+  // its height and width, and reshapes outputs (one per net output) to the
+  // net outputs for the whole input. Safe to call from any number of
+  // threads.
+  void Forward(const Blob<Dtype>& input,
+      const vector<Blob<Dtype>*>& outputs);
+
+  // The receptive field of net output output_id along axis 0 (height) or 1
+  // (width).
+  inline const ReceptiveField& field(const int output_id,
+      const int axis) const {
+    return fields_[output_id][axis];
+  }
+  inline const shared_ptr<InferenceEngine<Dtype> >& engine() const {
+    return engine_;
+  }
+
+ protected:
+  struct Tiling;
+
+  // Places the tiles along an axis of the input: tiles start at multiples of
+  // alignment_[axis] and take tile_size_[axis] pixels, but for the last.
+  void PlaceTiles(const int axis, const int length, Tiling* tiling) const;
+  // Works out which outputs each tile along an axis writes, given the
+  // lengths of the outputs for a full and for the last tile.
+  void AssignOutputs(const int axis, const vector<int>& full_lengths,
+      const vector<int>& last_lengths, Tiling* tiling) const;
+  void WorkerEntry(Tiling* tiling);
+  void RunTile(Net<Dtype>* net, const int tile_id, Tiling* tiling);
+
+  shared_ptr<InferenceEngine<Dtype> > engine_;
+  int tile_size_[2];
+  // The receptive field of each net output along each axis, the alignment
+  // that keeps the outputs of all tiles on the grids of the whole input, and
+  // how far apart full tiles may start.
+  vector<vector<ReceptiveField> > fields_;
+  int alignment_[2];
+  int tile_step_[2];
+
+  DISABLE_COPY_AND_ASSIGN(TiledInference);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_TILED_INFERENCE_H_
@@ -0,0 +1,101 @@
+#ifndef CAFFE_UTIL_WEIGHTS_STREAM_H_
+#define CAFFE_UTIL_WEIGHTS_STREAM_H_
+
+#include <string>
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace google { namespace protobuf { namespace io {
+class FileInputStream;
+class FileOutputStream;
+} } }
+
+namespace caffe {
+
+// A weights stream file holds the same information as a .caffemodel, but is
+// written and read one layer at a time, so neither side ever materializes the
+// whole model as a single NetParameter. The layout is
+//
+//   "CAFFEWTS"  magic
+//   varint32    format version
+//   record      NetParameter: the net definition, with no layer blobs
+//   record      LayerParameter: name, type and blobs of one layer
+//   ...         (one record per layer that has blobs)
+//   varint32    0, marking the end of the file
+//
+// where every record is a varint32 byte length followed by the serialized
+// message. Each record is parsed on its own, so only a single layer has to
+// stay under protobuf's 2 GB message limit.
+
+// Returns true if filename starts with the weights stream magic.
+bool IsWeightsStreamFile(const string& filename);
+
+/**
+ * @brief Writes a weights stream file: the header first, then any number of
+ *        layers, then Close. A file that is not closed reads as truncated.
+ */
+class WeightsStreamWriter {
+ public:
+  explicit WeightsStreamWriter(const string& filename);
+  ~WeightsStreamWriter();
+
+  // Writes the net definition; the blobs of its layers are not written.
+  void WriteHeader(const NetParameter& net_param);
+  // Writes the name, type and blobs of a layer.
+  void WriteLayer(const LayerParameter& layer_param);
+  // Writes the end marker and syncs the file to disk.
+  void Close();
+
+ private:
+  void WriteRecord(const google::protobuf::Message& message);
+
+  string filename_;
+  int fd_;
+  shared_ptr<google::protobuf::io::FileOutputStream> output_;
+  bool header_written_;
+
+  DISABLE_COPY_AND_ASSIGN(WeightsStreamWriter);
+};
+
+/**
+ * @brief Reads a weights stream file written by WeightsStreamWriter. The
+ *        header is read on construction; ReadLayer then returns the layers in
+ *        file order.
+ */
+class WeightsStreamReader {
+ public:
+  explicit WeightsStreamReader(const string& filename);
+  ~WeightsStreamReader();
+
+  inline const NetParameter& header() const { return header_; }
+  // Reads the next layer into layer_param and returns true, or returns false
+  // at the end of the file.
+  bool ReadLayer(LayerParameter* layer_param);
+
+ private:
+  // Returns false at the end marker.
+  bool ReadRecord(google::protobuf::Message* message);
+
+  string filename_;
+  int fd_;
+  shared_ptr<google::protobuf::io::FileInputStream> input_;
+  NetParameter header_;
+  bool done_;
+
+  DISABLE_COPY_AND_ASSIGN(WeightsStreamReader);
+};
+
+// Converts a complete NetParameter to a weights stream file and back. These
+// hold the whole model in memory and are meant for converting .caffemodel
+// files; Net::ToWeightsStream and Net::CopyTrainedLayersFrom stream. The
+// blobs of net_param are swapped out while the header is written and are
+// back in place on return.
+void WriteNetParamToWeightsStream(NetParameter* net_param,
+    const string& filename);
+void ReadNetParamFromWeightsStream(const string& filename,
+    NetParameter* net_param);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_WEIGHTS_STREAM_H_
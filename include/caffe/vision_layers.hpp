@@ -13,6 +13,8 @@
 #include "caffe/loss_layers.hpp"
 #include "caffe/neuron_layers.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/half.hpp"
+#include "caffe/util/quantize.hpp"
 
 namespace caffe {
 
@@ -30,10 +32,17 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
 
+  virtual void ShareDerivedParamsFrom(Layer<Dtype>* source);
+
   virtual inline int MinBottomBlobs() const { return 1; }
   virtual inline int MinTopBlobs() const { return 1; }
   virtual inline bool EqualNumBottomTopBlobs() const { return true; }
 
+  /// The int8 copy of the weights used by INT8 inference.
+  inline const QuantizedWeights<Dtype>* quantized_weights() const {
+    return quantized_weights_.get();
+  }
+
  protected:
   // Helper functions that abstract away the column buffer and gemm arguments.
   // The last argument in forward_cpu_gemm is so that we can skip the im2col if
@@ -41,6 +50,14 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   void forward_cpu_gemm(const Dtype* input, const Dtype* weights,
       Dtype* output, bool skip_im2col = false);
   void forward_cpu_bias(Dtype* output, const Dtype* bias);
+  // Same as forward_cpu_gemm, in 8-bit integer arithmetic on a quantized
+  // copy of the weights.
+  void forward_cpu_gemm_int8(const Dtype* input, Dtype* output);
+  // Same as forward_cpu_gemm, with the weights held in half precision.
+  void forward_cpu_gemm_half(const Dtype* input, Dtype* output);
+  // Makes the int8 copy of the weights if they changed since the last one
+  // was made.
+  void UpdateDerivedWeights();
   void backward_cpu_gemm(const Dtype* input, const Dtype* weights,
       Dtype* output);
   void weight_cpu_gemm(const Dtype* input, const Dtype* output, Dtype*
@@ -75,6 +92,10 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   int height_out_, width_out_;
   bool bias_term_;
   bool is_1x1_;
+  /// Whether Forward_cpu runs in INT8 (see QuantizationParameter).
+  bool int8_;
+  /// Whether the weights are stored in half precision.
+  bool fp16_;
 
  private:
   // wrap im2col/col2im so we don't have to remember the (long) argument lists
@@ -109,6 +130,13 @@ class BaseConvolutionLayer : public Layer<Dtype> {
 
   Blob<Dtype> col_buffer_;
   Blob<Dtype> bias_multiplier_;
+
+  // Shared between the layers of nets serving the same model (see
+  // ShareDerivedParamsFrom).
+  shared_ptr<QuantizedWeights<Dtype> > quantized_weights_;
+  vector<int8_t> quantized_input_;
+  vector<int8_t> quantized_col_;
+  vector<float> output_scale_;
 };
 
 /**
@@ -157,6 +185,9 @@ class ConvolutionLayer : public BaseConvolutionLayer<Dtype> {
    *  - bias_term (\b optional, default true). Whether to have a bias.
    *  - engine: convolution has CAFFE (matrix multiplication) and CUDNN (library
    *    kernels + stream parallelism) engines.
+   *  - quantization_param (\b optional). With precision INT8, the CPU forward
+   *    pass runs in 8-bit integer arithmetic on quantized weights and inputs.
+   *    With precision FP16, the Net stores the weights in half precision.
    */
   explicit ConvolutionLayer(const LayerParameter& param)
       : BaseConvolutionLayer<Dtype>(param) {}
@@ -398,6 +429,11 @@ class PoolingLayer : public Layer<Dtype> {
     return (this->layer_param_.pooling_param().pool() ==
             PoolingParameter_PoolMethod_MAX) ? 2 : 1;
   }
+  // Stochastic pooling samples new locations on every training pass.
+  virtual inline bool RepeatableForward() const {
+    return this->phase_ != TRAIN || this->layer_param_.pooling_param().pool()
+        != PoolingParameter_PoolMethod_STOCHASTIC;
+  }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
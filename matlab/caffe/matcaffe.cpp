@@ -3,6 +3,8 @@
 // caffe::Caffe functions so that one could easily call it from matlab.
 // Note that for matlab, we will simply use float as the data type.
 
+#include <cstring>
+#include <set>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -10,6 +12,7 @@
 #include "mex.h"
 
 #include "caffe/caffe.hpp"
+#include "caffe/util/half.hpp"
 
 #define MEX_ARGS int nlhs, mxArray **plhs, int nrhs, const mxArray **prhs
 
@@ -48,34 +51,122 @@ static int init_key = -2;
 //
 // If you have multiple images, cat them with cat(4, ...)
 //
-// The actual forward function. It takes in a cell array of 4-D arrays as
-// input and outputs a cell array.
-
-static mxArray* do_forward(const mxArray* const bottom) {
+// forward_into takes data in this order without copying it: in CPU mode the
+// input arrays become the storage of the input blobs for the pass, unless a
+// layer computes in place on them, and the outputs are written into
+// preallocated arrays instead of new ones.
+
+// Checks that bottom is a cell array of one single-precision array per
+// input blob, holding a whole number of items of the blob. Returns that
+// number of items, which is the same for all the inputs.
+static int check_inputs(const mxArray* const bottom) {
   const vector<Blob<float>*>& input_blobs = net_->input_blobs();
-  if (static_cast<unsigned int>(mxGetDimensions(bottom)[0]) !=
-      input_blobs.size()) {
+  if (!mxIsCell(bottom) ||
+      mxGetNumberOfElements(bottom) != input_blobs.size()) {
     mex_error("Invalid input size");
   }
+  int num = -1;
   for (unsigned int i = 0; i < input_blobs.size(); ++i) {
     const mxArray* const elem = mxGetCell(bottom, i);
-    if (!mxIsSingle(elem)) {
+    if (!elem || !mxIsSingle(elem) || mxIsComplex(elem)) {
       mex_error("MatCaffe require single-precision float point data");
     }
-    if (mxGetNumberOfElements(elem) != input_blobs[i]->count()) {
+    const int item_count = input_blobs[i]->count(1);
+    const int count = mxGetNumberOfElements(elem);
+    if (count == 0 || count % item_count != 0 ||
+        (num >= 0 && count / item_count != num)) {
       std::string error_msg;
       error_msg += "MatCaffe input size does not match the input size ";
       error_msg += "of the network";
       mex_error(error_msg);
     }
+    num = count / item_count;
+  }
+  return num;
+}
+
+// Reshapes the input blobs to num items, and the rest of the net to match,
+// unless they hold num items already.
+static void reshape_inputs(const int num) {
+  const vector<Blob<float>*>& input_blobs = net_->input_blobs();
+  bool reshaped = false;
+  for (unsigned int i = 0; i < input_blobs.size(); ++i) {
+    if (input_blobs[i]->shape(0) != num) {
+      vector<int> shape = input_blobs[i]->shape();
+      shape[0] = num;
+      input_blobs[i]->Reshape(shape);
+      reshaped = true;
+    }
+  }
+  if (reshaped) {
+    net_->Reshape();
+  }
+}
+
+// Returns, for each input blob, whether the forward pass writes into its
+// data: a layer computes in place on it, or on a Split or Flatten top that
+// shares its data. Such inputs cannot be bound to matlab arrays, which may
+// share their data with other variables.
+static vector<bool> inputs_written_in_place() {
+  const vector<Blob<float>*>& input_blobs = net_->input_blobs();
+  const vector<shared_ptr<Layer<float> > >& layers = net_->layers();
+  const vector<vector<Blob<float>*> >& bottom_vecs = net_->bottom_vecs();
+  const vector<vector<Blob<float>*> >& top_vecs = net_->top_vecs();
+  vector<bool> written(input_blobs.size(), false);
+  for (unsigned int i = 0; i < input_blobs.size(); ++i) {
+    std::set<const Blob<float>*> aliases;
+    aliases.insert(input_blobs[i]);
+    for (unsigned int layer_id = 0; layer_id < layers.size(); ++layer_id) {
+      const vector<Blob<float>*>& bottom = bottom_vecs[layer_id];
+      const vector<Blob<float>*>& top = top_vecs[layer_id];
+      const char* const type = layers[layer_id]->type();
+      const bool shares_data =
+          strcmp(type, "Split") == 0 || strcmp(type, "Flatten") == 0;
+      for (unsigned int j = 0; j < bottom.size(); ++j) {
+        if (!aliases.count(bottom[j])) { continue; }
+        for (unsigned int k = 0; k < top.size(); ++k) {
+          if (top[k] == bottom[j]) {
+            written[i] = true;
+          } else if (shares_data) {
+            aliases.insert(top[k]);
+          }
+        }
+      }
+    }
+  }
+  return written;
+}
 
+// Feeds the (checked) inputs to the input blobs by copying them or, for those
+// with bind set in CPU mode, by making them the storage of the blobs. The
+// previous storage of bound blobs is then returned in saved (NULL for copied
+// ones) for restore_inputs.
+static void set_inputs(const mxArray* const bottom, const vector<bool>& bind,
+    vector<shared_ptr<Blob<float> > >* saved) {
+  const vector<Blob<float>*>& input_blobs = net_->input_blobs();
+  saved->clear();
+  saved->resize(input_blobs.size());
+  for (unsigned int i = 0; i < input_blobs.size(); ++i) {
+    const mxArray* const elem = mxGetCell(bottom, i);
     const float* const data_ptr =
-        reinterpret_cast<const float* const>(mxGetPr(elem));
+        reinterpret_cast<const float* const>(mxGetData(elem));
     switch (Caffe::mode()) {
-    case Caffe::CPU:
-      caffe_copy(input_blobs[i]->count(), data_ptr,
-          input_blobs[i]->mutable_cpu_data());
+    case Caffe::CPU: {
+      if (!bind[i]) {
+        caffe_copy(input_blobs[i]->count(), data_ptr,
+            input_blobs[i]->mutable_cpu_data());
+        break;
+      }
+      shared_ptr<Blob<float> > previous(new Blob<float>());
+      previous->ReshapeLike(*input_blobs[i]);
+      previous->ShareData(*input_blobs[i]);
+      (*saved)[i] = previous;
+      Blob<float> bound;
+      bound.ReshapeLike(*input_blobs[i]);
+      bound.set_cpu_data(const_cast<float*>(data_ptr));
+      input_blobs[i]->ShareData(bound);
       break;
+    }
     case Caffe::GPU:
       caffe_copy(input_blobs[i]->count(), data_ptr,
           input_blobs[i]->mutable_gpu_data());
@@ -84,6 +175,51 @@ static mxArray* do_forward(const mxArray* const bottom) {
       mex_error("Unknown Caffe mode");
     }  // switch (Caffe::mode())
   }
+}
+
+// Gives the bound input blobs back their own storage, along with the blobs
+// that came to share the bound arrays in the pass (the tops of Split and
+// Flatten layers), so that no blob refers to arrays matlab may free.
+static void restore_inputs(const vector<shared_ptr<Blob<float> > >& saved) {
+  const vector<Blob<float>*>& input_blobs = net_->input_blobs();
+  const vector<shared_ptr<Blob<float> > >& blobs = net_->blobs();
+  for (unsigned int i = 0; i < saved.size(); ++i) {
+    if (!saved[i]) { continue; }
+    const shared_ptr<SyncedMemory> bound = input_blobs[i]->data();
+    for (unsigned int j = 0; j < blobs.size(); ++j) {
+      if (blobs[j]->data() == bound) {
+        blobs[j]->ShareData(*saved[i]);
+      }
+    }
+  }
+}
+
+// Copies a blob's data or diff into a single-precision array.
+static void copy_from_blob(const Blob<float>* blob, const bool diff,
+    float* data_ptr) {
+  switch (Caffe::mode()) {
+  case Caffe::CPU:
+    caffe_copy(blob->count(), diff ? blob->cpu_diff() : blob->cpu_data(),
+        data_ptr);
+    break;
+  case Caffe::GPU:
+    caffe_copy(blob->count(), diff ? blob->gpu_diff() : blob->gpu_data(),
+        data_ptr);
+    break;
+  default:
+    mex_error("Unknown Caffe mode");
+  }  // switch (Caffe::mode())
+}
+
+// The actual forward function. It takes in a cell array of 4-D arrays as
+// input and outputs a cell array. The net is reshaped to the number of items
+// in the inputs, which may differ from the last batch, e.g. one run by
+// forward_into.
+static mxArray* do_forward(const mxArray* const bottom) {
+  reshape_inputs(check_inputs(bottom));
+  // The inputs are copied, as backward needs them after the arrays are gone.
+  vector<shared_ptr<Blob<float> > > saved;
+  set_inputs(bottom, vector<bool>(net_->input_blobs().size(), false), &saved);
   const vector<Blob<float>*>& output_blobs = net_->ForwardPrefilled();
   mxArray* mx_out = mxCreateCellMatrix(output_blobs.size(), 1);
   for (unsigned int i = 0; i < output_blobs.size(); ++i) {
@@ -93,24 +229,56 @@ static mxArray* do_forward(const mxArray* const bottom) {
       output_blobs[i]->channels(), output_blobs[i]->num()};
     mxArray* mx_blob =  mxCreateNumericArray(4, dims, mxSINGLE_CLASS, mxREAL);
     mxSetCell(mx_out, i, mx_blob);
-    float* data_ptr = reinterpret_cast<float*>(mxGetPr(mx_blob));
-    switch (Caffe::mode()) {
-    case Caffe::CPU:
-      caffe_copy(output_blobs[i]->count(), output_blobs[i]->cpu_data(),
-          data_ptr);
-      break;
-    case Caffe::GPU:
-      caffe_copy(output_blobs[i]->count(), output_blobs[i]->gpu_data(),
-          data_ptr);
-      break;
-    default:
-      mex_error("Unknown Caffe mode");
-    }  // switch (Caffe::mode())
+    copy_from_blob(output_blobs[i], false,
+        reinterpret_cast<float*>(mxGetData(mx_blob)));
   }
 
   return mx_out;
 }
 
+// Runs a batch of any number of items through the net, reshaping it to the
+// inputs, and writes the outputs into the preallocated single-precision
+// arrays of the top cell array, which must hold as many elements as the
+// outputs. Since they are written in place, they must not share their data
+// with other matlab variables (e.g. by being copies made with =). The inputs
+// are not kept, so backward cannot follow.
+static void do_forward_into(const mxArray* const bottom,
+    const mxArray* const top) {
+  const int num = check_inputs(bottom);
+  const vector<Blob<float>*>& input_blobs = net_->input_blobs();
+  const vector<Blob<float>*>& output_blobs = net_->output_blobs();
+  if (!mxIsCell(top) || mxGetNumberOfElements(top) != output_blobs.size()) {
+    mex_error("Invalid output size");
+  }
+  for (unsigned int i = 0; i < output_blobs.size(); ++i) {
+    const mxArray* const elem = mxGetCell(top, i);
+    if (!elem || !mxIsSingle(elem) || mxIsComplex(elem)) {
+      mex_error("MatCaffe require single-precision float point data");
+    }
+  }
+  reshape_inputs(num);
+  for (unsigned int i = 0; i < output_blobs.size(); ++i) {
+    if (mxGetNumberOfElements(mxGetCell(top, i)) != output_blobs[i]->count()) {
+      std::string error_msg;
+      error_msg += "MatCaffe output size does not match the output size ";
+      error_msg += "of the network";
+      mex_error(error_msg);
+    }
+  }
+  // Inputs that the pass writes into are copied, to leave the arrays as they
+  // were.
+  vector<bool> bind = inputs_written_in_place();
+  bind.flip();
+  vector<shared_ptr<Blob<float> > > saved;
+  set_inputs(bottom, bind, &saved);
+  net_->ForwardPrefilled();
+  restore_inputs(saved);
+  for (unsigned int i = 0; i < output_blobs.size(); ++i) {
+    copy_from_blob(output_blobs[i], false,
+        reinterpret_cast<float*>(mxGetData(mxGetCell(top, i))));
+  }
+}
+
 static mxArray* do_backward(const mxArray* const top_diff) {
   const vector<Blob<float>*>& output_blobs = net_->output_blobs();
   const vector<Blob<float>*>& input_blobs = net_->input_blobs();
@@ -147,17 +315,8 @@ static mxArray* do_backward(const mxArray* const top_diff) {
       input_blobs[i]->channels(), input_blobs[i]->num()};
     mxArray* mx_blob =  mxCreateNumericArray(4, dims, mxSINGLE_CLASS, mxREAL);
     mxSetCell(mx_out, i, mx_blob);
-    float* data_ptr = reinterpret_cast<float*>(mxGetPr(mx_blob));
-    switch (Caffe::mode()) {
-    case Caffe::CPU:
-      caffe_copy(input_blobs[i]->count(), input_blobs[i]->cpu_diff(), data_ptr);
-      break;
-    case Caffe::GPU:
-      caffe_copy(input_blobs[i]->count(), input_blobs[i]->gpu_diff(), data_ptr);
-      break;
-    default:
-        mex_error("Unknown Caffe mode");
-    }  // switch (Caffe::mode())
+    copy_from_blob(input_blobs[i], true,
+        reinterpret_cast<float*>(mxGetData(mx_blob)));
   }
 
   return mx_out;
@@ -223,6 +382,12 @@ static mxArray* do_get_weights() {
         mxSetCell(mx_layer_cells, j, mx_weights);
         float* weights_ptr = reinterpret_cast<float*>(mxGetPr(mx_weights));
 
+        if (layer_blobs[j]->is_half()) {
+          // Half precision weights are converted without touching the net.
+          caffe_cpu_half2float(layer_blobs[j]->count(),
+              layer_blobs[j]->cpu_half_data(), weights_ptr);
+          continue;
+        }
         switch (Caffe::mode()) {
         case Caffe::CPU:
           caffe_copy(layer_blobs[j]->count(), layer_blobs[j]->cpu_data(),
@@ -321,6 +486,16 @@ static void forward(MEX_ARGS) {
   plhs[0] = do_forward(prhs[0]);
 }
 
+static void forward_into(MEX_ARGS) {
+  if (nrhs != 2) {
+    ostringstream error_msg;
+    error_msg << "Expected 2 arguments, got " << nrhs;
+    mex_error(error_msg.str());
+  }
+
+  do_forward_into(prhs[0], prhs[1]);
+}
+
 static void backward(MEX_ARGS) {
   if (nrhs != 1) {
     ostringstream error_msg;
@@ -375,6 +550,7 @@ struct handler_registry {
 static handler_registry handlers[] = {
   // Public API functions
   { "forward",            forward         },
+  { "forward_into",       forward_into    },
   { "backward",           backward        },
   { "init",               init            },
   { "is_initialized",     is_initialized  },
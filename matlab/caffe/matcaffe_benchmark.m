@@ -0,0 +1,97 @@
+function matcaffe_benchmark(im, use_gpu, num_iterations)
+% matcaffe_benchmark(im, use_gpu, num_iterations)
+%
+% Times a 10-crop forward pass of the ILSVRC network through
+% caffe('forward'), which copies the input into the network and returns new
+% output arrays, and through caffe('forward_into'), which uses the input in
+% place (in CPU mode) and writes into a preallocated output array. Also
+% times caffe('get_weights') against the cached matcaffe_weights().
+%
+% input
+%   im              color image as uint8 HxWx3
+%   use_gpu         1 to use the GPU, 0 to use the CPU
+%   num_iterations  number of timed runs of each (default 10)
+%
+% Usage:
+%  im = imread('../../examples/images/cat.jpg');
+%  matcaffe_benchmark(im, 0);
+
+if nargin < 1
+  im = imread('peppers.png');
+end
+if nargin < 2
+  use_gpu = 0;
+end
+if nargin < 3
+  num_iterations = 10;
+end
+matcaffe_init(use_gpu);
+
+% prepare oversampled input as matcaffe_demo does, already in Caffe's
+% [width, height, channels, num] order
+input_data = {prepare_image(im)};
+scores = {zeros(1, 1, 1000, 10, 'single')};
+
+% warm up, allocating the network's memory for 10 items
+caffe('forward', input_data);
+caffe('forward_into', input_data, scores);
+
+tic;
+for i = 1:num_iterations
+  copied_scores = caffe('forward', input_data);
+end
+forward_time = toc / num_iterations;
+tic;
+for i = 1:num_iterations
+  caffe('forward_into', input_data, scores);
+end
+forward_into_time = toc / num_iterations;
+fprintf('forward:      %.2f ms\n', forward_time * 1000);
+fprintf('forward_into: %.2f ms\n', forward_into_time * 1000);
+fprintf('max difference: %g\n', ...
+    max(abs(copied_scores{1}(:) - scores{1}(:))));
+
+tic;
+for i = 1:num_iterations
+  layers = caffe('get_weights');
+end
+get_weights_time = toc / num_iterations;
+tic;
+for i = 1:num_iterations
+  layers = matcaffe_weights();
+end
+cached_weights_time = toc / num_iterations;
+fprintf('get_weights:      %.2f ms\n', get_weights_time * 1000);
+fprintf('matcaffe_weights: %.2f ms\n', cached_weights_time * 1000);
+
+% ------------------------------------------------------------------------
+function images = prepare_image(im)
+% ------------------------------------------------------------------------
+d = load('ilsvrc_2012_mean');
+IMAGE_MEAN = d.image_mean;
+IMAGE_DIM = 256;
+CROPPED_DIM = 227;
+
+% resize to fixed input size
+im = single(im);
+im = imresize(im, [IMAGE_DIM IMAGE_DIM], 'bilinear');
+% permute from RGB to BGR (IMAGE_MEAN is already BGR)
+im = im(:,:,[3 2 1]) - IMAGE_MEAN;
+
+% oversample (4 corners, center, and their x-axis flips)
+images = zeros(CROPPED_DIM, CROPPED_DIM, 3, 10, 'single');
+indices = [0 IMAGE_DIM-CROPPED_DIM] + 1;
+curr = 1;
+for i = indices
+  for j = indices
+    images(:, :, :, curr) = ...
+        permute(im(i:i+CROPPED_DIM-1, j:j+CROPPED_DIM-1, :), [2 1 3]);
+    images(:, :, :, curr+5) = images(end:-1:1, :, :, curr);
+    curr = curr + 1;
+  end
+end
+center = floor(indices(2) / 2)+1;
+images(:,:,:,5) = ...
+    permute(im(center:center+CROPPED_DIM-1,center:center+CROPPED_DIM-1,:), ...
+        [2 1 3]);
+images(:,:,:,10) = images(end:-1:1, :, :, curr);
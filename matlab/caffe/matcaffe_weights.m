@@ -0,0 +1,18 @@
+function layers = matcaffe_weights()
+% layers = matcaffe_weights()
+%
+% Returns the weights of the network as caffe('get_weights') does, but only
+% copies them out of Caffe once per network: matcaffe does not change the
+% weights, so they are cached until the network is initialized again.
+% Matlab shares the cached arrays with the caller until either modifies them.
+%
+% output
+%   layers   struct array with the weights and layer_names of each layer
+
+persistent cached_layers cached_key
+key = caffe('get_init_key');
+if isempty(cached_key) || cached_key ~= key
+  cached_layers = caffe('get_weights');
+  cached_key = key;
+end
+layers = cached_layers;
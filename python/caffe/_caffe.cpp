@@ -13,6 +13,7 @@
 #include <string>  // NOLINT(build/include_order)
 #include <vector>  // NOLINT(build/include_order)
 #include <fstream>  // NOLINT
+#include <sstream>  // NOLINT
 
 #include "caffe/caffe.hpp"
 #include "caffe/python_layer.hpp"
@@ -32,6 +33,17 @@ namespace caffe {
 typedef float Dtype;
 const int NPY_DTYPE = NPY_FLOAT32;
 
+// Releases the GIL for the lifetime of the object, so that other Python
+// threads run while Caffe computes. PythonLayer takes it back as needed.
+class ScopedGILRelease {
+ public:
+  ScopedGILRelease() : state_(PyEval_SaveThread()) {}
+  ~ScopedGILRelease() { PyEval_RestoreThread(state_); }
+
+ private:
+  PyThreadState* state_;
+};
+
 // Selecting mode.
 void set_mode_cpu() { Caffe::set_mode(Caffe::CPU); }
 void set_mode_gpu() { Caffe::set_mode(Caffe::GPU); }
@@ -93,6 +105,42 @@ shared_ptr<Net<Dtype> > Net_Init_Load(
   return net;
 }
 
+Dtype Net_ForwardFromTo(Net<Dtype>* net, int start, int end) {
+  ScopedGILRelease gil;
+  return net->ForwardFromTo(start, end);
+}
+
+void Net_BackwardFromTo(Net<Dtype>* net, int start, int end) {
+  ScopedGILRelease gil;
+  net->BackwardFromTo(start, end);
+}
+
+void Net_Reshape(Net<Dtype>* net) {
+  ScopedGILRelease gil;
+  net->Reshape();
+}
+
+// Takes a shape (a sequence of ints) per net input, as Net::Reserve.
+void Net_Reserve(Net<Dtype>* net, bp::object shapes) {
+  if (bp::len(shapes) != net->num_inputs()) {
+    throw std::runtime_error("reserve needs a shape per net input");
+  }
+  vector<vector<int> > input_shapes(net->num_inputs());
+  for (int i = 0; i < input_shapes.size(); ++i) {
+    bp::object shape = shapes[i];
+    for (int j = 0; j < bp::len(shape); ++j) {
+      input_shapes[i].push_back(bp::extract<int>(shape[j]));
+    }
+  }
+  ScopedGILRelease gil;
+  net->Reserve(input_shapes);
+}
+
+void Net_CopyFrom(Net<Dtype>* net, string filename) {
+  ScopedGILRelease gil;
+  net->CopyTrainedLayersFrom(filename);
+}
+
 void Net_Save(const Net<Dtype>& net, string filename) {
   NetParameter net_param;
   net.ToProto(&net_param, false);
@@ -126,9 +174,173 @@ void Net_SetInputArrays(Net<Dtype>* net, bp::object data_obj,
         " multiple of batch size");
   }
 
-  md_layer->Reset(static_cast<Dtype*>(PyArray_DATA(data_arr)),
-      static_cast<Dtype*>(PyArray_DATA(labels_arr)),
-      PyArray_DIMS(data_arr)[0]);
+  Dtype* data = static_cast<Dtype*>(PyArray_DATA(data_arr));
+  Dtype* labels = static_cast<Dtype*>(PyArray_DATA(labels_arr));
+  const int n = PyArray_DIMS(data_arr)[0];
+  ScopedGILRelease gil;
+  md_layer->Reset(data, labels, n);
+}
+
+// Wraps a C contiguous float32 array with num_axes axes in a blob without
+// copying it, raising an exception mentioning name otherwise.
+static shared_ptr<Blob<Dtype> > WrapArray(bp::object obj, const string& name,
+    const int num_axes) {
+  if (!PyArray_Check(obj.ptr())) {
+    throw std::runtime_error(name + " must be an ndarray");
+  }
+  PyArrayObject* arr = reinterpret_cast<PyArrayObject*>(obj.ptr());
+  if (!(PyArray_FLAGS(arr) & NPY_ARRAY_C_CONTIGUOUS)) {
+    throw std::runtime_error(name + " must be C contiguous");
+  }
+  if (PyArray_NDIM(arr) != num_axes) {
+    std::ostringstream error;
+    error << name << " must be " << num_axes << "-d";
+    throw std::runtime_error(error.str());
+  }
+  if (PyArray_TYPE(arr) != NPY_FLOAT32) {
+    throw std::runtime_error(name + " must be float32");
+  }
+  if (PyArray_SIZE(arr) == 0) {
+    throw std::runtime_error(name + " must not be empty");
+  }
+  vector<int> shape(PyArray_DIMS(arr), PyArray_DIMS(arr) + num_axes);
+  shared_ptr<Blob<Dtype> > blob(new Blob<Dtype>(shape));
+  blob->set_cpu_data(static_cast<Dtype*>(PyArray_DATA(arr)));
+  return blob;
+}
+
+// Reads a list of channel indices for DataTransformer.
+static vector<int> ChannelSwap(bp::list channel_swap_list,
+    const int channels) {
+  vector<int> channel_swap;
+  for (int c = 0; c < bp::len(channel_swap_list); ++c) {
+    channel_swap.push_back(bp::extract<int>(channel_swap_list[c]));
+    if (channel_swap[c] < 0 || channel_swap[c] >= channels) {
+      throw std::runtime_error("channel swap out of range");
+    }
+  }
+  if (!channel_swap.empty() && channel_swap.size() != channels) {
+    throw std::runtime_error("channel swap must have one entry per channel");
+  }
+  return channel_swap;
+}
+
+// Preprocesses a list of (H x W x K) float32 images into a contiguous
+// (N x K x H x W) array (e.g. the data of an input blob) with a
+// DataTransformer, resizing, cropping and scaling them off the GIL.
+void TransformImages(bp::list images_list, bp::object out_obj,
+    int resize_height, int resize_width, bool oversample,
+    bp::list channel_swap_list, Dtype raw_scale, Dtype input_scale,
+    bp::list mean_list, int num_threads) {
+  const int num_images = bp::len(images_list);
+  if (num_images == 0) {
+    throw std::runtime_error("no images to transform");
+  }
+  // Wrap the images and the output array without copying them.
+  vector<shared_ptr<Blob<Dtype> > > image_blobs;
+  vector<Blob<Dtype>*> images;
+  for (int i = 0; i < num_images; ++i) {
+    image_blobs.push_back(WrapArray(images_list[i], "images", 3));
+    if (image_blobs[i]->shape(2) != image_blobs[0]->shape(2)) {
+      throw std::runtime_error("images must have the same number of "
+          "channels");
+    }
+    images.push_back(image_blobs[i].get());
+  }
+  shared_ptr<Blob<Dtype> > out = WrapArray(out_obj, "output array", 4);
+  const int channels = images[0]->shape(2);
+  if (out->channels() != channels) {
+    throw std::runtime_error("output array has wrong number of channels");
+  }
+  if (out->num() != num_images * (oversample ? 10 : 1)) {
+    throw std::runtime_error("output array must have one item per crop");
+  }
+  if (resize_height < out->height() || resize_width < out->width()) {
+    throw std::runtime_error("images must be resized to at least the crop "
+        "size");
+  }
+  vector<int> channel_swap = ChannelSwap(channel_swap_list, channels);
+  TransformationParameter param;
+  param.set_scale(input_scale);
+  for (int c = 0; c < bp::len(mean_list); ++c) {
+    param.add_mean_value(bp::extract<Dtype>(mean_list[c]));
+  }
+  if (param.mean_value_size() > 1 && param.mean_value_size() != channels) {
+    throw std::runtime_error("mean must have one value per channel");
+  }
+  DataTransformer<Dtype> transformer(param, TEST);
+  ScopedGILRelease gil;
+  transformer.TransformImages(images, resize_height, resize_width,
+      oversample, channel_swap, raw_scale, out.get(), num_threads);
+}
+
+// Warps the regions of an (H x W x K) float32 image given by an R x 4 int32
+// array of y1, x1, y2, x2 into a contiguous (R x K x H x W) array, e.g. the
+// data of an input blob, off the GIL. mean is None, a list of channel means
+// or a (K x H x W) float32 array.
+void TransformRegions(bp::object image_obj, bp::object regions_obj,
+    bp::object out_obj, int context_pad, bp::list channel_swap_list,
+    Dtype raw_scale, Dtype input_scale, bp::object mean_obj,
+    int num_threads) {
+  shared_ptr<Blob<Dtype> > image = WrapArray(image_obj, "image", 3);
+  const int channels = image->shape(2);
+  if (!PyArray_Check(regions_obj.ptr())) {
+    throw std::runtime_error("regions must be an ndarray");
+  }
+  PyArrayObject* regions_arr =
+      reinterpret_cast<PyArrayObject*>(regions_obj.ptr());
+  if (!(PyArray_FLAGS(regions_arr) & NPY_ARRAY_C_CONTIGUOUS) ||
+      PyArray_TYPE(regions_arr) != NPY_INT32 ||
+      PyArray_NDIM(regions_arr) != 2 || PyArray_DIMS(regions_arr)[1] != 4 ||
+      PyArray_DIMS(regions_arr)[0] == 0) {
+    throw std::runtime_error("regions must be a C contiguous R x 4 int32 "
+        "array");
+  }
+  const int num_regions = PyArray_DIMS(regions_arr)[0];
+  const int32_t* boxes = static_cast<int32_t*>(PyArray_DATA(regions_arr));
+  vector<vector<int> > regions(num_regions);
+  for (int i = 0; i < num_regions; ++i) {
+    regions[i].assign(boxes + i * 4, boxes + (i + 1) * 4);
+    if (regions[i][0] > regions[i][2] || regions[i][1] > regions[i][3]) {
+      throw std::runtime_error("regions must not be empty");
+    }
+  }
+  shared_ptr<Blob<Dtype> > out = WrapArray(out_obj, "output array", 4);
+  if (out->num() != num_regions || out->channels() != channels) {
+    throw std::runtime_error("output array must have an item per region and "
+        "the channels of the image");
+  }
+  if (context_pad < 0 ||
+      2 * context_pad >= std::min(out->height(), out->width())) {
+    throw std::runtime_error("context pad must leave room for the region");
+  }
+  vector<int> channel_swap = ChannelSwap(channel_swap_list, channels);
+  TransformationParameter param;
+  param.set_scale(input_scale);
+  shared_ptr<Blob<Dtype> > mean;
+  if (PyArray_Check(mean_obj.ptr())) {
+    mean = WrapArray(mean_obj, "mean", 3);
+    if (mean->shape(0) != channels || mean->shape(1) < out->height() ||
+        mean->shape(2) < out->width()) {
+      throw std::runtime_error("mean must have the channels of the image "
+          "and at least the size of the output");
+    }
+  } else if (!mean_obj.is_none()) {
+    bp::list mean_list = bp::extract<bp::list>(mean_obj);
+    for (int c = 0; c < bp::len(mean_list); ++c) {
+      param.add_mean_value(bp::extract<Dtype>(mean_list[c]));
+    }
+    if (param.mean_value_size() > 1 && param.mean_value_size() != channels) {
+      throw std::runtime_error("mean must have one value per channel");
+    }
+  }
+  DataTransformer<Dtype> transformer(param, TEST);
+  if (mean) {
+    transformer.SetMean(*mean);
+  }
+  ScopedGILRelease gil;
+  transformer.TransformRegions(*image, regions, context_pad, channel_swap,
+      raw_scale, out.get(), num_threads);
 }
 
 Solver<Dtype>* GetSolverFromFile(const string& filename) {
@@ -154,6 +366,14 @@ struct NdarrayConverterGenerator::apply<Dtype*> {
   };
 };
 
+// Drops the reference to the memory of a blob held by an ndarray's base.
+static void ReleaseSyncedMemory(PyObject* capsule) {
+  delete static_cast<shared_ptr<SyncedMemory>*>(
+      PyCapsule_GetPointer(capsule, NULL));
+}
+
+// Wraps the data (or, if diff, the diff) of a blob as an ndarray.
+template <bool diff>
 struct NdarrayCallPolicies : public bp::default_call_policies {
   typedef NdarrayConverterGenerator result_converter;
   PyObject* postcall(PyObject* pyargs, PyObject* result) {
@@ -168,14 +388,50 @@ struct NdarrayCallPolicies : public bp::default_call_policies {
     vector<npy_intp> dims(blob->shape().begin(), blob->shape().end());
     PyObject *arr_obj = PyArray_SimpleNewFromData(num_axes, dims.data(),
                                                   NPY_FLOAT32, data);
-    // SetBaseObject steals a ref, so we need to INCREF.
-    Py_INCREF(pyblob.ptr());
+    // The array keeps the memory it views alive rather than the blob, so it
+    // stays valid when the blob is reshaped or its data rebound.
+    shared_ptr<SyncedMemory> memory = diff ? blob->diff() : blob->data();
+    PyObject* capsule = PyCapsule_New(new shared_ptr<SyncedMemory>(memory),
+        NULL, &ReleaseSyncedMemory);
+    // SetBaseObject steals the capsule's ref.
     PyArray_SetBaseObject(reinterpret_cast<PyArrayObject*>(arr_obj),
-        pyblob.ptr());
+        capsule);
     return arr_obj;
   }
 };
 
+// Makes a C contiguous float32 array with as many axes as the blob its data,
+// reshaping the blob to the array, and returns a blob holding the previous
+// data to restore it with _share_data. The array is not copied, so the
+// caller keeps it alive while it is bound.
+shared_ptr<Blob<Dtype> > Blob_BindData(Blob<Dtype>* self,
+    bp::object array_obj) {
+  if (!PyArray_Check(array_obj.ptr())) {
+    throw std::runtime_error("bound data must be an ndarray");
+  }
+  PyArrayObject* arr = reinterpret_cast<PyArrayObject*>(array_obj.ptr());
+  if (!(PyArray_FLAGS(arr) & NPY_ARRAY_C_CONTIGUOUS)) {
+    throw std::runtime_error("bound data must be C contiguous");
+  }
+  if (PyArray_TYPE(arr) != NPY_FLOAT32) {
+    throw std::runtime_error("bound data must be float32");
+  }
+  if (PyArray_NDIM(arr) != self->num_axes()) {
+    throw std::runtime_error("bound data must have as many axes as the blob");
+  }
+  if (PyArray_SIZE(arr) == 0) {
+    throw std::runtime_error("bound data must not be empty");
+  }
+  vector<int> shape(PyArray_DIMS(arr), PyArray_DIMS(arr) + PyArray_NDIM(arr));
+  self->Reshape(shape);
+  shared_ptr<Blob<Dtype> > previous(new Blob<Dtype>(shape));
+  previous->ShareData(*self);
+  Blob<Dtype> bound(shape);
+  bound.set_cpu_data(static_cast<Dtype*>(PyArray_DATA(arr)));
+  self->ShareData(bound);
+  return previous;
+}
+
 bp::object Blob_Reshape(bp::tuple args, bp::dict kwargs) {
   if (bp::len(kwargs) > 0) {
     throw std::runtime_error("Blob.reshape takes no kwargs");
@@ -199,17 +455,18 @@ BOOST_PYTHON_MODULE(_caffe) {
   bp::def("set_mode_cpu", &set_mode_cpu);
   bp::def("set_mode_gpu", &set_mode_gpu);
   bp::def("set_device", &Caffe::SetDevice);
+  bp::def("transform_images", &TransformImages);
+  bp::def("transform_regions", &TransformRegions);
 
   bp::class_<Net<Dtype>, shared_ptr<Net<Dtype> >, boost::noncopyable >("Net",
     bp::no_init)
     .def("__init__", bp::make_constructor(&Net_Init))
     .def("__init__", bp::make_constructor(&Net_Init_Load))
-    .def("_forward", &Net<Dtype>::ForwardFromTo)
-    .def("_backward", &Net<Dtype>::BackwardFromTo)
-    .def("reshape", &Net<Dtype>::Reshape)
-    // The cast is to select a particular overload.
-    .def("copy_from", static_cast<void (Net<Dtype>::*)(const string)>(
-        &Net<Dtype>::CopyTrainedLayersFrom))
+    .def("_forward", &Net_ForwardFromTo)
+    .def("_backward", &Net_BackwardFromTo)
+    .def("reshape", &Net_Reshape)
+    .def("reserve", &Net_Reserve)
+    .def("copy_from", &Net_CopyFrom)
     .def("share_with", &Net<Dtype>::ShareTrainedLayersWith)
     .add_property("_blobs", bp::make_function(&Net<Dtype>::blobs,
         bp::return_internal_reference<>()))
@@ -237,10 +494,12 @@ BOOST_PYTHON_MODULE(_caffe) {
     .add_property("count",    static_cast<int (Blob<Dtype>::*)() const>(
         &Blob<Dtype>::count))
     .def("reshape",           bp::raw_function(&Blob_Reshape))
+    .def("_bind_data",        &Blob_BindData)
+    .def("_share_data",       &Blob<Dtype>::ShareData)
     .add_property("data",     bp::make_function(&Blob<Dtype>::mutable_cpu_data,
-          NdarrayCallPolicies()))
+          NdarrayCallPolicies<false>()))
     .add_property("diff",     bp::make_function(&Blob<Dtype>::mutable_cpu_diff,
-          NdarrayCallPolicies()));
+          NdarrayCallPolicies<true>()));
 
   bp::class_<Layer<Dtype>, shared_ptr<PythonLayer<Dtype> >,
     boost::noncopyable>("Layer", bp::init<const LayerParameter&>())
@@ -293,6 +552,9 @@ BOOST_PYTHON_MODULE(_caffe) {
   bp::class_<vector<bool> >("BoolVec")
     .def(bp::vector_indexing_suite<vector<bool> >());
 
+  // Create the GIL, so that the bindings can release it.
+  PyEval_InitThreads();
+
   // boost python expects a void (missing) return value, while import_array
   // returns NULL for python3. import_array1() forces a void return value.
   import_array1();
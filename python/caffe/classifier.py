@@ -39,6 +39,7 @@ class Classifier(caffe.Net):
         if channel_swap is not None:
             self.transformer.set_channel_swap(in_, channel_swap)
 
+        self.batch_size = self.blobs[in_].data.shape[0]
         self.crop_dims = np.array(self.blobs[in_].data.shape[2:])
         if not image_dims:
             image_dims = self.crop_dims
@@ -57,33 +58,29 @@ class Classifier(caffe.Net):
         Give
         predictions: (N x C) ndarray of class probabilities
                      for N images and C classes.
-        """
-        # Scale to standardize input dimensions.
-        input_ = np.zeros((len(inputs),
-            self.image_dims[0], self.image_dims[1], inputs[0].shape[2]),
-            dtype=np.float32)
-        for ix, in_ in enumerate(inputs):
-            input_[ix] = caffe.io.resize_image(in_, self.image_dims)
-
-        if oversample:
-            # Generate center, corner, and mirrored crops.
-            input_ = caffe.io.oversample(input_, self.crop_dims)
-        else:
-            # Take center crop.
-            center = np.array(self.image_dims) / 2.0
-            crop = np.tile(center, (1, 2))[0] + np.concatenate([
-                -self.crop_dims / 2.0,
-                self.crop_dims / 2.0
-            ])
-            input_ = input_[:, crop[0]:crop[2], crop[1]:crop[3], :]
 
-        # Classify
-        caffe_in = np.zeros(np.array(input_.shape)[[0,3,1,2]],
-                            dtype=np.float32)
-        for ix, in_ in enumerate(input_):
-            caffe_in[ix] = self.transformer.preprocess(self.inputs[0], in_)
-        out = self.forward_all(**{self.inputs[0]: caffe_in})
-        predictions = out[self.outputs[0]]
+        The images are resized bilinearly, repeating their edge pixels like
+        OpenCV. This matches caffe.io.resize_image except at the image edges
+        and, where skimage anti-aliases, when shrinking.
+        """
+        # Resize, crop and preprocess natively into the input blob, as many
+        # images at a time as the net's batch size holds the crops of (but at
+        # least one).
+        in_ = self.inputs[0]
+        crops_per_image = 10 if oversample else 1
+        images_per_batch = max(1, self.batch_size // crops_per_image)
+        predictions = []
+        for i in range(0, len(inputs), images_per_batch):
+            images = inputs[i:i + images_per_batch]
+            self.blobs[in_].reshape(len(images) * crops_per_image,
+                                    *self.blobs[in_].data.shape[1:])
+            self.transformer.preprocess_batch(in_, images,
+                                              out=self.blobs[in_].data,
+                                              image_dims=self.image_dims,
+                                              oversample=oversample)
+            out = self.forward()
+            predictions.append(out[self.outputs[0]].copy())
+        predictions = np.concatenate(predictions)
 
         # For oversampling, average predictions across crops.
         if oversample:
@@ -67,34 +67,36 @@ class Detector(caffe.Net):
         detections: list of {filename: image filename, window: crop coordinates,
             predictions: prediction vector} dicts.
         """
-        # Extract windows.
-        window_inputs = []
-        for image_fname, windows in images_windows:
-            image = caffe.io.load_image(image_fname).astype(np.float32)
-            for window in windows:
-                window_inputs.append(self.crop(image, window))
-
-        # Run through the net (warping windows to input dimensions).
+        # Warp the windows of each image to the input dimensions natively
+        # and run them through the net in batches of the input blob size.
         in_ = self.inputs[0]
-        caffe_in = np.zeros((len(window_inputs), window_inputs[0].shape[2])
-                            + self.blobs[in_].data.shape[2:],
-                            dtype=np.float32)
-        for ix, window_in in enumerate(window_inputs):
-            caffe_in[ix] = self.transformer.preprocess(in_, window_in)
-        out = self.forward_all(**{in_: caffe_in})
-        predictions = out[self.outputs[0]].squeeze(axis=(2,3))
-
-        # Package predictions with images and windows.
+        batch_size = self.blobs[in_].num
         detections = []
-        ix = 0
         for image_fname, windows in images_windows:
-            for window in windows:
-                detections.append({
-                    'window': window,
-                    'prediction': predictions[ix],
-                    'filename': image_fname
-                })
-                ix += 1
+            image = caffe.io.load_image(image_fname).astype(np.float32)
+            boxes = np.array(windows, dtype=np.int32).reshape(-1, 4)
+            if not self.context_pad:
+                # Without context, windows are cropped as im[ymin:ymax,
+                # xmin:xmax].
+                boxes[:, 2:] -= 1
+            for ix in range(0, len(boxes), batch_size):
+                batch = boxes[ix:ix + batch_size]
+                self.blobs[in_].reshape(len(batch),
+                                        *self.blobs[in_].data.shape[1:])
+                self.transformer.preprocess_regions(
+                    in_, image, batch, out=self.blobs[in_].data,
+                    context_pad=self.context_pad)
+                out = self.forward()
+                predictions = out[self.outputs[0]].reshape(len(batch), -1)
+                # Package predictions with images and windows.
+                for window, prediction in zip(windows[ix:ix + batch_size],
+                                              predictions):
+                    detections.append({
+                        'window': window,
+                        'prediction': prediction.copy(),
+                        'filename': image_fname
+                    })
+        self.blobs[in_].reshape(batch_size, *self.blobs[in_].data.shape[1:])
         return detections
 
 
@@ -1,3 +1,5 @@
+import multiprocessing
+
 import numpy as np
 import skimage.io
 from scipy.ndimage import zoom
@@ -13,6 +15,8 @@ except:
     else:
         raise
 
+from caffe._caffe import transform_images, transform_regions
+
 ## proto / datum / ndarray conversion
 
 def blobproto_to_array(blob, return_diff=False):
@@ -156,6 +160,109 @@ class Transformer:
         return caffe_in
 
 
+    def preprocess_batch(self, in_, images, out=None, image_dims=None,
+                         oversample=False, num_threads=None):
+        """
+        Format a batch of inputs for Caffe as preprocess() does, but natively
+        and in parallel: resize each image to image_dims, take the center crop
+        of the input dimensions (or, with oversample, the corner and center
+        crops and their mirrors as oversample() does) and write the crops
+        into out, e.g. the data of the input blob after reshaping it.
+
+        Take
+        in_: name of input blob to preprocess for
+        images: iterable of (H' x W' x K) ndarrays
+        out: (N x K x H x W) float32 ndarray to fill, or None for a new one,
+            with N the number of crops
+        image_dims: (height, width) to resize to before cropping.
+            Default is the input dimensions.
+        oversample: take ten crops per image instead of the center one
+        num_threads: number of threads to use. Default is one per CPU.
+
+        Give
+        out: the preprocessed crops
+        """
+        self.__check_input(in_)
+        transpose = self.transpose.get(in_)
+        if transpose is not None and tuple(transpose) != (2, 0, 1):
+            raise ValueError('preprocess_batch only transposes H x W x K '
+                             'images to K x H x W.')
+        channel_swap = self.channel_swap.get(in_)
+        raw_scale = self.raw_scale.get(in_)
+        mean = self.mean.get(in_)
+        input_scale = self.input_scale.get(in_)
+        in_dims = self.inputs[in_][2:]
+        if image_dims is None:
+            image_dims = in_dims
+        images = [np.ascontiguousarray(im, dtype=np.float32) for im in images]
+        num_crops = len(images) * (10 if oversample else 1)
+        if out is None:
+            out = np.empty((num_crops, self.inputs[in_][1]) + tuple(in_dims),
+                           dtype=np.float32)
+        # Channel means are subtracted natively; elementwise means after.
+        mean_values = []
+        if mean is not None and mean.shape[1:] == (1, 1):
+            mean_values = list(mean.ravel())
+            mean = None
+        transform_images(images, out, int(image_dims[0]), int(image_dims[1]),
+                         oversample, list(channel_swap or []),
+                         1.0 if raw_scale is None else raw_scale,
+                         1.0 if input_scale is None else input_scale,
+                         mean_values,
+                         num_threads or multiprocessing.cpu_count())
+        if mean is not None:
+            out -= mean * (1.0 if input_scale is None else input_scale)
+        return out
+
+
+    def preprocess_regions(self, in_, image, windows, out=None, context_pad=0,
+                           num_threads=None):
+        """
+        Format windows of an image for Caffe natively and in parallel: warp
+        each window (with context_pad pixels of surrounding context) to the
+        input dimensions and preprocess it as preprocess() does. Context
+        outside the image is left at the mean, as in R-CNN.
+
+        Take
+        in_: name of input blob to preprocess for
+        image: (H' x W' x K) ndarray
+        windows: (N x 4) window coordinates as ymin, xmin, ymax, xmax,
+            inclusive
+        out: (N x K x H x W) float32 ndarray to fill, or None for a new one
+        context_pad: amount of context for cropping
+        num_threads: number of threads to use. Default is one per CPU.
+
+        Give
+        out: the preprocessed windows
+        """
+        self.__check_input(in_)
+        transpose = self.transpose.get(in_)
+        if transpose is not None and tuple(transpose) != (2, 0, 1):
+            raise ValueError('preprocess_regions only transposes H x W x K '
+                             'images to K x H x W.')
+        channel_swap = self.channel_swap.get(in_)
+        raw_scale = self.raw_scale.get(in_)
+        mean = self.mean.get(in_)
+        input_scale = self.input_scale.get(in_)
+        image = np.ascontiguousarray(image, dtype=np.float32)
+        windows = np.ascontiguousarray(windows, dtype=np.int32)
+        if out is None:
+            out = np.empty((len(windows), self.inputs[in_][1])
+                           + tuple(self.inputs[in_][2:]), dtype=np.float32)
+        if mean is not None:
+            if mean.shape[-2:] == (1, 1):
+                mean = list(mean.ravel())
+            else:
+                mean = np.ascontiguousarray(mean, dtype=np.float32).reshape(
+                    (-1,) + mean.shape[-2:])
+        transform_regions(image, windows, out, context_pad or 0,
+                          list(channel_swap or []),
+                          1.0 if raw_scale is None else raw_scale,
+                          1.0 if input_scale is None else input_scale,
+                          mean, num_threads or multiprocessing.cpu_count())
+        return out
+
+
     def deprocess(self, in_, data):
         """
         Invert Caffe formatting; see preprocess().
@@ -49,7 +49,8 @@ def _Net_outputs(self):
     return [list(self.blobs.keys())[i] for i in self._outputs]
 
 
-def _Net_forward(self, blobs=None, start=None, end=None, **kwargs):
+def _Net_forward(self, blobs=None, start=None, end=None, bind_inputs=False,
+                 **kwargs):
     """
     Forward pass: prepare inputs and run the net forward.
 
@@ -60,9 +61,14 @@ def _Net_forward(self, blobs=None, start=None, end=None, **kwargs):
             If None, input is taken from data layers.
     start: optional name of layer at which to begin the forward pass
     end: optional name of layer at which to finish the forward pass (inclusive)
+    bind_inputs: use the input ndarrays (C-contiguous float32, with as many
+            axes as the blobs) as the input blobs' storage during the pass
+            instead of copying them; the input blobs are reshaped to them.
+            The net holds on to them until the next forward pass.
 
     Give
-    outs: {blob name: blob ndarray} dict.
+    outs: {blob name: blob ndarray} dict. The ndarrays are views of the blobs
+          (or the bound inputs), valid until the next pass changes them.
     """
     if blobs is None:
         blobs = []
@@ -85,14 +91,31 @@ def _Net_forward(self, blobs=None, start=None, end=None, **kwargs):
         # Set input according to defined shapes and make arrays single and
         # C-contiguous as Caffe expects.
         for in_, blob in kwargs.iteritems():
+            if bind_inputs:
+                continue
             if blob.shape[0] != self.blobs[in_].num:
                 raise Exception('Input is not batch sized')
             self.blobs[in_].data[...] = blob
 
-    self._forward(start_ind, end_ind)
+    # Layers that share the storage of an input (e.g. splits) refer to the
+    # previously bound arrays until this pass reshapes them, so keep those
+    # alive until it is done.
+    bound_inputs = getattr(self, '_bound_inputs', {})
+    previous = {}
+    try:
+        if bind_inputs:
+            for in_, blob in kwargs.iteritems():
+                previous[in_] = self.blobs[in_]._bind_data(blob)
+        self._forward(start_ind, end_ind)
+        bound_inputs = kwargs if bind_inputs else {}
+    finally:
+        for in_, data in previous.iteritems():
+            self.blobs[in_]._share_data(data)
+        self._bound_inputs = bound_inputs
 
     # Unpack blobs to extract
-    return {out: self.blobs[out].data for out in outputs}
+    return {out: self._bound_inputs.get(out, self.blobs[out].data)
+            for out in outputs}
 
 
 def _Net_backward(self, diffs=None, start=None, end=None, **kwargs):
@@ -0,0 +1,88 @@
+import unittest
+import tempfile
+import os
+import numpy as np
+
+import caffe
+
+def classifier_net_file():
+    """Make a deploy net taking batches of two 8 x 8 color images and giving
+    their class scores, returning the name of the (temporary) file."""
+
+    f = tempfile.NamedTemporaryFile(delete=False)
+    f.write("""name: 'classifiernet'
+    input: 'data' input_shape { dim: 2 dim: 3 dim: 8 dim: 8 }
+    layer { type: 'InnerProduct' name: 'score' bottom: 'data' top: 'score'
+      inner_product_param { num_output: 5
+        weight_filler { type: 'gaussian' std: 0.01 } } }""")
+    f.close()
+    return f.name
+
+def smooth_image(height, width, rng):
+    """Make a (height x width x 3) image of waves with random phases."""
+    y, x = np.mgrid[0:height, 0:width]
+    return np.dstack([0.5 + 0.3 * np.sin(0.5 * x + p) * np.cos(0.4 * y + q)
+                      for p, q in 6 * rng.rand(3, 2)])
+
+class TestClassifier(unittest.TestCase):
+    def setUp(self):
+        net_file = classifier_net_file()
+        f = tempfile.NamedTemporaryFile(delete=False)
+        f.close()
+        caffe.Net(net_file, caffe.TEST).save(f.name)
+        self.classifier = caffe.Classifier(net_file, f.name,
+                                           image_dims=(12, 12),
+                                           mean=np.array([100., 110., 120.]),
+                                           raw_scale=255,
+                                           channel_swap=(2, 1, 0))
+        os.remove(net_file)
+        os.remove(f.name)
+        rng = np.random.RandomState(1701)
+        # Random weights, but for the outermost pixels of the crops, which
+        # the native resize and skimage extend differently (see below).
+        weights = self.classifier.params['score'][0].data.reshape(5, 3, 8, 8)
+        weights[...] = 0.01 * rng.randn(*weights.shape)
+        weights[:, :, [0, -1], :] = 0
+        weights[:, :, :, [0, -1]] = 0
+        # Smooth images, smaller than image_dims: skimage anti-aliases when
+        # it shrinks an image, depending on its version.
+        self.images = [smooth_image(6, 7, rng), smooth_image(9, 10, rng),
+                       smooth_image(10, 8, rng)]
+
+    def reference_inputs(self, images, oversample):
+        """Preprocess images as Classifier.predict did before it preprocessed
+        natively: resize with caffe.io.resize_image, then crop and preprocess
+        each crop in numpy."""
+        images = np.array([caffe.io.resize_image(im, (12, 12))
+                           for im in images])
+        if oversample:
+            crops = caffe.io.oversample(images, (8, 8))
+        else:
+            crops = images[:, 2:10, 2:10, :]
+        return np.array([self.classifier.transformer.preprocess('data', crop)
+                         for crop in crops])
+
+    def test_predict_matches_resize_image(self):
+        """Check that the native bilinear resize gives the inputs and
+        predictions of caffe.io.resize_image (skimage)"""
+        for oversample in [False, True]:
+            predictions = self.classifier.predict(self.images, oversample)
+            self.assertEqual((len(self.images), 5), predictions.shape)
+            # The images are run two (center crops) or one (ten crops) at a
+            # time, so the input blob is left with the crops of the last one.
+            inputs = self.reference_inputs(self.images[-1:], oversample)
+            data = self.classifier.blobs['data'].data
+            self.assertEqual(inputs.shape, data.shape)
+            # skimage extends an image past its edges according to its mode,
+            # the native resize repeats the edge pixels. Only the outermost
+            # resized pixels, at the edges of the corner crops, differ.
+            self.assertTrue(np.allclose(data[:, :, 1:-1, 1:-1],
+                                        inputs[:, :, 1:-1, 1:-1], atol=1e-3))
+            # The weights ignore those pixels, so the scores of all the images
+            # agree.
+            inputs = self.reference_inputs(self.images, oversample)
+            self.classifier.blobs['data'].reshape(*inputs.shape)
+            scores = self.classifier.forward(data=inputs)['score']
+            if oversample:
+                scores = scores.reshape((len(scores) // 10, 10, -1)).mean(1)
+            self.assertTrue(np.allclose(predictions, scores, atol=1e-3))
@@ -31,6 +31,32 @@ def simple_net_file(num_output):
     f.close()
     return f.name
 
+def input_net_file():
+    """Make a net fed by an input blob, which two layers read, returning the
+    name of the (temporary) file."""
+
+    f = tempfile.NamedTemporaryFile(delete=False)
+    f.write("""name: 'inputnet' input: 'data' input_shape { dim: 2 dim: 3 }
+    layer { type: 'InnerProduct' name: 'ip' bottom: 'data' top: 'ip'
+      inner_product_param { num_output: 4
+        weight_filler { type: 'gaussian' std: 1 } } }
+    layer { type: 'ReLU' name: 'relu' bottom: 'data' top: 'relu' }""")
+    f.close()
+    return f.name
+
+def half_net_file():
+    """Make a net with half precision weights, returning the name of the
+    (temporary) file."""
+
+    f = tempfile.NamedTemporaryFile(delete=False)
+    f.write("""name: 'halfnet' input: 'data' input_shape { dim: 2 dim: 3 }
+    layer { type: 'InnerProduct' name: 'ip' bottom: 'data' top: 'ip'
+      inner_product_param { num_output: 4
+        weight_filler { type: 'gaussian' std: 1 } }
+      quantization_param { precision: FP16 } }""")
+    f.close()
+    return f.name
+
 class TestNet(unittest.TestCase):
     def setUp(self):
         self.num_output = 13
@@ -76,3 +102,77 @@ class TestNet(unittest.TestCase):
             for i in range(len(self.net.params[name])):
                 self.assertEqual(abs(self.net.params[name][i].data
                     - net2.params[name][i].data).sum(), 0)
+
+class TestBindInputs(unittest.TestCase):
+    def setUp(self):
+        net_file = input_net_file()
+        self.net = caffe.Net(net_file, caffe.TEST)
+        os.remove(net_file)
+        self.data = np.random.randn(5, 3).astype(np.float32)
+
+    def test_bind_inputs(self):
+        self.net.blobs['data'].reshape(*self.data.shape)
+        expected = {out: blob.copy()
+                    for out, blob in self.net.forward(data=self.data).items()}
+        outs = self.net.forward(bind_inputs=True, blobs=['data'],
+                                data=self.data)
+        for out in expected:
+            self.assertEqual(abs(outs[out] - expected[out]).sum(), 0)
+        # Bound inputs are returned as they are, not copied.
+        self.assertTrue(outs['data'] is self.data)
+
+    def test_bind_inputs_reshapes(self):
+        outs = self.net.forward(bind_inputs=True, data=self.data)
+        self.assertEqual(outs['ip'].shape, (5, 4))
+        self.assertEqual(abs(outs['relu'] - np.maximum(self.data, 0)).sum(),
+                         0)
+
+    def test_bind_inputs_checks(self):
+        with self.assertRaises(RuntimeError):
+            self.net.forward(bind_inputs=True,
+                             data=self.data.astype(np.float64))
+        with self.assertRaises(RuntimeError):
+            self.net.forward(bind_inputs=True, data=self.data.T)
+        with self.assertRaises(RuntimeError):
+            self.net.forward(bind_inputs=True, data=self.data.ravel())
+        # The net still runs with its own storage.
+        self.net.forward()
+
+    def test_reserve(self):
+        data = np.random.randn(8, 3).astype(np.float32)
+        self.net.reserve([(8, 3)])
+        self.assertEqual(self.net.blobs['data'].data.shape, (2, 3))
+        weight, bias = [p.data for p in self.net.params['ip']]
+        expected = data.dot(weight.T) + bias
+        # Batches up to the reserved size run in the same memory.
+        addresses = set()
+        for num in (1, 8, 5, 8, 2):
+            self.net.blobs['data'].reshape(num, 3)
+            ip = self.net.forward(data=data[:num])['ip']
+            self.assertTrue(abs(ip - expected[:num]).max() < 1e-5)
+            addresses.add(ip.__array_interface__['data'][0])
+        self.assertEqual(len(addresses), 1)
+
+    def test_views_outlive_reshape(self):
+        ip = self.net.forward(bind_inputs=True, data=self.data)['ip']
+        expected = ip.copy()
+        # Growing the blob frees its memory, but not while ip views it.
+        self.net.blobs['ip'].reshape(1000, 4)
+        self.net.blobs['ip'].data[...] = 0
+        self.assertEqual(abs(ip - expected).sum(), 0)
+
+    def test_diff_leaves_data(self):
+        """Check that reading the diff of half precision weights does not
+        touch their data, which cannot be read in float"""
+        net_file = half_net_file()
+        net = caffe.Net(net_file, caffe.TEST)
+        os.remove(net_file)
+        f = tempfile.NamedTemporaryFile(delete=False)
+        f.close()
+        net.save(f.name)
+        half_size = os.path.getsize(f.name)
+        self.assertEqual(net.params['ip'][0].diff.shape, (4, 3))
+        # The weights are still saved in half precision.
+        net.save(f.name)
+        self.assertEqual(os.path.getsize(f.name), half_size)
+        os.remove(f.name)
@@ -1,6 +1,10 @@
 import unittest
 import tempfile
 import os
+import sys
+import threading
+import time
+import contextlib
 
 import caffe
 
@@ -19,6 +23,45 @@ class SimpleLayer(caffe.Layer):
     def backward(self, top, propagate_down, bottom):
         bottom[0].diff[...] = 10 * top[0].diff
 
+# Appended to as forward passes reach StartLayer and FinishLayer, and by the
+# tests: (event, name of the thread) pairs.
+forward_log = []
+
+# NumPy may release the GIL while it computes, so the layers log right next
+# to the C++ part of the pass, after and before their own work.
+class StartLayer(SimpleLayer):
+    """A SimpleLayer that logs the start of a forward pass"""
+
+    def forward(self, bottom, top):
+        super(StartLayer, self).forward(bottom, top)
+        forward_log.append(('start', threading.current_thread().name))
+
+class FinishLayer(SimpleLayer):
+    """A SimpleLayer that logs the end of a forward pass"""
+
+    def forward(self, bottom, top):
+        forward_log.append(('finish', threading.current_thread().name))
+        super(FinishLayer, self).forward(bottom, top)
+
+@contextlib.contextmanager
+def switch_threads_on_release_only():
+    """Keep the interpreter from switching threads by itself, so that a thread
+    waiting for the GIL only runs once the holder releases it"""
+    if hasattr(sys, 'setswitchinterval'):
+        interval = sys.getswitchinterval()
+        sys.setswitchinterval(1000)
+        try:
+            yield
+        finally:
+            sys.setswitchinterval(interval)
+    else:
+        interval = sys.getcheckinterval()
+        sys.setcheckinterval(sys.maxint)
+        try:
+            yield
+        finally:
+            sys.setcheckinterval(interval)
+
 def python_net_file():
     with tempfile.NamedTemporaryFile(delete=False) as f:
         f.write("""name: 'pythonnet' force_backward: true
@@ -31,6 +74,22 @@ def python_net_file():
           python_param { module: 'test_python_layer' layer: 'SimpleLayer' } }""")
         return f.name
 
+def threaded_net_file():
+    """Make a net with a slow convolution between Python layers logging the
+    start and the end of its forward pass"""
+    with tempfile.NamedTemporaryFile(delete=False) as f:
+        f.write("""name: 'threadednet'
+        input: 'data' input_shape { dim: 1 dim: 32 dim: 64 dim: 64 }
+        layer { type: 'Python' name: 'start' bottom: 'data' top: 'start'
+          python_param { module: 'test_python_layer' layer: 'StartLayer' } }
+        layer { type: 'Convolution' name: 'conv' bottom: 'start' top: 'conv'
+          convolution_param { num_output: 64 kernel_size: 3 pad: 1
+            weight_filler { type: 'gaussian' std: 0.01 } } }
+        layer { type: 'Python' name: 'finish' bottom: 'conv' top: 'finish'
+          python_param { module: 'test_python_layer'
+            layer: 'FinishLayer' } }""")
+        return f.name
+
 class TestPythonLayer(unittest.TestCase):
     def setUp(self):
         net_file = python_net_file()
@@ -58,3 +117,64 @@ class TestPythonLayer(unittest.TestCase):
         for blob in self.net.blobs.itervalues():
             for d in blob.data.shape:
                 self.assertEqual(s, d)
+
+class TestPythonLayerThreads(unittest.TestCase):
+    def setUp(self):
+        net_file = python_net_file()
+        self.nets = [caffe.Net(net_file, caffe.TRAIN) for _ in range(4)]
+        os.remove(net_file)
+
+    def test_concurrent_forward(self):
+        """Check that nets run from several threads, taking the GIL back for
+        their Python layers, give the same results as run one at a time"""
+        def forward(net, x):
+            for _ in range(10):
+                net.blobs['data'].data[...] = x
+                net.forward()
+        threads = [threading.Thread(target=forward, args=(net, x))
+                   for x, net in enumerate(self.nets)]
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+        for x, net in enumerate(self.nets):
+            for y in net.blobs['three'].data.flat:
+                self.assertEqual(y, 10**3 * x)
+
+    def threaded_nets(self, num_nets):
+        net_file = threaded_net_file()
+        nets = [caffe.Net(net_file, caffe.TEST) for _ in range(num_nets)]
+        os.remove(net_file)
+        del forward_log[:]
+        return nets
+
+    def test_forward_releases_gil(self):
+        """Check that this thread runs while another one is in the convolution
+        of a forward pass"""
+        net, = self.threaded_nets(1)
+        thread = threading.Thread(target=net.forward, name='forward')
+        with switch_threads_on_release_only():
+            thread.start()
+            # This thread only gets the GIL between the Python layers of the
+            # pass if the convolution releases it.
+            while thread.is_alive():
+                forward_log.append(('tick', 'main'))
+                time.sleep(0.001)
+        events = [event for event, _ in forward_log]
+        start, finish = events.index('start'), events.index('finish')
+        self.assertIn('tick', events[start:finish])
+
+    def test_concurrent_forwards_overlap(self):
+        """Check that the forward passes of nets run from two threads overlap,
+        each starting before the other finishes"""
+        nets = self.threaded_nets(2)
+        threads = [threading.Thread(target=net.forward, name=str(i))
+                   for i, net in enumerate(nets)]
+        with switch_threads_on_release_only():
+            for thread in threads:
+                thread.start()
+            for thread in threads:
+                thread.join()
+        # Holding the GIL, the passes would run one after the other.
+        self.assertEqual(['start', 'start', 'finish', 'finish'],
+                         [event for event, _ in forward_log])
@@ -1,9 +1,12 @@
 #include <climits>
+#include <cmath>
+#include <cstring>
 #include <vector>
 
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/syncedmem.hpp"
+#include "caffe/util/half.hpp"
 #include "caffe/util/math_functions.hpp"
 
 namespace caffe {
@@ -22,6 +25,7 @@ void Blob<Dtype>::Reshape(const int num, const int channels, const int height,
 template <typename Dtype>
 void Blob<Dtype>::Reshape(const vector<int>& shape) {
   CHECK_LE(shape.size(), kMaxBlobAxes);
+  const int old_count = count_;
   count_ = 1;
   shape_.resize(shape.size());
   for (int i = 0; i < shape.size(); ++i) {
@@ -33,6 +37,9 @@ void Blob<Dtype>::Reshape(const vector<int>& shape) {
     capacity_ = count_;
     data_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
     diff_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
+    half_data_.reset(new SyncedMemory(capacity_ * sizeof(uint16_t)));
+  } else if (count_ != old_count && is_half()) {
+    half_data_->Release();
   }
 }
 
@@ -69,18 +76,23 @@ Blob<Dtype>::Blob(const vector<int>& shape)
 template <typename Dtype>
 const Dtype* Blob<Dtype>::cpu_data() const {
   CHECK(data_);
+  CheckNotHalf();
   return (const Dtype*)data_->cpu_data();
 }
 
 template <typename Dtype>
 void Blob<Dtype>::set_cpu_data(Dtype* data) {
   CHECK(data);
+  if (is_half()) {
+    half_data_->Release();
+  }
   data_->set_cpu_data(data);
 }
 
 template <typename Dtype>
 const Dtype* Blob<Dtype>::gpu_data() const {
   CHECK(data_);
+  CheckNotHalf();
   return (const Dtype*)data_->gpu_data();
 }
 
@@ -99,12 +111,14 @@ const Dtype* Blob<Dtype>::gpu_diff() const {
 template <typename Dtype>
 Dtype* Blob<Dtype>::mutable_cpu_data() {
   CHECK(data_);
+  RestoreFromHalf();
   return static_cast<Dtype*>(data_->mutable_cpu_data());
 }
 
 template <typename Dtype>
 Dtype* Blob<Dtype>::mutable_gpu_data() {
   CHECK(data_);
+  RestoreFromHalf();
   return static_cast<Dtype*>(data_->mutable_gpu_data());
 }
 
@@ -123,7 +137,10 @@ Dtype* Blob<Dtype>::mutable_gpu_diff() {
 template <typename Dtype>
 void Blob<Dtype>::ShareData(const Blob& other) {
   CHECK_EQ(count_, other.count());
-  data_ = other.data();
+  CHECK(other.data_);
+  // Sharing the half data too keeps both Blobs in the same precision.
+  data_ = other.data_;
+  half_data_ = other.half_data_;
 }
 
 template <typename Dtype>
@@ -140,6 +157,7 @@ template <> void Blob<int>::Update() { NOT_IMPLEMENTED; }
 
 template <typename Dtype>
 void Blob<Dtype>::Update() {
+  RestoreFromHalf();
   // We will perform update based on where the data is located.
   switch (data_->head()) {
   case SyncedMemory::HEAD_AT_CPU:
@@ -177,6 +195,15 @@ template <> int Blob<int>::asum_data() const {
 template <typename Dtype>
 Dtype Blob<Dtype>::asum_data() const {
   if (!data_) { return 0; }
+  if (is_half()) {
+    // Read the half data in place rather than converting the shared data.
+    const uint16_t* half_data = cpu_half_data();
+    Dtype asum = 0;
+    for (int i = 0; i < count_; ++i) {
+      asum += std::fabs(caffe_half_to_float(half_data[i]));
+    }
+    return asum;
+  }
   switch (data_->head()) {
   case SyncedMemory::HEAD_AT_CPU:
     return caffe_cpu_asum(count_, cpu_data());
@@ -249,6 +276,15 @@ Dtype Blob<Dtype>::sumsq_data() const {
   Dtype sumsq;
   const Dtype* data;
   if (!data_) { return 0; }
+  if (is_half()) {
+    const uint16_t* half_data = cpu_half_data();
+    sumsq = 0;
+    for (int i = 0; i < count_; ++i) {
+      const Dtype value = caffe_half_to_float(half_data[i]);
+      sumsq += value * value;
+    }
+    return sumsq;
+  }
   switch (data_->head()) {
   case SyncedMemory::HEAD_AT_CPU:
     data = cpu_data();
@@ -320,6 +356,7 @@ template <typename Dtype>
 void Blob<Dtype>::scale_data(Dtype scale_factor) {
   Dtype* data;
   if (!data_) { return; }
+  RestoreFromHalf();
   switch (data_->head()) {
   case SyncedMemory::HEAD_AT_CPU:
     data = mutable_cpu_data();
@@ -406,6 +443,10 @@ void Blob<Dtype>::CopyFrom(const Blob& source, bool copy_diff, bool reshape) {
       LOG(FATAL) << "Trying to copy blobs of different sizes.";
     }
   }
+  if (!copy_diff && is_half()) {
+    // The data is overwritten, so there is no need to restore it.
+    half_data_->Release();
+  }
   switch (Caffe::mode()) {
   case Caffe::GPU:
     if (copy_diff) {
@@ -454,9 +495,70 @@ void Blob<Dtype>::FromProto(const BlobProto& proto, bool reshape) {
     CHECK(ShapeEquals(proto)) << "shape mismatch (reshape not set)";
   }
   // copy data
-  Dtype* data_vec = mutable_cpu_data();
-  for (int i = 0; i < count_; ++i) {
-    data_vec[i] = proto.data(i);
+  if (proto.data_index_size() > 0) {
+    CHECK(!proto.has_half_data()) << "Sparse half_data is not supported";
+    CHECK_EQ(proto.data_index_size(), proto.data_size())
+        << "data_index and data differ in size";
+    if (is_half()) {
+      // Expand straight into the half data, which keeps the Blob in half
+      // precision like the dense data below. Half zero is all zero bits.
+      uint16_t* half_vec =
+          static_cast<uint16_t*>(half_data_->mutable_cpu_data());
+      memset(half_vec, 0, sizeof(uint16_t) * count_);
+      for (int i = 0; i < proto.data_index_size(); ++i) {
+        const int index = proto.data_index(i);
+        CHECK_GE(index, 0);
+        CHECK_LT(index, count_) << "data_index out of range";
+        half_vec[index] = caffe_float_to_half(proto.data(i));
+      }
+      data_->Release();
+    } else {
+      Dtype* data_vec = mutable_cpu_data();
+      memset(data_vec, 0, sizeof(Dtype) * count_);
+      for (int i = 0; i < proto.data_index_size(); ++i) {
+        const int index = proto.data_index(i);
+        CHECK_GE(index, 0);
+        CHECK_LT(index, count_) << "data_index out of range";
+        data_vec[index] = proto.data(i);
+      }
+    }
+  } else if (proto.has_half_data()) {
+    CHECK_EQ(proto.half_data().size(), count_ * sizeof(uint16_t))
+        << "half_data does not match the blob size";
+    const string& bytes = proto.half_data();
+    vector<uint16_t> buffer;
+    uint16_t* half_vec;
+    if (is_half()) {
+      half_vec = static_cast<uint16_t*>(half_data_->mutable_cpu_data());
+    } else {
+      buffer.resize(count_);
+      half_vec = &buffer[0];
+    }
+    for (int i = 0; i < count_; ++i) {
+      half_vec[i] = static_cast<uint8_t>(bytes[2 * i])
+          | (static_cast<uint8_t>(bytes[2 * i + 1]) << 8);
+    }
+    if (is_half()) {
+      data_->Release();
+    } else {
+      caffe_cpu_half2float(count_, half_vec, mutable_cpu_data());
+    }
+  } else {
+    CHECK_EQ(proto.data_size(), count_) << "data does not match the blob size";
+    if (is_half()) {
+      // Convert straight into the half data without restoring the Dtype copy.
+      uint16_t* half_vec =
+          static_cast<uint16_t*>(half_data_->mutable_cpu_data());
+      for (int i = 0; i < count_; ++i) {
+        half_vec[i] = caffe_float_to_half(proto.data(i));
+      }
+      data_->Release();
+    } else {
+      Dtype* data_vec = mutable_cpu_data();
+      for (int i = 0; i < count_; ++i) {
+        data_vec[i] = proto.data(i);
+      }
+    }
   }
   if (proto.diff_size() > 0) {
     Dtype* diff_vec = mutable_cpu_diff();
@@ -474,9 +576,22 @@ void Blob<Dtype>::ToProto(BlobProto* proto, bool write_diff) const {
   }
   proto->clear_data();
   proto->clear_diff();
-  const Dtype* data_vec = cpu_data();
-  for (int i = 0; i < count_; ++i) {
-    proto->add_data(data_vec[i]);
+  proto->clear_half_data();
+  proto->clear_data_index();
+  if (is_half()) {
+    // Half data is written as little-endian 16-bit words.
+    const uint16_t* half_vec = cpu_half_data();
+    string* bytes = proto->mutable_half_data();
+    bytes->resize(count_ * sizeof(uint16_t));
+    for (int i = 0; i < count_; ++i) {
+      (*bytes)[2 * i] = static_cast<char>(half_vec[i] & 0xff);
+      (*bytes)[2 * i + 1] = static_cast<char>(half_vec[i] >> 8);
+    }
+  } else {
+    const Dtype* data_vec = cpu_data();
+    for (int i = 0; i < count_; ++i) {
+      proto->add_data(data_vec[i]);
+    }
   }
   if (write_diff) {
     const Dtype* diff_vec = cpu_diff();
@@ -486,6 +601,42 @@ void Blob<Dtype>::ToProto(BlobProto* proto, bool write_diff) const {
   }
 }
 
+template <typename Dtype>
+void Blob<Dtype>::ToHalf() {
+  if (is_half()) { return; }
+  const Dtype* data = cpu_data();
+  caffe_cpu_float2half(count_, data,
+      static_cast<uint16_t*>(half_data_->mutable_cpu_data()));
+  // Free the Dtype copy in place, so that Blobs sharing it see the change.
+  data_->Release();
+}
+
+template <typename Dtype>
+bool Blob<Dtype>::is_half() const {
+  return half_data_ && half_data_->head() != SyncedMemory::UNINITIALIZED;
+}
+
+template <typename Dtype>
+const uint16_t* Blob<Dtype>::cpu_half_data() const {
+  CHECK(is_half()) << "The blob data is not held in half precision.";
+  return static_cast<const uint16_t*>(half_data_->cpu_data());
+}
+
+template <typename Dtype>
+void Blob<Dtype>::CheckNotHalf() const {
+  CHECK(!is_half()) << "The blob data is held in half precision: read it "
+      << "through cpu_half_data(), or call RestoreFromHalf() first.";
+}
+
+template <typename Dtype>
+void Blob<Dtype>::RestoreFromHalf() {
+  if (!is_half()) { return; }
+  caffe_cpu_half2float(count_,
+      static_cast<const uint16_t*>(half_data_->cpu_data()),
+      static_cast<Dtype*>(data_->mutable_cpu_data()));
+  half_data_->Release();
+}
+
 INSTANTIATE_CLASS(Blob);
 template class Blob<int>;
 template class Blob<unsigned int>;
@@ -1,3 +1,4 @@
+#include <boost/thread.hpp>
 #include <glog/logging.h>
 #include <cstdio>
 #include <ctime>
@@ -30,6 +31,13 @@ int64_t cluster_seedgen(void) {
 }
 
 
+Caffe::RNG& Caffe::rng_stream() {
+  if (!Get().random_generator_->get()) {
+    Get().random_generator_->reset(new RNG());
+  }
+  return *Get().random_generator_->get();
+}
+
 void GlobalInit(int* pargc, char*** pargv) {
   // Google flags.
   ::gflags::ParseCommandLineFlags(pargc, pargv, true);
@@ -42,13 +50,14 @@ void GlobalInit(int* pargc, char*** pargv) {
 #ifdef CPU_ONLY  // CPU-only Caffe.
 
 Caffe::Caffe()
-    : random_generator_(), mode_(Caffe::CPU) { }
+    : random_generator_(new boost::thread_specific_ptr<RNG>()),
+      mode_(Caffe::CPU) { }
 
 Caffe::~Caffe() { }
 
 void Caffe::set_random_seed(const unsigned int seed) {
   // RNG seed
-  Get().random_generator_.reset(new RNG(seed));
+  Get().random_generator_->reset(new RNG(seed));
 }
 
 void Caffe::SetDevice(const int device_id) {
@@ -85,7 +94,8 @@ void* Caffe::RNG::generator() {
 #else  // Normal GPU + CPU Caffe.
 
 Caffe::Caffe()
-    : cublas_handle_(NULL), curand_generator_(NULL), random_generator_(),
+    : cublas_handle_(NULL), curand_generator_(NULL),
+    random_generator_(new boost::thread_specific_ptr<RNG>()),
     mode_(Caffe::CPU) {
   // Try to create a cublas handler, and report an error if failed (but we will
   // keep the program running as one might just want to run CPU code).
@@ -123,7 +133,7 @@ void Caffe::set_random_seed(const unsigned int seed) {
     }
   }
   // RNG seed
-  Get().random_generator_.reset(new RNG(seed));
+  Get().random_generator_->reset(new RNG(seed));
 }
 
 void Caffe::SetDevice(const int device_id) {
@@ -1,5 +1,8 @@
 #include <opencv2/core/core.hpp>
 
+#include <boost/thread.hpp>
+
+#include <algorithm>
 #include <string>
 #include <vector>
 
@@ -395,6 +398,455 @@ void DataTransformer<Dtype>::Transform(Blob<Dtype>* input_blob,
   }
 }
 
+// A crop of a resized image: where it starts and whether it is mirrored.
+struct ImageCrop {
+  int h_off;
+  int w_off;
+  bool mirror;
+};
+
+// What the threads of TransformImages share.
+template <typename Dtype>
+struct ImageBatch {
+  const vector<Blob<Dtype>*>* images;
+  int resize_height;
+  int resize_width;
+  int channels;
+  int height;
+  int width;
+  vector<int> channel_swap;
+  Dtype raw_scale;
+  Dtype scale;
+  // The crops of each image in turn, crops_per_image each.
+  vector<ImageCrop> crops;
+  int crops_per_image;
+  // A mean of the size of the crops or of the resized images, or NULL.
+  const Dtype* mean;
+  bool mean_at_crop;
+  // The mean of each channel, or 0.
+  vector<Dtype> mean_values;
+  Dtype* transformed_data;
+};
+
+// Bilinearly resizes an image of height x width x channels values, whose
+// rows start row_step values apart, aligning the pixel centers as OpenCV and
+// skimage do.
+template <typename Dtype>
+static void ResizeImage(const Dtype* image, const int height,
+    const int width, const int channels, const int row_step,
+    const int resize_height, const int resize_width, Dtype* resized) {
+  vector<int> x0(resize_width);
+  vector<int> x1(resize_width);
+  vector<Dtype> dx(resize_width);
+  const float w_scale = static_cast<float>(width) / resize_width;
+  for (int w = 0; w < resize_width; ++w) {
+    const float x = std::min(std::max((w + 0.5f) * w_scale - 0.5f, 0.f),
+        width - 1.f);
+    x0[w] = static_cast<int>(x);
+    x1[w] = std::min(x0[w] + 1, width - 1);
+    dx[w] = x - x0[w];
+  }
+  const float h_scale = static_cast<float>(height) / resize_height;
+  for (int h = 0; h < resize_height; ++h) {
+    const float y = std::min(std::max((h + 0.5f) * h_scale - 0.5f, 0.f),
+        height - 1.f);
+    const int y0 = static_cast<int>(y);
+    const int y1 = std::min(y0 + 1, height - 1);
+    const Dtype dy = y - y0;
+    const Dtype* row0 = image + y0 * row_step;
+    const Dtype* row1 = image + y1 * row_step;
+    for (int w = 0; w < resize_width; ++w) {
+      const Dtype* p00 = row0 + x0[w] * channels;
+      const Dtype* p01 = row0 + x1[w] * channels;
+      const Dtype* p10 = row1 + x0[w] * channels;
+      const Dtype* p11 = row1 + x1[w] * channels;
+      for (int c = 0; c < channels; ++c) {
+        const Dtype top = p00[c] + dx[w] * (p01[c] - p00[c]);
+        const Dtype bottom = p10[c] + dx[w] * (p11[c] - p10[c]);
+        *resized++ = top + dy * (bottom - top);
+      }
+    }
+  }
+}
+
+// Transforms images [begin, end) of the batch.
+template <typename Dtype>
+static void TransformImageRange(const ImageBatch<Dtype>* batch,
+    const int begin, const int end) {
+  const int channels = batch->channels;
+  const int height = batch->height;
+  const int width = batch->width;
+  const int resize_height = batch->resize_height;
+  const int resize_width = batch->resize_width;
+  const int num_crops = batch->crops_per_image;
+  vector<Dtype> resized;
+  for (int i = begin; i < end; ++i) {
+    const Blob<Dtype>* image = (*batch->images)[i];
+    const Dtype* source = image->cpu_data();
+    if (image->shape(0) != resize_height || image->shape(1) != resize_width) {
+      resized.resize(resize_height * resize_width * channels);
+      ResizeImage(source, image->shape(0), image->shape(1), channels,
+          image->shape(1) * channels, resize_height, resize_width, &resized[0]);
+      source = &resized[0];
+    }
+    for (int k = 0; k < num_crops; ++k) {
+      const ImageCrop& crop = batch->crops[i * num_crops + k];
+      Dtype* transformed_data = batch->transformed_data +
+          (i * num_crops + k) * channels * height * width;
+      for (int c = 0; c < channels; ++c) {
+        const int source_c = batch->channel_swap[c];
+        const Dtype mean_value = batch->mean_values[c];
+        for (int h = 0; h < height; ++h) {
+          const Dtype* row = source +
+              ((h + crop.h_off) * resize_width + crop.w_off) * channels;
+          // The mean for the value at w is mean_row[w * mean_step].
+          const Dtype* mean_row = NULL;
+          int mean_step = 1;
+          if (batch->mean && batch->mean_at_crop) {
+            mean_row = batch->mean + (c * height + h) * width;
+          } else if (batch->mean) {
+            mean_row = batch->mean + (c * resize_height + h + crop.h_off) *
+                resize_width + crop.w_off;
+            if (crop.mirror) {
+              mean_row += width - 1;
+              mean_step = -1;
+            }
+          }
+          for (int w = 0; w < width; ++w) {
+            const int source_w = crop.mirror ? width - 1 - w : w;
+            Dtype value = row[source_w * channels + source_c] *
+                batch->raw_scale - mean_value;
+            if (mean_row) {
+              value -= mean_row[w * mean_step];
+            }
+            *transformed_data++ = value * batch->scale;
+          }
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void DataTransformer<Dtype>::TransformImages(
+    const vector<Blob<Dtype>*>& images, const int resize_height,
+    const int resize_width, const bool oversample,
+    const vector<int>& channel_swap, const Dtype raw_scale,
+    Blob<Dtype>* transformed_blob, const int num_threads) {
+  CHECK_GT(images.size(), 0);
+  CHECK_EQ(transformed_blob->num_axes(), 4);
+  ImageBatch<Dtype> batch;
+  batch.images = &images;
+  batch.resize_height = resize_height;
+  batch.resize_width = resize_width;
+  batch.channels = images[0]->shape(2);
+  batch.height = transformed_blob->height();
+  batch.width = transformed_blob->width();
+  for (int i = 0; i < images.size(); ++i) {
+    CHECK_EQ(images[i]->num_axes(), 3) << "Images are height x width x "
+        << "channels.";
+    CHECK_EQ(images[i]->shape(2), batch.channels)
+        << "All images need the same channels.";
+    // Bring the data to the CPU here rather than from the threads.
+    images[i]->cpu_data();
+  }
+  CHECK_GE(resize_height, batch.height);
+  CHECK_GE(resize_width, batch.width);
+  if (param_.crop_size()) {
+    CHECK_EQ(param_.crop_size(), batch.height);
+    CHECK_EQ(param_.crop_size(), batch.width);
+  }
+  batch.channel_swap = channel_swap;
+  if (channel_swap.empty()) {
+    for (int c = 0; c < batch.channels; ++c) {
+      batch.channel_swap.push_back(c);
+    }
+  }
+  CHECK_EQ(batch.channel_swap.size(), batch.channels);
+  for (int c = 0; c < batch.channels; ++c) {
+    CHECK_GE(batch.channel_swap[c], 0);
+    CHECK_LT(batch.channel_swap[c], batch.channels);
+  }
+  batch.raw_scale = raw_scale;
+  batch.scale = param_.scale();
+  batch.mean = NULL;
+  batch.mean_at_crop = false;
+  if (data_mean_.count() > 0) {
+    CHECK_EQ(batch.channels, data_mean_.channels());
+    batch.mean_at_crop = data_mean_.height() == batch.height &&
+        data_mean_.width() == batch.width;
+    if (!batch.mean_at_crop) {
+      CHECK_EQ(resize_height, data_mean_.height());
+      CHECK_EQ(resize_width, data_mean_.width());
+    }
+    batch.mean = data_mean_.cpu_data();
+  }
+  batch.mean_values.resize(batch.channels, Dtype(0));
+  if (mean_values_.size() > 0) {
+    CHECK(mean_values_.size() == 1 || mean_values_.size() == batch.channels)
+        << "Specify either 1 mean_value or as many as channels: "
+        << batch.channels;
+    for (int c = 0; c < batch.channels; ++c) {
+      batch.mean_values[c] = mean_values_[mean_values_.size() == 1 ? 0 : c];
+    }
+  }
+  // The crops, chosen here since Rand is not thread-safe.
+  const int h_end = resize_height - batch.height;
+  const int w_end = resize_width - batch.width;
+  const int h_offs[] = { 0, 0, h_end, h_end, h_end / 2 };
+  const int w_offs[] = { 0, w_end, 0, w_end, w_end / 2 };
+  batch.crops_per_image = oversample ? 10 : 1;
+  for (int i = 0; i < images.size(); ++i) {
+    if (oversample) {
+      for (int k = 0; k < 10; ++k) {
+        ImageCrop crop = { h_offs[k % 5], w_offs[k % 5], k >= 5 };
+        batch.crops.push_back(crop);
+      }
+    } else {
+      ImageCrop crop = { h_end / 2, w_end / 2, false };
+      // Like the other transforms, only crop at random when training with a
+      // crop_size.
+      if (phase_ == TRAIN && param_.crop_size()) {
+        crop.h_off = Rand(h_end + 1);
+        crop.w_off = Rand(w_end + 1);
+      }
+      crop.mirror = param_.mirror() && Rand(2);
+      batch.crops.push_back(crop);
+    }
+  }
+  transformed_blob->Reshape(images.size() * batch.crops_per_image,
+      batch.channels, batch.height, batch.width);
+  batch.transformed_data = transformed_blob->mutable_cpu_data();
+  const int threads = std::max(1, std::min<int>(num_threads, images.size()));
+  vector<shared_ptr<boost::thread> > workers;
+  for (int t = 1; t < threads; ++t) {
+    workers.push_back(shared_ptr<boost::thread>(new boost::thread(
+        &TransformImageRange<Dtype>, &batch, images.size() * t / threads,
+        images.size() * (t + 1) / threads)));
+  }
+  TransformImageRange(&batch, 0, images.size() / threads);
+  for (int t = 0; t < workers.size(); ++t) {
+    workers[t]->join();
+  }
+}
+
+// Where a region is taken from an image and put in a crop: the clipped box
+// y1, x1, y2, x2 (inclusive) is warped to height x width at pad_h, pad_w.
+struct WarpedRegion {
+  int y1;
+  int x1;
+  int y2;
+  int x2;
+  int height;
+  int width;
+  int pad_h;
+  int pad_w;
+};
+
+// What the threads of TransformRegions share.
+template <typename Dtype>
+struct RegionBatch {
+  const Dtype* image;
+  int image_width;
+  int channels;
+  int height;
+  int width;
+  vector<int> channel_swap;
+  Dtype raw_scale;
+  Dtype scale;
+  vector<WarpedRegion> regions;
+  // A mean at least the size of the crops, whose center is used, or NULL.
+  const Dtype* mean;
+  int mean_height;
+  int mean_width;
+  // The mean of each channel, or 0.
+  vector<Dtype> mean_values;
+  Dtype* transformed_data;
+};
+
+// Transforms regions [begin, end) of the batch.
+template <typename Dtype>
+static void TransformRegionRange(const RegionBatch<Dtype>* batch,
+    const int begin, const int end) {
+  const int channels = batch->channels;
+  const int height = batch->height;
+  const int width = batch->width;
+  const int mean_h_off = (batch->mean_height - height) / 2;
+  const int mean_w_off = (batch->mean_width - width) / 2;
+  vector<Dtype> warped;
+  for (int i = begin; i < end; ++i) {
+    const WarpedRegion& region = batch->regions[i];
+    Dtype* transformed_data =
+        batch->transformed_data + i * channels * height * width;
+    // The padding stays 0, i.e. at the mean, as in WindowDataLayer.
+    caffe_set(channels * height * width, Dtype(0), transformed_data);
+    if (region.height <= 0 || region.width <= 0) {
+      continue;
+    }
+    warped.resize(region.height * region.width * channels);
+    ResizeImage(batch->image +
+        (region.y1 * batch->image_width + region.x1) * channels,
+        region.y2 - region.y1 + 1, region.x2 - region.x1 + 1, channels,
+        batch->image_width * channels, region.height, region.width,
+        &warped[0]);
+    for (int c = 0; c < channels; ++c) {
+      const int source_c = batch->channel_swap[c];
+      const Dtype mean_value = batch->mean_values[c];
+      for (int h = 0; h < region.height; ++h) {
+        const int top_h = h + region.pad_h;
+        Dtype* top_row = transformed_data + (c * height + top_h) * width +
+            region.pad_w;
+        const Dtype* mean_row = batch->mean ? batch->mean +
+            (c * batch->mean_height + top_h + mean_h_off) * batch->mean_width +
+            region.pad_w + mean_w_off : NULL;
+        for (int w = 0; w < region.width; ++w) {
+          Dtype value = warped[(h * region.width + w) * channels + source_c] *
+              batch->raw_scale - mean_value;
+          if (mean_row) {
+            value -= mean_row[w];
+          }
+          top_row[w] = value * batch->scale;
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void DataTransformer<Dtype>::TransformRegions(const Blob<Dtype>& image,
+    const vector<vector<int> >& regions, const int context_pad,
+    const vector<int>& channel_swap, const Dtype raw_scale,
+    Blob<Dtype>* transformed_blob, const int num_threads) {
+  CHECK_EQ(image.num_axes(), 3) << "Images are height x width x channels.";
+  CHECK_GT(regions.size(), 0);
+  CHECK_EQ(transformed_blob->num_axes(), 4);
+  const int image_height = image.shape(0);
+  const int image_width = image.shape(1);
+  RegionBatch<Dtype> batch;
+  batch.image = image.cpu_data();
+  batch.image_width = image_width;
+  batch.channels = image.shape(2);
+  batch.height = transformed_blob->height();
+  batch.width = transformed_blob->width();
+  CHECK_GE(context_pad, 0);
+  CHECK_LT(2 * context_pad, std::min(batch.height, batch.width));
+  batch.channel_swap = channel_swap;
+  if (channel_swap.empty()) {
+    for (int c = 0; c < batch.channels; ++c) {
+      batch.channel_swap.push_back(c);
+    }
+  }
+  CHECK_EQ(batch.channel_swap.size(), batch.channels);
+  for (int c = 0; c < batch.channels; ++c) {
+    CHECK_GE(batch.channel_swap[c], 0);
+    CHECK_LT(batch.channel_swap[c], batch.channels);
+  }
+  batch.raw_scale = raw_scale;
+  batch.scale = param_.scale();
+  batch.mean = NULL;
+  batch.mean_height = batch.height;
+  batch.mean_width = batch.width;
+  if (data_mean_.count() > 0) {
+    CHECK_EQ(batch.channels, data_mean_.channels());
+    CHECK_GE(data_mean_.height(), batch.height);
+    CHECK_GE(data_mean_.width(), batch.width);
+    batch.mean = data_mean_.cpu_data();
+    batch.mean_height = data_mean_.height();
+    batch.mean_width = data_mean_.width();
+  }
+  batch.mean_values.resize(batch.channels, Dtype(0));
+  if (mean_values_.size() > 0) {
+    CHECK(mean_values_.size() == 1 || mean_values_.size() == batch.channels)
+        << "Specify either 1 mean_value or as many as channels: "
+        << batch.channels;
+    for (int c = 0; c < batch.channels; ++c) {
+      batch.mean_values[c] = mean_values_[mean_values_.size() == 1 ? 0 : c];
+    }
+  }
+  // Expand each box by the context, clip it to the image and keep track of
+  // the padding this leaves, as WindowDataLayer does.
+  const Dtype context_scale_h = static_cast<Dtype>(batch.height) /
+      (batch.height - 2 * context_pad);
+  const Dtype context_scale_w = static_cast<Dtype>(batch.width) /
+      (batch.width - 2 * context_pad);
+  for (int i = 0; i < regions.size(); ++i) {
+    CHECK_EQ(regions[i].size(), 4) << "Regions are y1, x1, y2, x2.";
+    WarpedRegion region = { regions[i][0], regions[i][1], regions[i][2],
+        regions[i][3], batch.height, batch.width, 0, 0 };
+    CHECK_LE(region.y1, region.y2);
+    CHECK_LE(region.x1, region.x2);
+    if (context_pad > 0) {
+      const Dtype half_height = (region.y2 - region.y1 + 1) / Dtype(2);
+      const Dtype half_width = (region.x2 - region.x1 + 1) / Dtype(2);
+      const Dtype center_y = region.y1 + half_height;
+      const Dtype center_x = region.x1 + half_width;
+      region.y1 = static_cast<int>(round(center_y -
+          half_height * context_scale_h));
+      region.y2 = static_cast<int>(round(center_y +
+          half_height * context_scale_h));
+      region.x1 = static_cast<int>(round(center_x -
+          half_width * context_scale_w));
+      region.x2 = static_cast<int>(round(center_x +
+          half_width * context_scale_w));
+    }
+    const int unclipped_height = region.y2 - region.y1 + 1;
+    const int unclipped_width = region.x2 - region.x1 + 1;
+    const int pad_y1 = std::max(0, -region.y1);
+    const int pad_x1 = std::max(0, -region.x1);
+    region.y1 = std::max(0, region.y1);
+    region.x1 = std::max(0, region.x1);
+    region.y2 = std::min(image_height - 1, region.y2);
+    region.x2 = std::min(image_width - 1, region.x2);
+    if (region.y1 > region.y2 || region.x1 > region.x2) {
+      // Entirely outside the image: all padding.
+      region.height = 0;
+      region.width = 0;
+      batch.regions.push_back(region);
+      continue;
+    }
+    const Dtype scale_y = static_cast<Dtype>(batch.height) / unclipped_height;
+    const Dtype scale_x = static_cast<Dtype>(batch.width) / unclipped_width;
+    region.height = static_cast<int>(round((region.y2 - region.y1 + 1) *
+        scale_y));
+    region.width = static_cast<int>(round((region.x2 - region.x1 + 1) *
+        scale_x));
+    region.pad_h = std::min(static_cast<int>(round(pad_y1 * scale_y)),
+        batch.height - 1);
+    region.pad_w = std::min(static_cast<int>(round(pad_x1 * scale_x)),
+        batch.width - 1);
+    // The warped, clipped region and the padding may not fit due to rounding.
+    region.height = std::max(1, std::min(region.height,
+        batch.height - region.pad_h));
+    region.width = std::max(1, std::min(region.width,
+        batch.width - region.pad_w));
+    batch.regions.push_back(region);
+  }
+  transformed_blob->Reshape(regions.size(), batch.channels, batch.height,
+      batch.width);
+  batch.transformed_data = transformed_blob->mutable_cpu_data();
+  const int num_regions = regions.size();
+  const int threads = std::max(1, std::min(num_threads, num_regions));
+  vector<shared_ptr<boost::thread> > workers;
+  for (int t = 1; t < threads; ++t) {
+    workers.push_back(shared_ptr<boost::thread>(new boost::thread(
+        &TransformRegionRange<Dtype>, &batch, num_regions * t / threads,
+        num_regions * (t + 1) / threads)));
+  }
+  TransformRegionRange(&batch, 0, num_regions / threads);
+  for (int t = 0; t < workers.size(); ++t) {
+    workers[t]->join();
+  }
+}
+
+template <typename Dtype>
+void DataTransformer<Dtype>::SetMean(const Blob<Dtype>& mean) {
+  CHECK_EQ(mean_values_.size(), 0) <<
+    "Cannot specify a mean and mean_value at the same time";
+  CHECK_EQ(mean.num_axes(), 3) << "The mean is channels x height x width.";
+  data_mean_.Reshape(1, mean.shape(0), mean.shape(1), mean.shape(2));
+  caffe_copy(mean.count(), mean.cpu_data(), data_mean_.mutable_cpu_data());
+}
+
 template <typename Dtype>
 void DataTransformer<Dtype>::InitRand() {
   const bool needs_rand = param_.mirror() ||
@@ -4,6 +4,7 @@
 #include "caffe/layer.hpp"
 #include "caffe/util/im2col.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/quantize.hpp"
 #include "caffe/vision_layers.hpp"
 
 namespace caffe {
@@ -98,6 +99,26 @@ void BaseConvolutionLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   }
   // Propagate gradients to the parameters (as directed by backward pass).
   this->param_propagate_down_.resize(this->blobs_.size(), true);
+  // INT8 inference keeps an int8 copy of the weights, made on the first
+  // forward pass after they change (see QuantizationParameter). It is CPU
+  // only.
+  int8_ = this->layer_param_.quantization_param().precision() ==
+      QuantizationParameter_Precision_INT8;
+  if (int8_) {
+    CHECK(!reverse_dimensions())
+        << "INT8 precision is not supported for Deconvolution.";
+    CHECK_EQ(this->phase_, TEST)
+        << "INT8 precision is only supported for inference.";
+  }
+  fp16_ = this->layer_param_.quantization_param().precision() ==
+      QuantizationParameter_Precision_FP16;
+  if (fp16_) {
+    CHECK(!reverse_dimensions())
+        << "FP16 precision is not supported for Deconvolution.";
+    CHECK_EQ(this->phase_, TEST)
+        << "FP16 precision is only supported for inference.";
+  }
+  quantized_weights_.reset(new QuantizedWeights<Dtype>());
 }
 
 template <typename Dtype>
@@ -146,12 +167,15 @@ void BaseConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   } else {
     col_buffer_.Reshape(1, kernel_dim_, height_out_, width_out_);
   }
-  // Set up the all ones "bias multiplier" for adding biases by BLAS
+  // Set up the all ones "bias multiplier" for adding biases by BLAS, unless
+  // it already has the size (e.g. when only the batch size changed).
   if (bias_term_) {
     vector<int> bias_multiplier_shape(1, height_out_ * width_out_);
-    bias_multiplier_.Reshape(bias_multiplier_shape);
-    caffe_set(bias_multiplier_.count(), Dtype(1),
-        bias_multiplier_.mutable_cpu_data());
+    if (bias_multiplier_.shape() != bias_multiplier_shape) {
+      bias_multiplier_.Reshape(bias_multiplier_shape);
+      caffe_set(bias_multiplier_.count(), Dtype(1),
+          bias_multiplier_.mutable_cpu_data());
+    }
   }
 }
 
@@ -173,6 +197,83 @@ void BaseConvolutionLayer<Dtype>::forward_cpu_gemm(const Dtype* input,
   }
 }
 
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::UpdateDerivedWeights() {
+  if (int8_ && !quantized_weights_->IsCurrent(*this->blobs_[0])) {
+    quantized_weights_->Quantize(*this->blobs_[0], conv_out_channels_,
+        this->layer_param_.quantization_param());
+  }
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::ShareDerivedParamsFrom(
+    Layer<Dtype>* source) {
+  BaseConvolutionLayer<Dtype>* layer =
+      dynamic_cast<BaseConvolutionLayer<Dtype>*>(source);
+  // Only copies made the same way can be shared.
+  if (!layer || !layer->int8_ || !int8_
+      || layer->layer_param_.quantization_param().SerializeAsString()
+         != this->layer_param_.quantization_param().SerializeAsString()) {
+    return;
+  }
+  layer->UpdateDerivedWeights();
+  quantized_weights_ = layer->quantized_weights_;
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_gemm_int8(const Dtype* input,
+    Dtype* output) {
+  const QuantizationParameter& quantization_param =
+      this->layer_param_.quantization_param();
+  UpdateDerivedWeights();
+  // Quantize the image before im2col so the column buffer is int8 too;
+  // zero padding stays exact since zero quantizes to zero.
+  const int input_count = conv_in_channels_ * conv_in_height_ * conv_in_width_;
+  const float input_scale = quantization_param.input_scale() > 0 ?
+      quantization_param.input_scale() :
+      caffe_int8_scale(caffe_cpu_absmax(input_count, input));
+  quantized_input_.resize(input_count);
+  caffe_cpu_quantize(input_count, input, input_scale, &quantized_input_[0]);
+  const int8_t* col_buff = &quantized_input_[0];
+  if (!is_1x1_) {
+    quantized_col_.resize(kernel_dim_ * conv_out_spatial_dim_);
+    im2col_cpu(&quantized_input_[0], conv_in_channels_, conv_in_height_,
+        conv_in_width_, kernel_h_, kernel_w_, pad_h_, pad_w_, stride_h_,
+        stride_w_, &quantized_col_[0]);
+    col_buff = &quantized_col_[0];
+  }
+  // Dequantize each output channel with the product of the two scales.
+  output_scale_.resize(conv_out_channels_);
+  for (int c = 0; c < conv_out_channels_; ++c) {
+    output_scale_[c] = input_scale * quantized_weights_->scale()[c];
+  }
+  for (int g = 0; g < group_; ++g) {
+    caffe_cpu_gemm_s8<Dtype>(CblasNoTrans, conv_out_channels_ / group_,
+        conv_out_spatial_dim_, kernel_dim_ / group_,
+        quantized_weights_->data() + weight_offset_ * g,
+        col_buff + col_offset_ * g,
+        &output_scale_[0] + conv_out_channels_ / group_ * g, NULL,
+        output + output_offset_ * g);
+  }
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_gemm_half(const Dtype* input,
+    Dtype* output) {
+  const uint16_t* weights = this->blobs_[0]->cpu_half_data();
+  const Dtype* col_buff = input;
+  if (!is_1x1_) {
+    conv_im2col_cpu(input, col_buffer_.mutable_cpu_data());
+    col_buff = col_buffer_.cpu_data();
+  }
+  for (int g = 0; g < group_; ++g) {
+    caffe_cpu_gemm_half<Dtype>(CblasNoTrans, conv_out_channels_ / group_,
+        conv_out_spatial_dim_, kernel_dim_ / group_,
+        weights + weight_offset_ * g, col_buff + col_offset_ * g,
+        output + output_offset_ * g);
+  }
+}
+
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::forward_cpu_bias(Dtype* output,
     const Dtype* bias) {
@@ -56,16 +56,60 @@ void ConcatLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   Dtype* top_data = top[0]->mutable_cpu_data();
   int offset_concat_axis = 0;
   const int top_concat_axis = top[0]->shape(concat_axis_);
+  // Each bottom is a contiguous slab of the top iff there is a single concat.
+  const bool share = this->share_views_ && num_concats_ == 1;
+  bool all_shared = share;
+  bool any_shared = false;
+  if (share) {
+    // A bottom re-pointed at its slot by an earlier pass is left behind when
+    // the bottoms before it change size, and its data may then lie under the
+    // slots of other bottoms. Move such bottoms back into storage of their own
+    // before any slot is written.
+    const Dtype* top_end = top_data + top[0]->data()->size() / sizeof(Dtype);
+    int offset = 0;
+    for (int i = 0; i < bottom.size(); ++i) {
+      const Dtype* bottom_data = bottom[i]->cpu_data();
+      const Dtype* slot_data = top_data + offset * concat_input_size_;
+      offset += bottom[i]->shape(concat_axis_);
+      if (bottom_data != slot_data && bottom_data >= top_data &&
+          bottom_data < top_end) {
+        bottom[i]->data()->Release();
+        caffe_copy(bottom[i]->count(), bottom_data,
+            bottom[i]->mutable_cpu_data());
+      }
+    }
+  }
   for (int i = 0; i < bottom.size(); ++i) {
     const Dtype* bottom_data = bottom[i]->cpu_data();
     const int bottom_concat_axis = bottom[i]->shape(concat_axis_);
+    Dtype* slot_data = top_data + offset_concat_axis * concat_input_size_;
+    offset_concat_axis += bottom_concat_axis;
+    if (share && bottom_data == slot_data) {
+      // The producer already wrote this bottom in place.
+      any_shared = true;
+      continue;
+    }
     for (int n = 0; n < num_concats_; ++n) {
       caffe_copy(bottom_concat_axis * concat_input_size_,
           bottom_data + n * bottom_concat_axis * concat_input_size_,
-          top_data + (n * top_concat_axis + offset_concat_axis)
-              * concat_input_size_);
+          slot_data + n * top_concat_axis * concat_input_size_);
     }
-    offset_concat_axis += bottom_concat_axis;
+    // Re-point the bottom at its (now identical) slot so that the next pass
+    // writes it in place. Only whole allocations can be re-pointed.
+    if (share && bottom[i]->data()->size() ==
+        bottom[i]->count() * sizeof(Dtype)) {
+      bottom[i]->set_cpu_data(slot_data);
+      any_shared = true;
+    } else {
+      all_shared = false;
+    }
+  }
+  if (all_shared) {
+    aliased_memory_.clear();
+  }
+  if (any_shared && (aliased_memory_.empty() ||
+      aliased_memory_.back() != top[0]->data())) {
+    aliased_memory_.push_back(top[0]->data());
   }
 }
 
@@ -38,6 +38,10 @@ void DataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
       cursor_->Next();
     }
   }
+  const DataParameter& data_param = this->layer_param_.data_param();
+  CHECK_GE(data_param.shard_count(), 1);
+  CHECK_LT(data_param.shard_id(), data_param.shard_count());
+  Skip(data_param.shard_id() * data_param.batch_size());
   // Read a data point, and use it to initialize the top blob.
   Datum datum;
   datum.ParseFromString(cursor_->value());
@@ -154,12 +158,25 @@ void DataLayer<Dtype>::InternalThreadEntry() {
       cursor_->SeekToFirst();
     }
   }
+  // Skip the batches of the other shards.
+  const DataParameter& data_param = this->layer_param_.data_param();
+  Skip((data_param.shard_count() - 1) * batch_size);
   batch_timer.Stop();
   DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
   DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
   DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
 }
 
+template <typename Dtype>
+void DataLayer<Dtype>::Skip(const int count) {
+  for (int i = 0; i < count; ++i) {
+    cursor_->Next();
+    if (!cursor_->valid()) {
+      cursor_->SeekToFirst();
+    }
+  }
+}
+
 INSTANTIATE_CLASS(DataLayer);
 REGISTER_LAYER_CLASS(Data);
 
@@ -1,4 +1,3 @@
-#include <cfloat>
 #include <vector>
 
 #include "caffe/layer.hpp"
@@ -45,51 +44,62 @@ void EltwiseLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void EltwiseLayer<Dtype>::Forward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-  int* mask = NULL;
-  const Dtype* bottom_data_a = NULL;
-  const Dtype* bottom_data_b = NULL;
+  // Each kernel makes a single pass over the output, reading every input once
+  // per element, instead of one read-modify-write pass of the output per input.
+  const int num_bottom = bottom.size();
+  vector<const Dtype*> bottom_data(num_bottom);
+  for (int i = 0; i < num_bottom; ++i) {
+    bottom_data[i] = bottom[i]->cpu_data();
+  }
+  const Dtype* const* inputs = &bottom_data[0];
+  const Dtype* coeffs = &coeffs_[0];
   const int count = top[0]->count();
   Dtype* top_data = top[0]->mutable_cpu_data();
+  // The argmax mask is only needed by Backward.
+  int* mask = this->need_backward() && op_ == EltwiseParameter_EltwiseOp_MAX ?
+      max_idx_.mutable_cpu_data() : NULL;
   switch (op_) {
   case EltwiseParameter_EltwiseOp_PROD:
-    caffe_mul(count, bottom[0]->cpu_data(), bottom[1]->cpu_data(), top_data);
-    for (int i = 2; i < bottom.size(); ++i) {
-      caffe_mul(count, top_data, bottom[i]->cpu_data(), top_data);
+    CAFFE_PARALLEL_FOR
+    for (int idx = 0; idx < count; ++idx) {
+      Dtype prod = inputs[0][idx];
+      for (int i = 1; i < num_bottom; ++i) {
+        prod *= inputs[i][idx];
+      }
+      top_data[idx] = prod;
     }
     break;
   case EltwiseParameter_EltwiseOp_SUM:
-    caffe_set(count, Dtype(0), top_data);
-    // TODO(shelhamer) does BLAS optimize to sum for coeff = 1?
-    for (int i = 0; i < bottom.size(); ++i) {
-      caffe_axpy(count, coeffs_[i], bottom[i]->cpu_data(), top_data);
+    CAFFE_PARALLEL_FOR
+    for (int idx = 0; idx < count; ++idx) {
+      Dtype sum = 0;
+      for (int i = 0; i < num_bottom; ++i) {
+        sum += coeffs[i] * inputs[i][idx];
+      }
+      top_data[idx] = sum;
     }
     break;
   case EltwiseParameter_EltwiseOp_MAX:
-    // Initialize
-    mask = max_idx_.mutable_cpu_data();
-    caffe_set(count, -1, mask);
-    caffe_set(count, Dtype(-FLT_MAX), top_data);
-    // bottom 0 & 1
-    bottom_data_a = bottom[0]->cpu_data();
-    bottom_data_b = bottom[1]->cpu_data();
+    CAFFE_PARALLEL_FOR
     for (int idx = 0; idx < count; ++idx) {
-      if (bottom_data_a[idx] > bottom_data_b[idx]) {
-        top_data[idx] = bottom_data_a[idx];  // maxval
-        mask[idx] = 0;  // maxid
-      } else {
-        top_data[idx] = bottom_data_b[idx];  // maxval
-        mask[idx] = 1;  // maxid
+      // Same tie-breaking as the former pairwise passes: bottom 1 wins ties
+      // against bottom 0, later bottoms must be strictly greater.
+      Dtype maxval = inputs[1][idx];
+      int maxid = 1;
+      if (inputs[0][idx] > maxval) {
+        maxval = inputs[0][idx];
+        maxid = 0;
       }
-    }
-    // bottom 2++
-    for (int blob_idx = 2; blob_idx < bottom.size(); ++blob_idx) {
-      bottom_data_b = bottom[blob_idx]->cpu_data();
-      for (int idx = 0; idx < count; ++idx) {
-        if (bottom_data_b[idx] > top_data[idx]) {
-          top_data[idx] = bottom_data_b[idx];  // maxval
-          mask[idx] = blob_idx;  // maxid
+      for (int i = 2; i < num_bottom; ++i) {
+        if (inputs[i][idx] > maxval) {
+          maxval = inputs[i][idx];
+          maxid = i;
         }
       }
+      top_data[idx] = maxval;
+      if (mask) {
+        mask[idx] = maxid;
+      }
     }
     break;
   default:
@@ -135,6 +145,8 @@ void EltwiseLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
         }
         break;
       case EltwiseParameter_EltwiseOp_MAX:
+        CHECK(this->need_backward())
+            << "Eltwise MAX skipped its mask; set_need_backward(true) first.";
         mask = max_idx_.cpu_data();
         for (int index = 0; index < count; ++index) {
           Dtype gradient = 0;
@@ -5,6 +5,7 @@
 #include "caffe/filler.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/quantize.hpp"
 #include "caffe/vision_layers.hpp"
 
 namespace caffe {
@@ -49,6 +50,20 @@ void InnerProductLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     }
   }  // parameter initialization
   this->param_propagate_down_.resize(this->blobs_.size(), true);
+  int8_ = this->layer_param_.quantization_param().precision() ==
+      QuantizationParameter_Precision_INT8;
+  if (int8_) {
+    CHECK_EQ(this->phase_, TEST)
+        << "INT8 precision is only supported for inference.";
+  }
+  fp16_ = this->layer_param_.quantization_param().precision() ==
+      QuantizationParameter_Precision_FP16;
+  if (fp16_) {
+    CHECK_EQ(this->phase_, TEST)
+        << "FP16 precision is only supported for inference.";
+  }
+  quantized_weights_.reset(new QuantizedWeights<Dtype>());
+  sparse_weights_.reset(new SparseWeights<Dtype>());
 }
 
 template <typename Dtype>
@@ -69,22 +84,81 @@ void InnerProductLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   top_shape.resize(axis + 1);
   top_shape[axis] = N_;
   top[0]->Reshape(top_shape);
-  // Set up the bias multiplier
-  if (bias_term_) {
+  // Set up the bias multiplier, unless it already has the size.
+  if (bias_term_ && bias_multiplier_.count() != M_) {
     vector<int> bias_shape(1, M_);
     bias_multiplier_.Reshape(bias_shape);
     caffe_set(M_, Dtype(1), bias_multiplier_.mutable_cpu_data());
   }
 }
 
+template <typename Dtype>
+void InnerProductLayer<Dtype>::UpdateDerivedWeights() {
+  const Blob<Dtype>& weights = *this->blobs_[0];
+  const float sparsity_threshold =
+      this->layer_param_.inner_product_param().sparsity_threshold();
+  if (int8_) {
+    if (!quantized_weights_->IsCurrent(weights)) {
+      quantized_weights_->Quantize(weights, N_,
+          this->layer_param_.quantization_param());
+    }
+  } else if (sparsity_threshold > 0 && this->phase_ == TEST && !fp16_
+      && !sparse_weights_->IsCurrent(weights)) {
+    sparse_weights_->FromWeights(weights, N_, sparsity_threshold);
+  }
+}
+
+template <typename Dtype>
+void InnerProductLayer<Dtype>::ShareDerivedParamsFrom(Layer<Dtype>* source) {
+  InnerProductLayer<Dtype>* layer =
+      dynamic_cast<InnerProductLayer<Dtype>*>(source);
+  // Only copies made the same way can be shared.
+  if (!layer || layer->phase_ != this->phase_
+      || layer->layer_param_.quantization_param().SerializeAsString()
+         != this->layer_param_.quantization_param().SerializeAsString()
+      || layer->layer_param_.inner_product_param().sparsity_threshold()
+         != this->layer_param_.inner_product_param().sparsity_threshold()) {
+    return;
+  }
+  layer->UpdateDerivedWeights();
+  quantized_weights_ = layer->quantized_weights_;
+  sparse_weights_ = layer->sparse_weights_;
+}
+
 template <typename Dtype>
 void InnerProductLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
-  const Dtype* weight = this->blobs_[0]->cpu_data();
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, M_, N_, K_, (Dtype)1.,
-      bottom_data, weight, (Dtype)0., top_data);
+  // Weights are loaded after setup, so their int8 or CSR copy is made on the
+  // first forward pass, and again after they change.
+  UpdateDerivedWeights();
+  if (int8_) {
+    const QuantizationParameter& quantization_param =
+        this->layer_param_.quantization_param();
+    const int count = M_ * K_;
+    const float input_scale = quantization_param.input_scale() > 0 ?
+        quantization_param.input_scale() :
+        caffe_int8_scale(caffe_cpu_absmax(count, bottom_data));
+    quantized_bottom_.resize(count);
+    caffe_cpu_quantize(count, bottom_data, input_scale, &quantized_bottom_[0]);
+    output_scale_.resize(N_);
+    for (int j = 0; j < N_; ++j) {
+      output_scale_[j] = input_scale * quantized_weights_->scale()[j];
+    }
+    caffe_cpu_gemm_s8<Dtype>(CblasTrans, M_, N_, K_, &quantized_bottom_[0],
+        quantized_weights_->data(), NULL, &output_scale_[0], top_data);
+  } else if (sparse_weights_->initialized()) {
+    sparse_weights_->MultiplyTransposed(M_, bottom_data, top_data);
+  } else if (fp16_ && this->blobs_[0]->is_half()) {
+    // The Net converts the weights when it is set up (see Net::Init).
+    caffe_cpu_gemm_half<Dtype>(CblasTrans, M_, N_, K_,
+        this->blobs_[0]->cpu_half_data(), bottom_data, top_data);
+  } else {
+    const Dtype* weight = this->blobs_[0]->cpu_data();
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, M_, N_, K_, (Dtype)1.,
+        bottom_data, weight, (Dtype)0., top_data);
+  }
   if (bias_term_) {
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, M_, N_, 1, (Dtype)1.,
         bias_multiplier_.cpu_data(),
@@ -101,13 +175,13 @@ void InnerProductLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const Dtype* bottom_data = bottom[0]->cpu_data();
     // Gradient with respect to weight
     caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, N_, K_, M_, (Dtype)1.,
-        top_diff, bottom_data, (Dtype)0., this->blobs_[0]->mutable_cpu_diff());
+        top_diff, bottom_data, (Dtype)1., this->blobs_[0]->mutable_cpu_diff());
   }
   if (bias_term_ && this->param_propagate_down_[1]) {
     const Dtype* top_diff = top[0]->cpu_diff();
     // Gradient with respect to bias
     caffe_cpu_gemv<Dtype>(CblasTrans, M_, N_, (Dtype)1., top_diff,
-        bias_multiplier_.cpu_data(), (Dtype)0.,
+        bias_multiplier_.cpu_data(), (Dtype)1.,
         this->blobs_[1]->mutable_cpu_diff());
   }
   if (propagate_down[0]) {
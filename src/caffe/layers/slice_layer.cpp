@@ -73,19 +73,58 @@ template <typename Dtype>
 void SliceLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   int offset_slice_axis = 0;
+  // Each top is a contiguous slab of the bottom iff there is a single slice.
+  const bool share = this->share_views_ && num_slices_ == 1;
   const Dtype* bottom_data = bottom[0]->cpu_data();
   const int bottom_slice_axis = bottom[0]->shape(slice_axis_);
+  bool all_shared = share;
+  bool any_shared = false;
+  if (share) {
+    // A top re-pointed at its slice by an earlier pass is left behind when
+    // the tops before it change size, and writing it would then overwrite
+    // other slices. Give such tops back storage of their own.
+    const Dtype* bottom_end =
+        bottom_data + bottom[0]->data()->size() / sizeof(Dtype);
+    int offset = 0;
+    for (int i = 0; i < top.size(); ++i) {
+      const Dtype* top_data = top[i]->cpu_data();
+      const Dtype* slice_data = bottom_data + offset * slice_size_;
+      offset += top[i]->shape(slice_axis_);
+      if (top_data != slice_data && top_data >= bottom_data &&
+          top_data < bottom_end) {
+        top[i]->data()->Release();
+      }
+    }
+  }
   for (int i = 0; i < top.size(); ++i) {
-    Dtype* top_data = top[i]->mutable_cpu_data();
     const int top_slice_axis = top[i]->shape(slice_axis_);
+    const Dtype* slice_data = bottom_data + offset_slice_axis * slice_size_;
+    offset_slice_axis += top_slice_axis;
+    if (share && top[i]->cpu_data() == slice_data) {
+      any_shared = true;
+      continue;
+    }
+    Dtype* top_data = top[i]->mutable_cpu_data();
     for (int n = 0; n < num_slices_; ++n) {
       const int top_offset = n * top_slice_axis * slice_size_;
-      const int bottom_offset =
-          (n * bottom_slice_axis + offset_slice_axis) * slice_size_;
+      const int bottom_offset = n * bottom_slice_axis * slice_size_;
       caffe_copy(top_slice_axis * slice_size_,
-          bottom_data + bottom_offset, top_data + top_offset);
+          slice_data + bottom_offset, top_data + top_offset);
     }
-    offset_slice_axis += top_slice_axis;
+    if (share && top[i]->data()->size() == top[i]->count() * sizeof(Dtype)) {
+      // The Net only enables sharing if nothing writes the tops in place.
+      top[i]->set_cpu_data(const_cast<Dtype*>(slice_data));
+      any_shared = true;
+    } else {
+      all_shared = false;
+    }
+  }
+  if (all_shared) {
+    aliased_memory_.clear();
+  }
+  if (any_shared && (aliased_memory_.empty() ||
+      aliased_memory_.back() != bottom[0]->data())) {
+    aliased_memory_.push_back(bottom[0]->data());
   }
 }
 
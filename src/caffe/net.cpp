@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <cmath>
 #include <map>
 #include <set>
 #include <string>
@@ -11,8 +12,10 @@
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/insert_splits.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/mapped_weights.hpp"
 #include "caffe/util/math_functions.hpp"
 #include "caffe/util/upgrade_proto.hpp"
+#include "caffe/util/weights_stream.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
@@ -140,6 +143,18 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
     for (int param_id = 0; param_id < num_param_blobs; ++param_id) {
       AppendParam(param, layer_id, param_id);
     }
+    // FP16 weights are converted once, here; trained weights copied in later
+    // load straight into the half data, and sharing the weights shares it.
+    // Only the layers with a half precision forward can read them.
+    if (layer_param.quantization_param().precision() ==
+        QuantizationParameter_Precision_FP16) {
+      CHECK(layer_param.type() == "InnerProduct" ||
+            layer_param.type() == "Convolution")
+          << "FP16 precision is only supported for InnerProduct and "
+          << "Convolution layers, not layer " << layer_param.name()
+          << " of type " << layer_param.type();
+      layers_[layer_id]->blobs()[0]->ToHalf();
+    }
     // Finally, set the backward flag
     layer_need_backward_.push_back(need_backward);
     if (need_backward) {
@@ -199,6 +214,9 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
       }
     }
   }
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    layers_[layer_id]->set_need_backward(layer_need_backward_[layer_id]);
+  }
   // In the end, all remaining blobs are considered output blobs.
   for (set<string>::iterator it = available_blobs.begin();
       it != available_blobs.end(); ++it) {
@@ -213,6 +231,14 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
     layer_names_index_[layer_names_[layer_id]] = layer_id;
   }
   GetLearningRateAndWeightDecay();
+  if (param.zero_copy_concat_slice()) {
+    ShareConcatSliceViews();
+  }
+  PlanCheckpoints(param);
+  // Nothing is recorded yet, so the first pass reshapes every layer.
+  reshaped_shapes_.assign(layers_.size(), vector<vector<int> >());
+  reshaped_data_.assign(layers_.size(),
+      vector<boost::weak_ptr<SyncedMemory> >());
   debug_info_ = param.debug_info();
   LOG(INFO) << "Network initialization done.";
   LOG(INFO) << "Memory required for data: " << memory_used_ * sizeof(Dtype);
@@ -458,6 +484,304 @@ void Net<Dtype>::GetLearningRateAndWeightDecay() {
   }
 }
 
+template <typename Dtype>
+bool Net<Dtype>::BlobWrittenAfter(const int blob_id, const int layer_id) const {
+  // Split tops share their bottom's memory, so follow them as well.
+  set<int> aliases;
+  aliases.insert(blob_id);
+  for (int i = layer_id + 1; i < layers_.size(); ++i) {
+    const bool is_split = (string(layers_[i]->type()) == "Split");
+    bool reads_alias = false;
+    for (int j = 0; j < bottom_id_vecs_[i].size(); ++j) {
+      reads_alias |= aliases.count(bottom_id_vecs_[i][j]) > 0;
+    }
+    for (int j = 0; j < top_id_vecs_[i].size(); ++j) {
+      const int top_blob_id = top_id_vecs_[i][j];
+      if (is_split && reads_alias) {
+        aliases.insert(top_blob_id);
+      } else if (aliases.count(top_blob_id)) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+template <typename Dtype>
+void Net<Dtype>::ShareConcatSliceViews() {
+  // The (non in-place) producer of each blob; -1 for net inputs.
+  vector<int> producer(blobs_.size(), -1);
+  for (int i = 0; i < layers_.size(); ++i) {
+    for (int j = 0; j < top_id_vecs_[i].size(); ++j) {
+      const int blob_id = top_id_vecs_[i][j];
+      if (std::find(bottom_id_vecs_[i].begin(), bottom_id_vecs_[i].end(),
+          blob_id) == bottom_id_vecs_[i].end()) {
+        producer[blob_id] = i;
+      }
+    }
+  }
+  for (int i = 0; i < layers_.size(); ++i) {
+    const string type = layers_[i]->type();
+    bool share = false;
+    if (type == "Concat") {
+      // The bottoms are re-pointed into the top: their producers must own
+      // their memory outright (no Split siblings, no other aliasing layer,
+      // no externally set data) and nothing may later write the top.
+      share = !BlobWrittenAfter(top_id_vecs_[i][0], i);
+      set<int> seen;
+      for (int j = 0; share && j < bottom_id_vecs_[i].size(); ++j) {
+        const int blob_id = bottom_id_vecs_[i][j];
+        const int producer_id = producer[blob_id];
+        if (producer_id < 0 || !seen.insert(blob_id).second) {
+          share = false;
+          break;
+        }
+        const string producer_type = layers_[producer_id]->type();
+        share = producer_type != "Split" && producer_type != "Concat" &&
+            producer_type != "Slice" && producer_type != "MemoryData";
+      }
+    } else if (type == "Slice") {
+      // The tops become views of the bottom: nothing may later write the
+      // bottom or any top, and the bottom must not be shared with a sibling.
+      const int bottom_blob_id = bottom_id_vecs_[i][0];
+      const int producer_id = producer[bottom_blob_id];
+      const string producer_type =
+          (producer_id < 0) ? "" : layers_[producer_id]->type();
+      share = !BlobWrittenAfter(bottom_blob_id, i) &&
+          producer_type != "Split" && producer_type != "MemoryData";
+      for (int j = 0; share && j < top_id_vecs_[i].size(); ++j) {
+        share = !BlobWrittenAfter(top_id_vecs_[i][j], i);
+      }
+    } else {
+      continue;
+    }
+    layers_[i]->set_share_views(share);
+    LOG(INFO) << layer_names_[i] << (share ? " shares" : " does not share")
+              << " memory between its inputs and outputs.";
+  }
+}
+
+// Returns the root of a memory in a union-find forest.
+static int RootMemory(const vector<int>& parent, int memory) {
+  while (parent[memory] != memory) { memory = parent[memory]; }
+  return memory;
+}
+
+template <typename Dtype>
+void Net<Dtype>::PlanCheckpoints(const NetParameter& param) {
+  const int num_layers = layers_.size();
+  layer_segment_.assign(num_layers, -1);
+  // Group the blobs by the memory holding their data, so that aliases are
+  // freed together: Flatten tops share their bottom's memory from the start,
+  // Split tops from their forward pass on.
+  map<SyncedMemory*, int> memory_group;
+  vector<int> memory_blob;
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    if (blobs_[blob_id]->count() == 0) { continue; }
+    SyncedMemory* memory = blobs_[blob_id]->data().get();
+    if (!memory_group.count(memory)) {
+      memory_group[memory] = memory_blob.size();
+      memory_blob.push_back(blob_id);
+    }
+  }
+  vector<int> memory_parent(memory_blob.size());
+  for (int i = 0; i < memory_parent.size(); ++i) { memory_parent[i] = i; }
+  for (int i = 0; i < num_layers; ++i) {
+    if (string(layers_[i]->type()) != "Split") { continue; }
+    const int bottom_memory =
+        memory_group[blobs_[bottom_id_vecs_[i][0]]->data().get()];
+    for (int j = 0; j < top_id_vecs_[i].size(); ++j) {
+      const int top_memory =
+          memory_group[blobs_[top_id_vecs_[i][j]]->data().get()];
+      memory_parent[RootMemory(memory_parent, top_memory)] =
+          RootMemory(memory_parent, bottom_memory);
+    }
+  }
+  map<int, int> root_group;
+  vector<int> blob_group(blobs_.size(), -1);
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    if (blobs_[blob_id]->count() == 0) { continue; }
+    const int root = RootMemory(memory_parent,
+        memory_group[blobs_[blob_id]->data().get()]);
+    if (!root_group.count(root)) {
+      const int group = root_group.size();
+      root_group[root] = group;
+    }
+    blob_group[blob_id] = root_group[root];
+  }
+  const int num_groups = root_group.size();
+  // The layers using and writing each group. A layer writes a group unless
+  // its top merely aliases one of its bottoms.
+  vector<int> first_use(num_groups, num_layers), last_use(num_groups, -1);
+  vector<int> first_write(num_groups, num_layers), last_write(num_groups, -1);
+  // Groups that must never be freed.
+  vector<bool> pinned(num_groups, false);
+  for (int i = 0; i < num_layers; ++i) {
+    for (int j = 0; j < bottom_id_vecs_[i].size(); ++j) {
+      const int group = blob_group[bottom_id_vecs_[i][j]];
+      if (group < 0) { continue; }
+      first_use[group] = std::min(first_use[group], i);
+      last_use[group] = std::max(last_use[group], i);
+      // Concat and Slice views point into memory they do not own.
+      pinned[group] = pinned[group] || layers_[i]->share_views();
+    }
+    for (int j = 0; j < top_id_vecs_[i].size(); ++j) {
+      const int blob_id = top_id_vecs_[i][j];
+      const int group = blob_group[blob_id];
+      if (group < 0) { continue; }
+      first_use[group] = std::min(first_use[group], i);
+      last_use[group] = std::max(last_use[group], i);
+      pinned[group] = pinned[group] || layers_[i]->share_views();
+      bool aliases = false;
+      for (int k = 0; k < bottom_id_vecs_[i].size(); ++k) {
+        aliases |= bottom_id_vecs_[i][k] != blob_id &&
+            blob_group[bottom_id_vecs_[i][k]] == group;
+      }
+      if (!aliases) {
+        first_write[group] = std::min(first_write[group], i);
+        last_write[group] = std::max(last_write[group], i);
+      }
+    }
+  }
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    if (blob_group[blob_id] >= 0 && blob_id < blob_loss_weights_.size() &&
+        blob_loss_weights_[blob_id] != Dtype(0)) {
+      pinned[blob_group[blob_id]] = true;
+    }
+  }
+  for (int i = 0; i < net_input_blob_indices_.size(); ++i) {
+    const int group = blob_group[net_input_blob_indices_[i]];
+    if (group >= 0) { pinned[group] = true; }
+  }
+  for (int i = 0; i < net_output_blob_indices_.size(); ++i) {
+    const int group = blob_group[net_output_blob_indices_[i]];
+    if (group >= 0) { pinned[group] = true; }
+  }
+  // The bytes of data and diffs of each group; its blobs share one data.
+  vector<size_t> group_bytes(num_groups, 0);
+  vector<size_t> group_data_bytes(num_groups, 0);
+  set<SyncedMemory*> counted;
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    const int group = blob_group[blob_id];
+    if (group < 0) { continue; }
+    group_data_bytes[group] = std::max(group_data_bytes[group],
+        blobs_[blob_id]->data()->size());
+    const shared_ptr<SyncedMemory>& diff = blobs_[blob_id]->diff();
+    if (blob_need_backward_[blob_id] && counted.insert(diff.get()).second) {
+      group_bytes[group] += diff->size();
+    }
+  }
+  blob_memory_total_ = 0;
+  for (int group = 0; group < num_groups; ++group) {
+    group_bytes[group] += group_data_bytes[group];
+    blob_memory_total_ += group_bytes[group];
+  }
+  blob_memory_peak_ = blob_memory_total_;
+  bool any_checkpoint = param.auto_checkpoint();
+  for (int i = 0; i < param.layer_size(); ++i) {
+    any_checkpoint |= param.layer(i).checkpoint();
+  }
+  if (!any_checkpoint) { return; }
+
+  // A cut after layer i is possible unless some memory is written on both
+  // sides of it: recomputing either side would then see the other's writes.
+  vector<bool> can_cut(num_layers, true);
+  for (int group = 0; group < num_groups; ++group) {
+    for (int i = first_write[group]; i < last_write[group]; ++i) {
+      can_cut[i] = false;
+    }
+  }
+  vector<bool> repeatable(num_layers);
+  for (int i = 0; i < num_layers; ++i) {
+    repeatable[i] = layers_[i]->RepeatableForward() &&
+        bottom_vecs_[i].size() > 0;
+  }
+  const int auto_length = param.auto_checkpoint() ?
+      static_cast<int>(std::ceil(std::sqrt(static_cast<double>(num_layers))))
+      : 0;
+  size_t max_freed = 0, total_freed = 0;
+  bool want_cut = false;
+  for (int start = 0, i = 0; i < num_layers; ++i) {
+    want_cut |= param.layer(i).checkpoint() ||
+        (auto_length > 0 && i + 1 - start >= auto_length);
+    // Automatic plans keep layers that cannot be recomputed on their own.
+    want_cut |= auto_length > 0 && (!repeatable[i] ||
+        (i + 1 < num_layers && !repeatable[i + 1]));
+    if (!(want_cut && can_cut[i])) { continue; }
+    want_cut = false;
+    const int end = i;
+    const int segment_start = start;
+    start = end + 1;
+    // The last segment would be recomputed right after its forward pass.
+    if (end == num_layers - 1) { break; }
+    bool segment_repeatable = true;
+    bool need_backward = false;
+    for (int j = segment_start; j <= end; ++j) {
+      segment_repeatable &= repeatable[j];
+      need_backward |= layer_need_backward_[j];
+    }
+    if (!segment_repeatable) {
+      LOG(INFO) << "Not checkpointing " << layer_names_[segment_start]
+                << " to " << layer_names_[end]
+                << ": not every layer can be recomputed.";
+      continue;
+    }
+    vector<int> blob_ids;
+    size_t freed = 0;
+    for (int group = 0; group < num_groups; ++group) {
+      if (!pinned[group] && first_use[group] >= segment_start &&
+          last_use[group] <= end) {
+        freed += group_bytes[group];
+      }
+    }
+    for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+      const int group = blob_group[blob_id];
+      if (group >= 0 && !pinned[group] &&
+          first_use[group] >= segment_start && last_use[group] <= end) {
+        blob_ids.push_back(blob_id);
+      }
+    }
+    if (blob_ids.empty()) { continue; }
+    const int segment_id = segment_layers_.size();
+    for (int j = segment_start; j <= end; ++j) {
+      layer_segment_[j] = segment_id;
+    }
+    segment_layers_.push_back(std::make_pair(segment_start, end));
+    segment_blob_ids_.push_back(blob_ids);
+    segment_need_backward_.push_back(need_backward);
+    segment_released_.push_back(false);
+    max_freed = std::max(max_freed, freed);
+    total_freed += freed;
+    LOG(INFO) << "Checkpointing " << layer_names_[segment_start] << " to "
+              << layer_names_[end] << ": recomputes " << freed << " bytes.";
+  }
+  // At most one segment has its activations in memory at any time.
+  blob_memory_peak_ = blob_memory_total_ - total_freed + max_freed;
+  LOG(INFO) << "Peak memory for blobs: " << blob_memory_peak_
+            << " bytes with checkpointing, " << blob_memory_total_
+            << " bytes without.";
+}
+
+template <typename Dtype>
+void Net<Dtype>::ReleaseSegment(const int segment_id) {
+  const vector<int>& blob_ids = segment_blob_ids_[segment_id];
+  for (int i = 0; i < blob_ids.size(); ++i) {
+    blobs_[blob_ids[i]]->data()->Release();
+    blobs_[blob_ids[i]]->diff()->Release();
+  }
+  segment_released_[segment_id] = true;
+}
+
+template <typename Dtype>
+void Net<Dtype>::RestoreSegment(const int segment_id, const int end) {
+  if (!segment_released_[segment_id]) { return; }
+  for (int i = segment_layers_[segment_id].first; i <= end; ++i) {
+    ReshapeLayer(i);
+    layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
+  }
+  segment_released_[segment_id] = false;
+}
+
 template <typename Dtype>
 Dtype Net<Dtype>::ForwardFromTo(int start, int end) {
   CHECK_GE(start, 0);
@@ -468,12 +792,20 @@ Dtype Net<Dtype>::ForwardFromTo(int start, int end) {
       InputDebugInfo(i);
     }
   }
+  // Starting inside a freed segment recomputes its earlier layers.
+  if (layer_segment_[start] >= 0) {
+    RestoreSegment(layer_segment_[start], start - 1);
+  }
   for (int i = start; i <= end; ++i) {
     // LOG(ERROR) << "Forwarding " << layer_names_[i];
-    layers_[i]->Reshape(bottom_vecs_[i], top_vecs_[i]);
+    ReshapeLayer(i);
     Dtype layer_loss = layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
     loss += layer_loss;
     if (debug_info_) { ForwardDebugInfo(i); }
+    const int segment_id = layer_segment_[i];
+    if (segment_id >= 0 && segment_layers_[segment_id].second == i) {
+      ReleaseSegment(segment_id);
+    }
   }
   return loss;
 }
@@ -534,11 +866,21 @@ void Net<Dtype>::BackwardFromTo(int start, int end) {
   CHECK_GE(end, 0);
   CHECK_LT(start, layers_.size());
   for (int i = start; i >= end; --i) {
+    const int segment_id = layer_segment_[i];
+    if (segment_id >= 0 && segment_need_backward_[segment_id]) {
+      RestoreSegment(segment_id, i);
+    }
     if (layer_need_backward_[i]) {
       layers_[i]->Backward(
           top_vecs_[i], bottom_need_backward_[i], bottom_vecs_[i]);
       if (debug_info_) { BackwardDebugInfo(i); }
     }
+    for (int c = 0; c < after_backward_.size(); ++c) {
+      after_backward_[c]->run(i);
+    }
+    if (segment_id >= 0 && segment_layers_[segment_id].first == i) {
+      ReleaseSegment(segment_id);
+    }
   }
 }
 
@@ -644,6 +986,7 @@ void Net<Dtype>::ShareTrainedLayersWith(const Net* other) {
       CHECK(target_blobs[j]->shape() == source_blob->shape());
       target_blobs[j]->ShareData(*source_blob);
     }
+    layers_[target_layer_id]->ShareDerivedParamsFrom(source_layer);
   }
 }
 
@@ -677,45 +1020,140 @@ void Net<Dtype>::Backward() {
   }
 }
 
+template <typename Dtype>
+void Net<Dtype>::ReshapeLayer(const int layer_id) {
+  const vector<Blob<Dtype>*>& bottom = bottom_vecs_[layer_id];
+  const vector<Blob<Dtype>*>& top = top_vecs_[layer_id];
+  vector<vector<int> >& shapes = reshaped_shapes_[layer_id];
+  vector<boost::weak_ptr<SyncedMemory> >& data = reshaped_data_[layer_id];
+  bool changed = bottom.empty() || shapes.empty() ||
+      !layers_[layer_id]->ReshapeDependsOnlyOnBottoms();
+  for (int i = 0; !changed && i < bottom.size(); ++i) {
+    changed = bottom[i]->shape() != shapes[i] ||
+        data[i].lock() != bottom[i]->data();
+  }
+  // The tops are compared too in case they were reshaped from outside.
+  for (int i = 0; !changed && i < top.size(); ++i) {
+    changed = top[i]->shape() != shapes[bottom.size() + i];
+  }
+  if (!changed) { return; }
+  layers_[layer_id]->Reshape(bottom, top);
+  shapes.resize(bottom.size() + top.size());
+  data.resize(bottom.size());
+  for (int i = 0; i < bottom.size(); ++i) {
+    shapes[i] = bottom[i]->shape();
+    data[i] = bottom[i]->data();
+  }
+  for (int i = 0; i < top.size(); ++i) {
+    shapes[bottom.size() + i] = top[i]->shape();
+  }
+}
+
 template <typename Dtype>
 void Net<Dtype>::Reshape() {
   for (int i = 0; i < layers_.size(); ++i) {
-    layers_[i]->Reshape(bottom_vecs_[i], top_vecs_[i]);
+    ReshapeLayer(i);
   }
 }
 
+template <typename Dtype>
+void Net<Dtype>::Reserve(const vector<vector<int> >& input_shapes) {
+  CHECK_EQ(input_shapes.size(), net_input_blobs_.size())
+      << "Expected one shape per net input.";
+  vector<vector<int> > shapes(net_input_blobs_.size());
+  for (int i = 0; i < net_input_blobs_.size(); ++i) {
+    shapes[i] = net_input_blobs_[i]->shape();
+    net_input_blobs_[i]->Reshape(input_shapes[i]);
+  }
+  Reshape();
+  for (int i = 0; i < net_input_blobs_.size(); ++i) {
+    net_input_blobs_[i]->Reshape(shapes[i]);
+  }
+  Reshape();
+}
+
 template <typename Dtype>
 void Net<Dtype>::CopyTrainedLayersFrom(const NetParameter& param) {
   int num_source_layers = param.layer_size();
   for (int i = 0; i < num_source_layers; ++i) {
-    const LayerParameter& source_layer = param.layer(i);
-    const string& source_layer_name = source_layer.name();
-    int target_layer_id = 0;
-    while (target_layer_id != layer_names_.size() &&
-        layer_names_[target_layer_id] != source_layer_name) {
-      ++target_layer_id;
+    CopyTrainedLayer(param.layer(i));
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::CopyTrainedLayer(const LayerParameter& source_layer) {
+  const string& source_layer_name = source_layer.name();
+  int target_layer_id = 0;
+  while (target_layer_id != layer_names_.size() &&
+      layer_names_[target_layer_id] != source_layer_name) {
+    ++target_layer_id;
+  }
+  if (target_layer_id == layer_names_.size()) {
+    DLOG(INFO) << "Ignoring source layer " << source_layer_name;
+    return;
+  }
+  DLOG(INFO) << "Copying source layer " << source_layer_name;
+  vector<shared_ptr<Blob<Dtype> > >& target_blobs =
+      layers_[target_layer_id]->blobs();
+  CHECK_EQ(target_blobs.size(), source_layer.blobs_size())
+      << "Incompatible number of blobs for layer " << source_layer_name;
+  for (int j = 0; j < target_blobs.size(); ++j) {
+    const bool kReshape = false;
+    target_blobs[j]->FromProto(source_layer.blobs(j), kReshape);
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::CopyTrainedLayersFrom(const string trained_filename) {
+  if (IsMappedWeightsFile(trained_filename)) {
+    MapTrainedLayersFrom(trained_filename);
+    return;
+  }
+  if (IsWeightsStreamFile(trained_filename)) {
+    WeightsStreamReader reader(trained_filename);
+    LayerParameter source_layer;
+    while (reader.ReadLayer(&source_layer)) {
+      CopyTrainedLayer(source_layer);
     }
-    if (target_layer_id == layer_names_.size()) {
+    return;
+  }
+  NetParameter param;
+  ReadNetParamsFromBinaryFileOrDie(trained_filename, &param);
+  CopyTrainedLayersFrom(param);
+}
+
+template <typename Dtype>
+void Net<Dtype>::MapTrainedLayersFrom(const string& trained_filename) {
+  shared_ptr<MappedWeights> weights(new MappedWeights(trained_filename));
+  const NetParameter& header = weights->header();
+  for (int i = 0; i < header.layer_size(); ++i) {
+    const LayerParameter& source_layer = header.layer(i);
+    const string& source_layer_name = source_layer.name();
+    if (!has_layer(source_layer_name)) {
       DLOG(INFO) << "Ignoring source layer " << source_layer_name;
       continue;
     }
-    DLOG(INFO) << "Copying source layer " << source_layer_name;
+    DLOG(INFO) << "Mapping source layer " << source_layer_name;
     vector<shared_ptr<Blob<Dtype> > >& target_blobs =
-        layers_[target_layer_id]->blobs();
+        layer_by_name(source_layer_name)->blobs();
     CHECK_EQ(target_blobs.size(), source_layer.blobs_size())
         << "Incompatible number of blobs for layer " << source_layer_name;
     for (int j = 0; j < target_blobs.size(); ++j) {
-      const bool kReshape = false;
-      target_blobs[j]->FromProto(source_layer.blobs(j), kReshape);
+      CHECK(target_blobs[j]->ShapeEquals(source_layer.blobs(j)))
+          << "Cannot map blob " << j << " of layer " << source_layer_name
+          << " of a different shape.";
+      float* data = weights->blob_data(i, j);
+      if (sizeof(Dtype) == sizeof(float)) {
+        target_blobs[j]->set_cpu_data(reinterpret_cast<Dtype*>(data));
+      } else {
+        Dtype* target_data = target_blobs[j]->mutable_cpu_data();
+        for (int k = 0; k < target_blobs[j]->count(); ++k) {
+          target_data[k] = data[k];
+        }
+      }
     }
   }
-}
-
-template <typename Dtype>
-void Net<Dtype>::CopyTrainedLayersFrom(const string trained_filename) {
-  NetParameter param;
-  ReadNetParamsFromBinaryFileOrDie(trained_filename, &param);
-  CopyTrainedLayersFrom(param);
+  mapped_weights_.push_back(weights);
 }
 
 template <typename Dtype>
@@ -739,6 +1177,43 @@ void Net<Dtype>::ToProto(NetParameter* param, bool write_diff) const {
   }
 }
 
+template <typename Dtype>
+void Net<Dtype>::ToDefinitionProto(NetParameter* param) const {
+  // The net as ToProto writes it, minus the blobs.
+  param->Clear();
+  param->set_name(name_);
+  for (int i = 0; i < net_input_blob_indices_.size(); ++i) {
+    param->add_input(blob_names_[net_input_blob_indices_[i]]);
+  }
+  for (int i = 0; i < layers_.size(); ++i) {
+    LayerParameter* layer_param = param->add_layer();
+    layer_param->CopyFrom(layers_[i]->layer_param());
+    layer_param->clear_blobs();
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::ToWeightsStream(const string& filename,
+    bool write_diff) const {
+  NetParameter header;
+  ToDefinitionProto(&header);
+  WeightsStreamWriter writer(filename);
+  writer.WriteHeader(header);
+  DLOG(INFO) << "Serializing " << layers_.size() << " layers";
+  LayerParameter layer_param;
+  for (int i = 0; i < layers_.size(); ++i) {
+    if (layers_[i]->blobs().empty()) { continue; }
+    layer_param.Clear();
+    layer_param.set_name(layer_names_[i]);
+    layer_param.set_type(layers_[i]->type());
+    for (int j = 0; j < layers_[i]->blobs().size(); ++j) {
+      layers_[i]->blobs()[j]->ToProto(layer_param.add_blobs(), write_diff);
+    }
+    writer.WriteLayer(layer_param);
+  }
+  writer.Close();
+}
+
 template <typename Dtype>
 void Net<Dtype>::Update() {
   // First, accumulate the diffs of any shared parameters into their owner's
@@ -777,6 +1252,27 @@ void Net<Dtype>::Update() {
   }
 }
 
+template <typename Dtype>
+void Net<Dtype>::ClearParamDiffs() {
+  for (int i = 0; i < params_.size(); ++i) {
+    Blob<Dtype>* blob = params_[i].get();
+    switch (Caffe::mode()) {
+    case Caffe::CPU:
+      caffe_set(blob->count(), static_cast<Dtype>(0),
+                blob->mutable_cpu_diff());
+      break;
+    case Caffe::GPU:
+#ifndef CPU_ONLY
+      caffe_gpu_set(blob->count(), static_cast<Dtype>(0),
+                    blob->mutable_gpu_diff());
+#else
+      NO_GPU;
+#endif
+      break;
+    }
+  }
+}
+
 template <typename Dtype>
 bool Net<Dtype>::has_blob(const string& blob_name) const {
   return blob_names_index_.find(blob_name) != blob_names_index_.end();
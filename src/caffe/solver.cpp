@@ -1,3 +1,5 @@
+#include <boost/thread.hpp>
+
 #include <cstdio>
 
 #include <algorithm>
@@ -7,41 +9,81 @@
 #include "caffe/net.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/solver.hpp"
+#include "caffe/util/allreduce.hpp"
+#include "caffe/util/benchmark.hpp"
 #include "caffe/util/io.hpp"
 #include "caffe/util/math_functions.hpp"
 #include "caffe/util/upgrade_proto.hpp"
+#include "caffe/util/weights_stream.hpp"
 
 namespace caffe {
 
 template <typename Dtype>
 Solver<Dtype>::Solver(const SolverParameter& param)
-    : net_() {
+    : net_(), stop_replicas_(false), allreduce_in_backward_(false) {
   Init(param);
 }
 
 template <typename Dtype>
 Solver<Dtype>::Solver(const string& param_file)
-    : net_() {
+    : net_(), stop_replicas_(false), allreduce_in_backward_(false) {
   SolverParameter param;
   ReadProtoFromTextFileOrDie(param_file, &param);
   Init(param);
 }
 
+template <typename Dtype>
+Solver<Dtype>::~Solver() {
+  WaitForTests();
+  if (!replica_threads_.empty()) {
+    stop_replicas_ = true;
+    replica_barrier_->wait();
+    for (int i = 0; i < replica_threads_.size(); ++i) {
+      replica_threads_[i]->join();
+    }
+  }
+}
+
 template <typename Dtype>
 void Solver<Dtype>::Init(const SolverParameter& param) {
   LOG(INFO) << "Initializing solver from parameters: " << std::endl
             << param.DebugString();
   param_ = param;
   CHECK_GE(param_.average_loss(), 1) << "average_loss should be non-negative.";
+  CHECK_GE(param_.rank(), 0);
+  CHECK_LT(param_.rank(), param_.world_size());
   if (param_.random_seed() >= 0) {
-    Caffe::set_random_seed(param_.random_seed());
+    // Each process draws its own random numbers; the parameters are made the
+    // same by BroadcastParams.
+    Caffe::set_random_seed(param_.random_seed() +
+        param_.rank() * param_.replicas());
   }
   // Scaffolding code
   InitTrainNet();
-  InitTestNets();
+  // Only rank 0 tests.
+  if (param_.rank() == 0) {
+    InitTestNets();
+  }
+  if (param_.world_size() > 1) {
+    InitAllreduce();
+  }
   LOG(INFO) << "Solver scaffolding done.";
   iter_ = 0;
   current_step_ = 0;
+  smoothed_loss_ = 0;
+}
+
+// Makes the Data layers of net_param read shard shard_id of shard_count.
+static void ShardDataLayers(const int shard_id, const int shard_count,
+    NetParameter* net_param) {
+  if (shard_count == 1) { return; }
+  for (int i = 0; i < net_param->layer_size(); ++i) {
+    LayerParameter* layer_param = net_param->mutable_layer(i);
+    if (layer_param->type() == "Data") {
+      layer_param->mutable_data_param()->set_shard_count(shard_count);
+      layer_param->mutable_data_param()->set_shard_id(shard_id);
+    }
+  }
 }
 
 template <typename Dtype>
@@ -79,7 +121,39 @@ void Solver<Dtype>::InitTrainNet() {
   net_state.MergeFrom(net_param.state());
   net_state.MergeFrom(param_.train_state());
   net_param.mutable_state()->CopyFrom(net_state);
-  net_.reset(new Net<Dtype>(net_param));
+  CHECK_GE(param_.replicas(), 1);
+  if (param_.replicas() > 1) {
+    InitReplicas(net_param);
+  } else {
+    ShardDataLayers(param_.rank(), param_.world_size(), &net_param);
+    net_.reset(new Net<Dtype>(net_param));
+  }
+}
+
+template <typename Dtype>
+void Solver<Dtype>::InitReplicas(const NetParameter& net_param) {
+  const int num_replicas = param_.replicas();
+  CHECK_EQ(Caffe::mode(), Caffe::CPU)
+      << "Data-parallel replicas are only supported in CPU mode.";
+  LOG(INFO) << "Creating " << num_replicas << " replicas of the training net.";
+  for (int r = 0; r < num_replicas; ++r) {
+    NetParameter replica_param(net_param);
+    ShardDataLayers(param_.rank() * num_replicas + r,
+        param_.world_size() * num_replicas, &replica_param);
+    replicas_.push_back(shared_ptr<Net<Dtype> >(
+        new Net<Dtype>(replica_param)));
+    if (r > 0) {
+      // Share the parameters; each replica keeps its own diffs.
+      replicas_[r]->ShareTrainedLayersWith(replicas_[0].get());
+    }
+  }
+  net_ = replicas_[0];
+  replica_losses_.resize(num_replicas);
+  replica_barrier_.reset(new boost::barrier(num_replicas));
+  for (int r = 1; r < num_replicas; ++r) {
+    replica_threads_.push_back(shared_ptr<boost::thread>(new boost::thread(
+        &Solver<Dtype>::ReplicaThreadEntry, this, r)));
+  }
 }
 
 template <typename Dtype>
@@ -165,7 +239,7 @@ void Solver<Dtype>::Step(int iters) {
   const int stop_iter = iter_ + iters;
   int average_loss = this->param_.average_loss();
   vector<Dtype> losses;
-  Dtype smoothed_loss = 0;
+  smoothed_loss_ = 0;
 
   for (; iter_ < stop_iter; ++iter_) {
     if (param_.test_interval() && iter_ % param_.test_interval() == 0
@@ -175,18 +249,34 @@ void Solver<Dtype>::Step(int iters) {
 
     const bool display = param_.display() && iter_ % param_.display() == 0;
     net_->set_debug_info(display && param_.debug_info());
-    Dtype loss = net_->ForwardBackward(bottom_vec);
+    // Backward accumulates the parameter gradients over the iter_size passes;
+    // ComputeUpdateValue averages them.
+    Dtype loss = 0;
+    if (replicas_.empty()) {
+      net_->ClearParamDiffs();
+      for (int i = 0; i < param_.iter_size(); ++i) {
+        allreduce_in_backward_ = allreduce_ && i == param_.iter_size() - 1;
+        loss += net_->ForwardBackward(bottom_vec);
+      }
+      allreduce_in_backward_ = false;
+      loss /= param_.iter_size();
+    } else {
+      loss = ReplicasForwardBackward();
+    }
+    if (allreduce_) {
+      loss = AllreduceGradients(loss);
+    }
     if (losses.size() < average_loss) {
       losses.push_back(loss);
       int size = losses.size();
-      smoothed_loss = (smoothed_loss * (size - 1) + loss) / size;
+      smoothed_loss_ = (smoothed_loss_ * (size - 1) + loss) / size;
     } else {
       int idx = (iter_ - start_iter) % average_loss;
-      smoothed_loss += (loss - losses[idx]) / average_loss;
+      smoothed_loss_ += (loss - losses[idx]) / average_loss;
       losses[idx] = loss;
     }
     if (display) {
-      LOG(INFO) << "Iteration " << iter_ << ", loss = " << smoothed_loss;
+      LOG(INFO) << "Iteration " << iter_ << ", loss = " << smoothed_loss_;
       const vector<Blob<Dtype>*>& result = net_->output_blobs();
       int score_index = 0;
       for (int j = 0; j < result.size(); ++j) {
@@ -211,12 +301,125 @@ void Solver<Dtype>::Step(int iters) {
     net_->Update();
 
     // Save a snapshot if needed.
-    if (param_.snapshot() && (iter_ + 1) % param_.snapshot() == 0) {
+    if (param_.snapshot() && (iter_ + 1) % param_.snapshot() == 0
+        && param_.rank() == 0) {
       Snapshot();
     }
   }
 }
 
+template <typename Dtype>
+Dtype Solver<Dtype>::ReplicasForwardBackward() {
+  // Release the replica threads and run net_ on this one.
+  replica_barrier_->wait();
+  ReplicaForwardBackward(0);
+  Dtype loss = 0;
+  for (int r = 0; r < replicas_.size(); ++r) {
+    loss += replica_losses_[r];
+  }
+  // Averaged over this process only, like the single net path in Step;
+  // AllreduceGradients averages it over the processes.
+  return loss / (param_.iter_size() * param_.replicas());
+}
+
+template <typename Dtype>
+void Solver<Dtype>::ReplicaForwardBackward(const int replica_id) {
+  Net<Dtype>* net = replicas_[replica_id].get();
+  vector<Blob<Dtype>*> bottom_vec;
+  net->ClearParamDiffs();
+  Dtype loss = 0;
+  for (int i = 0; i < param_.iter_size(); ++i) {
+    loss += net->ForwardBackward(bottom_vec);
+  }
+  replica_losses_[replica_id] = loss;
+  // Sum the diffs into replica 0 along a binary tree: at each level, replica
+  // r adds in the diffs of replica r + stride. The order of the additions only
+  // depends on the number of replicas, so the result is deterministic.
+  const int num_replicas = replicas_.size();
+  for (int stride = 1; stride < num_replicas; stride *= 2) {
+    replica_barrier_->wait();
+    if (replica_id % (2 * stride) != 0 || replica_id + stride >= num_replicas) {
+      continue;
+    }
+    const vector<shared_ptr<Blob<Dtype> > >& params = net->params();
+    const vector<shared_ptr<Blob<Dtype> > >& other_params =
+        replicas_[replica_id + stride]->params();
+    for (int i = 0; i < params.size(); ++i) {
+      caffe_axpy(params[i]->count(), Dtype(1), other_params[i]->cpu_diff(),
+          params[i]->mutable_cpu_diff());
+    }
+  }
+}
+
+template <typename Dtype>
+void Solver<Dtype>::ReplicaThreadEntry(const int replica_id) {
+  // Each thread has its own random number generator.
+  if (param_.random_seed() >= 0) {
+    Caffe::set_random_seed(param_.random_seed() +
+        param_.rank() * param_.replicas() + replica_id);
+  }
+  while (true) {
+    replica_barrier_->wait();
+    if (stop_replicas_) { return; }
+    ReplicaForwardBackward(replica_id);
+  }
+}
+
+template <typename Dtype>
+void Solver<Dtype>::InitAllreduce() {
+  allreduce_ = GetAllreduce<Dtype>(param_);
+  // Backward computes the gradients from the last layer to the first, so the
+  // buckets are filled in that order.
+  const vector<shared_ptr<Blob<Dtype> > >& net_params = net_->params();
+  vector<Blob<Dtype>*> params;
+  for (int i = net_params.size() - 1; i >= 0; --i) {
+    params.push_back(net_params[i].get());
+  }
+  gradient_allreduce_.reset(new BucketedAllreduce<Dtype>(allreduce_, params,
+      param_.allreduce_bucket_size()));
+  if (replicas_.empty()) {
+    backward_callback_.reset(new BackwardCallback(this));
+    net_->add_after_backward(backward_callback_.get());
+  }
+  LOG(INFO) << "Rank " << param_.rank() << " of " << param_.world_size()
+      << " joined; summing the gradients in "
+      << gradient_allreduce_->num_buckets() << " buckets.";
+}
+
+template <typename Dtype>
+void Solver<Dtype>::BroadcastParams() {
+  const vector<shared_ptr<Blob<Dtype> > >& net_params = net_->params();
+  for (int i = 0; i < net_params.size(); ++i) {
+    allreduce_->Broadcast(net_params[i]->mutable_cpu_data(),
+        net_params[i]->count());
+  }
+}
+
+template <typename Dtype>
+Dtype Solver<Dtype>::AllreduceGradients(Dtype loss) {
+  if (!replicas_.empty()) {
+    // The gradients of the replicas are only final once they are summed.
+    const int num_params = net_->params().size();
+    for (int i = 0; i < num_params; ++i) {
+      gradient_allreduce_->ParamReady(i);
+    }
+  }
+  gradient_allreduce_->Finish();
+  allreduce_->Sum(&loss, 1);
+  return loss / param_.world_size();
+}
+
+template <typename Dtype>
+void Solver<Dtype>::LayerBackwardDone(const int layer_id) {
+  if (!allreduce_in_backward_) { return; }
+  // gradient_allreduce_ takes the parameters in reverse order.
+  const int num_params = net_->params().size();
+  const vector<int>& param_ids = net_->param_id_vecs()[layer_id];
+  for (int i = 0; i < param_ids.size(); ++i) {
+    gradient_allreduce_->ParamReady(num_params - 1 - param_ids[i]);
+  }
+}
+
 template <typename Dtype>
 void Solver<Dtype>::Solve(const char* resume_file) {
   LOG(INFO) << "Solving " << net_->name();
@@ -226,16 +429,23 @@ void Solver<Dtype>::Solve(const char* resume_file) {
     LOG(INFO) << "Restoring previous solver status from " << resume_file;
     Restore(resume_file);
   }
+  // Start all the processes from the same parameters, however they were
+  // initialized or loaded.
+  if (allreduce_) {
+    BroadcastParams();
+  }
 
   // For a network that is trained by the solver, no bottom or top vecs
   // should be given, and we will just provide dummy vecs.
   Step(param_.max_iter() - iter_);
   // If we haven't already, save a snapshot after optimization, unless
   // overridden by setting snapshot_after_train := false
-  if (param_.snapshot_after_train()
+  if (param_.snapshot_after_train() && param_.rank() == 0
       && (!param_.snapshot() || iter_ % param_.snapshot() != 0)) {
     Snapshot();
   }
+  // Make sure the last snapshot is on disk before Solve returns.
+  snapshot_writer_.WaitForInternalThreadToExit();
   // After the optimization is done, run an additional train and test pass to
   // display the train and test loss/outputs if appropriate (based on the
   // display and test_interval settings, respectively).  Unlike in the rest of
@@ -250,12 +460,17 @@ void Solver<Dtype>::Solve(const char* resume_file) {
   if (param_.test_interval() && iter_ % param_.test_interval() == 0) {
     TestAll();
   }
+  WaitForTests();
   LOG(INFO) << "Optimization Done.";
 }
 
 
 template <typename Dtype>
 void Solver<Dtype>::TestAll() {
+  if (param_.test_async()) {
+    TestAllInBackground();
+    return;
+  }
   for (int test_net_id = 0; test_net_id < test_nets_.size(); ++test_net_id) {
     Test(test_net_id);
   }
@@ -267,6 +482,11 @@ void Solver<Dtype>::Test(const int test_net_id) {
             << ", Testing net (#" << test_net_id << ")";
   CHECK_NOTNULL(test_nets_[test_net_id].get())->
       ShareTrainedLayersWith(net_.get());
+  RunTest(test_net_id, "");
+}
+
+template <typename Dtype>
+void Solver<Dtype>::RunTest(const int test_net_id, const string& log_prefix) {
   vector<Dtype> test_score;
   vector<int> test_score_output_id;
   vector<Blob<Dtype>*> bottom_vec;
@@ -299,7 +519,7 @@ void Solver<Dtype>::Test(const int test_net_id) {
   }
   if (param_.test_compute_loss()) {
     loss /= param_.test_iter(test_net_id);
-    LOG(INFO) << "Test loss: " << loss;
+    LOG(INFO) << log_prefix << "Test loss: " << loss;
   }
   for (int i = 0; i < test_score.size(); ++i) {
     const int output_blob_index =
@@ -312,17 +532,100 @@ void Solver<Dtype>::Test(const int test_net_id) {
       loss_msg_stream << " (* " << loss_weight
                       << " = " << loss_weight * mean_score << " loss)";
     }
-    LOG(INFO) << "    Test net output #" << i << ": " << output_name << " = "
-        << mean_score << loss_msg_stream.str();
+    LOG(INFO) << log_prefix << "    Test net output #" << i << ": "
+        << output_name << " = " << mean_score << loss_msg_stream.str();
+  }
+}
+
+template <typename Dtype>
+void Solver<Dtype>::TestAllInBackground() {
+  CPUTimer timer;
+  timer.Start();
+  WaitForTests();
+  ShareTestWeights();
+  int device = 0;
+#ifndef CPU_ONLY
+  if (Caffe::mode() == Caffe::GPU) {
+    CUDA_CHECK(cudaGetDevice(&device));
+  }
+#endif
+  for (int test_net_id = 0; test_net_id < test_nets_.size(); ++test_net_id) {
+    LOG(INFO) << "Iteration " << iter_
+              << ", Testing net (#" << test_net_id << ") in the background";
+    test_threads_.push_back(shared_ptr<boost::thread>(new boost::thread(
+        &Solver<Dtype>::TestInBackground, this, test_net_id, iter_,
+        Caffe::mode(), device)));
+  }
+  LOG(INFO) << "Testing stalled training for " << timer.MilliSeconds()
+      << " ms";
+}
+
+template <typename Dtype>
+void Solver<Dtype>::TestInBackground(const int test_net_id, const int iter,
+    const Caffe::Brew mode, const int device) {
+  // The CUDA device is per host thread. Caffe::SetDevice is not used here as
+  // it would also replace the cuBLAS and cuRAND handles of the train net.
+#ifndef CPU_ONLY
+  if (mode == Caffe::GPU) {
+    CUDA_CHECK(cudaSetDevice(device));
+  }
+#endif
+  ostringstream log_prefix;
+  log_prefix << "Iteration " << iter << ", test net #" << test_net_id << ": ";
+  RunTest(test_net_id, log_prefix.str());
+}
+
+template <typename Dtype>
+void Solver<Dtype>::ShareTestWeights() {
+  const vector<shared_ptr<Layer<Dtype> > >& layers = net_->layers();
+  test_weights_.resize(layers.size());
+  for (int i = 0; i < layers.size(); ++i) {
+    const vector<shared_ptr<Blob<Dtype> > >& blobs = layers[i]->blobs();
+    test_weights_[i].resize(blobs.size());
+    for (int j = 0; j < blobs.size(); ++j) {
+      if (!test_weights_[i][j]) {
+        test_weights_[i][j].reset(new Blob<Dtype>());
+      }
+      const bool kCopyDiff = false, kReshape = true;
+      test_weights_[i][j]->CopyFrom(*blobs[j], kCopyDiff, kReshape);
+    }
+  }
+  // As in Net::ShareTrainedLayersWith, with the copy in place of the train
+  // net's own blobs.
+  for (int t = 0; t < test_nets_.size(); ++t) {
+    const Net<Dtype>& test_net = *test_nets_[t];
+    for (int i = 0; i < layers.size(); ++i) {
+      const string& source_layer_name = net_->layer_names()[i];
+      int target_layer_id = 0;
+      while (target_layer_id != test_net.layer_names().size() &&
+          test_net.layer_names()[target_layer_id] != source_layer_name) {
+        ++target_layer_id;
+      }
+      if (target_layer_id == test_net.layer_names().size()) { continue; }
+      const vector<shared_ptr<Blob<Dtype> > >& target_blobs =
+          test_net.layers()[target_layer_id]->blobs();
+      CHECK_EQ(target_blobs.size(), test_weights_[i].size())
+          << "Incompatible number of blobs for layer " << source_layer_name;
+      for (int j = 0; j < target_blobs.size(); ++j) {
+        CHECK(target_blobs[j]->shape() == test_weights_[i][j]->shape());
+        target_blobs[j]->ShareData(*test_weights_[i][j]);
+      }
+    }
   }
 }
 
+template <typename Dtype>
+void Solver<Dtype>::WaitForTests() {
+  for (int i = 0; i < test_threads_.size(); ++i) {
+    test_threads_[i]->join();
+  }
+  test_threads_.clear();
+}
 
 template <typename Dtype>
 void Solver<Dtype>::Snapshot() {
-  NetParameter net_param;
-  // For intermediate results, we will also dump the gradient values.
-  net_->ToProto(&net_param, param_.snapshot_diff());
+  CPUTimer timer;
+  timer.Start();
   string filename(param_.snapshot_prefix());
   string model_filename, snapshot_filename;
   const int kBufferSize = 20;
@@ -331,26 +634,138 @@ void Solver<Dtype>::Snapshot() {
   snprintf(iter_str_buffer, kBufferSize, "_iter_%d", iter_ + 1);
   filename += iter_str_buffer;
   model_filename = filename + ".caffemodel";
-  LOG(INFO) << "Snapshotting to " << model_filename;
-  WriteProtoToBinaryFile(net_param, model_filename.c_str());
+  if (param_.snapshot_weights_stream()) {
+    model_filename += ".stream";
+  }
   SolverState state;
-  SnapshotSolverState(&state);
+  vector<shared_ptr<Blob<Dtype> > > history;
+  SnapshotSolverState(&state, &history);
   state.set_iter(iter_ + 1);
   state.set_learned_net(model_filename);
   state.set_current_step(current_step_);
   snapshot_filename = filename + ".solverstate";
+  LOG(INFO) << "Snapshotting to " << model_filename;
   LOG(INFO) << "Snapshotting solver state to " << snapshot_filename;
-  WriteProtoToBinaryFile(state, snapshot_filename.c_str());
+  // For intermediate results, we will also dump the gradient values.
+  snapshot_writer_.Write(*net_, param_.snapshot_diff(), model_filename,
+      param_.snapshot_weights_stream(), &state, history, snapshot_filename,
+      param_.snapshot_async());
+  LOG(INFO) << "Snapshot stalled training for " << timer.MilliSeconds()
+      << " ms";
+}
+
+// Copies the data, and the diffs if copy_diff, of the blobs to host memory,
+// reusing the copies made before where they are large enough.
+template <typename Dtype>
+static void CopyBlobsToHost(const vector<shared_ptr<Blob<Dtype> > >& blobs,
+    const bool copy_diff, vector<shared_ptr<Blob<Dtype> > >* copies) {
+  copies->resize(blobs.size());
+  for (int i = 0; i < blobs.size(); ++i) {
+    if (!(*copies)[i]) {
+      (*copies)[i].reset(new Blob<Dtype>());
+    }
+    Blob<Dtype>* copy = (*copies)[i].get();
+    copy->ReshapeLike(*blobs[i]);
+    caffe_copy(copy->count(), blobs[i]->cpu_data(), copy->mutable_cpu_data());
+    if (copy_diff) {
+      caffe_copy(copy->count(), blobs[i]->cpu_diff(),
+          copy->mutable_cpu_diff());
+    }
+  }
+}
+
+template <typename Dtype>
+void SnapshotWriter<Dtype>::Write(const Net<Dtype>& net,
+    const bool write_diff, const string& model_filename,
+    const bool weights_stream, SolverState* state,
+    const vector<shared_ptr<Blob<Dtype> > >& history,
+    const string& state_filename, const bool async) {
+  CHECK(WaitForInternalThreadToExit()) << "Previous snapshot failed.";
+  net.ToDefinitionProto(&net_param_);
+  state_.Clear();
+  state_.Swap(state);
+  write_diff_ = write_diff;
+  weights_stream_ = weights_stream;
+  model_filename_ = model_filename;
+  state_filename_ = state_filename;
+  const vector<shared_ptr<Layer<Dtype> > >& layers = net.layers();
+  layer_blobs_.resize(layers.size());
+  if (!async) {
+    // Write the blobs themselves, and drop them afterwards so that a later
+    // copy never writes into them.
+    for (int i = 0; i < layers.size(); ++i) {
+      layer_blobs_[i] = layers[i]->blobs();
+    }
+    history_ = history;
+    WriteFiles();
+    layer_blobs_.clear();
+    history_.clear();
+    return;
+  }
+  for (int i = 0; i < layers.size(); ++i) {
+    CopyBlobsToHost(layers[i]->blobs(), write_diff, &layer_blobs_[i]);
+  }
+  CopyBlobsToHost(history, false, &history_);
+  CHECK(StartInternalThread()) << "Snapshot thread could not be started.";
+}
+
+template <typename Dtype>
+void SnapshotWriter<Dtype>::InternalThreadEntry() {
+  WriteFiles();
+}
+
+template <typename Dtype>
+void SnapshotWriter<Dtype>::WriteFiles() {
+  // The state names the model, so the model has to be on disk first.
+  if (weights_stream_) {
+    WriteWeightsStream();
+  } else {
+    for (int i = 0; i < layer_blobs_.size(); ++i) {
+      LayerParameter* layer_param = net_param_.mutable_layer(i);
+      for (int j = 0; j < layer_blobs_[i].size(); ++j) {
+        layer_blobs_[i][j]->ToProto(layer_param->add_blobs(), write_diff_);
+      }
+    }
+    WriteProtoToBinaryFileAtomic(net_param_, model_filename_);
+  }
+  for (int i = 0; i < history_.size(); ++i) {
+    history_[i]->ToProto(state_.add_history());
+  }
+  WriteProtoToBinaryFileAtomic(state_, state_filename_);
+  net_param_.Clear();
+  state_.Clear();
+  LOG(INFO) << "Snapshot " << state_filename_ << " written";
+}
+
+template <typename Dtype>
+void SnapshotWriter<Dtype>::WriteWeightsStream() {
+  // Written one layer at a time like Net::ToWeightsStream does, and renamed
+  // into place once complete.
+  const string temp_filename = model_filename_ + ".tmp";
+  WeightsStreamWriter writer(temp_filename);
+  writer.WriteHeader(net_param_);
+  LayerParameter layer_param;
+  for (int i = 0; i < layer_blobs_.size(); ++i) {
+    if (layer_blobs_[i].empty()) { continue; }
+    layer_param.Clear();
+    layer_param.set_name(net_param_.layer(i).name());
+    layer_param.set_type(net_param_.layer(i).type());
+    for (int j = 0; j < layer_blobs_[i].size(); ++j) {
+      layer_blobs_[i][j]->ToProto(layer_param.add_blobs(), write_diff_);
+    }
+    writer.WriteLayer(layer_param);
+  }
+  writer.Close();
+  CHECK_EQ(rename(temp_filename.c_str(), model_filename_.c_str()), 0)
+      << "Could not rename " << temp_filename << " to " << model_filename_;
 }
 
 template <typename Dtype>
 void Solver<Dtype>::Restore(const char* state_file) {
   SolverState state;
-  NetParameter net_param;
   ReadProtoFromBinaryFile(state_file, &state);
   if (state.has_learned_net()) {
-    ReadNetParamsFromBinaryFileOrDie(state.learned_net().c_str(), &net_param);
-    net_->CopyTrainedLayersFrom(net_param);
+    net_->CopyTrainedLayersFrom(state.learned_net());
   }
   iter_ = state.iter();
   current_step_ = state.current_step();
@@ -422,15 +837,33 @@ void SGDSolver<Dtype>::PreSolve() {
   for (int i = 0; i < net_params.size(); ++i) {
     const vector<int>& shape = net_params[i]->shape();
     history_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(shape)));
-    update_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(shape)));
-    temp_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(shape)));
   }
+#ifndef CPU_ONLY
+  // Only the GPU updates use update and temp; the CPU updates are fused.
+  if (Caffe::mode() == Caffe::GPU) {
+    for (int i = 0; i < net_params.size(); ++i) {
+      const vector<int>& shape = net_params[i]->shape();
+      update_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(shape)));
+      temp_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(shape)));
+    }
+  }
+#endif
 }
 
 template <typename Dtype>
-void SGDSolver<Dtype>::ClipGradients() {
+void SGDSolver<Dtype>::NormalizeGradients() {
+  if (this->accumulated_passes() == 1) { return; }
+  const Dtype accum_normalization = Dtype(1) / this->accumulated_passes();
+  const vector<shared_ptr<Blob<Dtype> > >& net_params = this->net_->params();
+  for (int i = 0; i < net_params.size(); ++i) {
+    net_params[i]->scale_diff(accum_normalization);
+  }
+}
+
+template <typename Dtype>
+Dtype SGDSolver<Dtype>::GetClipScale(const Dtype diff_scale) {
   const Dtype clip_gradients = this->param_.clip_gradients();
-  if (clip_gradients < 0) { return; }
+  if (clip_gradients < 0) { return Dtype(1); }
   const vector<shared_ptr<Blob<Dtype> > >& net_params = this->net_->params();
   Dtype sumsq_diff = 0;
   for (int i = 0; i < net_params.size(); ++i) {
@@ -438,73 +871,83 @@ void SGDSolver<Dtype>::ClipGradients() {
       sumsq_diff += net_params[i]->sumsq_diff();
     }
   }
-  const Dtype l2norm_diff = std::sqrt(sumsq_diff);
-  if (l2norm_diff > clip_gradients) {
-    Dtype scale_factor = clip_gradients / l2norm_diff;
-    LOG(INFO) << "Gradient clipping: scaling down gradients (L2 norm "
-        << l2norm_diff << " > " << clip_gradients << ") "
-        << "by scale factor " << scale_factor;
-    for (int i = 0; i < net_params.size(); ++i) {
-      if (this->net_->param_owners()[i] < 0) {
-        net_params[i]->scale_diff(scale_factor);
-      }
+  const Dtype l2norm_diff = std::sqrt(sumsq_diff) * diff_scale;
+  if (l2norm_diff <= clip_gradients) { return Dtype(1); }
+  Dtype scale_factor = clip_gradients / l2norm_diff;
+  LOG(INFO) << "Gradient clipping: scaling down gradients (L2 norm "
+      << l2norm_diff << " > " << clip_gradients << ") "
+      << "by scale factor " << scale_factor;
+  return scale_factor;
+}
+
+template <typename Dtype>
+void SGDSolver<Dtype>::ClipGradients() {
+  const Dtype scale_factor = GetClipScale(Dtype(1));
+  if (scale_factor == Dtype(1)) { return; }
+  const vector<shared_ptr<Blob<Dtype> > >& net_params = this->net_->params();
+  for (int i = 0; i < net_params.size(); ++i) {
+    if (this->net_->param_owners()[i] < 0) {
+      net_params[i]->scale_diff(scale_factor);
     }
   }
 }
 
+template <typename Dtype>
+void SGDSolver<Dtype>::GetLocalDecay(const int param_id, Dtype* l2_decay,
+    Dtype* l1_decay) {
+  const Dtype local_decay = this->param_.weight_decay() *
+      this->net_->params_weight_decay()[param_id];
+  const string& regularization_type = this->param_.regularization_type();
+  *l2_decay = 0;
+  *l1_decay = 0;
+  if (!local_decay) { return; }
+  if (regularization_type == "L2") {
+    *l2_decay = local_decay;
+  } else if (regularization_type == "L1") {
+    *l1_decay = local_decay;
+  } else {
+    LOG(FATAL) << "Unknown regularization type: " << regularization_type;
+  }
+}
+
 template <typename Dtype>
 void SGDSolver<Dtype>::ComputeUpdateValue() {
   const vector<shared_ptr<Blob<Dtype> > >& net_params = this->net_->params();
   const vector<float>& net_params_lr = this->net_->params_lr();
-  const vector<float>& net_params_weight_decay =
-      this->net_->params_weight_decay();
   // get the learning rate
   Dtype rate = GetLearningRate();
   if (this->param_.display() && this->iter_ % this->param_.display() == 0) {
     LOG(INFO) << "Iteration " << this->iter_ << ", lr = " << rate;
   }
-  ClipGradients();
   Dtype momentum = this->param_.momentum();
-  Dtype weight_decay = this->param_.weight_decay();
-  string regularization_type = this->param_.regularization_type();
   switch (Caffe::mode()) {
-  case Caffe::CPU:
+  case Caffe::CPU: {
+    // Clipping, weight decay, momentum and the copy to the diff are fused
+    // into a single pass over each parameter.
+    const Dtype accum_normalization = Dtype(1) / this->accumulated_passes();
+    const Dtype clip_scale = GetClipScale(accum_normalization);
     for (int param_id = 0; param_id < net_params.size(); ++param_id) {
-      // Compute the value to history, and then copy them to the blob's diff.
       Dtype local_rate = rate * net_params_lr[param_id];
-      Dtype local_decay = weight_decay * net_params_weight_decay[param_id];
-
-      if (local_decay) {
-        if (regularization_type == "L2") {
-          // add weight decay
-          caffe_axpy(net_params[param_id]->count(),
-              local_decay,
-              net_params[param_id]->cpu_data(),
-              net_params[param_id]->mutable_cpu_diff());
-        } else if (regularization_type == "L1") {
-          caffe_cpu_sign(net_params[param_id]->count(),
-              net_params[param_id]->cpu_data(),
-              temp_[param_id]->mutable_cpu_data());
-          caffe_axpy(net_params[param_id]->count(),
-              local_decay,
-              temp_[param_id]->cpu_data(),
-              net_params[param_id]->mutable_cpu_diff());
-        } else {
-          LOG(FATAL) << "Unknown regularization type: " << regularization_type;
-        }
-      }
-
-      caffe_cpu_axpby(net_params[param_id]->count(), local_rate,
-                net_params[param_id]->cpu_diff(), momentum,
-                history_[param_id]->mutable_cpu_data());
-      // copy
-      caffe_copy(net_params[param_id]->count(),
-          history_[param_id]->cpu_data(),
-          net_params[param_id]->mutable_cpu_diff());
+      Dtype l2_decay, l1_decay;
+      GetLocalDecay(param_id, &l2_decay, &l1_decay);
+      caffe_cpu_sgd_update(net_params[param_id]->count(),
+          net_params[param_id]->cpu_data(),
+          net_params[param_id]->mutable_cpu_diff(),
+          history_[param_id]->mutable_cpu_data(),
+          accum_normalization *
+          (this->net_->param_owners()[param_id] < 0 ? clip_scale : Dtype(1)),
+          l2_decay, l1_decay, local_rate, momentum);
     }
     break;
-  case Caffe::GPU:
+  }
+  case Caffe::GPU: {
 #ifndef CPU_ONLY
+    NormalizeGradients();
+    ClipGradients();
+    const vector<float>& net_params_weight_decay =
+        this->net_->params_weight_decay();
+    Dtype weight_decay = this->param_.weight_decay();
+    string regularization_type = this->param_.regularization_type();
     for (int param_id = 0; param_id < net_params.size(); ++param_id) {
       // Compute the value to history, and then copy them to the blob's diff.
       Dtype local_rate = rate * net_params_lr[param_id];
@@ -542,19 +985,16 @@ void SGDSolver<Dtype>::ComputeUpdateValue() {
     NO_GPU;
 #endif
     break;
+  }
   default:
     LOG(FATAL) << "Unknown caffe mode: " << Caffe::mode();
   }
 }
 
 template <typename Dtype>
-void SGDSolver<Dtype>::SnapshotSolverState(SolverState* state) {
-  state->clear_history();
-  for (int i = 0; i < history_.size(); ++i) {
-    // Add history
-    BlobProto* history_blob = state->add_history();
-    history_[i]->ToProto(history_blob);
-  }
+void SGDSolver<Dtype>::SnapshotSolverState(SolverState* state,
+    vector<shared_ptr<Blob<Dtype> > >* history) {
+  *history = history_;
 }
 
 template <typename Dtype>
@@ -571,66 +1011,38 @@ template <typename Dtype>
 void NesterovSolver<Dtype>::ComputeUpdateValue() {
   const vector<shared_ptr<Blob<Dtype> > >& net_params = this->net_->params();
   const vector<float>& net_params_lr = this->net_->params_lr();
-  const vector<float>& net_params_weight_decay =
-      this->net_->params_weight_decay();
   // get the learning rate
   Dtype rate = this->GetLearningRate();
   if (this->param_.display() && this->iter_ % this->param_.display() == 0) {
     LOG(INFO) << "Iteration " << this->iter_ << ", lr = " << rate;
   }
-  SGDSolver<Dtype>::ClipGradients();
   Dtype momentum = this->param_.momentum();
-  Dtype weight_decay = this->param_.weight_decay();
-  string regularization_type = this->param_.regularization_type();
   switch (Caffe::mode()) {
-  case Caffe::CPU:
+  case Caffe::CPU: {
+    const Dtype accum_normalization = Dtype(1) / this->accumulated_passes();
+    const Dtype clip_scale = this->GetClipScale(accum_normalization);
     for (int param_id = 0; param_id < net_params.size(); ++param_id) {
-      // save history momentum for stepping back
-      caffe_copy(net_params[param_id]->count(),
-          this->history_[param_id]->cpu_data(),
-          this->update_[param_id]->mutable_cpu_data());
-
       Dtype local_rate = rate * net_params_lr[param_id];
-      Dtype local_decay = weight_decay * net_params_weight_decay[param_id];
-
-      if (local_decay) {
-        if (regularization_type == "L2") {
-          // add weight decay
-          caffe_axpy(net_params[param_id]->count(),
-              local_decay,
-              net_params[param_id]->cpu_data(),
-              net_params[param_id]->mutable_cpu_diff());
-        } else if (regularization_type == "L1") {
-          caffe_cpu_sign(net_params[param_id]->count(),
-              net_params[param_id]->cpu_data(),
-              this->temp_[param_id]->mutable_cpu_data());
-          caffe_axpy(net_params[param_id]->count(),
-              local_decay,
-              this->temp_[param_id]->cpu_data(),
-              net_params[param_id]->mutable_cpu_diff());
-        } else {
-          LOG(FATAL) << "Unknown regularization type: " << regularization_type;
-        }
-      }
-
-      // update history
-      caffe_cpu_axpby(net_params[param_id]->count(), local_rate,
-                net_params[param_id]->cpu_diff(), momentum,
-                this->history_[param_id]->mutable_cpu_data());
-
-      // compute udpate: step back then over step
-      caffe_cpu_axpby(net_params[param_id]->count(), Dtype(1) + momentum,
-          this->history_[param_id]->cpu_data(), -momentum,
-          this->update_[param_id]->mutable_cpu_data());
-
-      // copy
-      caffe_copy(net_params[param_id]->count(),
-          this->update_[param_id]->cpu_data(),
-          net_params[param_id]->mutable_cpu_diff());
+      Dtype l2_decay, l1_decay;
+      this->GetLocalDecay(param_id, &l2_decay, &l1_decay);
+      caffe_cpu_nesterov_update(net_params[param_id]->count(),
+          net_params[param_id]->cpu_data(),
+          net_params[param_id]->mutable_cpu_diff(),
+          this->history_[param_id]->mutable_cpu_data(),
+          accum_normalization *
+          (this->net_->param_owners()[param_id] < 0 ? clip_scale : Dtype(1)),
+          l2_decay, l1_decay, local_rate, momentum);
     }
     break;
-  case Caffe::GPU:
+  }
+  case Caffe::GPU: {
 #ifndef CPU_ONLY
+    this->NormalizeGradients();
+    SGDSolver<Dtype>::ClipGradients();
+    const vector<float>& net_params_weight_decay =
+        this->net_->params_weight_decay();
+    Dtype weight_decay = this->param_.weight_decay();
+    string regularization_type = this->param_.regularization_type();
     for (int param_id = 0; param_id < net_params.size(); ++param_id) {
       // save history momentum for stepping back
       caffe_copy(net_params[param_id]->count(),
@@ -679,6 +1091,7 @@ void NesterovSolver<Dtype>::ComputeUpdateValue() {
     NO_GPU;
 #endif
     break;
+  }
   default:
     LOG(FATAL) << "Unknown caffe mode: " << Caffe::mode();
   }
@@ -688,75 +1101,38 @@ template <typename Dtype>
 void AdaGradSolver<Dtype>::ComputeUpdateValue() {
   const vector<shared_ptr<Blob<Dtype> > >& net_params = this->net_->params();
   const vector<float>& net_params_lr = this->net_->params_lr();
-  const vector<float>& net_params_weight_decay =
-      this->net_->params_weight_decay();
   // get the learning rate
   Dtype rate = this->GetLearningRate();
   Dtype delta = this->param_.delta();
   if (this->param_.display() && this->iter_ % this->param_.display() == 0) {
     LOG(INFO) << "Iteration " << this->iter_ << ", lr = " << rate;
   }
-  SGDSolver<Dtype>::ClipGradients();
-  Dtype weight_decay = this->param_.weight_decay();
-  string regularization_type = this->param_.regularization_type();
   switch (Caffe::mode()) {
-  case Caffe::CPU:
+  case Caffe::CPU: {
+    const Dtype accum_normalization = Dtype(1) / this->accumulated_passes();
+    const Dtype clip_scale = this->GetClipScale(accum_normalization);
     for (int param_id = 0; param_id < net_params.size(); ++param_id) {
       Dtype local_rate = rate * net_params_lr[param_id];
-      Dtype local_decay = weight_decay * net_params_weight_decay[param_id];
-
-      if (local_decay) {
-        if (regularization_type == "L2") {
-          // add weight decay
-          caffe_axpy(net_params[param_id]->count(),
-              local_decay,
-              net_params[param_id]->cpu_data(),
-              net_params[param_id]->mutable_cpu_diff());
-        } else if (regularization_type == "L1") {
-          caffe_cpu_sign(net_params[param_id]->count(),
-              net_params[param_id]->cpu_data(),
-              this->temp_[param_id]->mutable_cpu_data());
-          caffe_axpy(net_params[param_id]->count(),
-              local_decay,
-              this->temp_[param_id]->cpu_data(),
-              net_params[param_id]->mutable_cpu_diff());
-        } else {
-          LOG(FATAL) << "Unknown regularization type: " << regularization_type;
-        }
-      }
-
-      // compute square of gradient in update
-      caffe_powx(net_params[param_id]->count(),
-          net_params[param_id]->cpu_diff(), Dtype(2),
-          this->update_[param_id]->mutable_cpu_data());
-
-      // update history
-      caffe_add(net_params[param_id]->count(),
-          this->update_[param_id]->cpu_data(),
-          this->history_[param_id]->cpu_data(),
-          this->history_[param_id]->mutable_cpu_data());
-
-      // prepare update
-      caffe_powx(net_params[param_id]->count(),
-                this->history_[param_id]->cpu_data(), Dtype(0.5),
-                this->update_[param_id]->mutable_cpu_data());
-
-      caffe_add_scalar(net_params[param_id]->count(),
-                delta, this->update_[param_id]->mutable_cpu_data());
-
-      caffe_div(net_params[param_id]->count(),
-                net_params[param_id]->cpu_diff(),
-                this->update_[param_id]->cpu_data(),
-                this->update_[param_id]->mutable_cpu_data());
-
-      // scale and copy
-      caffe_cpu_axpby(net_params[param_id]->count(), local_rate,
-          this->update_[param_id]->cpu_data(), Dtype(0),
-          net_params[param_id]->mutable_cpu_diff());
+      Dtype l2_decay, l1_decay;
+      this->GetLocalDecay(param_id, &l2_decay, &l1_decay);
+      caffe_cpu_adagrad_update(net_params[param_id]->count(),
+          net_params[param_id]->cpu_data(),
+          net_params[param_id]->mutable_cpu_diff(),
+          this->history_[param_id]->mutable_cpu_data(),
+          accum_normalization *
+          (this->net_->param_owners()[param_id] < 0 ? clip_scale : Dtype(1)),
+          l2_decay, l1_decay, local_rate, delta);
     }
     break;
-  case Caffe::GPU:
+  }
+  case Caffe::GPU: {
 #ifndef CPU_ONLY
+    this->NormalizeGradients();
+    SGDSolver<Dtype>::ClipGradients();
+    const vector<float>& net_params_weight_decay =
+        this->net_->params_weight_decay();
+    Dtype weight_decay = this->param_.weight_decay();
+    string regularization_type = this->param_.regularization_type();
     for (int param_id = 0; param_id < net_params.size(); ++param_id) {
       Dtype local_rate = rate * net_params_lr[param_id];
       Dtype local_decay = weight_decay * net_params_weight_decay[param_id];
@@ -814,11 +1190,13 @@ void AdaGradSolver<Dtype>::ComputeUpdateValue() {
     NO_GPU;
 #endif
     break;
+  }
   default:
     LOG(FATAL) << "Unknown caffe mode: " << Caffe::mode();
   }
 }
 
+INSTANTIATE_CLASS(SnapshotWriter);
 INSTANTIATE_CLASS(Solver);
 INSTANTIATE_CLASS(SGDSolver);
 INSTANTIATE_CLASS(NesterovSolver);
@@ -0,0 +1,153 @@
+#include <unistd.h>
+
+#include <boost/thread.hpp>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/util/allreduce.hpp"
+#include "caffe/util/io.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class AllreduceTest : public ::testing::Test {
+ protected:
+  AllreduceTest() : world_size_(3), count_(20), chunk_size_(7) {
+    // Ranks 0, 1 and 2 hold 1, 2, 3 times the sequence 0, 1, 2, ...
+    data_.resize(world_size_);
+    for (int r = 0; r < world_size_; ++r) {
+      for (int i = 0; i < count_; ++i) {
+        data_[r].push_back(Dtype((r + 1) * i));
+      }
+    }
+    std::ostringstream name;
+    name << "caffe_test_allreduce_" << getpid();
+    shm_name_ = name.str();
+    MakeTempDir(&socket_path_);
+    socket_path_ += "/socket";
+  }
+
+  shared_ptr<Allreduce<Dtype> > Connect(const int rank, const bool shm) {
+    if (shm) {
+      return shared_ptr<Allreduce<Dtype> >(new ShmAllreduce<Dtype>(rank,
+          world_size_, shm_name_, chunk_size_));
+    }
+    return shared_ptr<Allreduce<Dtype> >(new SocketAllreduce<Dtype>(rank,
+        world_size_, socket_path_, chunk_size_));
+  }
+
+  void RunRank(const int rank, const bool shm, const bool broadcast) {
+    shared_ptr<Allreduce<Dtype> > allreduce = Connect(rank, shm);
+    EXPECT_EQ(rank, allreduce->rank());
+    EXPECT_EQ(world_size_, allreduce->world_size());
+    if (broadcast) {
+      allreduce->Broadcast(&data_[rank][0], count_);
+    } else {
+      allreduce->Sum(&data_[rank][0], count_);
+    }
+  }
+
+  // Runs each rank on its own thread, as if in its own process.
+  void Run(const bool shm, const bool broadcast) {
+    vector<shared_ptr<boost::thread> > threads;
+    for (int r = 1; r < world_size_; ++r) {
+      threads.push_back(shared_ptr<boost::thread>(new boost::thread(
+          &AllreduceTest<Dtype>::RunRank, this, r, shm, broadcast)));
+    }
+    RunRank(0, shm, broadcast);
+    for (int i = 0; i < threads.size(); ++i) {
+      threads[i]->join();
+    }
+    const int scale = broadcast ? 1 : 6;
+    for (int r = 0; r < world_size_; ++r) {
+      for (int i = 0; i < count_; ++i) {
+        EXPECT_EQ(Dtype(scale * i), data_[r][i]);
+      }
+    }
+  }
+
+  int world_size_, count_, chunk_size_;
+  vector<vector<Dtype> > data_;
+  string shm_name_, socket_path_;
+};
+
+TYPED_TEST_CASE(AllreduceTest, TestDtypes);
+
+TYPED_TEST(AllreduceTest, TestShmSum) {
+  this->Run(true, false);
+}
+
+TYPED_TEST(AllreduceTest, TestShmBroadcast) {
+  this->Run(true, true);
+}
+
+TYPED_TEST(AllreduceTest, TestSocketSum) {
+  this->Run(false, false);
+}
+
+TYPED_TEST(AllreduceTest, TestSocketBroadcast) {
+  this->Run(false, true);
+}
+
+template <typename Dtype>
+class BucketedAllreduceTest : public AllreduceTest<Dtype> {
+ protected:
+  void RunBucketedRank(const int rank) {
+    shared_ptr<Allreduce<Dtype> > allreduce = this->Connect(rank, true);
+    // Buckets of at most 10 values: {0, 1}, {2} and {3}.
+    const int kCounts[] = {4, 6, 12, 3};
+    const int num_params = sizeof(kCounts) / sizeof(kCounts[0]);
+    vector<shared_ptr<Blob<Dtype> > > blobs;
+    vector<Blob<Dtype>*> params;
+    for (int i = 0; i < num_params; ++i) {
+      blobs.push_back(shared_ptr<Blob<Dtype> >(
+          new Blob<Dtype>(vector<int>(1, kCounts[i]))));
+      params.push_back(blobs[i].get());
+    }
+    BucketedAllreduce<Dtype> bucketed(allreduce, params, 10);
+    EXPECT_EQ(3, bucketed.num_buckets());
+    for (int iter = 0; iter < 2; ++iter) {
+      for (int i = 0; i < num_params; ++i) {
+        Dtype* diff = params[i]->mutable_cpu_diff();
+        for (int j = 0; j < params[i]->count(); ++j) {
+          diff[j] = (rank + 1) * (iter + i + j);
+        }
+        bucketed.ParamReady(i);
+      }
+      bucketed.Finish();
+      for (int i = 0; i < num_params; ++i) {
+        for (int j = 0; j < params[i]->count(); ++j) {
+          EXPECT_EQ(Dtype(6 * (iter + i + j)), params[i]->cpu_diff()[j]);
+        }
+      }
+    }
+  }
+
+  void RunBucketed() {
+    vector<shared_ptr<boost::thread> > threads;
+    for (int r = 1; r < this->world_size_; ++r) {
+      threads.push_back(shared_ptr<boost::thread>(new boost::thread(
+          &BucketedAllreduceTest<Dtype>::RunBucketedRank, this, r)));
+    }
+    RunBucketedRank(0);
+    for (int i = 0; i < threads.size(); ++i) {
+      threads[i]->join();
+    }
+  }
+};
+
+TYPED_TEST_CASE(BucketedAllreduceTest, TestDtypes);
+
+TYPED_TEST(BucketedAllreduceTest, TestSum) {
+  this->RunBucketed();
+}
+
+}  // namespace caffe
@@ -6,6 +6,8 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/util/half.hpp"
+#include "caffe/util/sparse.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
@@ -105,6 +107,134 @@ TYPED_TEST(BlobSimpleTest, TestLegacyBlobProtoShapeEquals) {
   EXPECT_FALSE(this->blob_->ShapeEquals(blob_proto));
 }
 
+TYPED_TEST(BlobSimpleTest, TestHalfRoundTrip) {
+  this->blob_preshaped_->mutable_cpu_diff();
+  TypeParam* data = this->blob_preshaped_->mutable_cpu_data();
+  const int count = this->blob_preshaped_->count();
+  for (int i = 0; i < count; ++i) {
+    // Integers up to 2048 are exact in half precision.
+    data[i] = i - 60;
+  }
+  this->blob_preshaped_->ToHalf();
+  EXPECT_TRUE(this->blob_preshaped_->is_half());
+  // The data survives a trip through BlobProto in half precision.
+  BlobProto proto;
+  this->blob_preshaped_->ToProto(&proto);
+  EXPECT_EQ(0, proto.data_size());
+  EXPECT_EQ(count * 2, proto.half_data().size());
+  Blob<TypeParam> loaded;
+  loaded.FromProto(proto);
+  EXPECT_FALSE(loaded.is_half());
+  for (int i = 0; i < count; ++i) {
+    EXPECT_EQ(i - 60, loaded.cpu_data()[i]);
+  }
+  // Float access restores the data.
+  data = this->blob_preshaped_->mutable_cpu_data();
+  EXPECT_FALSE(this->blob_preshaped_->is_half());
+  for (int i = 0; i < count; ++i) {
+    EXPECT_EQ(i - 60, data[i]);
+  }
+}
+
+TYPED_TEST(BlobSimpleTest, TestHalfShared) {
+  TypeParam* data = this->blob_preshaped_->mutable_cpu_data();
+  const int count = this->blob_preshaped_->count();
+  for (int i = 0; i < count; ++i) {
+    data[i] = i;
+  }
+  Blob<TypeParam> shared(this->blob_preshaped_->shape());
+  shared.ShareData(*this->blob_preshaped_);
+  // Converting either Blob converts the data they share.
+  shared.ToHalf();
+  EXPECT_TRUE(this->blob_preshaped_->is_half());
+  EXPECT_EQ(this->blob_preshaped_->cpu_half_data(), shared.cpu_half_data());
+  // The norms read the half data in place.
+  EXPECT_EQ(count * (count - 1) / 2, this->blob_preshaped_->asum_data());
+  EXPECT_EQ((count - 1) * count * (2 * count - 1) / 6, shared.sumsq_data());
+  EXPECT_TRUE(shared.is_half());
+  // A Blob sharing half data shares it too.
+  Blob<TypeParam> late(this->blob_preshaped_->shape());
+  late.ShareData(shared);
+  EXPECT_TRUE(late.is_half());
+  EXPECT_EQ(shared.cpu_half_data(), late.cpu_half_data());
+  // Restoring the float data drops the half data of every sharing Blob.
+  late.RestoreFromHalf();
+  EXPECT_FALSE(this->blob_preshaped_->is_half());
+  EXPECT_FALSE(shared.is_half());
+  EXPECT_EQ(count - 1, shared.cpu_data()[count - 1]);
+  EXPECT_EQ(this->blob_preshaped_->cpu_data(), late.cpu_data());
+  // As does writing in float.
+  shared.ToHalf();
+  this->blob_preshaped_->mutable_cpu_data()[0] = 7;
+  EXPECT_FALSE(shared.is_half());
+  EXPECT_FALSE(late.is_half());
+  EXPECT_EQ(7, late.cpu_data()[0]);
+}
+
+TYPED_TEST(BlobSimpleTest, TestSparseFromProto) {
+  BlobProto proto;
+  proto.mutable_shape()->add_dim(2);
+  proto.mutable_shape()->add_dim(3);
+  proto.add_data_index(1);
+  proto.add_data(5);
+  proto.add_data_index(4);
+  proto.add_data(-2);
+  this->blob_->FromProto(proto);
+  const TypeParam expected[] = {0, 5, 0, 0, -2, 0};
+  ASSERT_EQ(6, this->blob_->count());
+  for (int i = 0; i < 6; ++i) {
+    EXPECT_EQ(expected[i], this->blob_->cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(BlobSimpleTest, TestSparseFromProtoHalf) {
+  BlobProto proto;
+  proto.mutable_shape()->add_dim(2);
+  proto.mutable_shape()->add_dim(3);
+  proto.add_data_index(1);
+  proto.add_data(5);
+  proto.add_data_index(4);
+  proto.add_data(-2);
+  this->blob_->FromProto(proto);
+  this->blob_->ToHalf();
+  // Loading a sparse proto into a half Blob keeps it in half precision.
+  this->blob_->FromProto(proto);
+  ASSERT_TRUE(this->blob_->is_half());
+  TypeParam data[6];
+  caffe_cpu_half2float(6, this->blob_->cpu_half_data(), data);
+  const TypeParam expected[] = {0, 5, 0, 0, -2, 0};
+  for (int i = 0; i < 6; ++i) {
+    EXPECT_EQ(expected[i], data[i]);
+  }
+}
+
+TYPED_TEST(BlobSimpleTest, TestPruneFromProto) {
+  BlobProto proto;
+  proto.mutable_shape()->add_dim(2);
+  proto.mutable_shape()->add_dim(3);
+  const float values[] = {0.5, -3, 0.1, 0, 2, -0.2};
+  for (int i = 0; i < 6; ++i) {
+    proto.add_data(values[i]);
+  }
+  BlobProto sparse(proto);
+  EXPECT_EQ(4, PruneBlobProto(1, &sparse));
+  EXPECT_EQ(2, sparse.data_index_size());
+  this->blob_->FromProto(sparse);
+  const TypeParam expected[] = {0, -3, 0, 0, 2, 0};
+  ASSERT_EQ(6, this->blob_->count());
+  for (int i = 0; i < 6; ++i) {
+    EXPECT_EQ(expected[i], this->blob_->cpu_data()[i]);
+  }
+  // Pruning every entry must still leave a proto that loads.
+  BlobProto zeros(proto);
+  EXPECT_EQ(6, PruneBlobProto(10, &zeros));
+  this->blob_->FromProto(zeros);
+  ASSERT_EQ(6, this->blob_->count());
+  for (int i = 0; i < 6; ++i) {
+    EXPECT_EQ(0, this->blob_->cpu_data()[i]);
+  }
+}
+
 template <typename TypeParam>
 class BlobMathTest : public MultiDeviceTest<TypeParam> {
   typedef typename TypeParam::Dtype Dtype;
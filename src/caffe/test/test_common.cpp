@@ -1,3 +1,5 @@
+#include <boost/thread.hpp>
+
 #include <cstring>
 
 #include "gtest/gtest.h"
@@ -44,6 +46,34 @@ TEST_F(CommonTest, TestRandSeedCPU) {
   }
 }
 
+static void ReseedAndDraw(int* data) {
+  Caffe::set_random_seed(1702);
+  caffe_rng_bernoulli(10, 0.5, data);
+}
+
+TEST_F(CommonTest, TestRandSeedPerThreadCPU) {
+  // Seeding and drawing on another thread does not disturb this thread's
+  // stream.
+  SyncedMemory data_a(10 * sizeof(int));
+  SyncedMemory data_b(10 * sizeof(int));
+  SyncedMemory data_thread(10 * sizeof(int));
+  Caffe::set_random_seed(1701);
+  caffe_rng_bernoulli(10, 0.5, static_cast<int*>(data_a.mutable_cpu_data()));
+  caffe_rng_bernoulli(10, 0.5, static_cast<int*>(data_a.mutable_cpu_data()));
+
+  Caffe::set_random_seed(1701);
+  caffe_rng_bernoulli(10, 0.5, static_cast<int*>(data_b.mutable_cpu_data()));
+  boost::thread thread(&ReseedAndDraw,
+      static_cast<int*>(data_thread.mutable_cpu_data()));
+  thread.join();
+  caffe_rng_bernoulli(10, 0.5, static_cast<int*>(data_b.mutable_cpu_data()));
+
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_EQ(static_cast<const int*>(data_a.cpu_data())[i],
+        static_cast<const int*>(data_b.cpu_data())[i]);
+  }
+}
+
 #ifndef CPU_ONLY  // GPU Caffe singleton test.
 
 TEST_F(CommonTest, TestRandSeedGPU) {
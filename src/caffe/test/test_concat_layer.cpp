@@ -154,6 +154,86 @@ TYPED_TEST(ConcatLayerTest, TestForwardChannels) {
   }
 }
 
+TYPED_TEST(ConcatLayerTest, TestForwardNumSharedViews) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_concat_param()->set_axis(0);
+  ConcatLayer<Dtype> layer(layer_param);
+  layer.set_share_views(true);
+  layer.SetUp(this->blob_bottom_vec_1_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_1_, this->blob_top_vec_);
+  const int count_0 = this->blob_bottom_0_->count();
+  const int count_2 = this->blob_bottom_2_->count();
+  if (Caffe::mode() == Caffe::CPU) {
+    // After the first pass the bottoms live in their slots of the top.
+    EXPECT_EQ(this->blob_top_->cpu_data(), this->blob_bottom_0_->cpu_data());
+    EXPECT_EQ(this->blob_top_->cpu_data() + count_0,
+              this->blob_bottom_2_->cpu_data());
+  }
+  // Writing the bottoms and forwarding again gives the new concatenation.
+  caffe_set(count_0, Dtype(4), this->blob_bottom_0_->mutable_cpu_data());
+  caffe_set(count_2, Dtype(5), this->blob_bottom_2_->mutable_cpu_data());
+  layer.Reshape(this->blob_bottom_vec_1_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_1_, this->blob_top_vec_);
+  const Dtype* top_data = this->blob_top_->cpu_data();
+  for (int i = 0; i < count_0; ++i) {
+    EXPECT_EQ(Dtype(4), top_data[i]);
+  }
+  for (int i = 0; i < count_2; ++i) {
+    EXPECT_EQ(Dtype(5), top_data[count_0 + i]);
+  }
+}
+
+TYPED_TEST(ConcatLayerTest, TestForwardNumSharedViewsReshape) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_concat_param()->set_axis(0);
+  ConcatLayer<Dtype> layer(layer_param);
+  layer.set_share_views(true);
+  layer.SetUp(this->blob_bottom_vec_1_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_1_, this->blob_top_vec_);
+  // Grow the first bottom and shrink the second by as much, so that the top
+  // keeps its size but the slot of the second bottom moves onto the data its
+  // producer wrote in the old slot.
+  this->blob_bottom_0_->Reshape(3, 3, 6, 5);
+  this->blob_bottom_2_->Reshape(4, 3, 6, 5);
+  const int count_0 = this->blob_bottom_0_->count();
+  const int count_2 = this->blob_bottom_2_->count();
+  caffe_set(count_0, Dtype(4), this->blob_bottom_0_->mutable_cpu_data());
+  caffe_set(count_2, Dtype(5), this->blob_bottom_2_->mutable_cpu_data());
+  layer.Reshape(this->blob_bottom_vec_1_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_1_, this->blob_top_vec_);
+  ASSERT_EQ(count_0 + count_2, this->blob_top_->count());
+  const Dtype* top_data = this->blob_top_->cpu_data();
+  for (int i = 0; i < count_0; ++i) {
+    EXPECT_EQ(Dtype(4), top_data[i]);
+  }
+  for (int i = 0; i < count_2; ++i) {
+    EXPECT_EQ(Dtype(5), top_data[count_0 + i]);
+  }
+}
+
+TYPED_TEST(ConcatLayerTest, TestForwardChannelsSharedViewsFallback) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ConcatLayer<Dtype> layer(layer_param);
+  layer.set_share_views(true);
+  layer.SetUp(this->blob_bottom_vec_0_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_0_, this->blob_top_vec_);
+  // With num > 1 the channel slots are strided, so the bottoms are copied.
+  EXPECT_NE(this->blob_top_->cpu_data(), this->blob_bottom_0_->cpu_data());
+  for (int n = 0; n < this->blob_top_->num(); ++n) {
+    for (int c = 0; c < this->blob_top_->channels(); ++c) {
+      for (int h = 0; h < this->blob_top_->height(); ++h) {
+        for (int w = 0; w < this->blob_top_->width(); ++w) {
+          EXPECT_EQ(this->blob_top_->data_at(n, c, h, w),
+              c < 3 ? Dtype(1) : Dtype(2));
+        }
+      }
+    }
+  }
+}
+
 TYPED_TEST(ConcatLayerTest, TestGradientNum) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
@@ -6,6 +6,7 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/util/half.hpp"
 #include "caffe/vision_layers.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -217,6 +218,76 @@ TYPED_TEST(ConvolutionLayerTest, TestSimpleConvolution) {
   }
 }
 
+TYPED_TEST(ConvolutionLayerTest, TestConvolutionInt8) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.set_phase(TEST);
+  layer_param.mutable_quantization_param()->set_precision(
+      QuantizationParameter_Precision_INT8);
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->set_kernel_size(3);
+  convolution_param->set_stride(2);
+  convolution_param->set_pad(1);
+  convolution_param->set_num_output(4);
+  convolution_param->set_group(1);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("constant");
+  convolution_param->mutable_bias_filler()->set_value(0.1);
+  shared_ptr<Layer<Dtype> > layer(
+      new ConvolutionLayer<Dtype>(layer_param));
+  layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  // Check against the float reference convolution, up to quantization error.
+  caffe_conv(this->blob_bottom_, convolution_param, layer->blobs(),
+      this->MakeReferenceTop(this->blob_top_));
+  const Dtype* top_data = this->blob_top_->cpu_data();
+  const Dtype* ref_top_data = this->ref_blob_top_->cpu_data();
+  const Dtype tolerance = 5e-2 * caffe_cpu_absmax(this->blob_top_->count(),
+      ref_top_data);
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(top_data[i], ref_top_data[i], tolerance);
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestConvolutionFP16) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Half precision weights are only read on the CPU.
+  if (Caffe::mode() != Caffe::CPU) { return; }
+  LayerParameter layer_param;
+  layer_param.set_phase(TEST);
+  layer_param.mutable_quantization_param()->set_precision(
+      QuantizationParameter_Precision_FP16);
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->set_kernel_size(3);
+  convolution_param->set_stride(2);
+  convolution_param->set_num_output(3);
+  convolution_param->set_group(3);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("constant");
+  convolution_param->mutable_bias_filler()->set_value(0.1);
+  shared_ptr<Layer<Dtype> > layer(
+      new ConvolutionLayer<Dtype>(layer_param));
+  layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  // Convert the weights as Net::Init does.
+  layer->blobs()[0]->ToHalf();
+  layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  // The reference reads the weights back in float, rounded to half precision,
+  // so the two should agree up to summation order.
+  vector<shared_ptr<Blob<Dtype> > > weights(layer->blobs());
+  weights[0].reset(new Blob<Dtype>(layer->blobs()[0]->shape()));
+  caffe_cpu_half2float(weights[0]->count(), layer->blobs()[0]->cpu_half_data(),
+      weights[0]->mutable_cpu_data());
+  caffe_conv(this->blob_bottom_, convolution_param, weights,
+      this->MakeReferenceTop(this->blob_top_));
+  const Dtype* top_data = this->blob_top_->cpu_data();
+  const Dtype* ref_top_data = this->ref_blob_top_->cpu_data();
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(top_data[i], ref_top_data[i], 1e-4);
+  }
+}
+
 TYPED_TEST(ConvolutionLayerTest, Test1x1Convolution) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
@@ -104,6 +104,31 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     }
   }
 
+  // With shard_count shards of batch_size 1, shard shard_id reads every
+  // shard_count-th record, starting at record shard_id.
+  void TestReadShard() {
+    const int kShardCount = 2;
+    for (int shard_id = 0; shard_id < kShardCount; ++shard_id) {
+      LayerParameter param;
+      param.set_phase(TRAIN);
+      DataParameter* data_param = param.mutable_data_param();
+      data_param->set_batch_size(1);
+      data_param->set_source(filename_->c_str());
+      data_param->set_backend(backend_);
+      data_param->set_shard_count(kShardCount);
+      data_param->set_shard_id(shard_id);
+
+      DataLayer<Dtype> layer(param);
+      layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+      for (int iter = 0; iter < 10; ++iter) {
+        layer.Forward(blob_bottom_vec_, blob_top_vec_);
+        EXPECT_EQ((shard_id + iter * kShardCount) % 5,
+                  blob_top_label_->cpu_data()[0])
+            << "debug: shard " << shard_id << " iter " << iter;
+      }
+    }
+  }
+
   void TestReshape(DataParameter_DB backend) {
     const int num_inputs = 5;
     // Save data of varying shapes.
@@ -354,6 +379,12 @@ TYPED_TEST(DataLayerTest, TestReadLevelDB) {
   this->TestRead();
 }
 
+TYPED_TEST(DataLayerTest, TestReadShardLevelDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LEVELDB);
+  this->TestReadShard();
+}
+
 TYPED_TEST(DataLayerTest, TestReshapeLevelDB) {
   this->TestReshape(DataParameter_DB_LEVELDB);
 }
@@ -392,6 +423,12 @@ TYPED_TEST(DataLayerTest, TestReadLMDB) {
   this->TestRead();
 }
 
+TYPED_TEST(DataLayerTest, TestReadShardLMDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  this->TestReadShard();
+}
+
 TYPED_TEST(DataLayerTest, TestReshapeLMDB) {
   this->TestReshape(DataParameter_DB_LMDB);
 }
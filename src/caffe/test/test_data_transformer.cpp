@@ -10,6 +10,7 @@
 #include "caffe/filler.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/io.hpp"
+#include "caffe/util/math_functions.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
@@ -352,4 +353,243 @@ TYPED_TEST(DataTransformTest, TestMeanFile) {
   }
 }
 
+TYPED_TEST(DataTransformTest, TestTransformImages) {
+  TransformationParameter transform_param;
+  transform_param.add_mean_value(1);
+  transform_param.add_mean_value(2);
+  transform_param.set_scale(0.5);
+  const int channels = 2;
+  const int height = 3;
+  const int width = 4;
+  // One image of the net input size and one twice as large, whose 2 x 2
+  // blocks hold the same values and so resize to those of the first.
+  vector<int> shape(3);
+  shape[0] = height;
+  shape[1] = width;
+  shape[2] = channels;
+  Blob<TypeParam> image(shape);
+  shape[0] *= 2;
+  shape[1] *= 2;
+  Blob<TypeParam> large_image(shape);
+  for (int h = 0; h < 2 * height; ++h) {
+    for (int w = 0; w < 2 * width; ++w) {
+      for (int c = 0; c < channels; ++c) {
+        const TypeParam value = ((h / 2) * width + w / 2) * channels + c;
+        large_image.mutable_cpu_data()[(h * 2 * width + w) * channels + c] =
+            value;
+        if (h % 2 == 0 && w % 2 == 0) {
+          image.mutable_cpu_data()[((h / 2) * width + w / 2) * channels + c] =
+              value;
+        }
+      }
+    }
+  }
+  vector<Blob<TypeParam>*> images;
+  images.push_back(&image);
+  images.push_back(&large_image);
+  vector<int> channel_swap;
+  channel_swap.push_back(1);
+  channel_swap.push_back(0);
+  Blob<TypeParam> blob(1, channels, height, width);
+  DataTransformer<TypeParam> transformer(transform_param, TEST);
+  transformer.InitRand();
+  transformer.TransformImages(images, height, width, false, channel_swap, 2,
+      &blob, 2);
+  ASSERT_EQ(2, blob.num());
+  EXPECT_EQ(channels, blob.channels());
+  for (int n = 0; n < 2; ++n) {
+    for (int c = 0; c < channels; ++c) {
+      for (int h = 0; h < height; ++h) {
+        for (int w = 0; w < width; ++w) {
+          const TypeParam value = (h * width + w) * channels + 1 - c;
+          EXPECT_NEAR((value * 2 - (c + 1)) * 0.5,
+              blob.data_at(n, c, h, w), 1e-4);
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(DataTransformTest, TestTransformImagesResize) {
+  TransformationParameter transform_param;
+  vector<int> shape(3);
+  shape[0] = 2;
+  shape[1] = 2;
+  shape[2] = 1;
+  Blob<TypeParam> image(shape);
+  for (int j = 0; j < 4; ++j) {
+    image.mutable_cpu_data()[j] = j;
+  }
+  vector<Blob<TypeParam>*> images(1, &image);
+  Blob<TypeParam> blob(1, 1, 4, 4);
+  DataTransformer<TypeParam> transformer(transform_param, TEST);
+  transformer.InitRand();
+  transformer.TransformImages(images, 4, 4, false, vector<int>(), 1, &blob,
+      1);
+  // Pixel centers are aligned, so the outer pixels keep the corner values.
+  const TypeParam expected_row[] = { 0, 0.25, 0.75, 1 };
+  for (int w = 0; w < 4; ++w) {
+    EXPECT_NEAR(expected_row[w], blob.data_at(0, 0, 0, w), 1e-5);
+    EXPECT_NEAR(expected_row[w] + 2, blob.data_at(0, 0, 3, w), 1e-5);
+  }
+  EXPECT_NEAR(0.5, blob.data_at(0, 0, 1, 0), 1e-5);
+}
+
+TYPED_TEST(DataTransformTest, TestTransformImagesOversample) {
+  TransformationParameter transform_param;
+  const int num = 3;
+  const int height = 4;
+  const int width = 5;
+  const int crop_height = 2;
+  const int crop_width = 3;
+  vector<int> shape(3);
+  shape[0] = height;
+  shape[1] = width;
+  shape[2] = 1;
+  vector<shared_ptr<Blob<TypeParam> > > image_blobs;
+  vector<Blob<TypeParam>*> images;
+  for (int n = 0; n < num; ++n) {
+    image_blobs.push_back(shared_ptr<Blob<TypeParam> >(
+        new Blob<TypeParam>(shape)));
+    images.push_back(image_blobs.back().get());
+    for (int j = 0; j < height * width; ++j) {
+      images[n]->mutable_cpu_data()[j] = n * 100 + j;
+    }
+  }
+  Blob<TypeParam> blob(1, 1, crop_height, crop_width);
+  DataTransformer<TypeParam> transformer(transform_param, TEST);
+  transformer.InitRand();
+  transformer.TransformImages(images, height, width, true, vector<int>(), 1,
+      &blob, 2);
+  ASSERT_EQ(num * 10, blob.num());
+  // The corners, the center and their mirrors, as caffe.io.oversample.
+  const int h_offs[] = { 0, 0, 2, 2, 1 };
+  const int w_offs[] = { 0, 2, 0, 2, 1 };
+  for (int n = 0; n < num; ++n) {
+    for (int k = 0; k < 10; ++k) {
+      for (int h = 0; h < crop_height; ++h) {
+        for (int w = 0; w < crop_width; ++w) {
+          const int image_w = k < 5 ? w : crop_width - 1 - w;
+          const TypeParam expected = n * 100 +
+              (h + h_offs[k % 5]) * width + image_w + w_offs[k % 5];
+          EXPECT_EQ(expected, blob.data_at(n * 10 + k, 0, h, w));
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(DataTransformTest, TestTransformRegions) {
+  TransformationParameter transform_param;
+  transform_param.add_mean_value(1);
+  transform_param.add_mean_value(2);
+  transform_param.set_scale(0.5);
+  const int channels = 2;
+  const int height = 6;
+  const int width = 4;
+  vector<int> shape(3);
+  shape[0] = 6;
+  shape[1] = 8;
+  shape[2] = channels;
+  Blob<TypeParam> image(shape);
+  for (int j = 0; j < image.count(); ++j) {
+    image.mutable_cpu_data()[j] = j;
+  }
+  // A region of the crop size, one partly above the image and one outside.
+  const int boxes[][4] = { { 0, 2, 5, 5 }, { -3, 0, 2, 3 },
+      { 10, 10, 12, 12 } };
+  vector<vector<int> > regions;
+  for (int i = 0; i < 3; ++i) {
+    regions.push_back(vector<int>(boxes[i], boxes[i] + 4));
+  }
+  vector<int> channel_swap;
+  channel_swap.push_back(1);
+  channel_swap.push_back(0);
+  Blob<TypeParam> blob(1, channels, height, width);
+  DataTransformer<TypeParam> transformer(transform_param, TEST);
+  transformer.InitRand();
+  transformer.TransformRegions(image, regions, 0, channel_swap, 2, &blob, 2);
+  ASSERT_EQ(3, blob.num());
+  for (int c = 0; c < channels; ++c) {
+    for (int h = 0; h < height; ++h) {
+      for (int w = 0; w < width; ++w) {
+        const TypeParam value = (h * 8 + w + 2) * channels + 1 - c;
+        EXPECT_NEAR((value * 2 - (c + 1)) * 0.5, blob.data_at(0, c, h, w),
+            1e-4);
+        if (h < 3) {
+          EXPECT_EQ(0, blob.data_at(1, c, h, w));
+        } else {
+          const TypeParam value = ((h - 3) * 8 + w) * channels + 1 - c;
+          EXPECT_NEAR((value * 2 - (c + 1)) * 0.5,
+              blob.data_at(1, c, h, w), 1e-4);
+        }
+        EXPECT_EQ(0, blob.data_at(2, c, h, w));
+      }
+    }
+  }
+}
+
+TYPED_TEST(DataTransformTest, TestTransformRegionsContext) {
+  TransformationParameter transform_param;
+  vector<int> shape(3);
+  shape[0] = 8;
+  shape[1] = 8;
+  shape[2] = 1;
+  Blob<TypeParam> image(shape);
+  caffe_set(image.count(), TypeParam(1), image.mutable_cpu_data());
+  vector<vector<int> > regions(2, vector<int>(4));
+  // Its context is inside the image.
+  regions[0][0] = 2;
+  regions[0][1] = 2;
+  regions[0][2] = 5;
+  regions[0][3] = 5;
+  // Its context reaches a pixel past the top left corner.
+  regions[1][0] = 0;
+  regions[1][1] = 0;
+  regions[1][2] = 1;
+  regions[1][3] = 1;
+  Blob<TypeParam> blob(1, 1, 4, 4);
+  DataTransformer<TypeParam> transformer(transform_param, TEST);
+  transformer.InitRand();
+  transformer.TransformRegions(image, regions, 1, vector<int>(), 1, &blob, 1);
+  ASSERT_EQ(2, blob.num());
+  for (int h = 0; h < 4; ++h) {
+    for (int w = 0; w < 4; ++w) {
+      EXPECT_NEAR(1, blob.data_at(0, 0, h, w), 1e-5);
+      EXPECT_NEAR(h == 0 || w == 0 ? 0 : 1, blob.data_at(1, 0, h, w), 1e-5);
+    }
+  }
+}
+
+TYPED_TEST(DataTransformTest, TestTransformRegionsMean) {
+  TransformationParameter transform_param;
+  vector<int> shape(3);
+  shape[0] = 5;
+  shape[1] = 5;
+  shape[2] = 1;
+  Blob<TypeParam> image(shape);
+  caffe_set(image.count(), TypeParam(0), image.mutable_cpu_data());
+  // A mean larger than the crops, whose center is subtracted.
+  shape[0] = 1;
+  shape[1] = 4;
+  shape[2] = 6;
+  Blob<TypeParam> mean(shape);
+  for (int j = 0; j < mean.count(); ++j) {
+    mean.mutable_cpu_data()[j] = j;
+  }
+  vector<vector<int> > regions(1, vector<int>(4, 0));
+  regions[0][2] = 1;
+  regions[0][3] = 3;
+  Blob<TypeParam> blob(1, 1, 2, 4);
+  DataTransformer<TypeParam> transformer(transform_param, TEST);
+  transformer.InitRand();
+  transformer.SetMean(mean);
+  transformer.TransformRegions(image, regions, 0, vector<int>(), 1, &blob, 1);
+  for (int h = 0; h < 2; ++h) {
+    for (int w = 0; w < 4; ++w) {
+      EXPECT_EQ(-((h + 1) * 6 + w + 1), blob.data_at(0, 0, h, w));
+    }
+  }
+}
+
 }  // namespace caffe
@@ -0,0 +1,131 @@
+#include <boost/thread.hpp>
+
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/net.hpp"
+#include "caffe/util/dynamic_batcher.hpp"
+#include "caffe/util/inference_engine.hpp"
+#include "caffe/util/io.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class DynamicBatcherTest : public ::testing::Test {
+ protected:
+  DynamicBatcherTest() : num_requests_(8) {
+    Caffe::set_mode(Caffe::CPU);
+    const string proto =
+        "name: 'BatcherNetwork' "
+        "input: 'data' "
+        "input_shape { dim: 1 dim: 6 } "
+        "layer { "
+        "  name: 'ip' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'data' "
+        "  top: 'ip' "
+        "  inner_product_param { "
+        "    num_output: 4 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.5 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'prob' "
+        "  type: 'Softmax' "
+        "  bottom: 'ip' "
+        "  top: 'prob' "
+        "} ";
+    NetParameter model;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &model));
+    model.mutable_state()->set_phase(TEST);
+    Net<Dtype> reference(model);
+    NetParameter weights;
+    reference.ToProto(&weights);
+    string weights_file;
+    MakeTempFilename(&weights_file);
+    WriteProtoToBinaryFile(weights, weights_file);
+    engine_.reset(new InferenceEngine<Dtype>(model, weights_file, 1));
+    // Single item requests and their outputs from a single net.
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    vector<int> shape(2);
+    shape[0] = 1;
+    shape[1] = 6;
+    for (int i = 0; i < num_requests_; ++i) {
+      inputs_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(shape)));
+      filler.Fill(inputs_[i].get());
+      vector<Blob<Dtype>*> bottom(1, inputs_[i].get());
+      expected_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+      expected_[i]->CopyFrom(*reference.Forward(bottom)[0], false, true);
+      outputs_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    }
+  }
+
+  void RunRequest(DynamicBatcher<Dtype>* batcher, const int request) {
+    vector<Blob<Dtype>*> inputs(1, inputs_[request].get());
+    vector<Blob<Dtype>*> outputs(1, outputs_[request].get());
+    batcher->Predict(inputs, outputs);
+  }
+
+  // Runs each request from its own thread.
+  void RunConcurrently(DynamicBatcher<Dtype>* batcher) {
+    vector<shared_ptr<boost::thread> > threads;
+    for (int i = 0; i < num_requests_; ++i) {
+      threads.push_back(shared_ptr<boost::thread>(new boost::thread(
+          &DynamicBatcherTest<Dtype>::RunRequest, this, batcher, i)));
+    }
+    for (int i = 0; i < threads.size(); ++i) {
+      threads[i]->join();
+    }
+  }
+
+  const int num_requests_;
+  shared_ptr<InferenceEngine<Dtype> > engine_;
+  vector<shared_ptr<Blob<Dtype> > > inputs_;
+  vector<shared_ptr<Blob<Dtype> > > expected_;
+  vector<shared_ptr<Blob<Dtype> > > outputs_;
+};
+
+TYPED_TEST_CASE(DynamicBatcherTest, TestDtypes);
+
+TYPED_TEST(DynamicBatcherTest, TestFullBatches) {
+  // The delay is long enough that only full batches are run.
+  DynamicBatcher<TypeParam> batcher(this->engine_, 4, 10000);
+  this->RunConcurrently(&batcher);
+  const TypeParam kTolerance = 1e-5;
+  for (int i = 0; i < this->num_requests_; ++i) {
+    ASSERT_TRUE(this->expected_[i]->shape() == this->outputs_[i]->shape());
+    for (int j = 0; j < this->expected_[i]->count(); ++j) {
+      EXPECT_NEAR(this->expected_[i]->cpu_data()[j],
+                  this->outputs_[i]->cpu_data()[j], kTolerance);
+    }
+  }
+  const Histogram batch_fill = batcher.batch_fill();
+  EXPECT_EQ(2, batch_fill.count());
+  EXPECT_EQ(2, batch_fill.bucket_count(3));
+  EXPECT_EQ(this->num_requests_, batcher.queue_latency().count());
+}
+
+TYPED_TEST(DynamicBatcherTest, TestDeadline) {
+  // A lone request runs once it has waited for the delay.
+  DynamicBatcher<TypeParam> batcher(this->engine_, 4, 1);
+  this->RunRequest(&batcher, 0);
+  const Histogram batch_fill = batcher.batch_fill();
+  EXPECT_EQ(1, batch_fill.count());
+  EXPECT_EQ(1, batch_fill.bucket_count(0));
+  EXPECT_TRUE(this->expected_[0]->shape() == this->outputs_[0]->shape());
+}
+
+}  // namespace caffe
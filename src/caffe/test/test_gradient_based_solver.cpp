@@ -1,4 +1,9 @@
+#include <unistd.h>
+
+#include <boost/thread.hpp>
+
 #include <algorithm>
+#include <fstream>  // NOLINT(readability/streams)
 #include <string>
 #include <utility>
 #include <vector>
@@ -8,8 +13,12 @@
 #include "gtest/gtest.h"
 
 #include "caffe/common.hpp"
+#include "caffe/data_layers.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/solver.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/weights_stream.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
@@ -23,12 +32,15 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
 
  protected:
   GradientBasedSolverTest() :
-      seed_(1701), num_(5), channels_(3), height_(10), width_(10) {}
+      seed_(1701), num_(5), channels_(3), height_(10), width_(10),
+      snapshot_async_(false), snapshot_weights_stream_(false) {}
 
   shared_ptr<SGDSolver<Dtype> > solver_;
   int seed_;
   int num_, channels_, height_, width_;
   Dtype delta_;  // Stability constant for AdaGrad.
+  string snapshot_prefix_;
+  bool snapshot_async_, snapshot_weights_stream_;
 
   virtual SolverParameter_SolverType solver_type() = 0;
   virtual void InitSolver(const SolverParameter& param) = 0;
@@ -56,7 +68,8 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
   }
 
   void RunLeastSquaresSolver(const Dtype learning_rate,
-      const Dtype weight_decay, const Dtype momentum, const int num_iters) {
+      const Dtype weight_decay, const Dtype momentum, const int num_iters,
+      const int snapshot = 0) {
     ostringstream proto;
     proto <<
        "max_iter: " << num_iters << " "
@@ -113,11 +126,85 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
     if (momentum != 0) {
       proto << "momentum: " << momentum << " ";
     }
+    if (snapshot != 0) {
+      proto << "snapshot: " << snapshot << " "
+            << "snapshot_prefix: '" << snapshot_prefix_ << "' "
+            << "snapshot_async: " << (snapshot_async_ ? "true" : "false")
+            << " snapshot_weights_stream: "
+            << (snapshot_weights_stream_ ? "true" : "false") << " ";
+    }
     Caffe::set_random_seed(this->seed_);
     this->InitSolverFromProtoString(proto.str());
     this->solver_->Solve();
   }
 
+  // Runs the solver with a snapshot after every iteration and checks the
+  // last snapshot against the solver.
+  void CheckSnapshot() {
+    const int kNumIters = 4;
+    string snapshot_dir;
+    MakeTempDir(&snapshot_dir);
+    snapshot_prefix_ = snapshot_dir + "/snapshot";
+    RunLeastSquaresSolver(0.01, 0.1, 0.9, kNumIters, 1);
+    // Solve waits for the background writes, so the last snapshot must be
+    // complete and match the solver.
+    std::ostringstream filename;
+    filename << snapshot_prefix_ << "_iter_" << kNumIters;
+    SolverState state;
+    ReadProtoFromBinaryFileOrDie(filename.str() + ".solverstate", &state);
+    EXPECT_EQ(kNumIters, state.iter());
+    NetParameter net_param;
+    if (snapshot_weights_stream_) {
+      EXPECT_EQ(filename.str() + ".caffemodel.stream", state.learned_net());
+      EXPECT_FALSE(std::ifstream((state.learned_net() + ".tmp").c_str())
+          .good());
+      ASSERT_TRUE(IsWeightsStreamFile(state.learned_net()));
+      ReadNetParamFromWeightsStream(state.learned_net(), &net_param);
+    } else {
+      // By default the model is a NetParameter any protobuf reader can load.
+      EXPECT_EQ(filename.str() + ".caffemodel", state.learned_net());
+      ASSERT_FALSE(IsWeightsStreamFile(state.learned_net()));
+      ReadProtoFromBinaryFileOrDie(state.learned_net(), &net_param);
+    }
+    const vector<shared_ptr<Blob<Dtype> > >& params =
+        solver_->net()->params();
+    const vector<shared_ptr<Blob<Dtype> > >& history =
+        solver_->history();
+    ASSERT_EQ(params.size(), state.history_size());
+    // BlobProto stores single precision values.
+    Blob<Dtype> snapshot_blob;
+    for (int i = 0; i < params.size(); ++i) {
+      snapshot_blob.FromProto(state.history(i));
+      ASSERT_EQ(history[i]->count(), snapshot_blob.count());
+      for (int j = 0; j < snapshot_blob.count(); ++j) {
+        EXPECT_EQ(static_cast<float>(history[i]->cpu_data()[j]),
+                  snapshot_blob.cpu_data()[j]);
+      }
+    }
+    // The InnerProduct layer holds the weights and the bias.
+    ASSERT_EQ(2, net_param.layer(1).blobs_size());
+    for (int i = 0; i < params.size(); ++i) {
+      snapshot_blob.FromProto(net_param.layer(1).blobs(i));
+      ASSERT_EQ(params[i]->count(), snapshot_blob.count());
+      for (int j = 0; j < snapshot_blob.count(); ++j) {
+        EXPECT_EQ(static_cast<float>(params[i]->cpu_data()[j]),
+                  snapshot_blob.cpu_data()[j]);
+      }
+    }
+    // Restore reads the parameters back from the model.
+    for (int i = 0; i < params.size(); ++i) {
+      caffe_set(params[i]->count(), Dtype(0), params[i]->mutable_cpu_data());
+    }
+    solver_->Restore((filename.str() + ".solverstate").c_str());
+    for (int i = 0; i < params.size(); ++i) {
+      snapshot_blob.FromProto(net_param.layer(1).blobs(i));
+      for (int j = 0; j < snapshot_blob.count(); ++j) {
+        EXPECT_EQ(snapshot_blob.cpu_data()[j],
+                  static_cast<float>(params[i]->cpu_data()[j]));
+      }
+    }
+  }
+
   // Compute an update value given the current state of the train net,
   // using the analytical formula for the least squares gradient.
   // updated_params will store the updated weight and bias results,
@@ -306,6 +393,33 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
 };
 
 
+// Trains rank rank of a multi-process job, run on a thread of its own, on
+// one example per replica, taken in order from data and targets. Returns the
+// parameters and the loss of the last iteration.
+template <typename Dtype>
+static void TrainRank(const SolverParameter& param, const int rank,
+    const int seed, Dtype* data, Dtype* targets,
+    vector<shared_ptr<Blob<Dtype> > >* params, Dtype* loss) {
+  SolverParameter rank_param(param);
+  rank_param.set_rank(rank);
+  Caffe::set_random_seed(seed);
+  SGDSolver<Dtype> solver(rank_param);
+  vector<shared_ptr<Net<Dtype> > > nets(solver.replica_nets());
+  if (nets.empty()) {
+    nets.push_back(solver.net());
+  }
+  for (int r = 0; r < nets.size(); ++r) {
+    shared_ptr<MemoryDataLayer<Dtype> > data_layer =
+        boost::static_pointer_cast<MemoryDataLayer<Dtype> >(
+            nets[r]->layers()[0]);
+    data_layer->Reset(data + r * data_layer->channels() *
+        data_layer->height() * data_layer->width(), targets + r, 1);
+  }
+  solver.Solve();
+  *params = solver.net()->params();
+  *loss = solver.smoothed_loss();
+}
+
 template <typename TypeParam>
 class SGDSolverTest : public GradientBasedSolverTest<TypeParam> {
   typedef typename TypeParam::Dtype Dtype;
@@ -318,6 +432,116 @@ class SGDSolverTest : public GradientBasedSolverTest<TypeParam> {
   virtual SolverParameter_SolverType solver_type() {
     return SolverParameter_SolverType_SGD;
   }
+
+  // world_size processes (threads here) of replicas replicas each, with one
+  // example per replica, should update the parameters, and report the loss,
+  // as a single process with a batch of all the examples does.
+  void TestLeastSquaresUpdateDistributed(const int world_size,
+      const int replicas) {
+    const int kNumIters = 3;
+    const int num = world_size * replicas;
+    const int D = this->channels_ * this->height_ * this->width_;
+    vector<Dtype> data(num * D), targets(num);
+    Caffe::set_random_seed(this->seed_);
+    caffe_rng_gaussian<Dtype>(data.size(), 0, 1, &data[0]);
+    caffe_rng_gaussian<Dtype>(targets.size(), 0, 1, &targets[0]);
+    vector<vector<shared_ptr<Blob<Dtype> > > > params(world_size + 1);
+    vector<Dtype> losses(world_size + 1);
+    for (int distribute = 0; distribute < 2; ++distribute) {
+      ostringstream proto;
+      proto <<
+         "max_iter: " << kNumIters << " "
+         "world_size: " << (distribute ? world_size : 1) << " "
+         "replicas: " << (distribute ? replicas : 1) << " "
+         "allreduce_endpoint: 'caffe_test_solver_" << getpid() << "' "
+         "base_lr: 0.01 "
+         "lr_policy: 'fixed' "
+         "momentum: 0.9 "
+         "weight_decay: 0.1 "
+         "snapshot_after_train: false "
+         "solver_mode: CPU "
+         "net_param { "
+         "  name: 'TestNetwork' "
+         "  layer { "
+         "    name: 'data' "
+         "    type: 'MemoryData' "
+         "    memory_data_param { "
+         "      batch_size: " << (distribute ? 1 : num) << " "
+         "      channels: " << this->channels_ << " "
+         "      height: " << this->height_ << " "
+         "      width: " << this->width_ << " "
+         "    } "
+         "    top: 'data' "
+         "    top: 'targets' "
+         "  } "
+         "  layer { "
+         "    name: 'innerprod' "
+         "    type: 'InnerProduct' "
+         "    inner_product_param { "
+         "      num_output: 1 "
+         "      weight_filler { "
+         "        type: 'gaussian' "
+         "        std: 1.0 "
+         "      } "
+         "      bias_filler { "
+         "        type: 'gaussian' "
+         "        std: 1.0 "
+         "      } "
+         "    } "
+         "    bottom: 'data' "
+         "    top: 'innerprod' "
+         "  } "
+         "  layer { "
+         "    name: 'loss' "
+         "    type: 'EuclideanLoss' "
+         "    bottom: 'innerprod' "
+         "    bottom: 'targets' "
+         "  } "
+         "} ";
+      SolverParameter param;
+      CHECK(google::protobuf::TextFormat::ParseFromString(proto.str(),
+          &param));
+      if (!distribute) {
+        Caffe::set_random_seed(this->seed_);
+        SGDSolver<Dtype> solver(param);
+        boost::static_pointer_cast<MemoryDataLayer<Dtype> >(
+            solver.net()->layers()[0])->Reset(&data[0], &targets[0], num);
+        solver.Solve();
+        params[0] = solver.net()->params();
+        losses[0] = solver.smoothed_loss();
+      } else {
+        vector<shared_ptr<boost::thread> > threads;
+        for (int r = 1; r < world_size; ++r) {
+          threads.push_back(shared_ptr<boost::thread>(new boost::thread(
+              &TrainRank<Dtype>, param, r, this->seed_,
+              &data[r * replicas * D], &targets[r * replicas],
+              &params[r + 1], &losses[r + 1])));
+        }
+        TrainRank<Dtype>(param, 0, this->seed_, &data[0], &targets[0],
+            &params[1], &losses[1]);
+        for (int i = 0; i < threads.size(); ++i) {
+          threads[i]->join();
+        }
+      }
+    }
+    // Every rank ends up with the parameters and the loss of the single
+    // process.
+    const double kPrecision = 1e-4;
+    for (int r = 1; r <= world_size; ++r) {
+      EXPECT_NEAR(losses[0], losses[r],
+          kPrecision * std::max(Dtype(1), Dtype(fabs(losses[0]))));
+      ASSERT_EQ(params[0].size(), params[r].size());
+      for (int i = 0; i < params[0].size(); ++i) {
+        ASSERT_EQ(params[0][i]->count(), params[r][i]->count());
+        for (int j = 0; j < params[0][i]->count(); ++j) {
+          const Dtype expected = params[0][i]->cpu_data()[j];
+          const Dtype distributed = params[r][i]->cpu_data()[j];
+          EXPECT_NEAR(expected, distributed,
+              kPrecision * std::max(Dtype(1), Dtype(fabs(expected))));
+        }
+      }
+    }
+  }
 };
 
 TYPED_TEST_CASE(SGDSolverTest, TestDtypesAndDevices);
@@ -373,6 +597,191 @@ TYPED_TEST(SGDSolverTest, TestLeastSquaresUpdateWithEverything) {
 }
 
 
+TYPED_TEST(SGDSolverTest, TestLeastSquaresUpdateWithIterSize) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Accumulating over kIterSize batches of num_ / kIterSize examples should
+  // update the parameters as a single batch of num_ examples does.
+  const int kIterSize = 5;
+  const int kNumIters = 3;
+  const int D = this->channels_ * this->height_ * this->width_;
+  vector<Dtype> data(this->num_ * D), targets(this->num_);
+  Caffe::set_random_seed(this->seed_);
+  caffe_rng_gaussian<Dtype>(data.size(), 0, 1, &data[0]);
+  caffe_rng_gaussian<Dtype>(targets.size(), 0, 1, &targets[0]);
+  vector<shared_ptr<Blob<Dtype> > > params[2];
+  for (int accumulate = 0; accumulate < 2; ++accumulate) {
+    const int iter_size = accumulate ? kIterSize : 1;
+    ostringstream proto;
+    proto <<
+       "max_iter: " << kNumIters << " "
+       "iter_size: " << iter_size << " "
+       "base_lr: 0.01 "
+       "lr_policy: 'fixed' "
+       "momentum: 0.9 "
+       "weight_decay: 0.1 "
+       "net_param { "
+       "  name: 'TestNetwork' "
+       "  layer { "
+       "    name: 'data' "
+       "    type: 'MemoryData' "
+       "    memory_data_param { "
+       "      batch_size: " << this->num_ / iter_size << " "
+       "      channels: " << this->channels_ << " "
+       "      height: " << this->height_ << " "
+       "      width: " << this->width_ << " "
+       "    } "
+       "    top: 'data' "
+       "    top: 'targets' "
+       "  } "
+       "  layer { "
+       "    name: 'innerprod' "
+       "    type: 'InnerProduct' "
+       "    inner_product_param { "
+       "      num_output: 1 "
+       "      weight_filler { "
+       "        type: 'gaussian' "
+       "        std: 1.0 "
+       "      } "
+       "      bias_filler { "
+       "        type: 'gaussian' "
+       "        std: 1.0 "
+       "      } "
+       "    } "
+       "    bottom: 'data' "
+       "    top: 'innerprod' "
+       "  } "
+       "  layer { "
+       "    name: 'loss' "
+       "    type: 'EuclideanLoss' "
+       "    bottom: 'innerprod' "
+       "    bottom: 'targets' "
+       "  } "
+       "} ";
+    Caffe::set_random_seed(this->seed_);
+    this->InitSolverFromProtoString(proto.str());
+    boost::static_pointer_cast<MemoryDataLayer<Dtype> >(
+        this->solver_->net()->layers()[0])->Reset(&data[0], &targets[0],
+        this->num_);
+    this->solver_->Solve();
+    params[accumulate] = this->solver_->net()->params();
+  }
+  const double kPrecision = 1e-4;
+  for (int i = 0; i < params[0].size(); ++i) {
+    ASSERT_EQ(params[0][i]->count(), params[1][i]->count());
+    for (int j = 0; j < params[0][i]->count(); ++j) {
+      const Dtype expected = params[0][i]->cpu_data()[j];
+      const Dtype accumulated = params[1][i]->cpu_data()[j];
+      EXPECT_NEAR(expected, accumulated,
+          kPrecision * std::max(Dtype(1), Dtype(fabs(expected))));
+    }
+  }
+}
+
+TYPED_TEST(SGDSolverTest, TestLeastSquaresUpdateWithReplicas) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Replicas run on the CPU only.
+  if (Caffe::mode() != Caffe::CPU) { return; }
+  // kReplicas replicas with one example each should update the parameters as
+  // a single batch of num_ examples does.
+  const int kReplicas = 5;
+  const int kNumIters = 3;
+  const int D = this->channels_ * this->height_ * this->width_;
+  vector<Dtype> data(this->num_ * D), targets(this->num_);
+  Caffe::set_random_seed(this->seed_);
+  caffe_rng_gaussian<Dtype>(data.size(), 0, 1, &data[0]);
+  caffe_rng_gaussian<Dtype>(targets.size(), 0, 1, &targets[0]);
+  vector<shared_ptr<Blob<Dtype> > > params[2];
+  for (int replicate = 0; replicate < 2; ++replicate) {
+    const int replicas = replicate ? kReplicas : 1;
+    ostringstream proto;
+    proto <<
+       "max_iter: " << kNumIters << " "
+       "replicas: " << replicas << " "
+       "base_lr: 0.01 "
+       "lr_policy: 'fixed' "
+       "momentum: 0.9 "
+       "weight_decay: 0.1 "
+       "net_param { "
+       "  name: 'TestNetwork' "
+       "  layer { "
+       "    name: 'data' "
+       "    type: 'MemoryData' "
+       "    memory_data_param { "
+       "      batch_size: " << this->num_ / replicas << " "
+       "      channels: " << this->channels_ << " "
+       "      height: " << this->height_ << " "
+       "      width: " << this->width_ << " "
+       "    } "
+       "    top: 'data' "
+       "    top: 'targets' "
+       "  } "
+       "  layer { "
+       "    name: 'innerprod' "
+       "    type: 'InnerProduct' "
+       "    inner_product_param { "
+       "      num_output: 1 "
+       "      weight_filler { "
+       "        type: 'gaussian' "
+       "        std: 1.0 "
+       "      } "
+       "      bias_filler { "
+       "        type: 'gaussian' "
+       "        std: 1.0 "
+       "      } "
+       "    } "
+       "    bottom: 'data' "
+       "    top: 'innerprod' "
+       "  } "
+       "  layer { "
+       "    name: 'loss' "
+       "    type: 'EuclideanLoss' "
+       "    bottom: 'innerprod' "
+       "    bottom: 'targets' "
+       "  } "
+       "} ";
+    Caffe::set_random_seed(this->seed_);
+    this->InitSolverFromProtoString(proto.str());
+    if (replicas == 1) {
+      boost::static_pointer_cast<MemoryDataLayer<Dtype> >(
+          this->solver_->net()->layers()[0])->Reset(&data[0], &targets[0],
+          this->num_);
+    } else {
+      // Feed each replica its own example.
+      const vector<shared_ptr<Net<Dtype> > >& replica_nets =
+          this->solver_->replica_nets();
+      ASSERT_EQ(kReplicas, replica_nets.size());
+      EXPECT_EQ(this->solver_->net(), replica_nets[0]);
+      for (int r = 0; r < kReplicas; ++r) {
+        boost::static_pointer_cast<MemoryDataLayer<Dtype> >(
+            replica_nets[r]->layers()[0])->Reset(&data[r * D], &targets[r], 1);
+      }
+    }
+    this->solver_->Solve();
+    params[replicate] = this->solver_->net()->params();
+  }
+  const double kPrecision = 1e-4;
+  for (int i = 0; i < params[0].size(); ++i) {
+    ASSERT_EQ(params[0][i]->count(), params[1][i]->count());
+    for (int j = 0; j < params[0][i]->count(); ++j) {
+      const Dtype expected = params[0][i]->cpu_data()[j];
+      const Dtype replicated = params[1][i]->cpu_data()[j];
+      EXPECT_NEAR(expected, replicated,
+          kPrecision * std::max(Dtype(1), Dtype(fabs(expected))));
+    }
+  }
+}
+
+TYPED_TEST(SGDSolverTest, TestLeastSquaresUpdateWithWorldSize) {
+  // The gradients are summed on the CPU.
+  if (Caffe::mode() != Caffe::CPU) { return; }
+  this->TestLeastSquaresUpdateDistributed(5, 1);
+}
+
+TYPED_TEST(SGDSolverTest, TestLeastSquaresUpdateWithWorldSizeAndReplicas) {
+  if (Caffe::mode() != Caffe::CPU) { return; }
+  this->TestLeastSquaresUpdateDistributed(2, 2);
+}
+
 template <typename TypeParam>
 class AdaGradSolverTest : public GradientBasedSolverTest<TypeParam> {
   typedef typename TypeParam::Dtype Dtype;
@@ -482,4 +891,24 @@ TYPED_TEST(NesterovSolverTest, TestNesterovLeastSquaresUpdateWithEverything) {
   }
 }
 
+TYPED_TEST(SGDSolverTest, TestSnapshot) {
+  this->CheckSnapshot();
+}
+
+TYPED_TEST(SGDSolverTest, TestSnapshotAsync) {
+  this->snapshot_async_ = true;
+  this->CheckSnapshot();
+}
+
+TYPED_TEST(SGDSolverTest, TestSnapshotWeightsStream) {
+  this->snapshot_weights_stream_ = true;
+  this->CheckSnapshot();
+}
+
+TYPED_TEST(SGDSolverTest, TestSnapshotWeightsStreamAsync) {
+  this->snapshot_async_ = true;
+  this->snapshot_weights_stream_ = true;
+  this->CheckSnapshot();
+}
+
 }  // namespace caffe
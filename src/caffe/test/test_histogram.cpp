@@ -0,0 +1,50 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/histogram.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class HistogramTest : public ::testing::Test {};
+
+TEST_F(HistogramTest, TestBuckets) {
+  vector<double> bounds;
+  bounds.push_back(1);
+  bounds.push_back(10);
+  Histogram histogram(bounds);
+  EXPECT_EQ(3, histogram.num_buckets());
+  EXPECT_EQ(0, histogram.count());
+  histogram.Add(0.5);
+  histogram.Add(1);
+  histogram.Add(5);
+  histogram.Add(20);
+  EXPECT_EQ(4, histogram.count());
+  EXPECT_EQ(1, histogram.bucket_count(0));
+  EXPECT_EQ(2, histogram.bucket_count(1));
+  EXPECT_EQ(1, histogram.bucket_count(2));
+  EXPECT_DOUBLE_EQ(26.5, histogram.sum());
+  EXPECT_DOUBLE_EQ(20, histogram.max());
+  EXPECT_EQ("<1: 1, <10: 2, >=10: 1", histogram.ToString());
+}
+
+TEST_F(HistogramTest, TestQuantile) {
+  Histogram histogram(Histogram::GeometricBounds(1, 8, 2));
+  ASSERT_EQ(4, histogram.bounds().size());
+  EXPECT_DOUBLE_EQ(8, histogram.bounds()[3]);
+  for (int i = 0; i < 90; ++i) {
+    histogram.Add(0.5);
+  }
+  for (int i = 0; i < 9; ++i) {
+    histogram.Add(3);
+  }
+  histogram.Add(100);
+  EXPECT_DOUBLE_EQ(1, histogram.Quantile(0.5));
+  EXPECT_DOUBLE_EQ(4, histogram.Quantile(0.99));
+  EXPECT_DOUBLE_EQ(100, histogram.Quantile(1));
+}
+
+}  // namespace caffe
@@ -0,0 +1,212 @@
+#include <boost/thread.hpp>
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/common_layers.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/net.hpp"
+#include "caffe/util/inference_engine.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/vision_layers.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class InferenceEngineTest : public ::testing::Test {
+ protected:
+  InferenceEngineTest() : num_requests_(12), num_threads_(4) {
+    Caffe::set_mode(Caffe::CPU);
+    const string proto =
+        "name: 'EngineNetwork' "
+        "input: 'data' "
+        "input_shape { dim: 1 dim: 2 dim: 4 dim: 4 } "
+        "layer { "
+        "  name: 'conv' "
+        "  type: 'Convolution' "
+        "  bottom: 'data' "
+        "  top: 'conv' "
+        "  convolution_param { "
+        "    num_output: 3 "
+        "    kernel_size: 3 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.5 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'relu' "
+        "  type: 'ReLU' "
+        "  bottom: 'conv' "
+        "  top: 'conv' "
+        "} "
+        "layer { "
+        "  name: 'ip' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'conv' "
+        "  top: 'ip' "
+        "  inner_product_param { "
+        "    num_output: 5 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.5 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'prob' "
+        "  type: 'Softmax' "
+        "  bottom: 'ip' "
+        "  top: 'prob' "
+        "} ";
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &model_));
+    model_.mutable_state()->set_phase(TEST);
+    Net<Dtype> reference(model_);
+    NetParameter weights;
+    reference.ToProto(&weights);
+    MakeTempFilename(&weights_file_);
+    WriteProtoToBinaryFile(weights, weights_file_);
+    // Requests of 1 to 3 images and their outputs from a single net.
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    for (int i = 0; i < num_requests_; ++i) {
+      inputs_.push_back(shared_ptr<Blob<Dtype> >(
+          new Blob<Dtype>(i % 3 + 1, 2, 4, 4)));
+      filler.Fill(inputs_[i].get());
+      reference.input_blobs()[0]->ReshapeLike(*inputs_[i]);
+      reference.input_blobs()[0]->CopyFrom(*inputs_[i]);
+      reference.ForwardPrefilled();
+      expected_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+      expected_[i]->CopyFrom(*reference.output_blobs()[0], false, true);
+      outputs_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    }
+  }
+
+  // Runs every num_threads_-th request, starting at the first_request-th.
+  void RunRequests(InferenceEngine<Dtype>* engine, const int first_request) {
+    for (int i = first_request; i < num_requests_; i += num_threads_) {
+      vector<Blob<Dtype>*> inputs(1, inputs_[i].get());
+      vector<Blob<Dtype>*> outputs(1, outputs_[i].get());
+      engine->Predict(inputs, outputs);
+    }
+  }
+
+  // Runs all the requests on num_threads_ threads.
+  void RunConcurrently(InferenceEngine<Dtype>* engine) {
+    vector<shared_ptr<boost::thread> > threads;
+    for (int i = 0; i < num_threads_; ++i) {
+      threads.push_back(shared_ptr<boost::thread>(new boost::thread(
+          &InferenceEngineTest<Dtype>::RunRequests, this, engine, i)));
+    }
+    for (int i = 0; i < threads.size(); ++i) {
+      threads[i]->join();
+    }
+  }
+
+  void CheckOutputs() {
+    // BLAS may sum in another order when called from several threads.
+    const Dtype kTolerance = 1e-5;
+    for (int i = 0; i < num_requests_; ++i) {
+      ASSERT_TRUE(expected_[i]->shape() == outputs_[i]->shape());
+      for (int j = 0; j < expected_[i]->count(); ++j) {
+        EXPECT_NEAR(expected_[i]->cpu_data()[j], outputs_[i]->cpu_data()[j],
+                    kTolerance);
+      }
+    }
+  }
+
+  const int num_requests_;
+  const int num_threads_;
+  NetParameter model_;
+  string weights_file_;
+  vector<shared_ptr<Blob<Dtype> > > inputs_;
+  vector<shared_ptr<Blob<Dtype> > > expected_;
+  vector<shared_ptr<Blob<Dtype> > > outputs_;
+};
+
+TYPED_TEST_CASE(InferenceEngineTest, TestDtypes);
+
+TYPED_TEST(InferenceEngineTest, TestSharedWeights) {
+  InferenceEngine<TypeParam> engine(this->model_, this->weights_file_, 3);
+  ASSERT_EQ(3, engine.num_instances());
+  const vector<shared_ptr<Blob<TypeParam> > >& params =
+      engine.instance(0)->params();
+  for (int i = 1; i < engine.num_instances(); ++i) {
+    ASSERT_EQ(params.size(), engine.instance(i)->params().size());
+    for (int j = 0; j < params.size(); ++j) {
+      EXPECT_EQ(params[j]->cpu_data(),
+                engine.instance(i)->params()[j]->cpu_data());
+    }
+  }
+}
+
+TYPED_TEST(InferenceEngineTest, TestSharedReducedPrecision) {
+  typedef TypeParam Dtype;
+  NetParameter model(this->model_);
+  model.mutable_layer(0)->mutable_quantization_param()->set_precision(
+      QuantizationParameter_Precision_INT8);
+  model.mutable_layer(2)->mutable_quantization_param()->set_precision(
+      QuantizationParameter_Precision_FP16);
+  // A layer without trained weights, left all zeros.
+  LayerParameter* sparse = model.add_layer();
+  sparse->CopyFrom(model.layer(2));
+  sparse->set_name("sparse");
+  sparse->set_top(0, "sparse");
+  sparse->clear_quantization_param();
+  sparse->mutable_inner_product_param()->set_sparsity_threshold(0.5);
+  sparse->mutable_inner_product_param()->mutable_weight_filler()->set_type(
+      "constant");
+  LayerParameter* silence = model.add_layer();
+  silence->set_name("silence");
+  silence->set_type("Silence");
+  silence->add_bottom("sparse");
+  InferenceEngine<Dtype> engine(model, this->weights_file_, 3);
+  this->RunConcurrently(&engine);
+  // Every instance uses the one int8, half and sparse copy of each layer.
+  std::set<const void*> int8_weights, half_weights, sparse_weights;
+  for (int i = 0; i < engine.num_instances(); ++i) {
+    Net<Dtype>* net = engine.instance(i).get();
+    const ConvolutionLayer<Dtype>* conv = dynamic_cast<
+        ConvolutionLayer<Dtype>*>(net->layer_by_name("conv").get());
+    ASSERT_TRUE(conv->quantized_weights()->initialized());
+    int8_weights.insert(conv->quantized_weights()->data());
+    const Blob<Dtype>& ip_weights = *net->layer_by_name("ip")->blobs()[0];
+    ASSERT_TRUE(ip_weights.is_half());
+    half_weights.insert(ip_weights.cpu_half_data());
+    const InnerProductLayer<Dtype>* sparse_ip = dynamic_cast<
+        InnerProductLayer<Dtype>*>(net->layer_by_name("sparse").get());
+    ASSERT_TRUE(sparse_ip->sparse_weights()->initialized());
+    sparse_weights.insert(sparse_ip->sparse_weights());
+  }
+  EXPECT_EQ(1, int8_weights.size());
+  EXPECT_EQ(1, half_weights.size());
+  EXPECT_EQ(1, sparse_weights.size());
+}
+
+TYPED_TEST(InferenceEngineTest, TestPredict) {
+  InferenceEngine<TypeParam> engine(this->model_, this->weights_file_, 1);
+  this->RunRequests(&engine, 0);
+  this->RunRequests(&engine, 1);
+  this->RunRequests(&engine, 2);
+  this->RunRequests(&engine, 3);
+  this->CheckOutputs();
+}
+
+TYPED_TEST(InferenceEngineTest, TestConcurrentPredict) {
+  // More threads than instances, so that requests wait for a free one.
+  InferenceEngine<TypeParam> engine(this->model_, this->weights_file_, 2);
+  this->RunConcurrently(&engine);
+  this->CheckOutputs();
+}
+
+}  // namespace caffe
@@ -0,0 +1,164 @@
+#include <boost/thread.hpp>
+
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/net.hpp"
+#include "caffe/util/dynamic_batcher.hpp"
+#include "caffe/util/inference_engine.hpp"
+#include "caffe/util/inference_server.hpp"
+#include "caffe/util/io.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class InferenceServerTest : public ::testing::Test {
+ protected:
+  InferenceServerTest() : num_clients_(4) {
+    Caffe::set_mode(Caffe::CPU);
+    const string proto =
+        "name: 'ServerNetwork' "
+        "input: 'data' "
+        "input_shape { dim: 1 dim: 6 } "
+        "layer { "
+        "  name: 'ip' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'data' "
+        "  top: 'ip' "
+        "  inner_product_param { "
+        "    num_output: 4 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.5 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'prob' "
+        "  type: 'Softmax' "
+        "  bottom: 'ip' "
+        "  top: 'prob' "
+        "} ";
+    NetParameter model;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &model));
+    model.mutable_state()->set_phase(TEST);
+    Net<Dtype> reference(model);
+    NetParameter weights;
+    reference.ToProto(&weights);
+    string weights_file;
+    MakeTempFilename(&weights_file);
+    WriteProtoToBinaryFile(weights, weights_file);
+    shared_ptr<InferenceEngine<Dtype> > engine(
+        new InferenceEngine<Dtype>(model, weights_file, 2));
+    batcher_.reset(new DynamicBatcher<Dtype>(engine, 4, 1));
+    // Requests of 1 to num_clients_ items and their outputs from a single
+    // net.
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    for (int i = 0; i < num_clients_; ++i) {
+      vector<int> shape(2);
+      shape[0] = i + 1;
+      shape[1] = 6;
+      inputs_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(shape)));
+      filler.Fill(inputs_[i].get());
+      vector<Blob<Dtype>*> bottom(1, inputs_[i].get());
+      reference.input_blobs()[0]->ReshapeLike(*inputs_[i]);
+      expected_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+      expected_[i]->CopyFrom(*reference.Forward(bottom)[0], false, true);
+      outputs_.push_back(vector<shared_ptr<Blob<Dtype> > >());
+    }
+    MakeTempFilename(&socket_path_);
+    server_.reset(new InferenceServer<Dtype>(batcher_, socket_path_));
+    serve_thread_.reset(new boost::thread(&InferenceServer<Dtype>::Serve,
+        server_.get()));
+  }
+
+  virtual ~InferenceServerTest() {
+    server_->Stop();
+    serve_thread_->join();
+  }
+
+  // Sends each request a few times over one connection.
+  void RunClient(const int request) {
+    InferenceClient<Dtype> client(socket_path_);
+    vector<Blob<Dtype>*> inputs(1, inputs_[request].get());
+    for (int i = 0; i < 3; ++i) {
+      string error;
+      EXPECT_TRUE(client.Predict(inputs, &outputs_[request], &error))
+          << error;
+    }
+  }
+
+  // Runs each client from its own thread.
+  void RunConcurrently() {
+    vector<shared_ptr<boost::thread> > threads;
+    for (int i = 0; i < num_clients_; ++i) {
+      threads.push_back(shared_ptr<boost::thread>(new boost::thread(
+          &InferenceServerTest<Dtype>::RunClient, this, i)));
+    }
+    for (int i = 0; i < threads.size(); ++i) {
+      threads[i]->join();
+    }
+  }
+
+  const int num_clients_;
+  shared_ptr<DynamicBatcher<Dtype> > batcher_;
+  string socket_path_;
+  shared_ptr<InferenceServer<Dtype> > server_;
+  shared_ptr<boost::thread> serve_thread_;
+  vector<shared_ptr<Blob<Dtype> > > inputs_;
+  vector<shared_ptr<Blob<Dtype> > > expected_;
+  vector<vector<shared_ptr<Blob<Dtype> > > > outputs_;
+};
+
+TYPED_TEST_CASE(InferenceServerTest, TestDtypes);
+
+TYPED_TEST(InferenceServerTest, TestPredict) {
+  this->RunConcurrently();
+  const TypeParam kTolerance = 1e-5;
+  for (int i = 0; i < this->num_clients_; ++i) {
+    ASSERT_EQ(1, this->outputs_[i].size());
+    const Blob<TypeParam>& output = *this->outputs_[i][0];
+    ASSERT_TRUE(this->expected_[i]->shape() == output.shape());
+    for (int j = 0; j < output.count(); ++j) {
+      EXPECT_NEAR(this->expected_[i]->cpu_data()[j], output.cpu_data()[j],
+                  kTolerance);
+    }
+  }
+  EXPECT_EQ(this->num_clients_ * 3, this->batcher_->queue_latency().count());
+}
+
+TYPED_TEST(InferenceServerTest, TestBadRequest) {
+  InferenceClient<TypeParam> client(this->socket_path_);
+  vector<int> shape(2);
+  shape[0] = 1;
+  shape[1] = 5;
+  Blob<TypeParam> input(shape);
+  vector<Blob<TypeParam>*> inputs(1, &input);
+  vector<shared_ptr<Blob<TypeParam> > > outputs;
+  string error;
+  EXPECT_FALSE(client.Predict(inputs, &outputs, &error));
+  EXPECT_NE(string::npos, error.find("shape")) << error;
+  // Too many items for a batch.
+  InferenceClient<TypeParam> other_client(this->socket_path_);
+  shape[0] = 5;
+  shape[1] = 6;
+  input.Reshape(shape);
+  EXPECT_FALSE(other_client.Predict(inputs, &outputs, &error));
+  // The server still answers good requests.
+  InferenceClient<TypeParam> good_client(this->socket_path_);
+  inputs[0] = this->inputs_[0].get();
+  EXPECT_TRUE(good_client.Predict(inputs, &outputs, &error)) << error;
+  EXPECT_EQ(1, this->batcher_->queue_latency().count());
+}
+
+}  // namespace caffe
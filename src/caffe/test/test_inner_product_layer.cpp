@@ -85,6 +85,166 @@ TYPED_TEST(InnerProductLayerTest, TestForward) {
   }
 }
 
+TYPED_TEST(InnerProductLayerTest, TestForwardInt8) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.set_phase(TEST);
+  InnerProductParameter* inner_product_param =
+      layer_param.mutable_inner_product_param();
+  inner_product_param->set_num_output(10);
+  inner_product_param->mutable_weight_filler()->set_type("gaussian");
+  inner_product_param->mutable_bias_filler()->set_type("gaussian");
+  InnerProductLayer<Dtype> float_layer(layer_param);
+  float_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  float_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<Dtype> float_top;
+  float_top.CopyFrom(*this->blob_top_, false, true);
+  // Run the same weights in INT8.
+  layer_param.mutable_quantization_param()->set_precision(
+      QuantizationParameter_Precision_INT8);
+  float_layer.blobs()[0]->ToProto(layer_param.add_blobs());
+  float_layer.blobs()[1]->ToProto(layer_param.add_blobs());
+  InnerProductLayer<Dtype> int8_layer(layer_param);
+  int8_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  int8_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const Dtype* float_data = float_top.cpu_data();
+  const Dtype* int8_data = this->blob_top_->cpu_data();
+  const Dtype tolerance = 5e-2 * caffe_cpu_absmax(float_top.count(),
+      float_data);
+  for (int i = 0; i < float_top.count(); ++i) {
+    EXPECT_NEAR(float_data[i], int8_data[i], tolerance);
+  }
+}
+
+TYPED_TEST(InnerProductLayerTest, TestForwardInt8AfterLoad) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.set_phase(TEST);
+  InnerProductParameter* inner_product_param =
+      layer_param.mutable_inner_product_param();
+  inner_product_param->set_num_output(10);
+  inner_product_param->set_bias_term(false);
+  inner_product_param->mutable_weight_filler()->set_type("gaussian");
+  InnerProductLayer<Dtype> float_layer(layer_param);
+  float_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer_param.mutable_quantization_param()->set_precision(
+      QuantizationParameter_Precision_INT8);
+  InnerProductLayer<Dtype> int8_layer(layer_param);
+  int8_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  int8_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  float_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<Dtype> float_top;
+  float_top.CopyFrom(*this->blob_top_, false, true);
+  const Dtype* float_data = float_top.cpu_data();
+  const Dtype tolerance = 5e-2 * caffe_cpu_absmax(float_top.count(),
+      float_data);
+  // Loading other weights, as Net::CopyTrainedLayersFrom does, must not
+  // leave the int8 copy of the old ones in use.
+  BlobProto weights;
+  float_layer.blobs()[0]->ToProto(&weights);
+  int8_layer.blobs()[0]->FromProto(weights, false);
+  int8_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  for (int i = 0; i < float_top.count(); ++i) {
+    EXPECT_NEAR(float_data[i], this->blob_top_->cpu_data()[i], tolerance);
+  }
+  // Nor must updating them in place.
+  int8_layer.blobs()[0]->scale_data(-1);
+  int8_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  for (int i = 0; i < float_top.count(); ++i) {
+    EXPECT_NEAR(-float_data[i], this->blob_top_->cpu_data()[i], tolerance);
+  }
+  // Nor sharing those of another layer.
+  int8_layer.blobs()[0]->ShareData(*float_layer.blobs()[0]);
+  int8_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  for (int i = 0; i < float_top.count(); ++i) {
+    EXPECT_NEAR(float_data[i], this->blob_top_->cpu_data()[i], tolerance);
+  }
+}
+
+TYPED_TEST(InnerProductLayerTest, TestForwardFP16) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Half precision weights are only read on the CPU.
+  if (Caffe::mode() != Caffe::CPU) { return; }
+  LayerParameter layer_param;
+  layer_param.set_phase(TEST);
+  InnerProductParameter* inner_product_param =
+      layer_param.mutable_inner_product_param();
+  inner_product_param->set_num_output(10);
+  inner_product_param->mutable_weight_filler()->set_type("gaussian");
+  inner_product_param->mutable_bias_filler()->set_type("gaussian");
+  InnerProductLayer<Dtype> float_layer(layer_param);
+  float_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  float_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<Dtype> float_top;
+  float_top.CopyFrom(*this->blob_top_, false, true);
+  // Run the same weights in FP16.
+  layer_param.mutable_quantization_param()->set_precision(
+      QuantizationParameter_Precision_FP16);
+  float_layer.blobs()[0]->ToProto(layer_param.add_blobs());
+  float_layer.blobs()[1]->ToProto(layer_param.add_blobs());
+  InnerProductLayer<Dtype> fp16_layer(layer_param);
+  fp16_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  // Convert the weights as Net::Init does.
+  fp16_layer.blobs()[0]->ToHalf();
+  fp16_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_TRUE(fp16_layer.blobs()[0]->is_half());
+  const Dtype* float_data = float_top.cpu_data();
+  const Dtype* fp16_data = this->blob_top_->cpu_data();
+  const Dtype tolerance = 1e-2 * caffe_cpu_absmax(float_top.count(),
+      float_data);
+  for (int i = 0; i < float_top.count(); ++i) {
+    EXPECT_NEAR(float_data[i], fp16_data[i], tolerance);
+  }
+}
+
+TYPED_TEST(InnerProductLayerTest, TestForwardSparse) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.set_phase(TEST);
+  InnerProductParameter* inner_product_param =
+      layer_param.mutable_inner_product_param();
+  inner_product_param->set_num_output(10);
+  inner_product_param->mutable_weight_filler()->set_type("gaussian");
+  inner_product_param->mutable_bias_filler()->set_type("gaussian");
+  InnerProductLayer<Dtype> dense_layer(layer_param);
+  dense_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  // Keep only every tenth weight.
+  Blob<Dtype>* weights = dense_layer.blobs()[0].get();
+  for (int i = 0; i < weights->count(); ++i) {
+    if (i % 10 != 0) {
+      weights->mutable_cpu_data()[i] = 0;
+    }
+  }
+  dense_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<Dtype> dense_top;
+  dense_top.CopyFrom(*this->blob_top_, false, true);
+  inner_product_param->set_sparsity_threshold(0.8);
+  weights->ToProto(layer_param.add_blobs());
+  dense_layer.blobs()[1]->ToProto(layer_param.add_blobs());
+  InnerProductLayer<Dtype> sparse_layer(layer_param);
+  sparse_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  sparse_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const Dtype* dense_data = dense_top.cpu_data();
+  const Dtype* sparse_data = this->blob_top_->cpu_data();
+  for (int i = 0; i < dense_top.count(); ++i) {
+    EXPECT_NEAR(dense_data[i], sparse_data[i], 1e-4);
+  }
+  // Loading dense weights, as Net::CopyTrainedLayersFrom does, must drop the
+  // sparse copy of the old ones.
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(weights);
+  dense_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  dense_top.CopyFrom(*this->blob_top_);
+  BlobProto weights_proto;
+  weights->ToProto(&weights_proto);
+  sparse_layer.blobs()[0]->FromProto(weights_proto, false);
+  sparse_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  for (int i = 0; i < dense_top.count(); ++i) {
+    EXPECT_NEAR(dense_data[i], sparse_data[i], 1e-4);
+  }
+}
+
 TYPED_TEST(InnerProductLayerTest, TestGradient) {
   typedef typename TypeParam::Dtype Dtype;
   bool IS_VALID_CUDA = false;
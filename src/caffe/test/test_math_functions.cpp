@@ -3,6 +3,7 @@
 #include <climits>
 #include <cmath>  // for std::fabs
 #include <cstdlib>  // for rand_r
+#include <vector>
 
 #include "gtest/gtest.h"
 
@@ -144,6 +145,93 @@ TYPED_TEST(MathFunctionsTest, TestCopyCPU) {
   }
 }
 
+// The fused solver updates are checked against the separate BLAS calls the
+// solvers made before, with gradient clipping and L2 or L1 weight decay.
+// AdaGrad squares and takes roots exactly where caffe_powx may be off by one
+// unit in the last place, so it is compared up to rounding.
+TYPED_TEST(MathFunctionsTest, TestSGDUpdateCPU) {
+  const int n = this->blob_bottom_->count();
+  const TypeParam* data = this->blob_bottom_->cpu_data();
+  const TypeParam rate = 0.01, momentum = 0.9, clip_scale = 0.5, decay = 0.1;
+  for (int l1 = 0; l1 < 2; ++l1) {
+    vector<TypeParam> diff(this->blob_top_->cpu_data(),
+        this->blob_top_->cpu_data() + n);
+    vector<TypeParam> history(this->blob_top_->cpu_diff(),
+        this->blob_top_->cpu_diff() + n);
+    vector<TypeParam> expected_diff(diff), expected_history(history);
+    vector<TypeParam> sign(n);
+    caffe_scal(n, clip_scale, &expected_diff[0]);
+    if (l1) {
+      caffe_cpu_sign(n, data, &sign[0]);
+      caffe_axpy(n, decay, &sign[0], &expected_diff[0]);
+    } else {
+      caffe_axpy(n, decay, data, &expected_diff[0]);
+    }
+    caffe_cpu_axpby(n, rate, &expected_diff[0], momentum,
+        &expected_history[0]);
+    caffe_copy(n, &expected_history[0], &expected_diff[0]);
+    caffe_cpu_sgd_update(n, data, &diff[0], &history[0], clip_scale,
+        l1 ? TypeParam(0) : decay, l1 ? decay : TypeParam(0), rate, momentum);
+    for (int i = 0; i < n; ++i) {
+      EXPECT_EQ(expected_diff[i], diff[i]);
+      EXPECT_EQ(expected_history[i], history[i]);
+    }
+  }
+}
+
+TYPED_TEST(MathFunctionsTest, TestNesterovUpdateCPU) {
+  const int n = this->blob_bottom_->count();
+  const TypeParam* data = this->blob_bottom_->cpu_data();
+  const TypeParam rate = 0.01, momentum = 0.9, clip_scale = 0.5, decay = 0.1;
+  vector<TypeParam> diff(this->blob_top_->cpu_data(),
+      this->blob_top_->cpu_data() + n);
+  vector<TypeParam> history(this->blob_top_->cpu_diff(),
+      this->blob_top_->cpu_diff() + n);
+  vector<TypeParam> expected_diff(diff), expected_history(history);
+  vector<TypeParam> update(history);
+  caffe_scal(n, clip_scale, &expected_diff[0]);
+  caffe_axpy(n, decay, data, &expected_diff[0]);
+  caffe_cpu_axpby(n, rate, &expected_diff[0], momentum, &expected_history[0]);
+  caffe_cpu_axpby(n, TypeParam(1) + momentum, &expected_history[0], -momentum,
+      &update[0]);
+  caffe_copy(n, &update[0], &expected_diff[0]);
+  caffe_cpu_nesterov_update(n, data, &diff[0], &history[0], clip_scale, decay,
+      TypeParam(0), rate, momentum);
+  for (int i = 0; i < n; ++i) {
+    EXPECT_EQ(expected_diff[i], diff[i]);
+    EXPECT_EQ(expected_history[i], history[i]);
+  }
+}
+
+TYPED_TEST(MathFunctionsTest, TestAdaGradUpdateCPU) {
+  const int n = this->blob_bottom_->count();
+  const TypeParam* data = this->blob_bottom_->cpu_data();
+  const TypeParam rate = 0.01, delta = 1e-8, clip_scale = 0.5, decay = 0.1;
+  vector<TypeParam> diff(this->blob_top_->cpu_data(),
+      this->blob_top_->cpu_data() + n);
+  vector<TypeParam> history(n);
+  caffe_abs(n, this->blob_top_->cpu_diff(), &history[0]);
+  vector<TypeParam> expected_diff(diff), expected_history(history);
+  vector<TypeParam> update(n);
+  caffe_scal(n, clip_scale, &expected_diff[0]);
+  caffe_axpy(n, decay, data, &expected_diff[0]);
+  caffe_powx(n, &expected_diff[0], TypeParam(2), &update[0]);
+  caffe_add(n, &update[0], &expected_history[0], &expected_history[0]);
+  caffe_powx(n, &expected_history[0], TypeParam(0.5), &update[0]);
+  caffe_add_scalar(n, delta, &update[0]);
+  caffe_div(n, &expected_diff[0], &update[0], &update[0]);
+  caffe_cpu_axpby(n, rate, &update[0], TypeParam(0), &expected_diff[0]);
+  caffe_cpu_adagrad_update(n, data, &diff[0], &history[0], clip_scale, decay,
+      TypeParam(0), rate, delta);
+  const TypeParam kErrorMargin = 1e-6;
+  for (int i = 0; i < n; ++i) {
+    EXPECT_NEAR(expected_diff[i], diff[i],
+        kErrorMargin * std::fabs(expected_diff[i]));
+    EXPECT_NEAR(expected_history[i], history[i],
+        kErrorMargin * expected_history[i]);
+  }
+}
+
 #ifndef CPU_ONLY
 
 // TODO: Fix caffe_gpu_hamming_distance and re-enable this test.
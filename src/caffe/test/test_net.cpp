@@ -9,7 +9,10 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/net.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/mapped_weights.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/weights_stream.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 #include "caffe/test/test_gradient_check_util.hpp"
@@ -613,6 +616,195 @@ class NetTest : public MultiDeviceTest<TypeParam> {
     InitNetFromProtoString(proto);
   }
 
+  virtual void InitConcatNet(const bool zero_copy,
+                             const bool in_place_after_concat = false) {
+    ostringstream proto;
+    proto <<
+        "name: 'ConcatNetwork' "
+        "zero_copy_concat_slice: " << (zero_copy ? "true " : "false ") <<
+        "input: 'data' "
+        "input_dim: 1 "
+        "input_dim: 3 "
+        "input_dim: 5 "
+        "input_dim: 5 "
+        "layer { "
+        "  name: 'conv_a' "
+        "  type: 'Convolution' "
+        "  bottom: 'data' "
+        "  top: 'conv_a' "
+        "  convolution_param { "
+        "    num_output: 4 "
+        "    kernel_size: 3 "
+        "    pad: 1 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'relu_a' "
+        "  type: 'ReLU' "
+        "  bottom: 'conv_a' "
+        "  top: 'conv_a' "
+        "} "
+        "layer { "
+        "  name: 'conv_b' "
+        "  type: 'Convolution' "
+        "  bottom: 'data' "
+        "  top: 'conv_b' "
+        "  convolution_param { "
+        "    num_output: 2 "
+        "    kernel_size: 1 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'concat' "
+        "  type: 'Concat' "
+        "  bottom: 'conv_a' "
+        "  bottom: 'conv_b' "
+        "  top: 'concat' "
+        "} ";
+    if (in_place_after_concat) {
+      proto <<
+          "layer { "
+          "  name: 'relu_concat' "
+          "  type: 'ReLU' "
+          "  bottom: 'concat' "
+          "  top: 'concat' "
+          "} ";
+    }
+    proto <<
+        "layer { "
+        "  name: 'slice' "
+        "  type: 'Slice' "
+        "  bottom: 'concat' "
+        "  top: 'slice_a' "
+        "  top: 'slice_b' "
+        "  slice_param { "
+        "    slice_point: 3 "
+        "  } "
+        "} ";
+    InitNetFromProtoString(proto.str());
+  }
+
+  // checkpoint is 0 for no checkpointing, 1 for checkpoints on pool1 and ip2,
+  // 2 for an automatic plan.
+  virtual void InitCheckpointNet(const int checkpoint) {
+    ostringstream proto;
+    proto <<
+        "name: 'CheckpointNetwork' "
+        "force_backward: true " <<
+        (checkpoint == 2 ? "auto_checkpoint: true " : "") <<
+        "input: 'data' "
+        "input_shape { dim: 2 dim: 3 dim: 6 dim: 6 } "
+        "input: 'label' "
+        "input_shape { dim: 2 } "
+        "layer { "
+        "  name: 'conv1' "
+        "  type: 'Convolution' "
+        "  bottom: 'data' "
+        "  top: 'conv1' "
+        "  convolution_param { "
+        "    num_output: 4 "
+        "    kernel_size: 3 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'relu1' "
+        "  type: 'ReLU' "
+        "  bottom: 'conv1' "
+        "  top: 'conv1' "
+        "} "
+        "layer { "
+        "  name: 'pool1' "
+        "  type: 'Pooling' "
+        "  bottom: 'conv1' "
+        "  top: 'pool1' "
+        "  pooling_param { "
+        "    pool: MAX "
+        "    kernel_size: 2 "
+        "    stride: 2 "
+        "  } " <<
+        (checkpoint == 1 ? "  checkpoint: true " : "") <<
+        "} "
+        "layer { "
+        "  name: 'ip1' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'pool1' "
+        "  top: 'ip1' "
+        "  inner_product_param { "
+        "    num_output: 6 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'sig1' "
+        "  type: 'Sigmoid' "
+        "  bottom: 'ip1' "
+        "  top: 'sig1' "
+        "} "
+        "layer { "
+        "  name: 'ip2' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'sig1' "
+        "  top: 'ip2' "
+        "  inner_product_param { "
+        "    num_output: 6 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "  } " <<
+        (checkpoint == 1 ? "  checkpoint: true " : "") <<
+        "} "
+        "layer { "
+        "  name: 'tanh2' "
+        "  type: 'TanH' "
+        "  bottom: 'ip2' "
+        "  top: 'ip2' "
+        "} "
+        "layer { "
+        "  name: 'sum' "
+        "  type: 'Eltwise' "
+        "  bottom: 'sig1' "
+        "  bottom: 'ip2' "
+        "  top: 'sum' "
+        "} "
+        "layer { "
+        "  name: 'ip3' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'sum' "
+        "  top: 'ip3' "
+        "  inner_product_param { "
+        "    num_output: 3 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'loss' "
+        "  type: 'SoftmaxWithLoss' "
+        "  bottom: 'ip3' "
+        "  bottom: 'label' "
+        "  top: 'loss' "
+        "} ";
+    InitNetFromProtoString(proto.str());
+  }
+
   int seed_;
   shared_ptr<Net<Dtype> > net_;
 };
@@ -942,6 +1134,117 @@ TYPED_TEST(NetTest, TestBackwardWithAccuracyLayer) {
   this->net_->ForwardBackward(bottom);
 }
 
+// Records the layers the backward pass is done with, and the parameter
+// gradients of each at that point.
+template <typename Dtype>
+class RecordingCallback : public Net<Dtype>::Callback {
+ public:
+  explicit RecordingCallback(const Net<Dtype>* net) : net_(net) {}
+  virtual void run(const int layer_id) {
+    layer_ids_.push_back(layer_id);
+    const vector<shared_ptr<Blob<Dtype> > >& blobs =
+        net_->layers()[layer_id]->blobs();
+    for (int i = 0; i < blobs.size(); ++i) {
+      shared_ptr<Blob<Dtype> > diff(new Blob<Dtype>());
+      diff->CopyFrom(*blobs[i], true, true);
+      diffs_.push_back(diff);
+    }
+  }
+
+  const Net<Dtype>* net_;
+  vector<int> layer_ids_;
+  vector<shared_ptr<Blob<Dtype> > > diffs_;
+};
+
+TYPED_TEST(NetTest, TestBackwardCallback) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->InitTinyNet();
+  RecordingCallback<Dtype> callback(this->net_.get());
+  this->net_->add_after_backward(&callback);
+  vector<Blob<Dtype>*> bottom;
+  this->net_->ForwardBackward(bottom);
+  // Every layer is reported, from the last to the first, including the data
+  // layer, which needs no backward.
+  ASSERT_EQ(3, callback.layer_ids_.size());
+  EXPECT_EQ(2, callback.layer_ids_[0]);
+  EXPECT_EQ(1, callback.layer_ids_[1]);
+  EXPECT_EQ(0, callback.layer_ids_[2]);
+  // The gradients of the inner product layer are final when it is reported.
+  const vector<shared_ptr<Blob<Dtype> > >& blobs =
+      this->net_->layer_by_name("innerproduct")->blobs();
+  ASSERT_EQ(blobs.size(), callback.diffs_.size());
+  for (int i = 0; i < blobs.size(); ++i) {
+    ASSERT_EQ(blobs[i]->count(), callback.diffs_[i]->count());
+    EXPECT_GT(blobs[i]->asum_diff(), 0);
+    for (int j = 0; j < blobs[i]->count(); ++j) {
+      EXPECT_EQ(blobs[i]->cpu_diff()[j], callback.diffs_[i]->cpu_diff()[j]);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestCheckpointGradients) {
+  typedef typename TypeParam::Dtype Dtype;
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  Blob<Dtype> data(2, 3, 6, 6);
+  filler.Fill(&data);
+  // The same pass with no checkpoints, explicit ones and an automatic plan.
+  Dtype losses[3];
+  vector<shared_ptr<Blob<Dtype> > > params[3];
+  Blob<Dtype> data_diffs[3];
+  for (int checkpoint = 0; checkpoint < 3; ++checkpoint) {
+    Caffe::set_random_seed(this->seed_);
+    this->InitCheckpointNet(checkpoint);
+    Net<Dtype>* net = this->net_.get();
+    if (checkpoint == 0) {
+      EXPECT_EQ(0, net->checkpoint_segments().size());
+      EXPECT_EQ(net->blob_memory_total(), net->blob_memory_peak());
+    } else {
+      EXPECT_GT(net->checkpoint_segments().size(), 0);
+      EXPECT_LE(net->blob_memory_peak(), net->blob_memory_total());
+    }
+    if (checkpoint == 1) {
+      // Only one segment at a time holds its activations.
+      EXPECT_LT(net->blob_memory_peak(), net->blob_memory_total());
+      // The cut after ip2 moves past tanh2, which also writes ip2.
+      ASSERT_EQ(2, net->checkpoint_segments().size());
+      EXPECT_EQ("conv1", net->layer_names()[
+          net->checkpoint_segments()[0].first]);
+      EXPECT_EQ("pool1", net->layer_names()[
+          net->checkpoint_segments()[0].second]);
+      EXPECT_EQ("ip1", net->layer_names()[
+          net->checkpoint_segments()[1].first]);
+      EXPECT_EQ("tanh2", net->layer_names()[
+          net->checkpoint_segments()[1].second]);
+    }
+    net->input_blobs()[0]->CopyFrom(data);
+    caffe_set(2, Dtype(1), net->input_blobs()[1]->mutable_cpu_data());
+    // Run twice to check that freed memory is recomputed on every pass.
+    for (int pass = 0; pass < 2; ++pass) {
+      net->ClearParamDiffs();
+      net->ForwardPrefilled(&losses[checkpoint]);
+      net->Backward();
+    }
+    this->CopyNetParams(true, &params[checkpoint]);
+    data_diffs[checkpoint].CopyFrom(*net->input_blobs()[0], true, true);
+  }
+  for (int checkpoint = 1; checkpoint < 3; ++checkpoint) {
+    EXPECT_FLOAT_EQ(losses[0], losses[checkpoint]);
+    ASSERT_EQ(params[0].size(), params[checkpoint].size());
+    for (int i = 0; i < params[0].size(); ++i) {
+      for (int j = 0; j < params[0][i]->count(); ++j) {
+        EXPECT_FLOAT_EQ(params[0][i]->cpu_diff()[j],
+                        params[checkpoint][i]->cpu_diff()[j]);
+      }
+    }
+    for (int j = 0; j < data.count(); ++j) {
+      EXPECT_FLOAT_EQ(data_diffs[0].cpu_diff()[j],
+                      data_diffs[checkpoint].cpu_diff()[j]);
+    }
+  }
+}
+
 TYPED_TEST(NetTest, TestUnsharedWeightsDataNet) {
   typedef typename TypeParam::Dtype Dtype;
   this->InitUnsharedWeightsNet();
@@ -960,6 +1263,55 @@ TYPED_TEST(NetTest, TestSharedWeightsDataNet) {
   EXPECT_FLOAT_EQ(loss, 0);
 }
 
+TYPED_TEST(NetTest, TestSharedHalfWeights) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Half precision weights are only read on the CPU.
+  if (Caffe::mode() != Caffe::CPU) { return; }
+  const string proto =
+      "name: 'HalfNet' "
+      "state { phase: TEST } "
+      "input: 'data' "
+      "input_dim: 4 "
+      "input_dim: 6 "
+      "input_dim: 1 "
+      "input_dim: 1 "
+      "layer { "
+      "  name: 'innerproduct' "
+      "  type: 'InnerProduct' "
+      "  inner_product_param { "
+      "    num_output: 3 "
+      "    weight_filler { type: 'gaussian' } "
+      "  } "
+      "  quantization_param { precision: FP16 } "
+      "  bottom: 'data' "
+      "  top: 'innerproduct' "
+      "} ";
+  this->InitNetFromProtoString(proto);
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  Net<Dtype> shared_net(param);
+  shared_net.ShareTrainedLayersWith(this->net_.get());
+  const Blob<Dtype>& weights =
+      *this->net_->layer_by_name("innerproduct")->blobs()[0];
+  const Blob<Dtype>& shared_weights =
+      *shared_net.layer_by_name("innerproduct")->blobs()[0];
+  ASSERT_TRUE(weights.is_half());
+  ASSERT_TRUE(shared_weights.is_half());
+  EXPECT_EQ(weights.cpu_half_data(), shared_weights.cpu_half_data());
+  // Forward reads the shared half data and leaves it in place.
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->net_->input_blobs()[0]);
+  shared_net.input_blobs()[0]->CopyFrom(*this->net_->input_blobs()[0]);
+  const vector<Blob<Dtype>*>& top = this->net_->ForwardPrefilled();
+  const vector<Blob<Dtype>*>& shared_top = shared_net.ForwardPrefilled();
+  EXPECT_TRUE(weights.is_half());
+  EXPECT_EQ(weights.cpu_half_data(), shared_weights.cpu_half_data());
+  for (int i = 0; i < top[0]->count(); ++i) {
+    EXPECT_EQ(top[0]->cpu_data()[i], shared_top[0]->cpu_data()[i]);
+  }
+}
+
 TYPED_TEST(NetTest, TestUnsharedWeightsDiffNet) {
   typedef typename TypeParam::Dtype Dtype;
   this->InitUnsharedWeightsNet();
@@ -1133,6 +1485,113 @@ TYPED_TEST(NetTest, TestSharedWeightsResume) {
   EXPECT_NE(ip1_weights->cpu_diff(), ip2_weights->cpu_diff());
 }
 
+TYPED_TEST(NetTest, TestWeightsStream) {
+  typedef typename TypeParam::Dtype Dtype;
+  const bool kBiasTerm = true, kForceBackward = false;
+  Caffe::set_random_seed(this->seed_);
+  this->InitUnsharedWeightsNet(NULL, NULL, kForceBackward, kBiasTerm);
+  string filename;
+  MakeTempFilename(&filename);
+  this->net_->ToWeightsStream(filename);
+  EXPECT_TRUE(IsWeightsStreamFile(filename));
+  vector<shared_ptr<Blob<Dtype> > > params;
+  for (int i = 0; i < this->net_->params().size(); ++i) {
+    params.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    params[i]->CopyFrom(*this->net_->params()[i], false, true);
+  }
+
+  // Reinitialize the net with other weights and stream in the saved ones.
+  Caffe::set_random_seed(this->seed_ + 1);
+  this->InitUnsharedWeightsNet(NULL, NULL, kForceBackward, kBiasTerm);
+  this->net_->CopyTrainedLayersFrom(filename);
+  ASSERT_EQ(params.size(), this->net_->params().size());
+  for (int i = 0; i < params.size(); ++i) {
+    const Blob<Dtype>& param = *this->net_->params()[i];
+    ASSERT_EQ(params[i]->count(), param.count());
+    for (int j = 0; j < param.count(); ++j) {
+      EXPECT_EQ(static_cast<float>(params[i]->cpu_data()[j]),
+                static_cast<float>(param.cpu_data()[j]));
+    }
+  }
+
+  // Converting to a NetParameter and back keeps the definition and blobs.
+  NetParameter net_param, expected_param;
+  ReadNetParamFromWeightsStream(filename, &net_param);
+  this->net_->ToProto(&expected_param);
+  EXPECT_EQ(expected_param.DebugString(), net_param.DebugString());
+  WriteNetParamToWeightsStream(&net_param, filename);
+  EXPECT_EQ(expected_param.DebugString(), net_param.DebugString());
+  WeightsStreamReader reader(filename);
+  ASSERT_EQ(expected_param.layer_size(), reader.header().layer_size());
+  for (int i = 0; i < reader.header().layer_size(); ++i) {
+    EXPECT_EQ(0, reader.header().layer(i).blobs_size());
+  }
+  LayerParameter layer_param;
+  int num_layers = 0;
+  while (reader.ReadLayer(&layer_param)) {
+    EXPECT_EQ(2, layer_param.blobs_size());
+    ++num_layers;
+  }
+  EXPECT_EQ(2, num_layers);
+  remove(filename.c_str());
+}
+
+TYPED_TEST(NetTest, TestMappedWeights) {
+  typedef typename TypeParam::Dtype Dtype;
+  const bool kBiasTerm = true, kForceBackward = false;
+  Caffe::set_random_seed(this->seed_);
+  this->InitUnsharedWeightsNet(NULL, NULL, kForceBackward, kBiasTerm);
+  NetParameter net_param;
+  this->net_->ToProto(&net_param);
+  string filename;
+  MakeTempFilename(&filename);
+  WriteMappedWeights(net_param, filename);
+  EXPECT_TRUE(IsMappedWeightsFile(filename));
+  vector<shared_ptr<Blob<Dtype> > > params;
+  for (int i = 0; i < this->net_->params().size(); ++i) {
+    params.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    params[i]->CopyFrom(*this->net_->params()[i], false, true);
+  }
+
+  // Map the weights into a net initialized with other weights.
+  for (int pass = 0; pass < 2; ++pass) {
+    Caffe::set_random_seed(this->seed_ + 1);
+    this->InitUnsharedWeightsNet(NULL, NULL, kForceBackward, kBiasTerm);
+    this->net_->CopyTrainedLayersFrom(filename);
+    ASSERT_EQ(params.size(), this->net_->params().size());
+    for (int i = 0; i < params.size(); ++i) {
+      const Blob<Dtype>& param = *this->net_->params()[i];
+      ASSERT_EQ(params[i]->count(), param.count());
+      for (int j = 0; j < param.count(); ++j) {
+        EXPECT_EQ(static_cast<float>(params[i]->cpu_data()[j]),
+                  static_cast<float>(param.cpu_data()[j]));
+      }
+    }
+    // Writes stay private to the net that made them, so the second pass
+    // still sees the weights of the file.
+    caffe_set(this->net_->params()[0]->count(), Dtype(0),
+        this->net_->params()[0]->mutable_cpu_data());
+  }
+
+  // Reading the file back gives the blobs of net_param.
+  NetParameter mapped_param;
+  MappedWeights(filename).ToProto(&mapped_param);
+  int layer_id = 0;
+  for (int i = 0; i < net_param.layer_size(); ++i) {
+    if (net_param.layer(i).blobs_size() == 0) { continue; }
+    ASSERT_LT(layer_id, mapped_param.layer_size());
+    const LayerParameter& layer = mapped_param.layer(layer_id++);
+    EXPECT_EQ(net_param.layer(i).name(), layer.name());
+    ASSERT_EQ(net_param.layer(i).blobs_size(), layer.blobs_size());
+    for (int j = 0; j < layer.blobs_size(); ++j) {
+      EXPECT_EQ(net_param.layer(i).blobs(j).DebugString(),
+                layer.blobs(j).DebugString());
+    }
+  }
+  EXPECT_EQ(layer_id, mapped_param.layer_size());
+  remove(filename.c_str());
+}
+
 TYPED_TEST(NetTest, TestParamPropagateDown) {
   typedef typename TypeParam::Dtype Dtype;
   vector<Blob<Dtype>*> bottom;
@@ -2224,4 +2683,140 @@ TYPED_TEST(NetTest, TestReshape) {
   }
 }
 
+TYPED_TEST(NetTest, TestReserve) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Items run in batches of alternating sizes up to the reserved one match
+  // the items run one at a time, and no blob memory is replaced.
+  Caffe::set_random_seed(this->seed_);
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  const int kMaxBatch = 4;
+  Blob<Dtype> items(kMaxBatch, 3, 100, 100);
+  filler.Fill(&items);
+  this->InitReshapableNet();
+  Blob<Dtype>* input_blob = this->net_->input_blobs()[0];
+  Blob<Dtype>* output_blob = this->net_->output_blobs()[0];
+  vector<shared_ptr<Blob<Dtype> > > expected;
+  for (int i = 0; i < kMaxBatch; ++i) {
+    input_blob->Reshape(1, 3, 100, 100);
+    caffe_copy(input_blob->count(), items.cpu_data() + items.offset(i),
+        input_blob->mutable_cpu_data());
+    this->net_->ForwardPrefilled();
+    expected.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    expected[i]->CopyFrom(*output_blob, false, true);
+  }
+  vector<vector<int> > shapes(1, items.shape());
+  this->net_->Reserve(shapes);
+  EXPECT_EQ(1, input_blob->num());
+  const vector<shared_ptr<Blob<Dtype> > >& blobs = this->net_->blobs();
+  vector<SyncedMemory*> memory;
+  for (int i = 0; i < blobs.size(); ++i) {
+    memory.push_back(blobs[i]->data().get());
+  }
+  const int kBatches[] = { 2, 4, 1, 3, 4, 2 };
+  for (int b = 0; b < sizeof(kBatches) / sizeof(kBatches[0]); ++b) {
+    const int num = kBatches[b];
+    input_blob->Reshape(num, 3, 100, 100);
+    caffe_copy(input_blob->count(), items.cpu_data(),
+        input_blob->mutable_cpu_data());
+    this->net_->ForwardPrefilled();
+    ASSERT_EQ(num, output_blob->num());
+    for (int i = 0; i < num; ++i) {
+      const Dtype* output = output_blob->cpu_data() + output_blob->offset(i);
+      for (int j = 0; j < expected[i]->count(); ++j) {
+        EXPECT_NEAR(expected[i]->cpu_data()[j], output[j], 1e-5);
+      }
+    }
+    for (int i = 0; i < blobs.size(); ++i) {
+      EXPECT_EQ(memory[i], blobs[i]->data().get());
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestReshapeAfterBlobChanges) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Layers are reshaped again when their blobs change between passes
+  // without a change of the input shape.
+  Caffe::set_random_seed(this->seed_);
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  this->InitReshapableNet();
+  Blob<Dtype>* input_blob = this->net_->input_blobs()[0];
+  Blob<Dtype>* output_blob = this->net_->output_blobs()[0];
+  Blob<Dtype> other_input(input_blob->shape());
+  filler.Fill(&other_input);
+  input_blob->CopyFrom(other_input);
+  this->net_->ForwardPrefilled();
+  Blob<Dtype> expected;
+  expected.CopyFrom(*output_blob, false, true);
+  filler.Fill(input_blob);
+  this->net_->ForwardPrefilled();
+  // An intermediate blob reshaped from outside, and the input bound to
+  // other memory.
+  Blob<Dtype>* pool1 = this->net_->blob_by_name("pool1").get();
+  const vector<int> pool1_shape = pool1->shape();
+  pool1->Reshape(1, 1, 1, 1);
+  input_blob->ShareData(other_input);
+  this->net_->ForwardPrefilled();
+  EXPECT_TRUE(pool1_shape == pool1->shape());
+  ASSERT_EQ(expected.count(), output_blob->count());
+  for (int i = 0; i < expected.count(); ++i) {
+    EXPECT_EQ(expected.cpu_data()[i], output_blob->cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(NetTest, TestZeroCopyConcatSlice) {
+  typedef typename TypeParam::Dtype Dtype;
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  Blob<Dtype> input1(1, 3, 5, 5);
+  Blob<Dtype> input2(2, 3, 5, 5);
+  filler.Fill(&input1);
+  filler.Fill(&input2);
+  // Run the same inputs, including a batch size that forces the copying
+  // fallback, through nets with and without zero-copy Concat and Slice.
+  vector<shared_ptr<Blob<Dtype> > > outputs[2];
+  for (int zero_copy = 0; zero_copy < 2; ++zero_copy) {
+    Caffe::set_random_seed(this->seed_);
+    this->InitConcatNet(zero_copy);
+    EXPECT_EQ(static_cast<bool>(zero_copy),
+              this->net_->layer_by_name("concat")->share_views());
+    EXPECT_EQ(static_cast<bool>(zero_copy),
+              this->net_->layer_by_name("slice")->share_views());
+    Blob<Dtype>* input_blob = this->net_->input_blobs()[0];
+    Blob<Dtype>* inputs[] = { &input1, &input1, &input2, &input1 };
+    for (int i = 0; i < 4; ++i) {
+      input_blob->ReshapeLike(*inputs[i]);
+      input_blob->CopyFrom(*inputs[i]);
+      this->net_->ForwardPrefilled();
+      for (int j = 0; j < this->net_->num_outputs(); ++j) {
+        shared_ptr<Blob<Dtype> > output(new Blob<Dtype>());
+        output->CopyFrom(*this->net_->output_blobs()[j], false, true);
+        outputs[zero_copy].push_back(output);
+      }
+    }
+  }
+  ASSERT_EQ(outputs[0].size(), outputs[1].size());
+  for (int i = 0; i < outputs[0].size(); ++i) {
+    ASSERT_EQ(outputs[0][i]->count(), outputs[1][i]->count());
+    for (int j = 0; j < outputs[0][i]->count(); ++j) {
+      EXPECT_EQ(outputs[0][i]->cpu_data()[j], outputs[1][i]->cpu_data()[j]);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestZeroCopyConcatInPlaceConsumer) {
+  // An in-place layer on the concatenation would clobber the data its
+  // producers keep for backward, so the Concat must keep copying. The Slice
+  // comes after the in-place layer and may still alias its input.
+  const bool kZeroCopy = true;
+  const bool kInPlaceAfterConcat = true;
+  this->InitConcatNet(kZeroCopy, kInPlaceAfterConcat);
+  EXPECT_FALSE(this->net_->layer_by_name("concat")->share_views());
+  EXPECT_TRUE(this->net_->layer_by_name("slice")->share_views());
+}
+
 }  // namespace caffe
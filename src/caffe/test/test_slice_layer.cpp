@@ -118,6 +118,63 @@ TYPED_TEST(SliceLayerTest, TestSliceAcrossNum) {
   }
 }
 
+TYPED_TEST(SliceLayerTest, TestSliceAcrossNumSharedViews) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_slice_param()->set_axis(0);
+  SliceLayer<Dtype> layer(layer_param);
+  layer.set_share_views(true);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_0_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_0_);
+  const int top_count = this->blob_top_0_->count();
+  if (Caffe::mode() == Caffe::CPU) {
+    // The tops are views of their slices of the bottom.
+    EXPECT_EQ(this->blob_bottom_->cpu_data(), this->blob_top_0_->cpu_data());
+    EXPECT_EQ(this->blob_bottom_->cpu_data() + top_count,
+              this->blob_top_1_->cpu_data());
+  }
+  // Forwarding again after changing the bottom sees the new values.
+  caffe_set(this->blob_bottom_->count(), Dtype(3),
+            this->blob_bottom_->mutable_cpu_data());
+  layer.Reshape(this->blob_bottom_vec_, this->blob_top_vec_0_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_0_);
+  for (int i = 0; i < top_count; ++i) {
+    EXPECT_EQ(Dtype(3), this->blob_top_0_->cpu_data()[i]);
+    EXPECT_EQ(Dtype(3), this->blob_top_1_->cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(SliceLayerTest, TestSliceAcrossNumSharedViewsReshape) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_slice_param()->set_axis(0);
+  SliceLayer<Dtype> layer(layer_param);
+  layer.set_share_views(true);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_0_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_0_);
+  // Shrinking the bottom moves the second slice, but the second top still
+  // points into the bottom where that slice was.
+  this->blob_bottom_->Reshape(4, 12, 2, 3);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  Blob<Dtype> bottom_copy;
+  bottom_copy.CopyFrom(*this->blob_bottom_, false, true);
+  layer.Reshape(this->blob_bottom_vec_, this->blob_top_vec_0_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_0_);
+  const int top_count = this->blob_top_0_->count();
+  ASSERT_EQ(bottom_copy.count(), 2 * top_count);
+  for (int i = 0; i < top_count; ++i) {
+    EXPECT_EQ(bottom_copy.cpu_data()[i], this->blob_top_0_->cpu_data()[i]);
+    EXPECT_EQ(bottom_copy.cpu_data()[top_count + i],
+              this->blob_top_1_->cpu_data()[i]);
+  }
+  // The bottom itself is left untouched.
+  for (int i = 0; i < bottom_copy.count(); ++i) {
+    EXPECT_EQ(bottom_copy.cpu_data()[i], this->blob_bottom_->cpu_data()[i]);
+  }
+}
+
 TYPED_TEST(SliceLayerTest, TestSliceAcrossChannels) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
@@ -105,4 +105,79 @@ TYPED_TEST(SolverTest, TestInitTrainTestNets) {
   EXPECT_TRUE(this->solver_->test_nets()[1]->has_layer("accuracy"));
 }
 
+TYPED_TEST(SolverTest, TestAsyncTest) {
+  typedef typename TypeParam::Dtype Dtype;
+  const string& proto =
+     "max_iter: 4 "
+     "base_lr: 0.1 "
+     "lr_policy: 'fixed' "
+     "test_interval: 2 "
+     "test_iter: 3 "
+     "test_async: true "
+     "snapshot_after_train: false "
+     "net_param { "
+     "  name: 'TestNetwork' "
+     "  layer { "
+     "    name: 'data' "
+     "    type: 'DummyData' "
+     "    dummy_data_param { "
+     "      shape { "
+     "        dim: 5 "
+     "        dim: 2 "
+     "        dim: 3 "
+     "        dim: 4 "
+     "      } "
+     "      shape { "
+     "        dim: 5 "
+     "      } "
+     "    } "
+     "    top: 'data' "
+     "    top: 'label' "
+     "  } "
+     "  layer { "
+     "    name: 'innerprod' "
+     "    type: 'InnerProduct' "
+     "    inner_product_param { "
+     "      num_output: 10 "
+     "      weight_filler { "
+     "        type: 'gaussian' "
+     "      } "
+     "    } "
+     "    bottom: 'data' "
+     "    top: 'innerprod' "
+     "  } "
+     "  layer { "
+     "    name: 'accuracy' "
+     "    type: 'Accuracy' "
+     "    bottom: 'innerprod' "
+     "    bottom: 'label' "
+     "    top: 'accuracy' "
+     "    exclude: { phase: TRAIN } "
+     "  } "
+     "  layer { "
+     "    name: 'loss' "
+     "    type: 'SoftmaxWithLoss' "
+     "    bottom: 'innerprod' "
+     "    bottom: 'label' "
+     "  } "
+     "} ";
+  this->InitSolverFromProtoString(proto);
+  this->solver_->Solve();
+  // The test nets evaluate a copy of the train net weights, taken after the
+  // last iteration, rather than the train net weights themselves.
+  ASSERT_EQ(1, this->solver_->test_nets().size());
+  const vector<shared_ptr<Blob<Dtype> > >& train_params =
+      this->solver_->net()->params();
+  const vector<shared_ptr<Blob<Dtype> > >& test_params =
+      this->solver_->test_nets()[0]->params();
+  ASSERT_EQ(train_params.size(), test_params.size());
+  for (int i = 0; i < train_params.size(); ++i) {
+    EXPECT_NE(train_params[i]->cpu_data(), test_params[i]->cpu_data());
+    ASSERT_EQ(train_params[i]->count(), test_params[i]->count());
+    for (int j = 0; j < train_params[i]->count(); ++j) {
+      EXPECT_EQ(train_params[i]->cpu_data()[j], test_params[i]->cpu_data()[j]);
+    }
+  }
+}
+
 }  // namespace caffe
@@ -68,6 +68,33 @@ TEST_F(SyncedMemoryTest, TestCPUWrite) {
   }
 }
 
+TEST_F(SyncedMemoryTest, TestRelease) {
+  SyncedMemory mem(10);
+  caffe_memset(mem.size(), 1, mem.mutable_cpu_data());
+  mem.Release();
+  EXPECT_EQ(mem.head(), SyncedMemory::UNINITIALIZED);
+  EXPECT_EQ(mem.size(), 10);
+  // The memory comes back zero-filled.
+  const char* cpu_data = static_cast<const char*>(mem.cpu_data());
+  EXPECT_EQ(mem.head(), SyncedMemory::HEAD_AT_CPU);
+  for (int i = 0; i < mem.size(); ++i) {
+    EXPECT_EQ(cpu_data[i], 0);
+  }
+}
+
+TEST_F(SyncedMemoryTest, TestVersion) {
+  SyncedMemory mem(10);
+  const int version = mem.version();
+  // Reads leave the version alone; anything that may write bumps it.
+  mem.cpu_data();
+  EXPECT_EQ(version, mem.version());
+  mem.mutable_cpu_data();
+  EXPECT_GT(mem.version(), version);
+  const int written = mem.version();
+  mem.Release();
+  EXPECT_GT(mem.version(), written);
+}
+
 #ifndef CPU_ONLY  // GPU test
 
 TEST_F(SyncedMemoryTest, TestGPURead) {
@@ -0,0 +1,201 @@
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/net.hpp"
+#include "caffe/util/inference_engine.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/tiled_inference.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class TiledInferenceTest : public ::testing::Test {
+ protected:
+  TiledInferenceTest() {
+    Caffe::set_mode(Caffe::CPU);
+    // Two outputs at different strides; the biases make the padding of
+    // inner layers differ from padding the input.
+    const string proto =
+        "name: 'TiledNetwork' "
+        "input: 'data' "
+        "input_shape { dim: 1 dim: 2 dim: 16 dim: 16 } "
+        "layer { "
+        "  name: 'conv1' "
+        "  type: 'Convolution' "
+        "  bottom: 'data' "
+        "  top: 'conv1' "
+        "  convolution_param { "
+        "    num_output: 4 "
+        "    kernel_size: 3 "
+        "    pad: 1 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.5 "
+        "    } "
+        "    bias_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.5 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'relu1' "
+        "  type: 'ReLU' "
+        "  bottom: 'conv1' "
+        "  top: 'conv1' "
+        "} "
+        "layer { "
+        "  name: 'pool1' "
+        "  type: 'Pooling' "
+        "  bottom: 'conv1' "
+        "  top: 'pool1' "
+        "  pooling_param { "
+        "    pool: MAX "
+        "    kernel_size: 3 "
+        "    stride: 2 "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'conv2' "
+        "  type: 'Convolution' "
+        "  bottom: 'pool1' "
+        "  top: 'conv2' "
+        "  convolution_param { "
+        "    num_output: 3 "
+        "    kernel_size: 3 "
+        "    pad: 1 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.5 "
+        "    } "
+        "    bias_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.5 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'norm2' "
+        "  type: 'LRN' "
+        "  bottom: 'conv2' "
+        "  top: 'norm2' "
+        "  lrn_param { "
+        "    local_size: 3 "
+        "    norm_region: WITHIN_CHANNEL "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'prob' "
+        "  type: 'Softmax' "
+        "  bottom: 'norm2' "
+        "  top: 'prob' "
+        "} "
+        "layer { "
+        "  name: 'edge' "
+        "  type: 'Convolution' "
+        "  bottom: 'data' "
+        "  top: 'edge' "
+        "  convolution_param { "
+        "    num_output: 2 "
+        "    kernel_size: 5 "
+        "    pad: 2 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.5 "
+        "    } "
+        "  } "
+        "} ";
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &model_));
+    model_.mutable_state()->set_phase(TEST);
+    Net<Dtype> reference(model_);
+    NetParameter weights;
+    reference.ToProto(&weights);
+    MakeTempFilename(&weights_file_);
+    WriteProtoToBinaryFile(weights, weights_file_);
+    // An input larger than the tiles and its outputs from a single pass.
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    input_.Reshape(2, 2, 45, 61);
+    filler.Fill(&input_);
+    reference.input_blobs()[0]->ReshapeLike(input_);
+    const vector<Blob<Dtype>*>& outputs =
+        reference.Forward(vector<Blob<Dtype>*>(1, &input_));
+    for (int i = 0; i < outputs.size(); ++i) {
+      expected_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+      expected_[i]->CopyFrom(*outputs[i], false, true);
+    }
+  }
+
+  void CheckTiled(const int num_instances, const int tile_height,
+      const int tile_width) {
+    shared_ptr<InferenceEngine<Dtype> > engine(
+        new InferenceEngine<Dtype>(model_, weights_file_, num_instances));
+    TiledInference<Dtype> tiled(engine, tile_height, tile_width);
+    vector<shared_ptr<Blob<Dtype> > > outputs;
+    vector<Blob<Dtype>*> output_vec;
+    for (int i = 0; i < expected_.size(); ++i) {
+      outputs.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+      output_vec.push_back(outputs[i].get());
+    }
+    tiled.Forward(input_, output_vec);
+    const Dtype kTolerance = 1e-5;
+    for (int i = 0; i < expected_.size(); ++i) {
+      ASSERT_TRUE(expected_[i]->shape() == outputs[i]->shape());
+      for (int j = 0; j < outputs[i]->count(); ++j) {
+        EXPECT_NEAR(expected_[i]->cpu_data()[j], outputs[i]->cpu_data()[j],
+                    kTolerance);
+      }
+    }
+    // The net instances only ever held tiles.
+    for (int i = 0; i < num_instances; ++i) {
+      const Blob<Dtype>* net_input = engine->instance(i)->input_blobs()[0];
+      EXPECT_LE(net_input->height(), tile_height);
+      EXPECT_LE(net_input->width(), tile_width);
+    }
+  }
+
+  NetParameter model_;
+  string weights_file_;
+  Blob<Dtype> input_;
+  vector<shared_ptr<Blob<Dtype> > > expected_;
+};
+
+TYPED_TEST_CASE(TiledInferenceTest, TestDtypes);
+
+TYPED_TEST(TiledInferenceTest, TestReceptiveFields) {
+  shared_ptr<InferenceEngine<TypeParam> > engine(
+      new InferenceEngine<TypeParam>(this->model_, this->weights_file_, 1));
+  TiledInference<TypeParam> tiled(engine, 32, 32);
+  // The outputs are edge and prob, in the order of their names.
+  for (int axis = 0; axis < 2; ++axis) {
+    EXPECT_EQ(1, tiled.field(0, axis).stride);
+    EXPECT_EQ(-2, tiled.field(0, axis).offset);
+    EXPECT_EQ(5, tiled.field(0, axis).size);
+    EXPECT_EQ(2, tiled.field(1, axis).stride);
+    EXPECT_EQ(-5, tiled.field(1, axis).offset);
+    EXPECT_EQ(13, tiled.field(1, axis).size);
+  }
+}
+
+TYPED_TEST(TiledInferenceTest, TestForward) {
+  this->CheckTiled(1, 20, 24);
+}
+
+TYPED_TEST(TiledInferenceTest, TestForwardParallel) {
+  this->CheckTiled(3, 17, 16);
+}
+
+TYPED_TEST(TiledInferenceTest, TestForwardSingleTile) {
+  this->CheckTiled(2, 64, 64);
+}
+
+}  // namespace caffe
@@ -0,0 +1,404 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/allreduce.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+// How long the processes wait for each other to join: kJoinTries times
+// kJoinInterval microseconds.
+const int kJoinTries = 6000;
+const int kJoinInterval = 10000;
+
+template <typename Dtype>
+void Allreduce<Dtype>::Broadcast(Dtype* data, const size_t count) {
+  if (rank_ != 0) {
+    caffe_set(count, Dtype(0), data);
+  }
+  Sum(data, count);
+}
+
+template <typename Dtype>
+struct ShmAllreduce<Dtype>::Header {
+  pthread_barrier_t barrier;
+  // Set by rank 0 once the barrier is initialized.
+  volatile int ready;
+};
+
+template <typename Dtype>
+ShmAllreduce<Dtype>::ShmAllreduce(const int rank, const int world_size,
+    const string& name, const size_t chunk_size)
+    : Allreduce<Dtype>(rank, world_size), chunk_size_(chunk_size) {
+  CHECK_GE(rank, 0);
+  CHECK_LT(rank, world_size);
+  CHECK_GT(chunk_size, 0);
+  // Shared memory names are a slash followed by no other slashes, so a path
+  // works as the name too.
+  name_ = name;
+  std::replace(name_.begin(), name_.end(), '/', '_');
+  name_ = "/" + name_;
+  // Keep the chunks cache line aligned.
+  const size_t header_size = (sizeof(Header) + 63) / 64 * 64;
+  map_size_ = header_size + (world_size + 1) * chunk_size * sizeof(Dtype);
+  int fd;
+  if (rank == 0) {
+    // Remove any segment left behind by a job that failed to start.
+    shm_unlink(name_.c_str());
+    fd = shm_open(name_.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    CHECK_NE(fd, -1) << "Could not create shared memory " << name_;
+    CHECK_EQ(ftruncate(fd, map_size_), 0) << "Could not size " << name_;
+  } else {
+    for (int tries = 0; ; ++tries) {
+      fd = shm_open(name_.c_str(), O_RDWR, 0600);
+      if (fd != -1) {
+        struct stat shm_stat;
+        if (fstat(fd, &shm_stat) == 0 &&
+            static_cast<size_t>(shm_stat.st_size) == map_size_) {
+          break;
+        }
+        close(fd);
+      }
+      CHECK_LT(tries, kJoinTries) << "Timed out waiting for rank 0 to create "
+          << name_ << " (are all ranks using the same chunk size?)";
+      usleep(kJoinInterval);
+    }
+  }
+  void* map = mmap(NULL, map_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  CHECK(map != MAP_FAILED) << "Could not map " << name_;
+  map_ = static_cast<char*>(map);
+  header_ = reinterpret_cast<Header*>(map_);
+  chunks_ = reinterpret_cast<Dtype*>(map_ + header_size);
+  sum_ = chunks_ + world_size * chunk_size;
+  if (rank == 0) {
+    pthread_barrierattr_t attr;
+    CHECK_EQ(pthread_barrierattr_init(&attr), 0);
+    CHECK_EQ(pthread_barrierattr_setpshared(&attr, PTHREAD_PROCESS_SHARED), 0);
+    CHECK_EQ(pthread_barrier_init(&header_->barrier, &attr, world_size), 0);
+    pthread_barrierattr_destroy(&attr);
+    __sync_synchronize();
+    header_->ready = 1;
+  } else {
+    for (int tries = 0; !header_->ready; ++tries) {
+      CHECK_LT(tries, kJoinTries) << "Timed out waiting for rank 0 to set up "
+          << name_;
+      usleep(kJoinInterval);
+    }
+    __sync_synchronize();
+  }
+  // Once every process has attached, the name is no longer needed.
+  Wait();
+  if (rank == 0) {
+    shm_unlink(name_.c_str());
+  }
+}
+
+template <typename Dtype>
+ShmAllreduce<Dtype>::~ShmAllreduce() {
+  munmap(map_, map_size_);
+}
+
+template <typename Dtype>
+void ShmAllreduce<Dtype>::Wait() {
+  const int result = pthread_barrier_wait(&header_->barrier);
+  CHECK(result == 0 || result == PTHREAD_BARRIER_SERIAL_THREAD)
+      << "Barrier failed on " << name_;
+}
+
+template <typename Dtype>
+void ShmAllreduce<Dtype>::Sum(Dtype* data, const size_t count) {
+  const int rank = this->rank_;
+  const int world_size = this->world_size_;
+  for (size_t offset = 0; offset < count; offset += chunk_size_) {
+    const size_t n = std::min(chunk_size_, count - offset);
+    caffe_copy(n, data + offset, chunks_ + rank * chunk_size_);
+    // After this barrier every process has finished copying the previous sum
+    // out, so sum_ can be overwritten.
+    Wait();
+    const size_t begin = n * rank / world_size;
+    const size_t end = n * (rank + 1) / world_size;
+    if (end > begin) {
+      caffe_copy(end - begin, chunks_ + begin, sum_ + begin);
+      for (int r = 1; r < world_size; ++r) {
+        caffe_add(end - begin, sum_ + begin, chunks_ + r * chunk_size_ + begin,
+            sum_ + begin);
+      }
+    }
+    Wait();
+    caffe_copy(n, sum_, data + offset);
+  }
+}
+
+static void ReadFully(const int fd, void* data, size_t size) {
+  char* bytes = static_cast<char*>(data);
+  while (size) {
+    const ssize_t result = read(fd, bytes, size);
+    if (result < 0 && errno == EINTR) { continue; }
+    CHECK_GT(result, 0) << "Lost the connection to another rank.";
+    bytes += result;
+    size -= result;
+  }
+}
+
+static void WriteFully(const int fd, const void* data, size_t size) {
+  const char* bytes = static_cast<const char*>(data);
+  while (size) {
+    const ssize_t result = write(fd, bytes, size);
+    if (result < 0 && errno == EINTR) { continue; }
+    CHECK_GT(result, 0) << "Lost the connection to another rank.";
+    bytes += result;
+    size -= result;
+  }
+}
+
+template <typename Dtype>
+SocketAllreduce<Dtype>::SocketAllreduce(const int rank, const int world_size,
+    const string& path, const size_t chunk_size)
+    : Allreduce<Dtype>(rank, world_size), path_(path),
+      chunk_size_(chunk_size), sockets_(world_size, -1) {
+  CHECK_GE(rank, 0);
+  CHECK_LT(rank, world_size);
+  CHECK_GT(chunk_size, 0);
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  CHECK_LT(path.size(), sizeof(address.sun_path)) << "Path too long: " << path;
+  strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+  if (rank == 0) {
+    const int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    CHECK_NE(listener, -1) << "Could not create a socket.";
+    unlink(path.c_str());
+    CHECK_EQ(bind(listener, reinterpret_cast<struct sockaddr*>(&address),
+        sizeof(address)), 0) << "Could not bind " << path;
+    CHECK_EQ(listen(listener, world_size), 0) << "Could not listen on " << path;
+    for (int i = 1; i < world_size; ++i) {
+      const int fd = accept(listener, NULL, NULL);
+      CHECK_NE(fd, -1) << "Could not accept a connection on " << path;
+      int32_t peer;
+      ReadFully(fd, &peer, sizeof(peer));
+      CHECK(peer > 0 && peer < world_size && sockets_[peer] == -1)
+          << "Unexpected rank " << peer << " connected to " << path;
+      sockets_[peer] = fd;
+    }
+    close(listener);
+    unlink(path.c_str());
+  } else {
+    for (int tries = 0; ; ++tries) {
+      const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+      CHECK_NE(fd, -1) << "Could not create a socket.";
+      if (connect(fd, reinterpret_cast<struct sockaddr*>(&address),
+          sizeof(address)) == 0) {
+        sockets_[0] = fd;
+        break;
+      }
+      close(fd);
+      CHECK_LT(tries, kJoinTries) << "Timed out connecting to rank 0 on "
+          << path;
+      usleep(kJoinInterval);
+    }
+    const int32_t peer = rank;
+    WriteFully(sockets_[0], &peer, sizeof(peer));
+  }
+  buffer_.resize(chunk_size);
+}
+
+template <typename Dtype>
+SocketAllreduce<Dtype>::~SocketAllreduce() {
+  for (int i = 0; i < sockets_.size(); ++i) {
+    if (sockets_[i] != -1) {
+      close(sockets_[i]);
+    }
+  }
+}
+
+template <typename Dtype>
+void SocketAllreduce<Dtype>::Sum(Dtype* data, const size_t count) {
+  const int world_size = this->world_size_;
+  for (size_t offset = 0; offset < count; offset += chunk_size_) {
+    const size_t n = std::min(chunk_size_, count - offset);
+    Dtype* chunk = data + offset;
+    if (this->rank_ == 0) {
+      for (int r = 1; r < world_size; ++r) {
+        ReadFully(sockets_[r], &buffer_[0], n * sizeof(Dtype));
+        caffe_add(n, chunk, &buffer_[0], chunk);
+      }
+      for (int r = 1; r < world_size; ++r) {
+        WriteFully(sockets_[r], chunk, n * sizeof(Dtype));
+      }
+    } else {
+      WriteFully(sockets_[0], chunk, n * sizeof(Dtype));
+      ReadFully(sockets_[0], chunk, n * sizeof(Dtype));
+    }
+  }
+}
+
+template <typename Dtype>
+shared_ptr<Allreduce<Dtype> > GetAllreduce(const SolverParameter& param) {
+  const int rank = param.rank();
+  const int world_size = param.world_size();
+  const size_t chunk_size = param.allreduce_bucket_size();
+  LOG(INFO) << "Rank " << rank << " of " << world_size << " joining "
+      << param.allreduce_endpoint();
+  switch (param.allreduce_transport()) {
+  case SolverParameter_AllreduceTransport_SHM:
+    return shared_ptr<Allreduce<Dtype> >(new ShmAllreduce<Dtype>(rank,
+        world_size, param.allreduce_endpoint(), chunk_size));
+  case SolverParameter_AllreduceTransport_SOCKET:
+    return shared_ptr<Allreduce<Dtype> >(new SocketAllreduce<Dtype>(rank,
+        world_size, param.allreduce_endpoint(), chunk_size));
+  default:
+    LOG(FATAL) << "Unknown allreduce transport: "
+        << param.allreduce_transport();
+  }
+  return shared_ptr<Allreduce<Dtype> >();
+}
+
+template <typename Dtype>
+BucketedAllreduce<Dtype>::BucketedAllreduce(
+    shared_ptr<Allreduce<Dtype> > allreduce,
+    const vector<Blob<Dtype>*>& params, const size_t bucket_size)
+    : allreduce_(allreduce), params_(params), param_bucket_(params.size()),
+      num_reduced_(0), stop_(false), mutex_(new boost::mutex()),
+      condition_(new boost::condition_variable()) {
+  size_t bucket_fill = 0;
+  for (int i = 0; i < params_.size(); ++i) {
+    const size_t count = params_[i]->count();
+    if (bucket_params_.empty() ||
+        (bucket_fill > 0 && bucket_fill + count > bucket_size)) {
+      bucket_params_.push_back(vector<int>());
+      bucket_fill = 0;
+    }
+    bucket_params_.back().push_back(i);
+    param_bucket_[i] = bucket_params_.size() - 1;
+    bucket_fill += count;
+  }
+  const int num_buckets = bucket_params_.size();
+  buffers_.resize(num_buckets);
+  bucket_data_.resize(num_buckets);
+  bucket_count_.resize(num_buckets);
+  bucket_pending_.resize(num_buckets);
+  for (int b = 0; b < num_buckets; ++b) {
+    size_t count = 0;
+    for (int i = 0; i < bucket_params_[b].size(); ++i) {
+      count += params_[bucket_params_[b][i]]->count();
+    }
+    if (bucket_params_[b].size() > 1) {
+      buffers_[b].resize(count);
+    }
+    bucket_count_[b] = count;
+    bucket_pending_[b] = bucket_params_[b].size();
+  }
+  thread_.reset(new boost::thread(&BucketedAllreduce<Dtype>::ThreadEntry,
+      this));
+}
+
+template <typename Dtype>
+BucketedAllreduce<Dtype>::~BucketedAllreduce() {
+  {
+    boost::mutex::scoped_lock lock(*mutex_);
+    stop_ = true;
+  }
+  condition_->notify_all();
+  thread_->join();
+}
+
+template <typename Dtype>
+void BucketedAllreduce<Dtype>::ParamReady(const int param_id) {
+  const int bucket = param_bucket_[param_id];
+  CHECK_GT(bucket_pending_[bucket], 0) << "The gradient of parameter "
+      << param_id << " was already marked ready.";
+  if (--bucket_pending_[bucket] > 0) { return; }
+  const vector<int>& bucket_params = bucket_params_[bucket];
+  if (buffers_[bucket].empty()) {
+    bucket_data_[bucket] = params_[bucket_params[0]]->mutable_cpu_diff();
+  } else {
+    Dtype* buffer = &buffers_[bucket][0];
+    for (int i = 0; i < bucket_params.size(); ++i) {
+      const Blob<Dtype>& param = *params_[bucket_params[i]];
+      caffe_copy(param.count(), param.cpu_diff(), buffer);
+      buffer += param.count();
+    }
+    bucket_data_[bucket] = &buffers_[bucket][0];
+  }
+  {
+    boost::mutex::scoped_lock lock(*mutex_);
+    queue_.push_back(bucket);
+  }
+  condition_->notify_all();
+}
+
+template <typename Dtype>
+void BucketedAllreduce<Dtype>::Finish() {
+  for (int b = 0; b < num_buckets(); ++b) {
+    CHECK_EQ(bucket_pending_[b], 0) << "Not all the gradients are ready.";
+  }
+  {
+    boost::mutex::scoped_lock lock(*mutex_);
+    while (num_reduced_ < num_buckets()) {
+      condition_->wait(lock);
+    }
+    num_reduced_ = 0;
+  }
+  for (int b = 0; b < num_buckets(); ++b) {
+    const vector<int>& bucket_params = bucket_params_[b];
+    if (!buffers_[b].empty()) {
+      const Dtype* buffer = &buffers_[b][0];
+      for (int i = 0; i < bucket_params.size(); ++i) {
+        Blob<Dtype>* param = params_[bucket_params[i]];
+        caffe_copy(param->count(), buffer, param->mutable_cpu_diff());
+        buffer += param->count();
+      }
+    }
+    bucket_pending_[b] = bucket_params.size();
+  }
+}
+
+template <typename Dtype>
+void BucketedAllreduce<Dtype>::ThreadEntry() {
+  while (true) {
+    int bucket;
+    {
+      boost::mutex::scoped_lock lock(*mutex_);
+      while (queue_.empty() && !stop_) {
+        condition_->wait(lock);
+      }
+      if (queue_.empty()) { return; }
+      bucket = queue_.front();
+      queue_.pop_front();
+    }
+    allreduce_->Sum(bucket_data_[bucket], bucket_count_[bucket]);
+    {
+      boost::mutex::scoped_lock lock(*mutex_);
+      ++num_reduced_;
+    }
+    condition_->notify_all();
+  }
+}
+
+INSTANTIATE_CLASS(Allreduce);
+INSTANTIATE_CLASS(ShmAllreduce);
+INSTANTIATE_CLASS(SocketAllreduce);
+INSTANTIATE_CLASS(BucketedAllreduce);
+template shared_ptr<Allreduce<float> > GetAllreduce<float>(
+    const SolverParameter& param);
+template shared_ptr<Allreduce<double> > GetAllreduce<double>(
+    const SolverParameter& param);
+
+}  // namespace caffe
@@ -0,0 +1,235 @@
+#include <boost/thread.hpp>
+
+#include <deque>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/dynamic_batcher.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+struct DynamicBatcher<Dtype>::Request {
+  const vector<Blob<Dtype>*>* inputs;
+  const vector<Blob<Dtype>*>* outputs;
+  // The number of items along the first axis.
+  int num;
+  boost::system_time enqueued;
+  bool done;
+};
+
+// Returns whether the inputs of two requests agree on all but the first axis.
+template <typename Dtype>
+static bool SameItemShape(const vector<Blob<Dtype>*>& a,
+    const vector<Blob<Dtype>*>& b) {
+  if (a.size() != b.size()) { return false; }
+  for (int i = 0; i < a.size(); ++i) {
+    if (a[i]->num_axes() != b[i]->num_axes()) { return false; }
+    for (int j = 1; j < a[i]->num_axes(); ++j) {
+      if (a[i]->shape(j) != b[i]->shape(j)) { return false; }
+    }
+  }
+  return true;
+}
+
+// The sizes of each batch: 1, 2, ..., max_batch_size.
+static vector<double> BatchFillBounds(const int max_batch_size) {
+  vector<double> bounds;
+  for (int i = 2; i <= max_batch_size + 1; ++i) {
+    bounds.push_back(i);
+  }
+  return bounds;
+}
+
+template <typename Dtype>
+DynamicBatcher<Dtype>::DynamicBatcher(
+    shared_ptr<InferenceEngine<Dtype> > engine, const int max_batch_size,
+    const double max_delay_ms)
+    : engine_(engine), max_batch_size_(max_batch_size),
+      max_delay_ms_(max_delay_ms),
+      queue_latency_(Histogram::GeometricBounds(0.01, 10000, 2)),
+      batch_fill_(BatchFillBounds(max_batch_size)), stop_(false),
+      mutex_(new boost::mutex()),
+      queue_changed_(new boost::condition_variable()),
+      batch_done_(new boost::condition_variable()) {
+  CHECK_GT(max_batch_size_, 0);
+  CHECK_GE(max_delay_ms_, 0);
+  // Reserve the memory of a full batch, so that batches of any size up to it
+  // only reshape the blobs.
+  for (int i = 0; i < engine_->num_instances(); ++i) {
+    Net<Dtype>* net = engine_->instance(i).get();
+    vector<vector<int> > shapes(net->num_inputs());
+    for (int j = 0; j < net->num_inputs(); ++j) {
+      shapes[j] = net->input_blobs()[j]->shape();
+      CHECK_GT(shapes[j].size(), 0) << "Net inputs need a batch axis.";
+      shapes[j][0] = max_batch_size_;
+    }
+    net->Reserve(shapes);
+  }
+  for (int i = 0; i < engine_->num_instances(); ++i) {
+    workers_.push_back(shared_ptr<boost::thread>(new boost::thread(
+        &DynamicBatcher<Dtype>::WorkerEntry, this)));
+  }
+}
+
+template <typename Dtype>
+DynamicBatcher<Dtype>::~DynamicBatcher() {
+  {
+    boost::mutex::scoped_lock lock(*mutex_);
+    stop_ = true;
+  }
+  queue_changed_->notify_all();
+  for (int i = 0; i < workers_.size(); ++i) {
+    workers_[i]->join();
+  }
+}
+
+template <typename Dtype>
+void DynamicBatcher<Dtype>::Predict(const vector<Blob<Dtype>*>& inputs,
+    const vector<Blob<Dtype>*>& outputs) {
+  CHECK_GT(inputs.size(), 0);
+  Request request;
+  request.inputs = &inputs;
+  request.outputs = &outputs;
+  request.num = inputs[0]->shape(0);
+  request.done = false;
+  CHECK_GT(request.num, 0);
+  CHECK_LE(request.num, max_batch_size_) << "Requests may hold at most "
+      << max_batch_size_ << " items.";
+  for (int i = 1; i < inputs.size(); ++i) {
+    CHECK_EQ(request.num, inputs[i]->shape(0))
+        << "The inputs must hold the same number of items.";
+  }
+  boost::mutex::scoped_lock lock(*mutex_);
+  CHECK(!stop_);
+  request.enqueued = boost::get_system_time();
+  queue_.push_back(&request);
+  queue_changed_->notify_all();
+  while (!request.done) {
+    batch_done_->wait(lock);
+  }
+}
+
+template <typename Dtype>
+int DynamicBatcher<Dtype>::BatchableItems() const {
+  int items = 0;
+  for (int i = 0; i < queue_.size(); ++i) {
+    if (items + queue_[i]->num > max_batch_size_ ||
+        !SameItemShape(*queue_[0]->inputs, *queue_[i]->inputs)) {
+      break;
+    }
+    items += queue_[i]->num;
+  }
+  return items;
+}
+
+template <typename Dtype>
+bool DynamicBatcher<Dtype>::NextBatch(vector<Request*>* batch) {
+  boost::mutex::scoped_lock lock(*mutex_);
+  while (true) {
+    while (queue_.empty() && !stop_) {
+      queue_changed_->wait(lock);
+    }
+    if (queue_.empty()) { return false; }
+    // Wait for the batch to fill up or for the oldest request to time out.
+    const Request* front = queue_.front();
+    const boost::system_time deadline = front->enqueued +
+        boost::posix_time::microseconds(
+            static_cast<int64_t>(max_delay_ms_ * 1000));
+    while (!stop_ && !queue_.empty() && queue_.front() == front &&
+        BatchableItems() < max_batch_size_ &&
+        boost::get_system_time() < deadline) {
+      queue_changed_->timed_wait(lock, deadline);
+    }
+    // Another worker may have taken the request meanwhile.
+    if (!queue_.empty() && queue_.front() == front) { break; }
+  }
+  const int items = BatchableItems();
+  const boost::system_time now = boost::get_system_time();
+  batch->clear();
+  for (int taken = 0; taken < items; taken += batch->back()->num) {
+    batch->push_back(queue_.front());
+    queue_.pop_front();
+    queue_latency_.Add((now - batch->back()->enqueued).total_microseconds()
+        / 1000.);
+  }
+  batch_fill_.Add(items);
+  return true;
+}
+
+template <typename Dtype>
+void DynamicBatcher<Dtype>::RunBatch(const vector<Request*>& batch) {
+  int items = 0;
+  for (int i = 0; i < batch.size(); ++i) {
+    items += batch[i]->num;
+  }
+  const int instance_id = engine_->AcquireInstance();
+  Net<Dtype>* net = engine_->instance(instance_id).get();
+  const vector<Blob<Dtype>*>& first_inputs = *batch[0]->inputs;
+  CHECK_EQ(first_inputs.size(), net->num_inputs()) << "Expected one input "
+      << "per net input.";
+  for (int i = 0; i < net->num_inputs(); ++i) {
+    vector<int> shape = first_inputs[i]->shape();
+    shape[0] = items;
+    Blob<Dtype>* input = net->input_blobs()[i];
+    input->Reshape(shape);
+    Dtype* input_data = input->mutable_cpu_data();
+    for (int j = 0; j < batch.size(); ++j) {
+      const Blob<Dtype>* request_input = (*batch[j]->inputs)[i];
+      caffe_copy(request_input->count(), request_input->cpu_data(),
+          input_data);
+      input_data += request_input->count();
+    }
+  }
+  net->ForwardPrefilled();
+  for (int i = 0; i < net->num_outputs(); ++i) {
+    const Blob<Dtype>* output = net->output_blobs()[i];
+    CHECK_GT(output->num_axes(), 0);
+    CHECK_EQ(items, output->shape(0)) << "Net outputs need a batch axis.";
+    const Dtype* output_data = output->cpu_data();
+    vector<int> shape = output->shape();
+    for (int j = 0; j < batch.size(); ++j) {
+      CHECK_EQ(batch[j]->outputs->size(), net->num_outputs())
+          << "Expected one output per net output.";
+      Blob<Dtype>* request_output = (*batch[j]->outputs)[i];
+      shape[0] = batch[j]->num;
+      request_output->Reshape(shape);
+      caffe_copy(request_output->count(), output_data,
+          request_output->mutable_cpu_data());
+      output_data += request_output->count();
+    }
+  }
+  engine_->ReleaseInstance(instance_id);
+}
+
+template <typename Dtype>
+void DynamicBatcher<Dtype>::WorkerEntry() {
+  vector<Request*> batch;
+  while (NextBatch(&batch)) {
+    RunBatch(batch);
+    {
+      boost::mutex::scoped_lock lock(*mutex_);
+      for (int i = 0; i < batch.size(); ++i) {
+        batch[i]->done = true;
+      }
+    }
+    batch_done_->notify_all();
+  }
+}
+
+template <typename Dtype>
+Histogram DynamicBatcher<Dtype>::queue_latency() const {
+  boost::mutex::scoped_lock lock(*mutex_);
+  return queue_latency_;
+}
+
+template <typename Dtype>
+Histogram DynamicBatcher<Dtype>::batch_fill() const {
+  boost::mutex::scoped_lock lock(*mutex_);
+  return batch_fill_;
+}
+
+INSTANTIATE_CLASS(DynamicBatcher);
+
+}  // namespace caffe
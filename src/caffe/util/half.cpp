@@ -0,0 +1,175 @@
+#ifdef __F16C__
+#include <immintrin.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "caffe/util/half.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+// Size of the Dtype weight panel converted at a time by caffe_cpu_gemm_half.
+const int kHalfPanelBytes = 1 << 20;
+
+uint16_t caffe_float_to_half(const float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  const uint16_t sign = (bits >> 16) & 0x8000;
+  const uint32_t abs = bits & 0x7fffffff;
+  if (abs >= 0x7f800000) {
+    // Inf stays inf; NaN stays a (quiet) NaN.
+    return sign | 0x7c00 | (abs > 0x7f800000 ? 0x200 : 0);
+  }
+  if (abs >= 0x477ff000) {
+    // Rounds past the largest half, 65504.
+    return sign | 0x7c00;
+  }
+  if (abs < 0x38800000) {
+    // Below the smallest normal half, 2^-14: round to a subnormal.
+    if (abs < 0x33000000) {
+      return sign;
+    }
+    const int shift = 126 - static_cast<int>(abs >> 23);
+    const uint32_t mantissa = (abs & 0x7fffff) | 0x800000;
+    uint32_t half = mantissa >> shift;
+    const uint32_t remainder = mantissa & ((1u << shift) - 1);
+    const uint32_t halfway = 1u << (shift - 1);
+    if (remainder > halfway || (remainder == halfway && (half & 1))) {
+      ++half;
+    }
+    return sign | half;
+  }
+  // Rebias the exponent from 127 to 15 and round off 13 mantissa bits; a
+  // carry out of the mantissa correctly bumps the exponent.
+  uint32_t half = (abs - 0x38000000) >> 13;
+  const uint32_t remainder = abs & 0x1fff;
+  if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1))) {
+    ++half;
+  }
+  return sign | half;
+}
+
+float caffe_half_to_float(const uint16_t value) {
+  const uint32_t sign = static_cast<uint32_t>(value & 0x8000) << 16;
+  uint32_t exponent = (value >> 10) & 0x1f;
+  uint32_t mantissa = value & 0x3ff;
+  uint32_t bits;
+  if (exponent == 0x1f) {
+    bits = sign | 0x7f800000 | (mantissa << 13);
+  } else if (exponent == 0) {
+    if (mantissa == 0) {
+      bits = sign;
+    } else {
+      // Normalize the subnormal.
+      exponent = 113;
+      while (!(mantissa & 0x400)) {
+        mantissa <<= 1;
+        --exponent;
+      }
+      bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+    }
+  } else {
+    bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+  }
+  float result;
+  memcpy(&result, &bits, sizeof(result));
+  return result;
+}
+
+template <typename Dtype>
+void caffe_cpu_float2half(const int n, const Dtype* x, uint16_t* y) {
+  for (int i = 0; i < n; ++i) {
+    y[i] = caffe_float_to_half(static_cast<float>(x[i]));
+  }
+}
+
+template <typename Dtype>
+void caffe_cpu_half2float(const int n, const uint16_t* x, Dtype* y) {
+  for (int i = 0; i < n; ++i) {
+    y[i] = static_cast<Dtype>(caffe_half_to_float(x[i]));
+  }
+}
+
+#ifdef __F16C__
+template <>
+void caffe_cpu_float2half<float>(const int n, const float* x, uint16_t* y) {
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(y + i), _mm256_cvtps_ph(
+        _mm256_loadu_ps(x + i), _MM_FROUND_TO_NEAREST_INT));
+  }
+  for (; i < n; ++i) {
+    y[i] = caffe_float_to_half(x[i]);
+  }
+}
+
+template <>
+void caffe_cpu_half2float<float>(const int n, const uint16_t* x, float* y) {
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    _mm256_storeu_ps(y + i, _mm256_cvtph_ps(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i))));
+  }
+  for (; i < n; ++i) {
+    y[i] = caffe_half_to_float(x[i]);
+  }
+}
+#endif
+
+template void caffe_cpu_float2half<float>(const int n, const float* x,
+    uint16_t* y);
+template void caffe_cpu_float2half<double>(const int n, const double* x,
+    uint16_t* y);
+template void caffe_cpu_float2half<int>(const int n, const int* x,
+    uint16_t* y);
+template void caffe_cpu_float2half<unsigned int>(const int n,
+    const unsigned int* x, uint16_t* y);
+template void caffe_cpu_half2float<float>(const int n, const uint16_t* x,
+    float* y);
+template void caffe_cpu_half2float<double>(const int n, const uint16_t* x,
+    double* y);
+template void caffe_cpu_half2float<int>(const int n, const uint16_t* x,
+    int* y);
+template void caffe_cpu_half2float<unsigned int>(const int n,
+    const uint16_t* x, unsigned int* y);
+
+template <typename Dtype>
+void caffe_cpu_gemm_half(const CBLAS_TRANSPOSE TransW, const int M,
+    const int N, const int K, const uint16_t* W, const Dtype* X, Dtype* C) {
+  const int num_rows = (TransW == CblasNoTrans) ? M : N;
+  const int panel_rows = std::max(1, std::min(num_rows,
+      static_cast<int>(kHalfPanelBytes / (K * sizeof(Dtype)))));
+  vector<Dtype> panel(panel_rows * K);
+  vector<Dtype> panel_output;
+  if (TransW == CblasTrans) {
+    panel_output.resize(M * panel_rows);
+  }
+  for (int row = 0; row < num_rows; row += panel_rows) {
+    const int rows = std::min(panel_rows, num_rows - row);
+    caffe_cpu_half2float(rows * K, W + row * K, &panel[0]);
+    if (TransW == CblasNoTrans) {
+      // The panel yields whole rows of C.
+      caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, rows, N, K,
+          Dtype(1), &panel[0], X, Dtype(0), C + row * N);
+    } else {
+      // The panel yields a block of columns of C.
+      caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, M, rows, K,
+          Dtype(1), X, &panel[0], Dtype(0), &panel_output[0]);
+      for (int i = 0; i < M; ++i) {
+        caffe_copy(rows, &panel_output[i * rows], C + i * N + row);
+      }
+    }
+  }
+}
+
+template void caffe_cpu_gemm_half<float>(const CBLAS_TRANSPOSE TransW,
+    const int M, const int N, const int K, const uint16_t* W, const float* X,
+    float* C);
+template void caffe_cpu_gemm_half<double>(const CBLAS_TRANSPOSE TransW,
+    const int M, const int N, const int K, const uint16_t* W, const double* X,
+    double* C);
+
+}  // namespace caffe
@@ -0,0 +1,68 @@
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/histogram.hpp"
+
+namespace caffe {
+
+Histogram::Histogram(const vector<double>& bounds)
+    : bounds_(bounds), counts_(bounds.size() + 1, 0), count_(0), sum_(0),
+      max_(0) {
+  for (int i = 1; i < bounds_.size(); ++i) {
+    CHECK_LT(bounds_[i - 1], bounds_[i]) << "Bounds must be increasing.";
+  }
+}
+
+vector<double> Histogram::GeometricBounds(const double first,
+    const double last, const double factor) {
+  CHECK_GT(first, 0);
+  CHECK_GT(factor, 1);
+  vector<double> bounds(1, first);
+  while (bounds.back() < last) {
+    bounds.push_back(bounds.back() * factor);
+  }
+  return bounds;
+}
+
+void Histogram::Add(const double value) {
+  const int bucket = std::upper_bound(bounds_.begin(), bounds_.end(), value)
+      - bounds_.begin();
+  ++counts_[bucket];
+  max_ = count_ ? std::max(max_, value) : value;
+  ++count_;
+  sum_ += value;
+}
+
+double Histogram::Quantile(const double q) const {
+  CHECK_GE(q, 0);
+  CHECK_LE(q, 1);
+  if (count_ == 0) { return 0; }
+  int64_t seen = 0;
+  for (int i = 0; i < bounds_.size(); ++i) {
+    seen += counts_[i];
+    if (seen > 0 && seen >= q * count_) {
+      return std::min(bounds_[i], max_);
+    }
+  }
+  return max_;
+}
+
+string Histogram::ToString() const {
+  std::ostringstream out;
+  for (int i = 0; i < counts_.size(); ++i) {
+    if (counts_[i] == 0) { continue; }
+    if (out.tellp() > 0) { out << ", "; }
+    if (i < bounds_.size()) {
+      out << "<" << bounds_[i];
+    } else {
+      out << ">=" << bounds_.back();
+    }
+    out << ": " << counts_[i];
+  }
+  return out.str();
+}
+
+}  // namespace caffe
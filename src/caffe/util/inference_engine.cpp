@@ -0,0 +1,108 @@
+#include <boost/thread.hpp>
+
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/inference_engine.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+InferenceEngine<Dtype>::InferenceEngine(const string& model_file,
+    const string& weights_file, const int num_instances) {
+  NetParameter model;
+  ReadNetParamsFromTextFileOrDie(model_file, &model);
+  Init(model, weights_file, num_instances);
+}
+
+template <typename Dtype>
+InferenceEngine<Dtype>::InferenceEngine(const NetParameter& model,
+    const string& weights_file, const int num_instances) {
+  Init(model, weights_file, num_instances);
+}
+
+template <typename Dtype>
+void InferenceEngine<Dtype>::Init(const NetParameter& model,
+    const string& weights_file, const int num_instances) {
+  CHECK_GT(num_instances, 0);
+  mutex_.reset(new boost::mutex());
+  instance_free_.reset(new boost::condition_variable());
+  NetParameter param(model);
+  param.mutable_state()->set_phase(TEST);
+  instances_.push_back(shared_ptr<Net<Dtype> >(new Net<Dtype>(param)));
+  Net<Dtype>* source = instances_[0].get();
+  source->CopyTrainedLayersFrom(weights_file);
+  // Bring the parameters to the device now: the instances only read them,
+  // while the first access would move data under concurrent readers. Half
+  // precision weights are only ever read as such, on the CPU (Net::Init
+  // only allows them on layers with a half precision forward).
+  for (int i = 0; i < source->params().size(); ++i) {
+    const Blob<Dtype>& param = *source->params()[i];
+    if (param.is_half()) {
+      CHECK_EQ(Caffe::mode(), Caffe::CPU)
+          << "Half precision weights are only supported on the CPU.";
+      param.cpu_half_data();
+    } else if (Caffe::mode() == Caffe::GPU) {
+      param.gpu_data();
+    } else {
+      param.cpu_data();
+    }
+  }
+  // Sharing the weights also makes their int8 and sparse copies on the
+  // source, once, and shares those.
+  for (int i = 1; i < num_instances; ++i) {
+    instances_.push_back(shared_ptr<Net<Dtype> >(new Net<Dtype>(param)));
+    instances_[i]->ShareTrainedLayersWith(source);
+  }
+  for (int i = num_instances - 1; i >= 0; --i) {
+    free_instances_.push_back(i);
+  }
+  LOG(INFO) << "Inference engine with " << num_instances
+            << " instances of " << source->name();
+}
+
+template <typename Dtype>
+int InferenceEngine<Dtype>::AcquireInstance() {
+  boost::mutex::scoped_lock lock(*mutex_);
+  while (free_instances_.empty()) {
+    instance_free_->wait(lock);
+  }
+  const int instance_id = free_instances_.back();
+  free_instances_.pop_back();
+  return instance_id;
+}
+
+template <typename Dtype>
+void InferenceEngine<Dtype>::ReleaseInstance(const int instance_id) {
+  {
+    boost::mutex::scoped_lock lock(*mutex_);
+    free_instances_.push_back(instance_id);
+  }
+  instance_free_->notify_one();
+}
+
+template <typename Dtype>
+void InferenceEngine<Dtype>::Predict(const vector<Blob<Dtype>*>& inputs,
+    const vector<Blob<Dtype>*>& outputs) {
+  const int instance_id = AcquireInstance();
+  Net<Dtype>* net = instances_[instance_id].get();
+  CHECK_EQ(inputs.size(), net->num_inputs()) << "Expected one input per "
+      << "net input.";
+  CHECK_EQ(outputs.size(), net->num_outputs()) << "Expected one output per "
+      << "net output.";
+  for (int i = 0; i < inputs.size(); ++i) {
+    net->input_blobs()[i]->ReshapeLike(*inputs[i]);
+    net->input_blobs()[i]->CopyFrom(*inputs[i]);
+  }
+  net->ForwardPrefilled();
+  for (int i = 0; i < outputs.size(); ++i) {
+    outputs[i]->CopyFrom(*net->output_blobs()[i], false, true);
+  }
+  ReleaseInstance(instance_id);
+}
+
+INSTANTIATE_CLASS(InferenceEngine);
+
+}  // namespace caffe
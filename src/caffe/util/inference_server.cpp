@@ -0,0 +1,430 @@
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/inference_server.hpp"
+
+namespace caffe {
+
+// Bounds on what a peer may ask to be read, so that a corrupt message fails
+// instead of allocating without limit.
+const uint32_t kMaxImageBytes = 64 << 20;
+const uint32_t kMaxErrorBytes = 1 << 16;
+
+// Unlike for Allreduce, a lost connection is not fatal to the server, so
+// these return whether all the bytes went through.
+static bool ReadFully(const int fd, void* data, size_t size) {
+  char* bytes = static_cast<char*>(data);
+  while (size) {
+    const ssize_t result = read(fd, bytes, size);
+    if (result < 0 && errno == EINTR) { continue; }
+    if (result <= 0) { return false; }
+    bytes += result;
+    size -= result;
+  }
+  return true;
+}
+
+static bool WriteFully(const int fd, const void* data, size_t size) {
+  const char* bytes = static_cast<const char*>(data);
+  while (size) {
+    // A peer that went away must not raise SIGPIPE.
+    const ssize_t result = send(fd, bytes, size, MSG_NOSIGNAL);
+    if (result < 0 && errno == EINTR) { continue; }
+    if (result <= 0) { return false; }
+    bytes += result;
+    size -= result;
+  }
+  return true;
+}
+
+// Values travel as float32 whatever the Dtype.
+static bool ReadValues(const int fd, const int count, float* data) {
+  return ReadFully(fd, data, count * sizeof(float));
+}
+
+static bool ReadValues(const int fd, const int count, double* data) {
+  if (count == 0) { return true; }
+  vector<float> values(count);
+  if (!ReadFully(fd, &values[0], count * sizeof(float))) { return false; }
+  std::copy(values.begin(), values.end(), data);
+  return true;
+}
+
+static bool WriteValues(const int fd, const int count, const float* data) {
+  return WriteFully(fd, data, count * sizeof(float));
+}
+
+static bool WriteValues(const int fd, const int count, const double* data) {
+  if (count == 0) { return true; }
+  const vector<float> values(data, data + count);
+  return WriteFully(fd, &values[0], count * sizeof(float));
+}
+
+// Reads a blob of at most max_count values into blob. Returns false with an
+// error if the blob is malformed, or with an empty error if the connection
+// is lost.
+template <typename Dtype>
+static bool ReadBlob(const int fd, const int64_t max_count, Blob<Dtype>* blob,
+    string* error) {
+  error->clear();
+  uint32_t num_axes;
+  if (!ReadFully(fd, &num_axes, sizeof(num_axes))) { return false; }
+  if (num_axes > kMaxBlobAxes) {
+    *error = "Too many axes.";
+    return false;
+  }
+  vector<int32_t> dims(num_axes);
+  if (num_axes && !ReadFully(fd, &dims[0], num_axes * sizeof(int32_t))) {
+    return false;
+  }
+  int64_t count = 1;
+  for (int i = 0; i < num_axes; ++i) {
+    if (dims[i] < 0) {
+      *error = "Negative dimension.";
+      return false;
+    }
+    count *= dims[i];
+    if (count > max_count) {
+      *error = "Blob too large.";
+      return false;
+    }
+  }
+  blob->Reshape(vector<int>(dims.begin(), dims.end()));
+  return ReadValues(fd, blob->count(), blob->mutable_cpu_data());
+}
+
+template <typename Dtype>
+static bool WriteBlob(const int fd, const Blob<Dtype>& blob) {
+  vector<int32_t> header(1, blob.num_axes());
+  header.insert(header.end(), blob.shape().begin(), blob.shape().end());
+  return WriteFully(fd, &header[0], header.size() * sizeof(int32_t)) &&
+      WriteValues(fd, blob.count(), blob.cpu_data());
+}
+
+static bool WriteError(const int fd, const string& error) {
+  const int32_t status = 1;
+  const uint32_t size = std::min<size_t>(error.size(), kMaxErrorBytes);
+  return WriteFully(fd, &status, sizeof(status)) &&
+      WriteFully(fd, &size, sizeof(size)) &&
+      WriteFully(fd, error.data(), size);
+}
+
+static void SocketAddress(const string& path, struct sockaddr_un* address) {
+  memset(address, 0, sizeof(*address));
+  address->sun_family = AF_UNIX;
+  CHECK_LT(path.size(), sizeof(address->sun_path)) << "Path too long: "
+      << path;
+  strncpy(address->sun_path, path.c_str(), sizeof(address->sun_path) - 1);
+}
+
+template <typename Dtype>
+InferenceServer<Dtype>::InferenceServer(
+    shared_ptr<DynamicBatcher<Dtype> > batcher, const string& socket_path)
+    : batcher_(batcher), socket_path_(socket_path), stop_(false),
+      mutex_(new boost::mutex()),
+      connection_closed_(new boost::condition_variable()) {
+  CHECK(batcher_);
+  // The batcher keeps reshaping the instances, so note the input shapes
+  // while it is idle.
+  const Net<Dtype>& net = *batcher_->engine()->instance(0);
+  for (int i = 0; i < net.num_inputs(); ++i) {
+    vector<int> shape = net.input_blobs()[i]->shape();
+    shape[0] = 1;
+    input_shapes_.push_back(shape);
+  }
+  num_outputs_ = net.num_outputs();
+  struct sockaddr_un address;
+  SocketAddress(socket_path, &address);
+  listener_ = socket(AF_UNIX, SOCK_STREAM, 0);
+  CHECK_NE(listener_, -1) << "Could not create a socket.";
+  unlink(socket_path.c_str());
+  CHECK_EQ(bind(listener_, reinterpret_cast<struct sockaddr*>(&address),
+      sizeof(address)), 0) << "Could not bind " << socket_path;
+  CHECK_EQ(listen(listener_, SOMAXCONN), 0) << "Could not listen on "
+      << socket_path;
+}
+
+template <typename Dtype>
+InferenceServer<Dtype>::~InferenceServer() {
+  close(listener_);
+  unlink(socket_path_.c_str());
+}
+
+template <typename Dtype>
+void InferenceServer<Dtype>::Serve() {
+  while (true) {
+    const int fd = accept(listener_, NULL, NULL);
+    if (stop_) {
+      if (fd != -1) { close(fd); }
+      break;
+    }
+    if (fd == -1) {
+      if (errno != EINTR && errno != ECONNABORTED) {
+        // Most likely out of file descriptors; retry once some are closed.
+        LOG(ERROR) << "Could not accept a connection: " << strerror(errno);
+        usleep(10000);
+      }
+      continue;
+    }
+    boost::mutex::scoped_lock lock(*mutex_);
+    connections_.push_back(fd);
+    boost::thread(&InferenceServer<Dtype>::HandleConnection, this, fd)
+        .detach();
+  }
+  // Wake the connections waiting for a request, and let those running one
+  // finish it.
+  boost::mutex::scoped_lock lock(*mutex_);
+  for (int i = 0; i < connections_.size(); ++i) {
+    shutdown(connections_[i], SHUT_RDWR);
+  }
+  while (!connections_.empty()) {
+    connection_closed_->wait(lock);
+  }
+}
+
+template <typename Dtype>
+void InferenceServer<Dtype>::Stop() {
+  stop_ = true;
+  shutdown(listener_, SHUT_RDWR);
+}
+
+template <typename Dtype>
+void InferenceServer<Dtype>::HandleConnection(const int fd) {
+  vector<shared_ptr<Blob<Dtype> > > inputs;
+  vector<shared_ptr<Blob<Dtype> > > outputs;
+  while (!stop_ && HandleRequest(fd, &inputs, &outputs)) {}
+  boost::mutex::scoped_lock lock(*mutex_);
+  connections_.erase(std::find(connections_.begin(), connections_.end(), fd));
+  close(fd);
+  connection_closed_->notify_all();
+}
+
+template <typename Dtype>
+bool InferenceServer<Dtype>::HandleRequest(const int fd,
+    vector<shared_ptr<Blob<Dtype> > >* inputs,
+    vector<shared_ptr<Blob<Dtype> > >* outputs) {
+  uint32_t kind;
+  if (!ReadFully(fd, &kind, sizeof(kind))) { return false; }
+  string error;
+  bool read = false;
+  if (kind == INFERENCE_TENSORS) {
+    read = ReadTensorRequest(fd, inputs, &error);
+  } else if (kind == INFERENCE_IMAGE) {
+    read = ReadImageRequest(fd, inputs, &error);
+  } else {
+    error = "Unknown request kind.";
+  }
+  if (!read) {
+    if (error.size()) { WriteError(fd, error); }
+    return false;
+  }
+  vector<Blob<Dtype>*> input_vec;
+  for (int i = 0; i < inputs->size(); ++i) {
+    input_vec.push_back((*inputs)[i].get());
+  }
+  vector<Blob<Dtype>*> output_vec;
+  for (int i = 0; i < num_outputs_; ++i) {
+    if (i == outputs->size()) {
+      outputs->push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    }
+    output_vec.push_back((*outputs)[i].get());
+  }
+  batcher_->Predict(input_vec, output_vec);
+  const int32_t status = 0;
+  const uint32_t num_blobs = num_outputs_;
+  if (!WriteFully(fd, &status, sizeof(status)) ||
+      !WriteFully(fd, &num_blobs, sizeof(num_blobs))) {
+    return false;
+  }
+  for (int i = 0; i < num_outputs_; ++i) {
+    if (!WriteBlob(fd, *output_vec[i])) { return false; }
+  }
+  return true;
+}
+
+template <typename Dtype>
+bool InferenceServer<Dtype>::ReadTensorRequest(const int fd,
+    vector<shared_ptr<Blob<Dtype> > >* inputs, string* error) {
+  uint32_t num_blobs;
+  if (!ReadFully(fd, &num_blobs, sizeof(num_blobs))) { return false; }
+  std::ostringstream message;
+  if (num_blobs != input_shapes_.size()) {
+    message << "Expected " << input_shapes_.size() << " input blobs, got "
+        << num_blobs << ".";
+    *error = message.str();
+    return false;
+  }
+  const int max_batch_size = batcher_->max_batch_size();
+  inputs->resize(num_blobs);
+  for (int i = 0; i < num_blobs; ++i) {
+    if (!(*inputs)[i]) {
+      (*inputs)[i].reset(new Blob<Dtype>());
+    }
+    Blob<Dtype>* input = (*inputs)[i].get();
+    const vector<int>& item_shape = input_shapes_[i];
+    int64_t max_count = max_batch_size;
+    for (int j = 1; j < item_shape.size(); ++j) {
+      max_count *= item_shape[j];
+    }
+    if (!ReadBlob(fd, max_count, input, error)) {
+      return false;
+    }
+    bool matches = input->num_axes() == item_shape.size() &&
+        input->shape(0) > 0 && input->shape(0) <= max_batch_size &&
+        input->shape(0) == (*inputs)[0]->shape(0);
+    for (int j = 1; matches && j < item_shape.size(); ++j) {
+      matches = input->shape(j) == item_shape[j];
+    }
+    if (!matches) {
+      message << "Input " << i << " has shape " << input->shape_string()
+          << "; expected 1 to " << max_batch_size << " items of shape "
+          << Blob<Dtype>(item_shape).shape_string() << ", as many as in "
+          << "the other inputs.";
+      *error = message.str();
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename Dtype>
+bool InferenceServer<Dtype>::ReadImageRequest(const int fd,
+    vector<shared_ptr<Blob<Dtype> > >* inputs, string* error) {
+  uint32_t size;
+  if (!ReadFully(fd, &size, sizeof(size))) { return false; }
+  if (input_shapes_.size() != 1 || input_shapes_[0].size() != 4 ||
+      (input_shapes_[0][1] != 1 && input_shapes_[0][1] != 3)) {
+    *error = "Image requests need a net with a single 1 or 3 channel image "
+        "input.";
+    return false;
+  }
+  if (size > kMaxImageBytes) {
+    *error = "Image too large.";
+    return false;
+  }
+  vector<char> bytes(size);
+  if (size && !ReadFully(fd, &bytes[0], size)) { return false; }
+  const int channels = input_shapes_[0][1];
+  const int height = input_shapes_[0][2];
+  const int width = input_shapes_[0][3];
+  cv::Mat image = cv::imdecode(bytes,
+      channels == 3 ? CV_LOAD_IMAGE_COLOR : CV_LOAD_IMAGE_GRAYSCALE);
+  if (!image.data) {
+    *error = "Could not decode the image.";
+    return false;
+  }
+  if (image.rows != height || image.cols != width) {
+    cv::Mat resized;
+    cv::resize(image, resized, cv::Size(width, height));
+    image = resized;
+  }
+  inputs->resize(1);
+  if (!(*inputs)[0]) {
+    (*inputs)[0].reset(new Blob<Dtype>());
+  }
+  Blob<Dtype>* input = (*inputs)[0].get();
+  input->Reshape(input_shapes_[0]);
+  Dtype* data = input->mutable_cpu_data();
+  for (int h = 0; h < height; ++h) {
+    const uchar* row = image.ptr<uchar>(h);
+    for (int w = 0; w < width; ++w) {
+      for (int c = 0; c < channels; ++c) {
+        data[(c * height + h) * width + w] = row[w * channels + c];
+      }
+    }
+  }
+  return true;
+}
+
+template <typename Dtype>
+InferenceClient<Dtype>::InferenceClient(const string& socket_path) {
+  struct sockaddr_un address;
+  SocketAddress(socket_path, &address);
+  fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+  CHECK_NE(fd_, -1) << "Could not create a socket.";
+  CHECK_EQ(connect(fd_, reinterpret_cast<struct sockaddr*>(&address),
+      sizeof(address)), 0) << "Could not connect to " << socket_path;
+}
+
+template <typename Dtype>
+InferenceClient<Dtype>::~InferenceClient() {
+  if (fd_ != -1) {
+    close(fd_);
+  }
+}
+
+template <typename Dtype>
+bool InferenceClient<Dtype>::Predict(const vector<Blob<Dtype>*>& inputs,
+    vector<shared_ptr<Blob<Dtype> > >* outputs, string* error) {
+  CHECK_NE(fd_, -1) << "The server closed the connection.";
+  const uint32_t header[2] = { INFERENCE_TENSORS,
+      static_cast<uint32_t>(inputs.size()) };
+  bool sent = WriteFully(fd_, header, sizeof(header));
+  for (int i = 0; sent && i < inputs.size(); ++i) {
+    sent = WriteBlob(fd_, *inputs[i]);
+  }
+  // The server may reject a request before reading all of it; its reply is
+  // still there to read then.
+  return ReadReply(outputs, error);
+}
+
+template <typename Dtype>
+bool InferenceClient<Dtype>::PredictImage(const string& image,
+    vector<shared_ptr<Blob<Dtype> > >* outputs, string* error) {
+  CHECK_NE(fd_, -1) << "The server closed the connection.";
+  const uint32_t header[2] = { INFERENCE_IMAGE,
+      static_cast<uint32_t>(image.size()) };
+  if (WriteFully(fd_, header, sizeof(header))) {
+    WriteFully(fd_, image.data(), image.size());
+  }
+  return ReadReply(outputs, error);
+}
+
+template <typename Dtype>
+bool InferenceClient<Dtype>::ReadReply(
+    vector<shared_ptr<Blob<Dtype> > >* outputs, string* error) {
+  int32_t status;
+  uint32_t size;
+  CHECK(ReadFully(fd_, &status, sizeof(status)) &&
+      ReadFully(fd_, &size, sizeof(size)))
+      << "Lost the connection to the server.";
+  if (status != 0) {
+    CHECK_LE(size, kMaxErrorBytes) << "Corrupt reply.";
+    error->resize(size);
+    CHECK(ReadFully(fd_, &(*error)[0], size))
+        << "Lost the connection to the server.";
+    close(fd_);
+    fd_ = -1;
+    return false;
+  }
+  outputs->resize(size);
+  for (int i = 0; i < size; ++i) {
+    if (!(*outputs)[i]) {
+      (*outputs)[i].reset(new Blob<Dtype>());
+    }
+    CHECK(ReadBlob(fd_, INT_MAX, (*outputs)[i].get(), error))
+        << "Lost the connection to the server. " << *error;
+  }
+  return true;
+}
+
+INSTANTIATE_CLASS(InferenceServer);
+INSTANTIATE_CLASS(InferenceClient);
+
+}  // namespace caffe
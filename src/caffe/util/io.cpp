@@ -9,6 +9,7 @@
 #include <stdint.h>
 
 #include <algorithm>
+#include <cstdio>
 #include <fstream>  // NOLINT(readability/streams)
 #include <string>
 #include <vector>
@@ -67,6 +68,18 @@ void WriteProtoToBinaryFile(const Message& proto, const char* filename) {
   CHECK(proto.SerializeToOstream(&output));
 }
 
+void WriteProtoToBinaryFileAtomic(const Message& proto, const char* filename) {
+  const string temp_filename = string(filename) + ".tmp";
+  int fd = open(temp_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  CHECK_NE(fd, -1) << "Could not open " << temp_filename;
+  CHECK(proto.SerializeToFileDescriptor(fd))
+      << "Could not write " << temp_filename;
+  CHECK_EQ(fsync(fd), 0) << "Could not sync " << temp_filename;
+  CHECK_EQ(close(fd), 0) << "Could not close " << temp_filename;
+  CHECK_EQ(rename(temp_filename.c_str(), filename), 0)
+      << "Could not rename " << temp_filename << " to " << filename;
+}
+
 cv::Mat ReadImageToCVMat(const string& filename,
     const int height, const int width, const bool is_color) {
   cv::Mat cv_img;
@@ -0,0 +1,213 @@
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <fstream>  // NOLINT(readability/streams)
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/util/mapped_weights.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+const char kMappedWeightsMagic[] = "CAFFEMAP";
+const size_t kMappedWeightsMagicSize = sizeof(kMappedWeightsMagic) - 1;
+const uint32_t kMappedWeightsVersion = 1;
+// Size of the magic, version and header size.
+const size_t kMappedWeightsPrefixSize = kMappedWeightsMagicSize + 8;
+// The blob data starts at a multiple of this (a common page size).
+const size_t kMappedWeightsDataAlignment = 4096;
+
+static size_t RoundUp(const size_t value, const size_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+// Returns the number of elements of a header blob, which has either a shape
+// or the legacy 4D dimensions. The header may come from an untrusted file, so
+// the blob is CHECKed to take at most max_bytes.
+static size_t BlobProtoCount(const BlobProto& proto, const size_t max_bytes) {
+  vector<int64_t> dims;
+  if (proto.has_num() || proto.has_channels() ||
+      proto.has_height() || proto.has_width()) {
+    dims.push_back(proto.num());
+    dims.push_back(proto.channels());
+    dims.push_back(proto.height());
+    dims.push_back(proto.width());
+  } else {
+    dims.assign(proto.shape().dim().begin(), proto.shape().dim().end());
+  }
+  const size_t max_count = max_bytes / sizeof(float);
+  size_t count = 1;
+  for (int i = 0; i < dims.size(); ++i) {
+    CHECK_GE(dims[i], 0) << "Negative blob dimension";
+    // Checked before multiplying, so that count can not overflow.
+    if (dims[i] > 0) {
+      CHECK_LE(count, max_count / dims[i]) << "Blob larger than the file";
+    }
+    count *= dims[i];
+  }
+  return count;
+}
+
+// Lays out the blobs of header in a file whose header is header_size bytes,
+// CHECKing that they end by max_end. Returns the end of the last blob.
+static size_t MappedWeightsOffsets(const NetParameter& header,
+    const size_t header_size, const size_t max_end,
+    vector<vector<size_t> >* offsets) {
+  // max_end leaves room to align any offset up to it without overflow.
+  CHECK_LE(max_end,
+      std::numeric_limits<size_t>::max() - kMappedWeightsDataAlignment);
+  CHECK_LE(kMappedWeightsPrefixSize + header_size, max_end);
+  size_t offset = RoundUp(kMappedWeightsPrefixSize + header_size,
+      kMappedWeightsDataAlignment);
+  offsets->resize(header.layer_size());
+  for (int i = 0; i < header.layer_size(); ++i) {
+    const LayerParameter& layer = header.layer(i);
+    (*offsets)[i].resize(layer.blobs_size());
+    for (int j = 0; j < layer.blobs_size(); ++j) {
+      offset = RoundUp(offset, kMappedWeightsAlignment);
+      CHECK_LE(offset, max_end) << "Blob past the end of the file";
+      (*offsets)[i][j] = offset;
+      offset += BlobProtoCount(layer.blobs(j), max_end - offset) *
+          sizeof(float);
+    }
+  }
+  return offset;
+}
+
+bool IsMappedWeightsFile(const string& filename) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  CHECK_NE(fd, -1) << "File not found: " << filename;
+  char magic[kMappedWeightsMagicSize];
+  const bool is_mapped =
+      read(fd, magic, kMappedWeightsMagicSize) == kMappedWeightsMagicSize &&
+      memcmp(magic, kMappedWeightsMagic, kMappedWeightsMagicSize) == 0;
+  close(fd);
+  return is_mapped;
+}
+
+void WriteMappedWeights(const NetParameter& net_param,
+    const string& filename) {
+  NetParameter header;
+  for (int i = 0; i < net_param.layer_size(); ++i) {
+    const LayerParameter& source_layer = net_param.layer(i);
+    if (source_layer.blobs_size() == 0) { continue; }
+    LayerParameter* layer = header.add_layer();
+    layer->set_name(source_layer.name());
+    layer->set_type(source_layer.type());
+    for (int j = 0; j < source_layer.blobs_size(); ++j) {
+      // Keep the shape as given, so that legacy 4D blobs still match.
+      const BlobProto& source_blob = source_layer.blobs(j);
+      BlobProto* blob = layer->add_blobs();
+      if (source_blob.has_num() || source_blob.has_channels() ||
+          source_blob.has_height() || source_blob.has_width()) {
+        blob->set_num(source_blob.num());
+        blob->set_channels(source_blob.channels());
+        blob->set_height(source_blob.height());
+        blob->set_width(source_blob.width());
+      } else {
+        blob->mutable_shape()->CopyFrom(source_blob.shape());
+      }
+    }
+  }
+  string header_string;
+  CHECK(header.SerializeToString(&header_string));
+  vector<vector<size_t> > offsets;
+  MappedWeightsOffsets(header, header_string.size(),
+      std::numeric_limits<size_t>::max() - kMappedWeightsDataAlignment,
+      &offsets);
+
+  std::ofstream output(filename.c_str(),
+      std::ios::out | std::ios::trunc | std::ios::binary);
+  CHECK(output.is_open()) << "Could not open " << filename;
+  const uint32_t header_size = header_string.size();
+  output.write(kMappedWeightsMagic, kMappedWeightsMagicSize);
+  output.write(reinterpret_cast<const char*>(&kMappedWeightsVersion),
+      sizeof(kMappedWeightsVersion));
+  output.write(reinterpret_cast<const char*>(&header_size),
+      sizeof(header_size));
+  output.write(header_string.data(), header_size);
+  size_t position = kMappedWeightsPrefixSize + header_size;
+  Blob<float> blob;
+  for (int i = 0, layer_id = 0; i < net_param.layer_size(); ++i) {
+    const LayerParameter& source_layer = net_param.layer(i);
+    if (source_layer.blobs_size() == 0) { continue; }
+    for (int j = 0; j < source_layer.blobs_size(); ++j) {
+      const size_t padding = offsets[layer_id][j] - position;
+      output.write(string(padding, '\0').data(), padding);
+      // FromProto expands sparse and half precision data.
+      blob.FromProto(source_layer.blobs(j));
+      output.write(reinterpret_cast<const char*>(blob.cpu_data()),
+          blob.count() * sizeof(float));
+      position = offsets[layer_id][j] + blob.count() * sizeof(float);
+    }
+    ++layer_id;
+  }
+  output.close();
+  CHECK(!output.fail()) << "Could not write " << filename;
+}
+
+MappedWeights::MappedWeights(const string& filename)
+    : filename_(filename), map_(NULL), map_size_(0) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  CHECK_NE(fd, -1) << "File not found: " << filename;
+  struct stat file_stat;
+  CHECK_EQ(fstat(fd, &file_stat), 0) << "Could not stat " << filename;
+  map_size_ = file_stat.st_size;
+  CHECK_GE(map_size_, kMappedWeightsPrefixSize) << "Truncated " << filename;
+  // A private mapping: unwritten pages are shared, written ones are copied.
+  void* map = mmap(NULL, map_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+      fd, 0);
+  close(fd);
+  CHECK(map != MAP_FAILED) << "Could not map " << filename;
+  map_ = static_cast<char*>(map);
+  CHECK_EQ(memcmp(map_, kMappedWeightsMagic, kMappedWeightsMagicSize), 0)
+      << filename << " is not a mapped weights file.";
+  uint32_t version, header_size;
+  memcpy(&version, map_ + kMappedWeightsMagicSize, sizeof(version));
+  memcpy(&header_size, map_ + kMappedWeightsMagicSize + sizeof(version),
+      sizeof(header_size));
+  CHECK_EQ(version, kMappedWeightsVersion)
+      << "Unsupported mapped weights version in " << filename;
+  CHECK_LE(kMappedWeightsPrefixSize + header_size, map_size_)
+      << "Truncated " << filename;
+  CHECK(header_.ParseFromArray(map_ + kMappedWeightsPrefixSize, header_size))
+      << "Failed to parse the header of " << filename;
+  MappedWeightsOffsets(header_, header_size, map_size_, &offsets_);
+}
+
+MappedWeights::~MappedWeights() {
+  if (map_) {
+    munmap(map_, map_size_);
+  }
+}
+
+float* MappedWeights::blob_data(const int layer_id, const int blob_id) const {
+  CHECK_GE(layer_id, 0);
+  CHECK_LT(layer_id, offsets_.size());
+  CHECK_GE(blob_id, 0);
+  CHECK_LT(blob_id, offsets_[layer_id].size());
+  return reinterpret_cast<float*>(map_ + offsets_[layer_id][blob_id]);
+}
+
+void MappedWeights::ToProto(NetParameter* net_param) const {
+  net_param->CopyFrom(header_);
+  for (int i = 0; i < header_.layer_size(); ++i) {
+    LayerParameter* layer = net_param->mutable_layer(i);
+    for (int j = 0; j < layer->blobs_size(); ++j) {
+      BlobProto* blob = layer->mutable_blobs(j);
+      const size_t count = BlobProtoCount(*blob, map_size_);
+      blob->mutable_data()->Resize(count, 0);
+      caffe_copy(count, blob_data(i, j), blob->mutable_data()->mutable_data());
+    }
+  }
+}
+
+}  // namespace caffe
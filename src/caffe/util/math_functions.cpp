@@ -1,6 +1,7 @@
 #include <boost/math/special_functions/next.hpp>
 #include <boost/random.hpp>
 
+#include <cmath>
 #include <limits>
 
 #include "caffe/common.hpp"
@@ -384,4 +385,87 @@ void caffe_cpu_scale<double>(const int n, const double alpha, const double *x,
   cblas_dscal(n, alpha, y, 1);
 }
 
+template <typename Dtype>
+inline Dtype caffe_update_gradient(const Dtype data, const Dtype diff,
+    const Dtype grad_scale, const Dtype l2_decay, const Dtype l1_decay) {
+  Dtype gradient = grad_scale == Dtype(1) ? diff : grad_scale * diff;
+  if (l2_decay) {
+    gradient += l2_decay * data;
+  } else if (l1_decay) {
+    gradient += l1_decay * static_cast<Dtype>(caffe_sign(data));
+  }
+  return gradient;
+}
+
+template <typename Dtype>
+void caffe_cpu_sgd_update(const int n, const Dtype* data, Dtype* diff,
+    Dtype* history, const Dtype grad_scale, const Dtype l2_decay,
+    const Dtype l1_decay, const Dtype rate, const Dtype momentum) {
+  CAFFE_PARALLEL_FOR
+  for (int i = 0; i < n; ++i) {
+    const Dtype gradient = caffe_update_gradient(data[i], diff[i],
+        grad_scale, l2_decay, l1_decay);
+    const Dtype value = rate * gradient + momentum * history[i];
+    history[i] = value;
+    diff[i] = value;
+  }
+}
+
+template void caffe_cpu_sgd_update<float>(const int n, const float* data,
+    float* diff, float* history, const float grad_scale,
+    const float l2_decay, const float l1_decay, const float rate,
+    const float momentum);
+template void caffe_cpu_sgd_update<double>(const int n, const double* data,
+    double* diff, double* history, const double grad_scale,
+    const double l2_decay, const double l1_decay, const double rate,
+    const double momentum);
+
+template <typename Dtype>
+void caffe_cpu_nesterov_update(const int n, const Dtype* data, Dtype* diff,
+    Dtype* history, const Dtype grad_scale, const Dtype l2_decay,
+    const Dtype l1_decay, const Dtype rate, const Dtype momentum) {
+  CAFFE_PARALLEL_FOR
+  for (int i = 0; i < n; ++i) {
+    const Dtype gradient = caffe_update_gradient(data[i], diff[i],
+        grad_scale, l2_decay, l1_decay);
+    const Dtype old_history = history[i];
+    const Dtype value = rate * gradient + momentum * old_history;
+    history[i] = value;
+    // step back then over step
+    diff[i] = (Dtype(1) + momentum) * value + -momentum * old_history;
+  }
+}
+
+template void caffe_cpu_nesterov_update<float>(const int n, const float* data,
+    float* diff, float* history, const float grad_scale,
+    const float l2_decay, const float l1_decay, const float rate,
+    const float momentum);
+template void caffe_cpu_nesterov_update<double>(const int n,
+    const double* data, double* diff, double* history,
+    const double grad_scale, const double l2_decay, const double l1_decay,
+    const double rate, const double momentum);
+
+template <typename Dtype>
+void caffe_cpu_adagrad_update(const int n, const Dtype* data, Dtype* diff,
+    Dtype* history, const Dtype grad_scale, const Dtype l2_decay,
+    const Dtype l1_decay, const Dtype rate, const Dtype delta) {
+  CAFFE_PARALLEL_FOR
+  for (int i = 0; i < n; ++i) {
+    const Dtype gradient = caffe_update_gradient(data[i], diff[i],
+        grad_scale, l2_decay, l1_decay);
+    const Dtype value = gradient * gradient + history[i];
+    history[i] = value;
+    diff[i] = rate * (gradient / (std::sqrt(value) + delta));
+  }
+}
+
+template void caffe_cpu_adagrad_update<float>(const int n, const float* data,
+    float* diff, float* history, const float grad_scale,
+    const float l2_decay, const float l1_decay, const float rate,
+    const float delta);
+template void caffe_cpu_adagrad_update<double>(const int n,
+    const double* data, double* diff, double* history,
+    const double grad_scale, const double l2_decay, const double l1_decay,
+    const double rate, const double delta);
+
 }  // namespace caffe
@@ -0,0 +1,127 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/quantize.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+Dtype caffe_cpu_absmax(const int n, const Dtype* x) {
+  Dtype absmax = 0;
+  for (int i = 0; i < n; ++i) {
+    const Dtype value = std::fabs(x[i]);
+    if (value > absmax) {
+      absmax = value;
+    }
+  }
+  return absmax;
+}
+
+template float caffe_cpu_absmax<float>(const int n, const float* x);
+template double caffe_cpu_absmax<double>(const int n, const double* x);
+
+template <typename Dtype>
+void caffe_cpu_quantize(const int n, const Dtype* x, const float scale,
+    int8_t* y) {
+  CHECK_GT(scale, 0) << "Quantization scale must be positive.";
+  const Dtype inv_scale = Dtype(1) / scale;
+  CAFFE_PARALLEL_FOR
+  for (int i = 0; i < n; ++i) {
+    const Dtype value = x[i] * inv_scale;
+    int q = static_cast<int>(value >= 0 ? value + Dtype(0.5)
+                                        : value - Dtype(0.5));
+    q = std::min(127, std::max(-127, q));
+    y[i] = static_cast<int8_t>(q);
+  }
+}
+
+template void caffe_cpu_quantize<float>(const int n, const float* x,
+    const float scale, int8_t* y);
+template void caffe_cpu_quantize<double>(const int n, const double* x,
+    const float scale, int8_t* y);
+
+template <typename Dtype>
+void caffe_cpu_gemm_s8(const CBLAS_TRANSPOSE TransB, const int M, const int N,
+    const int K, const int8_t* A, const int8_t* B, const float* row_scale,
+    const float* col_scale, Dtype* C) {
+  if (TransB == CblasTrans) {
+    // B is N x K, so every output is the dot product of two contiguous rows.
+    // Columns go outermost so that a row of B is reused across all of A.
+    CAFFE_PARALLEL_FOR
+    for (int j = 0; j < N; ++j) {
+      const int8_t* b = B + j * K;
+      const Dtype col = col_scale ? col_scale[j] : Dtype(1);
+      for (int i = 0; i < M; ++i) {
+        const int8_t* a = A + i * K;
+        int32_t acc = 0;
+        for (int k = 0; k < K; ++k) {
+          acc += static_cast<int32_t>(a[k]) * b[k];
+        }
+        const Dtype row = row_scale ? row_scale[i] : Dtype(1);
+        C[i * N + j] = static_cast<Dtype>(acc) * row * col;
+      }
+    }
+  } else {
+    // B is K x N: accumulate rows of B, weighted by A, into an int32 row.
+    CAFFE_PARALLEL_FOR
+    for (int i = 0; i < M; ++i) {
+      vector<int32_t> acc(N, 0);
+      const int8_t* a = A + i * K;
+      for (int k = 0; k < K; ++k) {
+        const int32_t weight = a[k];
+        if (weight == 0) { continue; }
+        const int8_t* b = B + k * N;
+        for (int j = 0; j < N; ++j) {
+          acc[j] += weight * b[j];
+        }
+      }
+      const Dtype row = row_scale ? row_scale[i] : Dtype(1);
+      Dtype* c = C + i * N;
+      for (int j = 0; j < N; ++j) {
+        const Dtype col = col_scale ? col_scale[j] : Dtype(1);
+        c[j] = static_cast<Dtype>(acc[j]) * row * col;
+      }
+    }
+  }
+}
+
+template void caffe_cpu_gemm_s8<float>(const CBLAS_TRANSPOSE TransB,
+    const int M, const int N, const int K, const int8_t* A, const int8_t* B,
+    const float* row_scale, const float* col_scale, float* C);
+template void caffe_cpu_gemm_s8<double>(const CBLAS_TRANSPOSE TransB,
+    const int M, const int N, const int K, const int8_t* A, const int8_t* B,
+    const float* row_scale, const float* col_scale, double* C);
+
+template <typename Dtype>
+void QuantizedWeights<Dtype>::Quantize(const Blob<Dtype>& weights,
+    const int num_output, const QuantizationParameter& param) {
+  const int dim = weights.count() / num_output;
+  CHECK_EQ(dim * num_output, weights.count())
+      << "Weights do not split into " << num_output << " output channels.";
+  CHECK(param.weight_scale_size() == 0
+      || param.weight_scale_size() == num_output)
+      << "Specify either no weight_scale or one per output channel.";
+  data_.resize(weights.count());
+  scale_.resize(num_output);
+  const Dtype* weight_data = weights.cpu_data();
+  for (int c = 0; c < num_output; ++c) {
+    const Dtype* row = weight_data + c * dim;
+    scale_[c] = param.weight_scale_size() ? param.weight_scale(c) :
+        caffe_int8_scale(caffe_cpu_absmax(dim, row));
+    caffe_cpu_quantize(dim, row, scale_[c], &data_[c * dim]);
+  }
+  source_ = weights.data();
+  source_version_ = weights.data()->version();
+}
+
+template <typename Dtype>
+bool QuantizedWeights<Dtype>::IsCurrent(const Blob<Dtype>& weights) const {
+  return initialized() && source_.lock() == weights.data()
+      && source_version_ == weights.data()->version();
+}
+
+INSTANTIATE_CLASS(QuantizedWeights);
+
+}  // namespace caffe
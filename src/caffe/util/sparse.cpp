@@ -0,0 +1,122 @@
+#include <cmath>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/sparse.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+float caffe_cpu_sparsity(const int n, const Dtype* x) {
+  if (n == 0) { return 0; }
+  int zeros = 0;
+  for (int i = 0; i < n; ++i) {
+    zeros += (x[i] == 0);
+  }
+  return static_cast<float>(zeros) / n;
+}
+
+template float caffe_cpu_sparsity<float>(const int n, const float* x);
+template float caffe_cpu_sparsity<double>(const int n, const double* x);
+
+int PruneBlobProto(const float threshold, BlobProto* blob) {
+  CHECK(!blob->has_half_data()) << "Cannot prune half precision weights.";
+  CHECK_EQ(blob->data_index_size(), 0) << "The weights are already sparse.";
+  const int count = blob->data_size();
+  vector<int> index;
+  vector<float> value;
+  for (int i = 0; i < count; ++i) {
+    if (std::fabs(blob->data(i)) >= threshold && blob->data(i) != 0) {
+      index.push_back(i);
+      value.push_back(blob->data(i));
+    }
+  }
+  // An index and a value per nonzero is only smaller below half density.
+  // A blob with no nonzeros stays dense, as an empty data_index could not
+  // be told apart from a dense blob without data.
+  blob->clear_data();
+  if (!index.empty() && 2 * index.size() < count) {
+    for (int i = 0; i < index.size(); ++i) {
+      blob->add_data_index(index[i]);
+      blob->add_data(value[i]);
+    }
+  } else {
+    blob->mutable_data()->Resize(count, 0);
+    for (int i = 0; i < index.size(); ++i) {
+      blob->set_data(index[i], value[i]);
+    }
+  }
+  return count - index.size();
+}
+
+template <typename Dtype>
+void SparseWeights<Dtype>::FromDense(const int rows, const int cols,
+    const Dtype* dense) {
+  rows_ = rows;
+  cols_ = cols;
+  row_ptr_.resize(rows + 1);
+  col_index_.clear();
+  values_.clear();
+  row_ptr_[0] = 0;
+  for (int i = 0; i < rows; ++i) {
+    const Dtype* row = dense + i * cols;
+    for (int j = 0; j < cols; ++j) {
+      if (row[j] != 0) {
+        col_index_.push_back(j);
+        values_.push_back(row[j]);
+      }
+    }
+    row_ptr_[i + 1] = values_.size();
+  }
+}
+
+template <typename Dtype>
+void SparseWeights<Dtype>::FromWeights(const Blob<Dtype>& weights,
+    const int rows, const float min_sparsity) {
+  const int cols = weights.count() / rows;
+  CHECK_EQ(rows * cols, weights.count())
+      << "Weights do not split into " << rows << " rows.";
+  const Dtype* dense = weights.cpu_data();
+  if (caffe_cpu_sparsity(weights.count(), dense) >= min_sparsity) {
+    FromDense(rows, cols, dense);
+  } else {
+    row_ptr_.clear();
+    col_index_.clear();
+    values_.clear();
+  }
+  source_ = weights.data();
+  source_version_ = weights.data()->version();
+}
+
+template <typename Dtype>
+bool SparseWeights<Dtype>::IsCurrent(const Blob<Dtype>& weights) const {
+  return source_.lock() == weights.data()
+      && source_version_ == weights.data()->version();
+}
+
+template <typename Dtype>
+void SparseWeights<Dtype>::MultiplyTransposed(const int M, const Dtype* X,
+    Dtype* C) const {
+  CHECK(initialized());
+  const int N = rows_;
+  const int K = cols_;
+  // Each output column is one sparse row of W dotted with every row of X, so
+  // the row's indices and values are reused across the whole batch.
+  CAFFE_PARALLEL_FOR
+  for (int j = 0; j < N; ++j) {
+    const int begin = row_ptr_[j];
+    const int end = row_ptr_[j + 1];
+    for (int i = 0; i < M; ++i) {
+      const Dtype* x = X + i * K;
+      Dtype sum = 0;
+      for (int p = begin; p < end; ++p) {
+        sum += values_[p] * x[col_index_[p]];
+      }
+      C[i * N + j] = sum;
+    }
+  }
+}
+
+INSTANTIATE_CLASS(SparseWeights);
+
+}  // namespace caffe
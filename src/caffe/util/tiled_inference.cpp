@@ -0,0 +1,360 @@
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/tiled_inference.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+struct TiledInference<Dtype>::Tiling {
+  const Blob<Dtype>* input;
+  const Dtype* input_data;
+  const vector<Blob<Dtype>*>* outputs;
+  vector<Dtype*> output_data;
+  // Along each axis: the first input pixel and the size of each tile, and
+  // the range of each output (in the whole output) that each tile writes,
+  // indexed by output and then by tile.
+  vector<int> start[2];
+  vector<int> size[2];
+  vector<vector<int> > begin[2];
+  vector<vector<int> > end[2];
+  // The next tile to run, guarded by mutex.
+  int next_tile;
+  boost::mutex mutex;
+};
+
+// Reads the window of a Convolution, Im2col or Pooling layer.
+template <typename Param>
+static void GetWindow(const Param& param, int* kernel, int* stride,
+    int* pad) {
+  kernel[0] = param.has_kernel_h() ? param.kernel_h() : param.kernel_size();
+  kernel[1] = param.has_kernel_w() ? param.kernel_w() : param.kernel_size();
+  stride[0] = param.has_stride_h() ? param.stride_h() : param.stride();
+  stride[1] = param.has_stride_w() ? param.stride_w() : param.stride();
+  pad[0] = param.has_pad_h() ? param.pad_h() : param.pad();
+  pad[1] = param.has_pad_w() ? param.pad_w() : param.pad();
+}
+
+// Returns whether a layer computes each position of its tops from the same
+// position of its bottoms only.
+static bool PositionWise(const LayerParameter& param) {
+  const string& type = param.type();
+  if (type == "Concat") {
+    const ConcatParameter& concat_param = param.concat_param();
+    return (concat_param.has_concat_dim() ? concat_param.concat_dim() :
+        (concat_param.axis() + 4) % 4) == 1;
+  }
+  if (type == "Slice") {
+    const SliceParameter& slice_param = param.slice_param();
+    return (slice_param.has_slice_dim() ? slice_param.slice_dim() :
+        (slice_param.axis() + 4) % 4) == 1;
+  }
+  if (type == "Softmax") {
+    return (param.softmax_param().axis() + 4) % 4 == 1;
+  }
+  // LRN across channels; within channels it has a window.
+  return type == "AbsVal" || type == "BNLL" || type == "Dropout" ||
+      type == "Eltwise" || type == "Exp" || type == "LRN" ||
+      type == "Power" || type == "PReLU" || type == "ReLU" ||
+      type == "Sigmoid" || type == "Split" || type == "TanH" ||
+      type == "Threshold";
+}
+
+template <typename Dtype>
+static bool SameFields(
+    const vector<typename TiledInference<Dtype>::ReceptiveField>& a,
+    const vector<typename TiledInference<Dtype>::ReceptiveField>& b) {
+  for (int i = 0; i < a.size(); ++i) {
+    if (a[i].stride != b[i].stride || a[i].offset != b[i].offset ||
+        a[i].size != b[i].size) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static int Gcd(const int a, const int b) {
+  return b == 0 ? a : Gcd(b, a % b);
+}
+
+template <typename Dtype>
+TiledInference<Dtype>::TiledInference(
+    shared_ptr<InferenceEngine<Dtype> > engine, const int tile_height,
+    const int tile_width) : engine_(engine) {
+  CHECK_GT(tile_height, 0);
+  CHECK_GT(tile_width, 0);
+  tile_size_[0] = tile_height;
+  tile_size_[1] = tile_width;
+  const Net<Dtype>& net = *engine_->instance(0);
+  CHECK_EQ(net.num_inputs(), 1) << "Tiling needs a net with a single input.";
+  CHECK_EQ(net.input_blobs()[0]->num_axes(), 4)
+      << "Tiling needs a 4-D net input.";
+  // Follow the receptive fields from the input through the layers.
+  typedef vector<ReceptiveField> Fields;
+  std::map<const Blob<Dtype>*, Fields> blob_fields;
+  const ReceptiveField pixel = { 1, 0, 1 };
+  blob_fields[net.input_blobs()[0]] = Fields(2, pixel);
+  for (int i = 0; i < net.layers().size(); ++i) {
+    const LayerParameter& param = net.layers()[i]->layer_param();
+    const vector<Blob<Dtype>*>& bottom = net.bottom_vecs()[i];
+    const vector<Blob<Dtype>*>& top = net.top_vecs()[i];
+    CHECK_GT(bottom.size(), 0) << "Cannot tile through " << param.type()
+        << " layer " << param.name() << ": tiles are fed to the net input.";
+    Fields fields = blob_fields[bottom[0]];
+    for (int j = 1; j < bottom.size(); ++j) {
+      CHECK(SameFields<Dtype>(fields, blob_fields[bottom[j]]))
+          << param.type() << " layer " << param.name() << " combines blobs "
+          << "with different receptive fields.";
+    }
+    int kernel[2], stride[2], pad[2];
+    if (param.type() == "Convolution" || param.type() == "Im2col") {
+      GetWindow(param.convolution_param(), kernel, stride, pad);
+    } else if (param.type() == "Pooling") {
+      CHECK(!param.pooling_param().global_pooling()) << "Cannot tile "
+          << "through global pooling layer " << param.name() << ".";
+      GetWindow(param.pooling_param(), kernel, stride, pad);
+    } else if (param.type() == "LRN" && param.lrn_param().norm_region() ==
+        LRNParameter_NormRegion_WITHIN_CHANNEL) {
+      kernel[0] = kernel[1] = param.lrn_param().local_size();
+      stride[0] = stride[1] = 1;
+      pad[0] = pad[1] = (param.lrn_param().local_size() - 1) / 2;
+    } else {
+      CHECK(PositionWise(param)) << "Cannot tile through " << param.type()
+          << " layer " << param.name() << ", which mixes positions.";
+      kernel[0] = kernel[1] = stride[0] = stride[1] = 1;
+      pad[0] = pad[1] = 0;
+    }
+    for (int axis = 0; axis < 2; ++axis) {
+      fields[axis].offset -= pad[axis] * fields[axis].stride;
+      fields[axis].size += (kernel[axis] - 1) * fields[axis].stride;
+      fields[axis].stride *= stride[axis];
+    }
+    for (int j = 0; j < top.size(); ++j) {
+      blob_fields[top[j]] = fields;
+    }
+  }
+  for (int i = 0; i < net.num_outputs(); ++i) {
+    CHECK_EQ(net.output_blobs()[i]->num_axes(), 4)
+        << "Tiling needs 4-D net outputs.";
+    fields_.push_back(blob_fields[net.output_blobs()[i]]);
+  }
+  // Tiles start at multiples of every output stride, and far enough apart
+  // that the outputs of neighbors meet.
+  for (int axis = 0; axis < 2; ++axis) {
+    alignment_[axis] = 1;
+    int step = tile_size_[axis];
+    for (int i = 0; i < fields_.size(); ++i) {
+      const ReceptiveField& field = fields_[i][axis];
+      alignment_[axis] = alignment_[axis] / Gcd(alignment_[axis],
+          field.stride) * field.stride;
+      const int first = (field.stride - 1 - field.offset) / field.stride;
+      const int span = tile_size_[axis] - field.size - field.offset;
+      const int last = span >= 0 ? span / field.stride : first - 1;
+      step = std::min(step, (last - first + 1) * field.stride);
+    }
+    tile_step_[axis] = step / alignment_[axis] * alignment_[axis];
+    CHECK_GT(tile_step_[axis], 0) << "Tiles of " << tile_size_[axis]
+        << " pixels are too small for the receptive fields of "
+        << net.name() << ".";
+  }
+  LOG(INFO) << "Tiling " << net.name() << " in tiles of " << tile_size_[0]
+            << " x " << tile_size_[1] << " pixels, " << tile_step_[0]
+            << " x " << tile_step_[1] << " pixels apart.";
+}
+
+template <typename Dtype>
+void TiledInference<Dtype>::PlaceTiles(const int axis, const int length,
+    Tiling* tiling) const {
+  vector<int>& start = tiling->start[axis];
+  vector<int>& size = tiling->size[axis];
+  start.assign(1, 0);
+  if (length > tile_size_[axis]) {
+    // The last tile ends with the input; it overlaps its neighbor more.
+    const int last = (length - tile_size_[axis] + alignment_[axis] - 1) /
+        alignment_[axis] * alignment_[axis];
+    while (start.back() + tile_step_[axis] < last) {
+      start.push_back(start.back() + tile_step_[axis]);
+    }
+    start.push_back(last);
+  }
+  size.resize(start.size());
+  for (int i = 0; i < start.size(); ++i) {
+    size[i] = std::min(tile_size_[axis], length - start[i]);
+  }
+}
+
+template <typename Dtype>
+void TiledInference<Dtype>::AssignOutputs(const int axis,
+    const vector<int>& full_lengths, const vector<int>& last_lengths,
+    Tiling* tiling) const {
+  const vector<int>& start = tiling->start[axis];
+  const vector<int>& size = tiling->size[axis];
+  const int num_tiles = start.size();
+  tiling->begin[axis].resize(fields_.size());
+  tiling->end[axis].resize(fields_.size());
+  for (int i = 0; i < fields_.size(); ++i) {
+    const ReceptiveField& field = fields_[i][axis];
+    vector<int>& begin = tiling->begin[axis][i];
+    vector<int>& end = tiling->end[axis][i];
+    begin.resize(num_tiles);
+    end.resize(num_tiles);
+    int written = 0;
+    for (int t = 0; t < num_tiles; ++t) {
+      // The outputs of the tile that see no padding the whole input lacks.
+      const bool last_tile = t + 1 == num_tiles;
+      const int length = last_tile ? last_lengths[i] : full_lengths[i];
+      const int first = start[t] == 0 ? 0 :
+          (field.stride - 1 - field.offset) / field.stride;
+      const int last = last_tile ? length - 1 : std::min(length - 1,
+          (size[t] - field.size - field.offset) / field.stride);
+      const int shift = start[t] / field.stride;
+      CHECK_LE(shift + first, written) << "Tiles leave a gap in the output.";
+      begin[t] = written;
+      end[t] = std::max(written, shift + last + 1);
+      written = end[t];
+    }
+  }
+}
+
+template <typename Dtype>
+void TiledInference<Dtype>::Forward(const Blob<Dtype>& input,
+    const vector<Blob<Dtype>*>& outputs) {
+  CHECK_EQ(outputs.size(), fields_.size()) << "Expected one output per net "
+      << "output.";
+  CHECK_EQ(input.num_axes(), 4);
+  Tiling tiling;
+  tiling.input = &input;
+  tiling.outputs = &outputs;
+  PlaceTiles(0, input.height(), &tiling);
+  PlaceTiles(1, input.width(), &tiling);
+  // Shape the net for a full and for the last tile, to learn the lengths of
+  // the outputs of tiles. Only the last tiles are smaller along an axis.
+  vector<vector<int> > output_shapes;
+  vector<int> full_lengths[2], last_lengths[2];
+  {
+    const int instance_id = engine_->AcquireInstance();
+    Net<Dtype>* net = engine_->instance(instance_id).get();
+    Blob<Dtype>* net_input = net->input_blobs()[0];
+    CHECK_EQ(input.channels(), net_input->channels());
+    vector<int> shape = input.shape();
+    for (int last = 0; last < 2; ++last) {
+      shape[2] = last ? tiling.size[0].back() : tiling.size[0][0];
+      shape[3] = last ? tiling.size[1].back() : tiling.size[1][0];
+      net_input->Reshape(shape);
+      net->Reshape();
+      for (int i = 0; i < net->num_outputs(); ++i) {
+        const Blob<Dtype>* output = net->output_blobs()[i];
+        if (last) {
+          last_lengths[0].push_back(output->height());
+          last_lengths[1].push_back(output->width());
+        } else {
+          full_lengths[0].push_back(output->height());
+          full_lengths[1].push_back(output->width());
+          output_shapes.push_back(output->shape());
+        }
+      }
+    }
+    engine_->ReleaseInstance(instance_id);
+  }
+  AssignOutputs(0, full_lengths[0], last_lengths[0], &tiling);
+  AssignOutputs(1, full_lengths[1], last_lengths[1], &tiling);
+  for (int i = 0; i < outputs.size(); ++i) {
+    output_shapes[i][2] = tiling.end[0][i].back();
+    output_shapes[i][3] = tiling.end[1][i].back();
+    outputs[i]->Reshape(output_shapes[i]);
+    tiling.output_data.push_back(outputs[i]->mutable_cpu_data());
+  }
+  tiling.input_data = input.cpu_data();
+  tiling.next_tile = 0;
+  const int num_tiles = tiling.start[0].size() * tiling.start[1].size();
+  const int num_workers = std::min(engine_->num_instances(), num_tiles);
+  if (num_workers == 1) {
+    WorkerEntry(&tiling);
+    return;
+  }
+  vector<shared_ptr<boost::thread> > workers;
+  for (int i = 0; i < num_workers; ++i) {
+    workers.push_back(shared_ptr<boost::thread>(new boost::thread(
+        &TiledInference<Dtype>::WorkerEntry, this, &tiling)));
+  }
+  for (int i = 0; i < workers.size(); ++i) {
+    workers[i]->join();
+  }
+}
+
+template <typename Dtype>
+void TiledInference<Dtype>::WorkerEntry(Tiling* tiling) {
+  const int instance_id = engine_->AcquireInstance();
+  Net<Dtype>* net = engine_->instance(instance_id).get();
+  // The first tile is as large as any.
+  vector<vector<int> > shapes(1, tiling->input->shape());
+  shapes[0][2] = tiling->size[0][0];
+  shapes[0][3] = tiling->size[1][0];
+  net->Reserve(shapes);
+  const int num_tiles = tiling->start[0].size() * tiling->start[1].size();
+  while (true) {
+    int tile_id;
+    {
+      boost::mutex::scoped_lock lock(tiling->mutex);
+      tile_id = tiling->next_tile++;
+    }
+    if (tile_id >= num_tiles) { break; }
+    RunTile(net, tile_id, tiling);
+  }
+  engine_->ReleaseInstance(instance_id);
+}
+
+template <typename Dtype>
+void TiledInference<Dtype>::RunTile(Net<Dtype>* net, const int tile_id,
+    Tiling* tiling) {
+  const int row = tile_id / tiling->start[1].size();
+  const int col = tile_id % tiling->start[1].size();
+  const Blob<Dtype>& input = *tiling->input;
+  Blob<Dtype>* net_input = net->input_blobs()[0];
+  vector<int> shape = input.shape();
+  shape[2] = tiling->size[0][row];
+  shape[3] = tiling->size[1][col];
+  net_input->Reshape(shape);
+  Dtype* tile_data = net_input->mutable_cpu_data();
+  for (int n = 0; n < shape[0]; ++n) {
+    for (int c = 0; c < shape[1]; ++c) {
+      for (int h = 0; h < shape[2]; ++h) {
+        caffe_copy(shape[3], tiling->input_data + input.offset(n, c,
+            tiling->start[0][row] + h, tiling->start[1][col]),
+            tile_data + net_input->offset(n, c, h));
+      }
+    }
+  }
+  net->ForwardPrefilled();
+  for (int i = 0; i < fields_.size(); ++i) {
+    const int h_begin = tiling->begin[0][i][row];
+    const int h_end = tiling->end[0][i][row];
+    const int w_begin = tiling->begin[1][i][col];
+    const int w_end = tiling->end[1][i][col];
+    if (h_begin == h_end || w_begin == w_end) { continue; }
+    const int h_shift = tiling->start[0][row] / fields_[i][0].stride;
+    const int w_shift = tiling->start[1][col] / fields_[i][1].stride;
+    const Blob<Dtype>* tile_output = net->output_blobs()[i];
+    const Dtype* tile_output_data = tile_output->cpu_data();
+    const Blob<Dtype>* output = (*tiling->outputs)[i];
+    for (int n = 0; n < output->num(); ++n) {
+      for (int c = 0; c < output->channels(); ++c) {
+        for (int h = h_begin; h < h_end; ++h) {
+          caffe_copy(w_end - w_begin, tile_output_data + tile_output->offset(
+              n, c, h - h_shift, w_begin - w_shift),
+              tiling->output_data[i] + output->offset(n, c, h, w_begin));
+        }
+      }
+    }
+  }
+}
+
+INSTANTIATE_CLASS(TiledInference);
+
+}  // namespace caffe
@@ -0,0 +1,191 @@
+#include <fcntl.h>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl.h>
+#include <unistd.h>
+
+#include <climits>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/weights_stream.hpp"
+
+namespace caffe {
+
+using google::protobuf::io::CodedInputStream;
+using google::protobuf::io::CodedOutputStream;
+using google::protobuf::io::FileInputStream;
+using google::protobuf::io::FileOutputStream;
+using google::protobuf::Message;
+
+const char kWeightsStreamMagic[] = "CAFFEWTS";
+const int kWeightsStreamMagicSize = sizeof(kWeightsStreamMagic) - 1;
+const uint32_t kWeightsStreamVersion = 1;
+// Limit on the size of a single record: 2 GB minus 1 byte.
+const int kWeightsStreamRecordLimit = INT_MAX;
+
+bool IsWeightsStreamFile(const string& filename) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  CHECK_NE(fd, -1) << "File not found: " << filename;
+  char magic[kWeightsStreamMagicSize];
+  const bool is_stream =
+      read(fd, magic, kWeightsStreamMagicSize) == kWeightsStreamMagicSize &&
+      memcmp(magic, kWeightsStreamMagic, kWeightsStreamMagicSize) == 0;
+  close(fd);
+  return is_stream;
+}
+
+WeightsStreamWriter::WeightsStreamWriter(const string& filename)
+    : filename_(filename), header_written_(false) {
+  fd_ = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  CHECK_NE(fd_, -1) << "Could not open " << filename;
+  output_.reset(new FileOutputStream(fd_));
+  CodedOutputStream coded_output(output_.get());
+  coded_output.WriteRaw(kWeightsStreamMagic, kWeightsStreamMagicSize);
+  coded_output.WriteVarint32(kWeightsStreamVersion);
+}
+
+WeightsStreamWriter::~WeightsStreamWriter() {
+  // Without Close the end marker is missing, so readers reject the file.
+  if (output_) {
+    output_.reset();
+    close(fd_);
+  }
+}
+
+void WeightsStreamWriter::WriteHeader(const NetParameter& net_param) {
+  CHECK(!header_written_) << "The header of " << filename_
+      << " was already written.";
+  CHECK_EQ(net_param.layers_size(), 0)
+      << "Upgrade the net to the current LayerParameter format first.";
+  for (int i = 0; i < net_param.layer_size(); ++i) {
+    CHECK_EQ(net_param.layer(i).blobs_size(), 0)
+        << "The header must not hold the blobs of layer "
+        << net_param.layer(i).name();
+  }
+  WriteRecord(net_param);
+  header_written_ = true;
+}
+
+void WeightsStreamWriter::WriteLayer(const LayerParameter& layer_param) {
+  CHECK(header_written_) << "Write the header of " << filename_ << " first.";
+  WriteRecord(layer_param);
+}
+
+void WeightsStreamWriter::Close() {
+  CHECK(output_) << filename_ << " is already closed.";
+  CHECK(header_written_) << "No header was written to " << filename_;
+  {
+    CodedOutputStream coded_output(output_.get());
+    coded_output.WriteVarint32(0);
+  }
+  CHECK(output_->Flush()) << "Could not write " << filename_;
+  output_.reset();
+  CHECK_EQ(fsync(fd_), 0) << "Could not sync " << filename_;
+  CHECK_EQ(close(fd_), 0) << "Could not close " << filename_;
+}
+
+void WeightsStreamWriter::WriteRecord(const Message& message) {
+  CHECK(output_) << filename_ << " is already closed.";
+  const int size = message.ByteSize();
+  CHECK_GT(size, 0) << "Empty record in " << filename_;
+  CodedOutputStream coded_output(output_.get());
+  coded_output.WriteVarint32(size);
+  message.SerializeWithCachedSizes(&coded_output);
+  CHECK(!coded_output.HadError()) << "Could not write " << filename_;
+}
+
+WeightsStreamReader::WeightsStreamReader(const string& filename)
+    : filename_(filename), done_(false) {
+  fd_ = open(filename.c_str(), O_RDONLY);
+  CHECK_NE(fd_, -1) << "File not found: " << filename;
+  input_.reset(new FileInputStream(fd_));
+  {
+    CodedInputStream coded_input(input_.get());
+    char magic[kWeightsStreamMagicSize];
+    uint32_t version;
+    CHECK(coded_input.ReadRaw(magic, kWeightsStreamMagicSize) &&
+          memcmp(magic, kWeightsStreamMagic, kWeightsStreamMagicSize) == 0)
+        << filename << " is not a weights stream file.";
+    CHECK(coded_input.ReadVarint32(&version)) << "Truncated " << filename;
+    CHECK_EQ(version, kWeightsStreamVersion)
+        << "Unsupported weights stream version in " << filename;
+  }
+  CHECK(ReadRecord(&header_)) << "No header in " << filename;
+}
+
+WeightsStreamReader::~WeightsStreamReader() {
+  input_.reset();
+  close(fd_);
+}
+
+bool WeightsStreamReader::ReadLayer(LayerParameter* layer_param) {
+  if (done_) {
+    return false;
+  }
+  done_ = !ReadRecord(layer_param);
+  return !done_;
+}
+
+bool WeightsStreamReader::ReadRecord(Message* message) {
+  // A fresh CodedInputStream per record, so the byte limit applies to each
+  // record rather than to the whole file.
+  CodedInputStream coded_input(input_.get());
+  coded_input.SetTotalBytesLimit(kWeightsStreamRecordLimit, 536870912);
+  uint32_t size;
+  CHECK(coded_input.ReadVarint32(&size)) << "Truncated " << filename_;
+  if (size == 0) {
+    return false;
+  }
+  const CodedInputStream::Limit limit = coded_input.PushLimit(size);
+  message->Clear();
+  CHECK(message->ParseFromCodedStream(&coded_input) &&
+        coded_input.ConsumedEntireMessage())
+      << "Failed to parse a record of " << filename_;
+  coded_input.PopLimit(limit);
+  return true;
+}
+
+void WriteNetParamToWeightsStream(NetParameter* net_param,
+    const string& filename) {
+  // Move the blobs out of the definition while the header is written.
+  vector<LayerParameter> weights(net_param->layer_size());
+  for (int i = 0; i < net_param->layer_size(); ++i) {
+    weights[i].mutable_blobs()->Swap(
+        net_param->mutable_layer(i)->mutable_blobs());
+  }
+  WeightsStreamWriter writer(filename);
+  writer.WriteHeader(*net_param);
+  for (int i = 0; i < net_param->layer_size(); ++i) {
+    if (weights[i].blobs_size() == 0) { continue; }
+    weights[i].set_name(net_param->layer(i).name());
+    weights[i].set_type(net_param->layer(i).type());
+    writer.WriteLayer(weights[i]);
+  }
+  writer.Close();
+  for (int i = 0; i < net_param->layer_size(); ++i) {
+    net_param->mutable_layer(i)->mutable_blobs()->Swap(
+        weights[i].mutable_blobs());
+  }
+}
+
+void ReadNetParamFromWeightsStream(const string& filename,
+    NetParameter* net_param) {
+  WeightsStreamReader reader(filename);
+  net_param->CopyFrom(reader.header());
+  LayerParameter layer_param;
+  while (reader.ReadLayer(&layer_param)) {
+    int layer_id = 0;
+    while (layer_id != net_param->layer_size() &&
+        net_param->layer(layer_id).name() != layer_param.name()) {
+      ++layer_id;
+    }
+    CHECK_LT(layer_id, net_param->layer_size()) << "Layer "
+        << layer_param.name() << " of " << filename << " is not in its header.";
+    net_param->mutable_layer(layer_id)->mutable_blobs()->Swap(
+        layer_param.mutable_blobs());
+  }
+}
+
+}  // namespace caffe
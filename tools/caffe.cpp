@@ -1,12 +1,21 @@
 #include <glog/logging.h>
 
+#include <algorithm>
+#include <cmath>
+#include <csignal>
 #include <cstring>
+#include <fstream>  // NOLINT(readability/streams)
+#include <iterator>
 #include <map>
 #include <string>
 #include <vector>
 
 #include "boost/algorithm/string.hpp"
+#include "boost/thread.hpp"
 #include "caffe/caffe.hpp"
+#include "caffe/util/dynamic_batcher.hpp"
+#include "caffe/util/inference_engine.hpp"
+#include "caffe/util/inference_server.hpp"
 
 using caffe::Blob;
 using caffe::Caffe;
@@ -30,6 +39,33 @@ DEFINE_string(weights, "",
     "Cannot be set simultaneously with snapshot.");
 DEFINE_int32(iterations, 50,
     "The number of iterations to run.");
+DEFINE_int32(world_size, 0,
+    "Optional; the number of processes training together on this machine. "
+    "Overrides the solver's world_size.");
+DEFINE_int32(rank, -1,
+    "Optional; the rank of this process, from 0 to world_size - 1. "
+    "Overrides the solver's rank.");
+DEFINE_string(allreduce, "",
+    "Optional; how the processes sum their gradients: 'shm' (POSIX shared "
+    "memory) or 'socket' (Unix domain sockets).");
+DEFINE_string(allreduce_endpoint, "",
+    "Optional; the shared memory name or socket path through which the "
+    "processes meet. Overrides the solver's allreduce_endpoint.");
+DEFINE_string(socket, "",
+    "The Unix domain socket path to serve on, or to send requests to.");
+DEFINE_int32(instances, 1,
+    "Optional; the number of net instances serving requests, each run by "
+    "its own worker thread.");
+DEFINE_int32(max_batch, 8,
+    "Optional; the most items the server runs through the net at once.");
+DEFINE_double(max_delay_ms, 2,
+    "Optional; how long a request may wait for its batch to fill up.");
+DEFINE_int32(clients, 4,
+    "Optional; the number of connections the load generator sends requests "
+    "on concurrently.");
+DEFINE_string(image, "",
+    "Optional; an encoded image the load generator sends instead of random "
+    "inputs.");
 
 // A simple registry for caffe commands.
 typedef int (*BrewFunction)();
@@ -108,6 +144,27 @@ int train() {
     FLAGS_gpu = solver_param.device_id();
   }
 
+  // Multi-process training: every process is started with the same solver
+  // and flags, except for the rank.
+  if (FLAGS_world_size > 0) {
+    solver_param.set_world_size(FLAGS_world_size);
+  }
+  if (FLAGS_rank >= 0) {
+    solver_param.set_rank(FLAGS_rank);
+  }
+  if (FLAGS_allreduce == "shm") {
+    solver_param.set_allreduce_transport(
+        caffe::SolverParameter_AllreduceTransport_SHM);
+  } else if (FLAGS_allreduce == "socket") {
+    solver_param.set_allreduce_transport(
+        caffe::SolverParameter_AllreduceTransport_SOCKET);
+  } else if (FLAGS_allreduce.size()) {
+    LOG(FATAL) << "Unknown allreduce transport: " << FLAGS_allreduce;
+  }
+  if (FLAGS_allreduce_endpoint.size()) {
+    solver_param.set_allreduce_endpoint(FLAGS_allreduce_endpoint);
+  }
+
   // Set device id and mode
   if (FLAGS_gpu >= 0) {
     LOG(INFO) << "Use GPU with device ID " << FLAGS_gpu;
@@ -293,6 +350,132 @@ int time() {
 }
 RegisterBrewFunction(time);
 
+// The server to stop on SIGINT or SIGTERM.
+caffe::InferenceServer<float>* g_server = NULL;
+
+void StopServer(int signal) {
+  if (g_server) {
+    g_server->Stop();
+  }
+}
+
+// Serve: answer inference requests on a Unix domain socket until
+// interrupted.
+int serve() {
+  CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to serve.";
+  CHECK_GT(FLAGS_weights.size(), 0) << "Need model weights to serve.";
+  CHECK_GT(FLAGS_socket.size(), 0) << "Need a socket path to serve on.";
+
+  // Set device id and mode
+  if (FLAGS_gpu >= 0) {
+    LOG(INFO) << "Use GPU with device ID " << FLAGS_gpu;
+    Caffe::SetDevice(FLAGS_gpu);
+    Caffe::set_mode(Caffe::GPU);
+  } else {
+    LOG(INFO) << "Use CPU.";
+    Caffe::set_mode(Caffe::CPU);
+  }
+  shared_ptr<caffe::InferenceEngine<float> > engine(
+      new caffe::InferenceEngine<float>(FLAGS_model, FLAGS_weights,
+      FLAGS_instances));
+  shared_ptr<caffe::DynamicBatcher<float> > batcher(
+      new caffe::DynamicBatcher<float>(engine, FLAGS_max_batch,
+      FLAGS_max_delay_ms));
+  caffe::InferenceServer<float> server(batcher, FLAGS_socket);
+  g_server = &server;
+  signal(SIGINT, StopServer);
+  signal(SIGTERM, StopServer);
+  LOG(INFO) << "Serving " << FLAGS_model << " on " << FLAGS_socket
+      << " with " << FLAGS_instances << " instances, batches of up to "
+      << FLAGS_max_batch << " items and " << FLAGS_max_delay_ms
+      << " ms delay.";
+  server.Serve();
+  g_server = NULL;
+  LOG(INFO) << "Queue latency (ms): " << batcher->queue_latency().ToString();
+  LOG(INFO) << "Batch sizes: " << batcher->batch_fill().ToString();
+  return 0;
+}
+RegisterBrewFunction(serve);
+
+// Sends FLAGS_iterations requests over one connection, one at a time, and
+// records their latencies in milliseconds.
+void SendRequests(const vector<shared_ptr<Blob<float> > >* inputs,
+    const caffe::string* image, vector<double>* latencies) {
+  caffe::InferenceClient<float> client(FLAGS_socket);
+  vector<Blob<float>*> input_vec;
+  for (int i = 0; i < inputs->size(); ++i) {
+    input_vec.push_back((*inputs)[i].get());
+  }
+  vector<shared_ptr<Blob<float> > > outputs;
+  caffe::string error;
+  caffe::CPUTimer timer;
+  for (int i = 0; i < FLAGS_iterations; ++i) {
+    timer.Start();
+    const bool answered = image->size() ?
+        client.PredictImage(*image, &outputs, &error) :
+        client.Predict(input_vec, &outputs, &error);
+    CHECK(answered) << "The server failed a request: " << error;
+    latencies->push_back(timer.MicroSeconds() / 1000);
+  }
+}
+
+// Load generator: measure the latency and throughput of a server.
+int loadgen() {
+  CHECK_GT(FLAGS_socket.size(), 0) << "Need the socket path of a server.";
+  CHECK(FLAGS_model.size() || FLAGS_image.size())
+      << "Need a model definition to make inputs for, or an image.";
+  CHECK_GT(FLAGS_clients, 0);
+  Caffe::set_mode(Caffe::CPU);
+  // Every request is the same single item.
+  vector<shared_ptr<Blob<float> > > inputs;
+  caffe::string image;
+  if (FLAGS_image.size()) {
+    std::ifstream file(FLAGS_image.c_str(), std::ios::binary);
+    CHECK(file) << "Could not read " << FLAGS_image;
+    image.assign(std::istreambuf_iterator<char>(file),
+        std::istreambuf_iterator<char>());
+  } else {
+    Net<float> caffe_net(FLAGS_model, caffe::TEST);
+    caffe::FillerParameter filler_param;
+    caffe::GaussianFiller<float> filler(filler_param);
+    for (int i = 0; i < caffe_net.num_inputs(); ++i) {
+      vector<int> shape = caffe_net.input_blobs()[i]->shape();
+      shape[0] = 1;
+      inputs.push_back(shared_ptr<Blob<float> >(new Blob<float>(shape)));
+      filler.Fill(inputs.back().get());
+    }
+  }
+  LOG(INFO) << "Sending " << FLAGS_iterations << " requests on each of "
+      << FLAGS_clients << " connections.";
+  vector<vector<double> > latencies(FLAGS_clients);
+  vector<shared_ptr<boost::thread> > clients;
+  caffe::CPUTimer total_timer;
+  total_timer.Start();
+  for (int i = 0; i < FLAGS_clients; ++i) {
+    clients.push_back(shared_ptr<boost::thread>(new boost::thread(
+        &SendRequests, &inputs, &image, &latencies[i])));
+  }
+  for (int i = 0; i < FLAGS_clients; ++i) {
+    clients[i]->join();
+  }
+  const double seconds = total_timer.MilliSeconds() / 1000;
+  vector<double> all;
+  for (int i = 0; i < FLAGS_clients; ++i) {
+    all.insert(all.end(), latencies[i].begin(), latencies[i].end());
+  }
+  CHECK_GT(all.size(), 0) << "Sent no requests.";
+  std::sort(all.begin(), all.end());
+  // Nearest rank percentiles.
+  const int p50 = std::max<int>(std::ceil(0.5 * all.size()) - 1, 0);
+  const int p99 = std::max<int>(std::ceil(0.99 * all.size()) - 1, 0);
+  LOG(INFO) << "Requests: " << all.size() << " in " << seconds << " s, "
+      << all.size() / seconds << " per second.";
+  LOG(INFO) << "Latency: p50 " << all[p50] << " ms, p99 " << all[p99]
+      << " ms, max " << all.back() << " ms.";
+  return 0;
+}
+RegisterBrewFunction(loadgen);
+
 int main(int argc, char** argv) {
   // Print output to stderr (while still logging).
   FLAGS_alsologtostderr = 1;
@@ -303,7 +486,9 @@ int main(int argc, char** argv) {
       "  train           train or finetune a model\n"
       "  test            score a model\n"
       "  device_query    show GPU diagnostic information\n"
-      "  time            benchmark model execution time");
+      "  time            benchmark model execution time\n"
+      "  serve           answer inference requests on a Unix socket\n"
+      "  loadgen         measure the latency and throughput of a server");
   // Run tool or show usage.
   caffe::GlobalInit(&argc, &argv);
   if (argc == 2) {
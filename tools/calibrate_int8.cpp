@@ -0,0 +1,158 @@
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "boost/algorithm/string.hpp"
+#include "caffe/caffe.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/quantize.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+using caffe::Blob;
+using caffe::Caffe;
+using caffe::Net;
+using caffe::NetParameter;
+using caffe::QuantizationParameter;
+using caffe::QuantizedWeights;
+using caffe::string;
+using caffe::vector;
+
+DEFINE_string(model, "",
+    "The model definition protocol buffer text file. Its data layers supply "
+    "the calibration batches and must produce the same batches on every run.");
+DEFINE_string(weights, "",
+    "The trained weights.");
+DEFINE_int32(iterations, 50,
+    "The number of calibration batches.");
+DEFINE_string(layers, "",
+    "Optional; comma-separated names of the layers to quantize. By default "
+    "every InnerProduct and Convolution layer is quantized.");
+DEFINE_string(output, "",
+    "Where to write the model definition with INT8 quantization_param.");
+
+// Adds the net outputs of one batch to scores, flattened as in `caffe test`.
+void AccumulateOutputs(const Net<float>& net, vector<float>* scores,
+    vector<string>* names) {
+  const bool first = scores->empty();
+  int idx = 0;
+  for (int j = 0; j < net.output_blobs().size(); ++j) {
+    const Blob<float>* output = net.output_blobs()[j];
+    const string& name = net.blob_names()[net.output_blob_indices()[j]];
+    for (int k = 0; k < output->count(); ++k, ++idx) {
+      if (first) {
+        scores->push_back(output->cpu_data()[k]);
+        names->push_back(name);
+      } else {
+        (*scores)[idx] += output->cpu_data()[k];
+      }
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  FLAGS_alsologtostderr = 1;
+  gflags::SetUsageMessage("picks INT8 quantization scales for a net\n"
+      "usage: calibrate_int8 -model deploy.prototxt -weights net.caffemodel "
+      "-output int8.prototxt [-iterations N] [-layers fc6,fc7]\n\n"
+      "Runs the float net over the batches of its data layers to find the "
+      "range of every quantized layer's input, writes a definition with the "
+      "resulting input and per-channel weight scales, and reports how the "
+      "net outputs change when the same batches are run in INT8.");
+  caffe::GlobalInit(&argc, &argv);
+  if (FLAGS_model.empty() || FLAGS_weights.empty() || FLAGS_output.empty()) {
+    gflags::ShowUsageWithFlagsRestrict(argv[0], "tools/calibrate_int8");
+    return 1;
+  }
+  Caffe::set_mode(Caffe::CPU);
+
+  NetParameter param;
+  caffe::ReadNetParamsFromTextFileOrDie(FLAGS_model, &param);
+  param.mutable_state()->set_phase(caffe::TEST);
+  Net<float> float_net(param);
+  float_net.CopyTrainedLayersFrom(FLAGS_weights);
+
+  std::set<string> requested;
+  if (!FLAGS_layers.empty()) {
+    vector<string> names;
+    boost::split(names, FLAGS_layers, boost::is_any_of(", "),
+        boost::token_compress_on);
+    requested.insert(names.begin(), names.end());
+  }
+  vector<int> layer_ids;
+  for (int i = 0; i < float_net.layers().size(); ++i) {
+    const string type = float_net.layers()[i]->type();
+    const string& name = float_net.layer_names()[i];
+    if (requested.empty() ? (type == "InnerProduct" || type == "Convolution")
+                          : requested.count(name) > 0) {
+      CHECK(type == "InnerProduct" || type == "Convolution")
+          << "Layer " << name << " of type " << type << " has no INT8 path.";
+      layer_ids.push_back(i);
+    }
+  }
+  if (!requested.empty()) {
+    CHECK_EQ(requested.size(), layer_ids.size())
+        << "Some of the requested layers are not in the net.";
+  }
+
+  // Calibrate: track the largest input magnitude each layer sees.
+  LOG(INFO) << "Calibrating " << layer_ids.size() << " layers over "
+      << FLAGS_iterations << " batches.";
+  vector<float> input_absmax(layer_ids.size(), 0);
+  vector<float> float_scores, int8_scores;
+  vector<string> output_names;
+  for (int iter = 0; iter < FLAGS_iterations; ++iter) {
+    float_net.ForwardPrefilled();
+    for (int l = 0; l < layer_ids.size(); ++l) {
+      const vector<Blob<float>*>& bottom =
+          float_net.bottom_vecs()[layer_ids[l]];
+      for (int b = 0; b < bottom.size(); ++b) {
+        input_absmax[l] = std::max(input_absmax[l], caffe::caffe_cpu_absmax(
+            bottom[b]->count(), bottom[b]->cpu_data()));
+      }
+    }
+    AccumulateOutputs(float_net, &float_scores, &output_names);
+  }
+
+  // Write the scales into the definition.
+  for (int l = 0; l < layer_ids.size(); ++l) {
+    const string& name = float_net.layer_names()[layer_ids[l]];
+    const Blob<float>& weights = *float_net.layers()[layer_ids[l]]->blobs()[0];
+    QuantizedWeights<float> quantized;
+    quantized.Quantize(weights, weights.shape(0), QuantizationParameter());
+    for (int i = 0; i < param.layer_size(); ++i) {
+      if (param.layer(i).name() != name) { continue; }
+      QuantizationParameter* quantization_param =
+          param.mutable_layer(i)->mutable_quantization_param();
+      quantization_param->set_precision(QuantizationParameter::INT8);
+      quantization_param->set_input_scale(
+          caffe::caffe_int8_scale(input_absmax[l]));
+      quantization_param->clear_weight_scale();
+      for (int c = 0; c < quantized.scale().size(); ++c) {
+        quantization_param->add_weight_scale(quantized.scale()[c]);
+      }
+    }
+    LOG(INFO) << name << ": input range " << input_absmax[l];
+  }
+  caffe::WriteProtoToTextFile(param, FLAGS_output);
+  LOG(INFO) << "Wrote " << FLAGS_output;
+
+  // Rerun the same batches in INT8 and compare the outputs.
+  Net<float> int8_net(param);
+  int8_net.CopyTrainedLayersFrom(FLAGS_weights);
+  vector<string> int8_names;
+  for (int iter = 0; iter < FLAGS_iterations; ++iter) {
+    int8_net.ForwardPrefilled();
+    AccumulateOutputs(int8_net, &int8_scores, &int8_names);
+  }
+  CHECK_EQ(float_scores.size(), int8_scores.size());
+  for (int i = 0; i < float_scores.size(); ++i) {
+    const float float_score = float_scores[i] / FLAGS_iterations;
+    const float int8_score = int8_scores[i] / FLAGS_iterations;
+    LOG(INFO) << output_names[i] << " = " << float_score << " (float), "
+        << int8_score << " (int8), change " << int8_score - float_score;
+  }
+  return 0;
+}
@@ -0,0 +1,43 @@
+// Reports the peak memory taken by the blobs of a training net with and
+// without gradient checkpointing: for the checkpoints set in the net (see
+// LayerParameter.checkpoint) and for an automatic plan (see
+// NetParameter.auto_checkpoint), along with the segments each plan recomputes.
+// Usage:
+//    checkpoint_memory net_proto_file
+
+#include <string>
+
+#include "caffe/caffe.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+static void ReportPlan(const string& plan, const NetParameter& net_param) {
+  Net<float> net(net_param);
+  const vector<pair<int, int> >& segments = net.checkpoint_segments();
+  for (int i = 0; i < segments.size(); ++i) {
+    LOG(INFO) << plan << " segment " << i << ": "
+        << net.layer_names()[segments[i].first] << " to "
+        << net.layer_names()[segments[i].second];
+  }
+  LOG(INFO) << plan << ": " << segments.size() << " segments, peak "
+      << net.blob_memory_peak() << " bytes ("
+      << net.blob_memory_total() << " bytes without checkpointing)";
+}
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  FLAGS_alsologtostderr = 1;
+  if (argc != 2) {
+    LOG(ERROR) << "Usage: checkpoint_memory net_proto_file";
+    return 1;
+  }
+  Caffe::set_mode(Caffe::CPU);
+  NetParameter net_param;
+  ReadNetParamsFromTextFileOrDie(argv[1], &net_param);
+  net_param.mutable_state()->set_phase(TRAIN);
+  ReportPlan("Net checkpoints", net_param);
+  net_param.set_auto_checkpoint(true);
+  ReportPlan("Automatic checkpoints", net_param);
+  return 0;
+}
@@ -0,0 +1,53 @@
+// Converts trained weights between the .caffemodel format, the weights stream
+// format (see caffe/util/weights_stream.hpp) and the memory-mapped format (see
+// caffe/util/mapped_weights.hpp). By default a .caffemodel is converted to a
+// weights stream and the other formats to a .caffemodel.
+// Usage:
+//    convert_weights weights_in weights_out [caffemodel|stream|mapped]
+
+#include <string>
+
+#include "caffe/caffe.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/mapped_weights.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+#include "caffe/util/weights_stream.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  FLAGS_alsologtostderr = 1;
+  if (argc != 3 && argc != 4) {
+    LOG(ERROR) << "Usage: convert_weights weights_in weights_out "
+        << "[caffemodel|stream|mapped]";
+    return 1;
+  }
+  const string input_filename(argv[1]);
+  const string output_filename(argv[2]);
+  NetParameter net_param;
+  string output_format = "caffemodel";
+  if (IsWeightsStreamFile(input_filename)) {
+    ReadNetParamFromWeightsStream(input_filename, &net_param);
+  } else if (IsMappedWeightsFile(input_filename)) {
+    MappedWeights(input_filename).ToProto(&net_param);
+  } else {
+    ReadNetParamsFromBinaryFileOrDie(input_filename, &net_param);
+    output_format = "stream";
+  }
+  if (argc == 4) {
+    output_format = argv[3];
+  }
+  if (output_format == "caffemodel") {
+    WriteProtoToBinaryFile(net_param, output_filename);
+  } else if (output_format == "stream") {
+    WriteNetParamToWeightsStream(&net_param, output_filename);
+  } else if (output_format == "mapped") {
+    WriteMappedWeights(net_param, output_filename);
+  } else {
+    LOG(ERROR) << "Unknown output format: " << output_format;
+    return 1;
+  }
+  LOG(INFO) << "Wrote " << output_format << " " << output_filename;
+  return 0;
+}
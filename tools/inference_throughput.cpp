@@ -0,0 +1,88 @@
+// Measures the CPU inference throughput of an InferenceEngine serving a model
+// from 1, 2, 4, ... up to max_instances threads, each with its own Net
+// instance, against a single Net run from one thread. Every request is one
+// input of the shape given in the deploy net.
+// Usage:
+//    inference_throughput model_file weights_file [max_instances] [requests]
+
+#include <boost/thread.hpp>
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "caffe/caffe.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/inference_engine.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+static void RunRequests(InferenceEngine<float>* engine,
+    const vector<Blob<float>*>* inputs, const int num_requests) {
+  vector<shared_ptr<Blob<float> > > output_blobs;
+  vector<Blob<float>*> outputs;
+  for (int i = 0; i < engine->instance(0)->num_outputs(); ++i) {
+    output_blobs.push_back(shared_ptr<Blob<float> >(new Blob<float>()));
+    outputs.push_back(output_blobs[i].get());
+  }
+  for (int i = 0; i < num_requests; ++i) {
+    engine->Predict(*inputs, outputs);
+  }
+}
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  FLAGS_alsologtostderr = 1;
+  if (argc < 3 || argc > 5) {
+    LOG(ERROR) << "Usage: inference_throughput model_file weights_file "
+        << "[max_instances] [requests]";
+    return 1;
+  }
+  const int max_instances = argc > 3 ? atoi(argv[3]) : 4;
+  const int num_requests = argc > 4 ? atoi(argv[4]) : 100;
+  CHECK_GT(max_instances, 0);
+  CHECK_GT(num_requests, 0);
+  Caffe::set_mode(Caffe::CPU);
+
+  // A single Net.
+  Net<float> net(argv[1], TEST);
+  net.CopyTrainedLayersFrom(argv[2]);
+  FillerParameter filler_param;
+  GaussianFiller<float> filler(filler_param);
+  vector<shared_ptr<Blob<float> > > input_blobs;
+  vector<Blob<float>*> inputs;
+  for (int i = 0; i < net.num_inputs(); ++i) {
+    input_blobs.push_back(shared_ptr<Blob<float> >(new Blob<float>()));
+    input_blobs[i]->ReshapeLike(*net.input_blobs()[i]);
+    filler.Fill(input_blobs[i].get());
+    inputs.push_back(input_blobs[i].get());
+  }
+  net.Forward(inputs);
+  Timer timer;
+  timer.Start();
+  for (int i = 0; i < num_requests; ++i) {
+    net.Forward(inputs);
+  }
+  const double base_rate = num_requests / (timer.MilliSeconds() / 1000);
+  LOG(INFO) << "single net: " << base_rate << " requests/s";
+
+  for (int instances = 1; instances <= max_instances; instances *= 2) {
+    InferenceEngine<float> engine(argv[1], argv[2], instances);
+    RunRequests(&engine, &inputs, instances);
+    const int requests_per_thread = (num_requests + instances - 1) / instances;
+    timer.Start();
+    vector<shared_ptr<boost::thread> > threads;
+    for (int i = 0; i < instances; ++i) {
+      threads.push_back(shared_ptr<boost::thread>(new boost::thread(
+          &RunRequests, &engine, &inputs, requests_per_thread)));
+    }
+    for (int i = 0; i < threads.size(); ++i) {
+      threads[i]->join();
+    }
+    const double rate = static_cast<double>(requests_per_thread) * instances /
+        (timer.MilliSeconds() / 1000);
+    LOG(INFO) << "instances: " << instances << "  " << rate
+        << " requests/s  speedup " << rate / base_rate;
+  }
+  return 0;
+}
@@ -0,0 +1,82 @@
+#include <glog/logging.h>
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include "boost/algorithm/string.hpp"
+#include "caffe/caffe.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/sparse.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+#include "caffe/util/weights_stream.hpp"
+
+using caffe::BlobProto;
+using caffe::LayerParameter;
+using caffe::NetParameter;
+using caffe::string;
+using caffe::vector;
+
+DEFINE_string(weights, "",
+    "The trained weights to prune.");
+DEFINE_string(output, "",
+    "Where to write the pruned weights.");
+DEFINE_double(threshold, 0,
+    "Weights with a magnitude below this are set to zero.");
+DEFINE_string(layers, "",
+    "Optional; comma-separated names of the layers to prune. By default "
+    "every InnerProduct layer is pruned.");
+
+int main(int argc, char** argv) {
+  FLAGS_alsologtostderr = 1;
+  gflags::SetUsageMessage("prunes small weights and stores them sparsely\n"
+      "usage: prune_weights -weights net.caffemodel -output pruned.caffemodel "
+      "-threshold T [-layers fc6,fc7]\n\n"
+      "Zeroes the weights of magnitude below T. Weight blobs left more than "
+      "half zeros are written in sparse form. Set sparsity_threshold in "
+      "inner_product_param to run such layers with a sparse product.");
+  caffe::GlobalInit(&argc, &argv);
+  if (FLAGS_weights.empty() || FLAGS_output.empty()) {
+    gflags::ShowUsageWithFlagsRestrict(argv[0], "tools/prune_weights");
+    return 1;
+  }
+
+  NetParameter param;
+  if (caffe::IsWeightsStreamFile(FLAGS_weights)) {
+    // E.g. a solver snapshot.
+    caffe::ReadNetParamFromWeightsStream(FLAGS_weights, &param);
+  } else {
+    caffe::ReadNetParamsFromBinaryFileOrDie(FLAGS_weights, &param);
+  }
+  std::set<string> requested;
+  if (!FLAGS_layers.empty()) {
+    vector<string> names;
+    boost::split(names, FLAGS_layers, boost::is_any_of(", "),
+        boost::token_compress_on);
+    requested.insert(names.begin(), names.end());
+  }
+  int num_pruned = 0;
+  for (int i = 0; i < param.layer_size(); ++i) {
+    LayerParameter* layer = param.mutable_layer(i);
+    if (requested.empty() ? layer->type() != "InnerProduct"
+                          : requested.count(layer->name()) == 0) {
+      continue;
+    }
+    CHECK_GT(layer->blobs_size(), 0)
+        << "Layer " << layer->name() << " has no weights.";
+    BlobProto* weights = layer->mutable_blobs(0);
+    const int count = weights->data_size();
+    const int zeros = caffe::PruneBlobProto(FLAGS_threshold, weights);
+    LOG(INFO) << layer->name() << ": " << zeros << " of " << count
+        << " weights are zero (" << 100. * zeros / count << "%)"
+        << (weights->data_index_size() > 0 ? ", stored sparse" : "");
+    ++num_pruned;
+  }
+  if (!requested.empty()) {
+    CHECK_EQ(requested.size(), num_pruned)
+        << "Some of the requested layers are not in the net.";
+  }
+  caffe::WriteProtoToBinaryFile(param, FLAGS_output);
+  LOG(INFO) << "Wrote " << FLAGS_output;
+  return 0;
+}
@@ -0,0 +1,62 @@
+// Measures how the CPU training throughput scales with the number of
+// data-parallel replicas (SolverParameter.replicas). The solver is run for a
+// number of iterations with 1, 2, 4, ... up to max_replicas replicas, each
+// replica training on its own batch, and the examples per second and the
+// speedup over a single replica are reported.
+// Usage:
+//    solver_scaling solver_proto_file [max_replicas] [iterations]
+
+#include <cstdlib>
+#include <string>
+
+#include "caffe/caffe.hpp"
+#include "caffe/util/benchmark.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  FLAGS_alsologtostderr = 1;
+  if (argc < 2 || argc > 4) {
+    LOG(ERROR) << "Usage: solver_scaling solver_proto_file "
+        << "[max_replicas] [iterations]";
+    return 1;
+  }
+  const int max_replicas = argc > 2 ? atoi(argv[2]) : 4;
+  const int iterations = argc > 3 ? atoi(argv[3]) : 20;
+  CHECK_GT(max_replicas, 0);
+  CHECK_GT(iterations, 0);
+  SolverParameter solver_param;
+  ReadProtoFromTextFileOrDie(argv[1], &solver_param);
+  solver_param.set_solver_mode(SolverParameter_SolverMode_CPU);
+  solver_param.clear_test_interval();
+  solver_param.set_display(0);
+  solver_param.set_snapshot(0);
+  solver_param.set_snapshot_after_train(false);
+  Caffe::set_mode(Caffe::CPU);
+
+  double base_rate = 0;
+  for (int replicas = 1; replicas <= max_replicas; replicas *= 2) {
+    solver_param.set_replicas(replicas);
+    shared_ptr<Solver<float> > solver(GetSolver<float>(solver_param));
+    // The batch size of the first input blob.
+    const int batch_size = solver->net()->input_blobs().size() ?
+        solver->net()->input_blobs()[0]->shape(0) :
+        solver->net()->top_vecs()[0][0]->shape(0);
+    // One iteration to warm up the allocations.
+    solver->Step(1);
+    Timer timer;
+    timer.Start();
+    solver->Step(iterations);
+    const double seconds = timer.MilliSeconds() / 1000;
+    const double rate = static_cast<double>(iterations) * replicas *
+        solver_param.iter_size() * batch_size / seconds;
+    if (replicas == 1) {
+      base_rate = rate;
+    }
+    LOG(INFO) << "replicas: " << replicas << "  "
+        << seconds * 1000 / iterations << " ms/iter  "
+        << rate << " examples/s  speedup " << rate / base_rate;
+  }
+  return 0;
+}